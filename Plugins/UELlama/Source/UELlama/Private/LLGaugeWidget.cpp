@@ -22,7 +22,7 @@ TSharedRef<SWidget> ULLGaugeWidget::RebuildWidget()
     {
         SAssignNew(SlateVisualizerWidget, SLLContextVisualizer)
             .TotalTokenCapacity(TAttribute<int32>::Create(TAttribute<int32>::FGetter::CreateUObject(this, &ULLGaugeWidget::GetCachedTotalCapacity)))
-            .ContextBlocks(TAttribute<TArray<FContextVisBlock>>::Create(TAttribute<TArray<FContextVisBlock>>::FGetter::CreateUObject(this, &ULLGaugeWidget::GetCachedBlocks)))
+            .ContextBlocksSource(&CachedBlocks)
             .KvCacheDecodedTokenCount(TAttribute<int32>::Create(TAttribute<int32>::FGetter::CreateUObject(this, &ULLGaugeWidget::GetCachedKvCacheCount)))
 			.IsStaticWorldInfoUpToDate(TAttribute<bool>::Create(TAttribute<bool>::FGetter::CreateUObject(this, &ULLGaugeWidget::GetCachedStaticWorldInfoUpToDate)))
 			.IsLowFrequencyStateUpToDate(TAttribute<bool>::Create(TAttribute<bool>::FGetter::CreateUObject(this, &ULLGaugeWidget::GetCachedLowFrequencyStateUpToDate)))
@@ -102,8 +102,15 @@ void ULLGaugeWidget::HandleLlamaContextChanged(const FContextVisPayload& NewCont
 {
     // UE_LOG(LogTemp, Log, TEXT("LLGaugeWidget: HandleLlamaContextChanged received. Blocks: %d"), NewContextState.Blocks.Num());
 
-    // Update cached values that the Slate widget's attributes are bound to
-    CachedBlocks = NewContextState.Blocks;
+    // Update cached values that the Slate widget reads. After the first full snapshot only the blocks the
+    // payload lists as changed are copied.
+    if (NewContextState.bIsFullSnapshot || CachedBlocks.Num() != NewContextState.Blocks.Num()) {
+        CachedBlocks = NewContextState.Blocks;
+    } else {
+        for (int32 BlockIndex : NewContextState.ChangedBlockIndices) {
+            if (CachedBlocks.IsValidIndex(BlockIndex)) CachedBlocks[BlockIndex] = NewContextState.Blocks[BlockIndex];
+        }
+    }
     CachedTotalCapacity = NewContextState.TotalTokenCapacity;
     CachedKvCacheCount = NewContextState.KvCacheDecodedTokenCount;
     bCachedStaticWorldInfoUpToDate = NewContextState.bIsStaticWorldInfoUpToDate;
@@ -134,11 +141,6 @@ void ULLGaugeWidget::HandleLlamaContextChanged(const FContextVisPayload& NewCont
 }
 
 // Getter functions for Slate TAttribute binding
-TArray<FContextVisBlock> ULLGaugeWidget::GetCachedBlocks() const
-{
-    return CachedBlocks;
-}
-
 int32 ULLGaugeWidget::GetCachedTotalCapacity() const
 {
     return CachedTotalCapacity;
@@ -2,7 +2,58 @@
 #include "LLInternal.h"
 #include "llama.h"
 #include "common.h"
+#include "ggml-cpu.h"
+#include <algorithm>
+#include "HAL/FileManager.h"
+#include "HAL/PlatformFileManager.h"
+#include "Hash/CityHash.h"
+#include "Misc/Paths.h"
 
+////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Folds a newer visualization delta into one not yet consumed: entries for the same block index are replaced,
+// new indices appended, and entries past the newer block count dropped. Perf figures keep the latest non-zero value.
+static void MergeContextVisDelta(FContextVisPayload& Into, FContextVisPayload&& Newer)
+{
+	for (int32 i = 0; i < Newer.ChangedBlockIndices.Num(); ++i) {
+		const int32 Slot = Into.ChangedBlockIndices.Find(Newer.ChangedBlockIndices[i]);
+		if (Slot == INDEX_NONE) {
+			Into.ChangedBlockIndices.Add(Newer.ChangedBlockIndices[i]);
+			Into.Blocks.Add(MoveTemp(Newer.Blocks[i]));
+		} else {
+			Into.Blocks[Slot] = MoveTemp(Newer.Blocks[i]);
+		}
+	}
+	for (int32 Slot = Into.ChangedBlockIndices.Num() - 1; Slot >= 0; --Slot) {
+		if (Into.ChangedBlockIndices[Slot] >= Newer.TotalBlockCount) {
+			Into.ChangedBlockIndices.RemoveAt(Slot);
+			Into.Blocks.RemoveAt(Slot);
+		}
+	}
+	Into.TotalBlockCount = Newer.TotalBlockCount;
+	Into.TotalTokenCapacity = Newer.TotalTokenCapacity;
+	Into.KvCacheDecodedTokenCount = Newer.KvCacheDecodedTokenCount;
+	if (Newer.fFmsPerTokenDecode > 0) Into.fFmsPerTokenDecode = Newer.fFmsPerTokenDecode;
+	if (Newer.fFmsPerTokenGenerate > 0) Into.fFmsPerTokenGenerate = Newer.fFmsPerTokenGenerate;
+}
+
+// Applies a delta to the game thread's full block list. Afterwards Merged.Blocks is complete and
+// Merged.ChangedBlockIndices/bIsFullSnapshot describe what this delta touched.
+static void ApplyContextVisDelta(FContextVisPayload& Merged, FContextVisPayload&& Delta)
+{
+	if (Delta.bIsFullSnapshot) Merged.Blocks.Reset();
+	Merged.Blocks.SetNum(Delta.TotalBlockCount);
+	for (int32 i = 0; i < Delta.ChangedBlockIndices.Num(); ++i) {
+		Merged.Blocks[Delta.ChangedBlockIndices[i]] = MoveTemp(Delta.Blocks[i]);
+	}
+	Merged.ChangedBlockIndices = MoveTemp(Delta.ChangedBlockIndices);
+	Merged.TotalBlockCount = Delta.TotalBlockCount;
+	Merged.bIsFullSnapshot = Delta.bIsFullSnapshot;
+	Merged.TotalTokenCapacity = Delta.TotalTokenCapacity;
+	Merged.KvCacheDecodedTokenCount = Delta.KvCacheDecodedTokenCount;
+	Merged.fFmsPerTokenDecode = Delta.fFmsPerTokenDecode;
+	Merged.fFmsPerTokenGenerate = Delta.fFmsPerTokenGenerate;
+}
 ////////////////////////////////////////////////////////////////////////////////////////////////
 
  static std::vector<llama_token> my_llama_tokenize(
@@ -11,7 +62,6 @@
      bool add_bos,
      bool special
  ) {
-	UE_LOG(LogTemp, Log, TEXT("my_llama_tokenize: %hs"), text.c_str());
      std::vector<llama_token> res;
      res.resize(text.length() + (add_bos ? 1 : 0)); // A reasonable initial size
      int n = llama_tokenize(
@@ -46,13 +96,16 @@
 
     LLInternal::~LLInternal()
     {
-        bIsRunning = false;
+        SignalStopRunning();
         if (ThreadHandle.joinable())
         {
             ThreadHandle.join();
         }
         // Ensure llama_free is called if model/ctx were loaded
+        FreeAgents_LlamaThread();
         if (ctx) llama_free(ctx);
+        FreeDraftModel_LlamaThread();
+        FreeThreadpools_LlamaThread();
         if (model) llama_model_free(model);
         if (batch.token) llama_batch_free(batch); // Check if initialized before freeing
         if (sampler_chain_instance) llama_sampler_free(sampler_chain_instance);
@@ -92,38 +145,136 @@
 
         llama_model_params model_params = llama_model_default_params();
         // model_params.n_gpu_layers = 50; // Configure as needed
+#if LLAMA_CPU_ONLY
+        model_params.n_gpu_layers = 0; // CPU backend only, nothing to offload to
+#endif
 
         model = llama_model_load_from_file(TCHAR_TO_UTF8(*ModelPathFStr), model_params);
         if (!model) {
             FString ErrorMsg = FString::Printf(TEXT("LlamaThread: Unable to load model from %s"), *ModelPathFStr);
             UE_LOG(LogTemp, Error, TEXT("%s"), *ErrorMsg);
-            qLlamaToMain.enqueue([this, ErrorMsg]() { if (errorCb) errorCb(ErrorMsg); });
+            PostToMain_LlamaThread([this, ErrorMsg]() { if (errorCb) errorCb(ErrorMsg); });
             return;
         }
         vocab = llama_model_get_vocab(model);
+        BuildChatTemplateTokens_LlamaThread();
         n_ctx_from_model = llama_model_n_ctx_train(model); // Or llama_n_ctx if using that for actual context size
 
         llama_context_params ctx_params = llama_context_default_params();
         ctx_params.n_ctx = n_ctx_from_model; // Use model's training context or a configured value
-        ctx_params.n_batch = 2048; // Or llama_n_batch(ctx) from model if available, or a sensible default. Max tokens per llama_decode call.
-        ctx_params.n_threads = n_threads; // From your global namespace
-        ctx_params.n_threads_batch = n_threads; // For batch processing
+        ctx_params.n_batch = FMath::Clamp(Config.PromptBatchSize, 1, n_ctx_from_model); // Max tokens per llama_decode call (prompt ingest chunk)
+        ctx_params.n_ubatch = FMath::Clamp(Config.PromptMicroBatchSize, 1, (int32)ctx_params.n_batch); // Physical micro-batch llama_decode splits each chunk into
+        ctx_params.n_threads = ResolveThreadCount(Config.GenerationThreads); // Single-token decode
+        ctx_params.n_threads_batch = ResolveThreadCount(Config.BatchThreads); // Prompt ingest
         ctx_params.no_perf = false;
+        ctx_params.n_seq_max = 1 + FMath::Clamp(Config.MaxAgents, 0, 63); // sequence 0 is AIXO, the rest are agents
 		this->batch_capacity = ctx_params.n_batch; // Store the capacity you used for context
+		UE_LOG(LogTemp, Log, TEXT("LlamaThread: Context n_ctx %d, n_batch %d, n_ubatch %d, threads %d (batch %d)."), ctx_params.n_ctx, ctx_params.n_batch, ctx_params.n_ubatch, ctx_params.n_threads, ctx_params.n_threads_batch);
 
         ctx = llama_init_from_model(model, ctx_params);
         if (!ctx) {
             FString ErrorMsg = TEXT("LlamaThread: Failed to create llama_context.");
             UE_LOG(LogTemp, Error, TEXT("%s"), *ErrorMsg);
-            qLlamaToMain.enqueue([this, ErrorMsg]() { if (errorCb) errorCb(ErrorMsg); });
+            PostToMain_LlamaThread([this, ErrorMsg]() { if (errorCb) errorCb(ErrorMsg); });
             llama_model_free(model); model = nullptr;
             return;
         }
+        if (Config.bUseDedicatedThreadpools) {
+            CreateThreadpools_LlamaThread(ctx_params.n_threads, ctx_params.n_threads_batch);
+        }
+        if (!Config.DraftModelPath.IsEmpty()) {
+            InitializeDraftModel_LlamaThread(model_params, ctx_params); // on failure generation just runs without speculation
+        }
 
         batch = llama_batch_init(ctx_params.n_batch, 0, 1); // n_tokens, embd, n_seq_max
 
         // Initialize Sampler Chain
+        BuildSamplerChain_LlamaThread();
+
+        // Initialize Stop Sequences
+        stopSequencesTokens.clear();
+        StopSeqHelper(TEXT("<|im_end|>")); // Qwen specific or your chosen EOS
+        StopSeqHelper(TEXT("~~~END_AIXO_TURN~~~"));
+        // Add other critical stop sequences (e.g., "Captain:", "TOOL_RESPONSE:")
+        // if you want the AI to robustly stop before generating these roles.
+
+        // Initialize Context Blocks
+        FixedContextBlocks.Empty();
+        ConversationHistoryTokens.clear();
+        StructuredConversationHistory.clear();
+        CurrentHighFrequencyStateTokens.clear();
+        kv_cache_token_cursor = 0; // Fresh start for KV cache
+		llama_kv_self_clear(ctx); // Explicitly clear KV cache on full init
+MirroredKvCacheTokens.clear();
+
+		UE_LOG(LogTemp, Log, TEXT("LlamaThread: Initialization tokenizing fixed blocks."));
+
+		// Just tokenize and store. DO NOT call InvalidateKVCacheFromPosition here.
+		_TokenizeAndStoreFixedBlockInternal(ELlamaContextBlockType::SystemPrompt, InitialSystemPromptFStr, true); // true for BOS
+		_TokenizeAndStoreFixedBlockInternal(ELlamaContextBlockType::StaticWorldInfo, Systems, false);
+		_TokenizeAndStoreFixedBlockInternal(ELlamaContextBlockType::LowFrequencyState, LowFreq, false);
+
+		UE_LOG(LogTemp, Log, TEXT("LlamaThread: Initialization complete. KV cursor at %d. Fixed blocks tokenized."), kv_cache_token_cursor);
+		// At this point, kv_cache_token_cursor is STILL 0. No decoding has happened.
+    
+		// 2. **** NEW: Pre-decode Fixed Blocks into KV Cache ****
+		UE_LOG(LogTemp, Log, TEXT("LlamaThread: Starting pre-decoding of fixed context blocks..."));
+		std::vector<llama_token> FixedBlocksCombinedTokens;
+		// Assemble tokens from FixedContextBlocks in order; blocks placed after the conversation are decoded below, not snapshotted
+		for (uint8 i = 0; i < (uint8)ELlamaContextBlockType::COUNT; ++i) {
+			if (IsTailBlock((ELlamaContextBlockType)i)) continue;
+			if (const FTokenizedContextBlock* Block = FixedContextBlocks.Find((ELlamaContextBlockType)i)) {
+				FixedBlocksCombinedTokens.insert(FixedBlocksCombinedTokens.end(), Block->Tokens.begin(), Block->Tokens.end());
+			}
+		}
+
+		UE_LOG(LogTemp, Log, TEXT("LlamaThread: Initialization about to send context visual update."));
+		BroadcastContextVisualUpdate_LlamaThread();
+
+		// Try to restore the fixed blocks from a KV snapshot written by an earlier run with the same model and prompt
+		FString SnapshotPath;
+		bool bRestoredFromSnapshot = false;
+		if (Config.bUseKvSnapshots && !FixedBlocksCombinedTokens.empty()) {
+			SnapshotPath = MakeFixedBlocksSnapshotPath(ModelPathFStr, FixedBlocksCombinedTokens);
+			bRestoredFromSnapshot = TryRestoreFixedBlocksSnapshot(SnapshotPath, FixedBlocksCombinedTokens);
+		}
+
+		if (bRestoredFromSnapshot) {
+			MirroredKvCacheTokens = FixedBlocksCombinedTokens;
+			kv_cache_token_cursor = MirroredKvCacheTokens.size();
+			PostToMain_LlamaThread([this]() { if (progressCb) progressCb(1.0f); });
+			UE_LOG(LogTemp, Log, TEXT("LlamaThread: Fixed context blocks restored from snapshot. KV cache populated with %d tokens."), MirroredKvCacheTokens.size());
+		} else if (!FixedBlocksCombinedTokens.empty()) {
+			if (!IngestPromptTokens_LlamaThread(FixedBlocksCombinedTokens.data(), FixedBlocksCombinedTokens.size(), false, TEXT("fixed blocks"), true)) {
+				// Handle error: maybe shutdown or mark as not ready
+				return;
+			}
+			kv_cache_token_cursor = MirroredKvCacheTokens.size();
+			UE_LOG(LogTemp, Log, TEXT("LlamaThread: Fixed context blocks pre-decoded. KV cache populated with %d tokens."), MirroredKvCacheTokens.size());
+			if (!SnapshotPath.IsEmpty()) SaveFixedBlocksSnapshot(SnapshotPath, FixedBlocksCombinedTokens);
+		}
+		std::vector<llama_token> InitialContextTokens;
+		AppendContextTokens(InitialContextTokens);
+		if (InitialContextTokens.size() > MirroredKvCacheTokens.size()) {
+			const int32_t Reused = SyncKVCacheToTokens(InitialContextTokens);
+			if (!IngestPromptTokens_LlamaThread(InitialContextTokens.data() + Reused, InitialContextTokens.size() - Reused, false, TEXT("tail blocks"))) {
+				return;
+			}
+		}
+		// --- End of Pre-decoding ---
+
+		// Signal main thread that AIXO is now ready (or after pre-decode)
+		FString msg = "Ready";
+		PostToMain_LlamaThread([this, msg]() { if (readyCb) readyCb(msg); });
 
+		BroadcastContextVisualUpdate_LlamaThread();
+
+		UE_LOG(LogTemp, Log, TEXT("LlamaThread: Initialization complete. KV cursor at %d. Fixed blocks tokenized and pre-decoded."), MirroredKvCacheTokens.size());
+    }
+
+	// (Re)creates the sampler chain; called at init and whenever the tool call grammar changes
+	void LLInternal::BuildSamplerChain_LlamaThread()
+	{
 		const float temp = 0.80f;
 		const int32_t top_k = 40;
 		const float top_p = 0.95f;
@@ -140,10 +291,24 @@
 
 		llama_token id = 0;
 
+		if (sampler_chain_instance) { llama_sampler_free(sampler_chain_instance); sampler_chain_instance = nullptr; }
+		tool_call_grammar_sampler = nullptr; // owned by the chain just freed
+
 		auto sparams = llama_sampler_chain_default_params();
 		sparams.no_perf = false;
 		sampler_chain_instance = llama_sampler_chain_init(sparams);
 
+		// Lazy tool-call grammar goes first so it masks the full vocabulary; it stays dormant until "<tool_call>" shows up in the output
+		if (!ToolCallGrammar.empty()) {
+			const char* trigger_patterns[] = { "[\\s\\S]*?(<tool_call>)[\\s\\S]*" };
+			tool_call_grammar_sampler = llama_sampler_init_grammar_lazy_patterns(vocab, ToolCallGrammar.c_str(), "root", trigger_patterns, 1, nullptr, 0);
+			if (tool_call_grammar_sampler) {
+				llama_sampler_chain_add(sampler_chain_instance, tool_call_grammar_sampler);
+			} else {
+				UE_LOG(LogTemp, Error, TEXT("LlamaThread: Tool call grammar failed to parse; tool calls will be sampled unconstrained."));
+			}
+		}
+
 		/// NOTE: Avoid using on the full vocabulary as searching for repeated tokens can become slow. For example, apply top-k or top-p sampling first.
 		llama_sampler_chain_add(sampler_chain_instance, llama_sampler_init_penalties(64, 1.10f, 0.0f, 0.0f));
 
@@ -184,102 +349,195 @@
 //        auto sparams = llama_sampler_chain_default_params();
 //        sampler_chain_instance = llama_sampler_chain_init(sparams);
 //        llama_sampler_chain_add(sampler_chain_instance, llama_sampler_init_greedy()); // Simplest for now
+	}
 
-        // Initialize Stop Sequences
-        stopSequencesTokens.clear();
-        StopSeqHelper(TEXT("<|im_end|>")); // Qwen specific or your chosen EOS
-        StopSeqHelper(TEXT("~~~END_AIXO_TURN~~~"));
-        // Add other critical stop sequences (e.g., "Captain:", "TOOL_RESPONSE:")
-        // if you want the AI to robustly stop before generating these roles.
-
-        // Initialize Context Blocks
-        FixedContextBlocks.Empty();
-        ConversationHistoryTokens.clear();
-        StructuredConversationHistory.clear();
-        CurrentHighFrequencyStateTokens.clear();
-        kv_cache_token_cursor = 0; // Fresh start for KV cache
-		llama_kv_self_clear(ctx); // Explicitly clear KV cache on full init
-MirroredKvCacheTokens.clear();
+	void LLInternal::SetToolCallGrammar_LlamaThread(const FString& GrammarGbnf)
+	{
+		ToolCallGrammar = TCHAR_TO_UTF8(*GrammarGbnf);
+		if (!model) return; // picked up by InitializeLlama_LlamaThread
+		BuildSamplerChain_LlamaThread();
+		UE_LOG(LogTemp, Log, TEXT("LlamaThread: Tool call grammar set (%d bytes), sampler chain rebuilt."), ToolCallGrammar.size());
+	}
 
-		UE_LOG(LogTemp, Log, TEXT("LlamaThread: Initialization tokenizing fixed blocks."));
+	// Requested thread count, or the default when <= 0: all physical cores but one, which is left to the game thread
+	int32 LLInternal::ResolveThreadCount(int32 Requested)
+	{
+		if (Requested > 0) return FMath::Min(Requested, GGML_MAX_N_THREADS);
+		return FMath::Max(1, FPlatformMisc::NumberOfCores() - 1);
+	}
 
-		// Just tokenize and store. DO NOT call InvalidateKVCacheFromPosition here.
-		_TokenizeAndStoreFixedBlockInternal(ELlamaContextBlockType::SystemPrompt, InitialSystemPromptFStr, true); // true for BOS
-		_TokenizeAndStoreFixedBlockInternal(ELlamaContextBlockType::StaticWorldInfo, Systems, false);
-		_TokenizeAndStoreFixedBlockInternal(ELlamaContextBlockType::LowFrequencyState, LowFreq, false);
+	// "0-7,16,18-19" -> cpumask; returns false (mask untouched) if the list has nothing usable in it
+	static bool ParseCpuAffinity(const FString& CpuList, bool (&OutMask)[GGML_MAX_N_THREADS])
+	{
+		TArray<FString> Ranges;
+		CpuList.ParseIntoArray(Ranges, TEXT(","), true);
+		bool bAny = false;
+		for (const FString& Range : Ranges) {
+			FString First, Last;
+			if (!Range.Split(TEXT("-"), &First, &Last)) First = Last = Range;
+			const int32 Lo = FCString::Atoi(*First.TrimStartAndEnd());
+			const int32 Hi = FCString::Atoi(*Last.TrimStartAndEnd());
+			for (int32 Cpu = FMath::Max(Lo, 0); Cpu <= Hi && Cpu < GGML_MAX_N_THREADS; Cpu++) {
+				OutMask[Cpu] = true;
+				bAny = true;
+			}
+		}
+		return bAny;
+	}
 
-		UE_LOG(LogTemp, Log, TEXT("LlamaThread: Initialization complete. KV cursor at %d. Fixed blocks tokenized."), kv_cache_token_cursor);
-		// At this point, kv_cache_token_cursor is STILL 0. No decoding has happened.
-    
-		// 2. **** NEW: Pre-decode Fixed Blocks into KV Cache ****
-		UE_LOG(LogTemp, Log, TEXT("LlamaThread: Starting pre-decoding of fixed context blocks..."));
-		std::vector<llama_token> FixedBlocksCombinedTokens;
-		// Assemble tokens from FixedContextBlocks in order
-		for (uint8 i = 0; i < (uint8)ELlamaContextBlockType::COUNT; ++i) {
-			if (const FTokenizedContextBlock* Block = FixedContextBlocks.Find((ELlamaContextBlockType)i)) {
-				FixedBlocksCombinedTokens.insert(FixedBlocksCombinedTokens.end(), Block->Tokens.begin(), Block->Tokens.end());
+	void LLInternal::CreateThreadpools_LlamaThread(int32 GenerationThreads, int32 BatchThreads)
+	{
+		auto MakeParams = [this](int32 Threads, const FString& Affinity) {
+			ggml_threadpool_params Params = ggml_threadpool_params_default(Threads);
+			Params.prio = (ggml_sched_priority)Config.ThreadpoolPriority;
+			Params.poll = (uint32_t)FMath::Clamp(Config.ThreadpoolPoll, 0, 100);
+			Params.strict_cpu = Config.bStrictCpuPlacement;
+			if (!Affinity.IsEmpty() && !ParseCpuAffinity(Affinity, Params.cpumask)) {
+				UE_LOG(LogTemp, Warning, TEXT("LlamaThread: Ignoring unusable CPU affinity '%s'."), *Affinity);
 			}
+			return Params;
+		};
+		const FString& BatchAffinity = Config.BatchCpuAffinity.IsEmpty() ? Config.GenerationCpuAffinity : Config.BatchCpuAffinity;
+		ggml_threadpool_params GenerationParams = MakeParams(GenerationThreads, Config.GenerationCpuAffinity);
+		ggml_threadpool_params BatchParams = MakeParams(BatchThreads, BatchAffinity);
+
+		GenerationThreadpool = ggml_threadpool_new(&GenerationParams);
+		// one pool serves both when they would be identical; otherwise the batch pool starts paused, so its
+		// threads stay parked until the first prompt decode resumes them
+		if (ggml_threadpool_params_match(&GenerationParams, &BatchParams)) {
+			BatchThreadpool = GenerationThreadpool;
+		} else {
+			BatchParams.paused = true;
+			BatchThreadpool = ggml_threadpool_new(&BatchParams);
+		}
+		if (!GenerationThreadpool || !BatchThreadpool) {
+			UE_LOG(LogTemp, Warning, TEXT("LlamaThread: Failed to create inference threadpools, using ggml's default threads."));
+			FreeThreadpools_LlamaThread();
+			return;
 		}
+		llama_attach_threadpool(ctx, GenerationThreadpool, BatchThreadpool);
+		UE_LOG(LogTemp, Log, TEXT("LlamaThread: Attached threadpools, generation %d threads, batch %d threads%s, priority %d, poll %d."),
+			GenerationThreads, BatchThreads, (BatchThreadpool == GenerationThreadpool) ? TEXT(" (shared)") : TEXT(""),
+			(int32)Config.ThreadpoolPriority, (int32)GenerationParams.poll);
+	}
 
-		UE_LOG(LogTemp, Log, TEXT("LlamaThread: Initialization about to send context visual update."));
-		BroadcastContextVisualUpdate_LlamaThread();
+	void LLInternal::FreeThreadpools_LlamaThread()
+	{
+		if (BatchThreadpool && BatchThreadpool != GenerationThreadpool) ggml_threadpool_free(BatchThreadpool);
+		if (GenerationThreadpool) ggml_threadpool_free(GenerationThreadpool);
+		GenerationThreadpool = nullptr;
+		BatchThreadpool = nullptr;
+	}
 
-		int32_t current_kv_pos_for_predecode = 0; // Start from beginning of cache
-	    double TokenStartTime = FPlatformTime::Seconds();
-		if (!FixedBlocksCombinedTokens.empty()) {
-			int batch_size_override = 64;
-			// Use a simplified version of DecodeTokensAndSample's prompt processing part
-			// Or a dedicated helper function for this.
-			// For now, let's conceptualize it:
-			for (int32_t i = 0; i < FixedBlocksCombinedTokens.size(); /* i advanced by batch */ ) {
-				common_batch_clear(batch);
-				int32_t n_batch_tokens = 0;
-				for (int32_t j = 0; j < batch_size_override/*this->batch_capacity*/ && i + j < FixedBlocksCombinedTokens.size(); ++j) {
-					common_batch_add(batch, FixedBlocksCombinedTokens[i + j], current_kv_pos_for_predecode + j, {0}, false /* no logits needed */);
-					n_batch_tokens++;
-				}
+	void LLInternal::SetThreadCounts_LlamaThread(int32 GenerationThreads, int32 BatchThreads)
+	{
+		Config.GenerationThreads = GenerationThreads;
+		Config.BatchThreads = BatchThreads;
+		if (!ctx) return; // picked up by InitializeLlama_LlamaThread
+		int32 NewGeneration = ResolveThreadCount(GenerationThreads);
+		int32 NewBatch = ResolveThreadCount(BatchThreads);
+		// a dedicated pool can run fewer threads than it was created with, but not more
+		if (GenerationThreadpool) NewGeneration = FMath::Min(NewGeneration, ggml_threadpool_get_n_threads(GenerationThreadpool));
+		if (BatchThreadpool) NewBatch = FMath::Min(NewBatch, ggml_threadpool_get_n_threads(BatchThreadpool));
+		llama_set_n_threads(ctx, NewGeneration, NewBatch);
+		if (draft_ctx) llama_set_n_threads(draft_ctx, NewGeneration, NewBatch);
+		UE_LOG(LogTemp, Log, TEXT("LlamaThread: Threads set to %d (batch %d)."), NewGeneration, NewBatch);
+	}
 
-				if (batch.n_tokens == 0) break;
+	bool LLInternal::InitializeDraftModel_LlamaThread(const llama_model_params& ModelParams, const llama_context_params& CtxParams)
+	{
+		draft_model = llama_model_load_from_file(TCHAR_TO_UTF8(*Config.DraftModelPath), ModelParams);
+		if (!draft_model) {
+			UE_LOG(LogTemp, Warning, TEXT("LlamaThread: Unable to load draft model from %s, speculative decoding off."), *Config.DraftModelPath);
+			return false;
+		}
 
-				if (llama_decode(ctx, batch) != 0) {
-					FString ErrorMsg = TEXT("LlamaThread: llama_decode failed during fixed blocks pre-decoding.");
-					UE_LOG(LogTemp, Error, TEXT("%s"), *ErrorMsg);
-					qLlamaToMain.enqueue([this, ErrorMsg]() { if (errorCb) errorCb(ErrorMsg); });
-					// Handle error: maybe shutdown or mark as not ready
-					return;
-				}
-				// Append successfully decoded tokens to MirroredKvCacheTokens
-//				for (int32_t k = 0; k < batch.n_tokens; ++k) {
-//					 MirroredKvCacheTokens.push_back(FixedBlocksCombinedTokens[i + k]); // Add the token that was processed
-//				}
-				MirroredKvCacheTokens.insert(MirroredKvCacheTokens.end(), FixedBlocksCombinedTokens.begin()+i, FixedBlocksCombinedTokens.begin()+i+batch.n_tokens);
-				current_kv_pos_for_predecode += batch.n_tokens;
-				i += batch.n_tokens;
-
-				// Optional: Send progress update to main thread for UI
-				float Progress = static_cast<float>(current_kv_pos_for_predecode) / FixedBlocksCombinedTokens.size();
-				qLlamaToMain.enqueue([this, Progress]() { if (progressCb) progressCb(Progress); });
-				if (i >= FixedBlocksCombinedTokens.size()) {
-					BroadcastContextVisualUpdate_LlamaThread();
-				} else {
-					BroadcastContextVisualUpdate_LlamaThread(batch.n_tokens, FPlatformTime::Seconds()-TokenStartTime);
-				}
-				TokenStartTime = FPlatformTime::Seconds();
-				if (!bIsRunning) return;
-			}
-			kv_cache_token_cursor = MirroredKvCacheTokens.size();
-			UE_LOG(LogTemp, Log, TEXT("LlamaThread: Fixed context blocks pre-decoded. KV cache populated with %d tokens."), MirroredKvCacheTokens.size());
+		// Drafted tokens are checked against the main model's by id, so both must tokenize the same way.
+		// Vocab sizes may differ by padding; the special tokens and the shared ids' text must not.
+		const llama_vocab* DraftVocab = llama_model_get_vocab(draft_model);
+		const int32 MainTokens = llama_vocab_n_tokens(vocab);
+		const int32 DraftVocabTokens = llama_vocab_n_tokens(DraftVocab);
+		bool bCompatible = FMath::Abs(MainTokens - DraftVocabTokens) <= 128 &&
+			llama_vocab_bos(DraftVocab) == llama_vocab_bos(vocab) && llama_vocab_eos(DraftVocab) == llama_vocab_eos(vocab);
+		for (llama_token Id = 0; bCompatible && Id < FMath::Min3(MainTokens, DraftVocabTokens, 1024); Id++) {
+			const char* MainText = llama_vocab_get_text(vocab, Id);
+			const char* DraftText = llama_vocab_get_text(DraftVocab, Id);
+			bCompatible = MainText && DraftText && FCStringAnsi::Strcmp(MainText, DraftText) == 0;
+		}
+		if (!bCompatible) {
+			UE_LOG(LogTemp, Warning, TEXT("LlamaThread: Draft model %s has a different vocabulary (%d vs %d tokens), speculative decoding off."),
+				*Config.DraftModelPath, DraftVocabTokens, MainTokens);
+			FreeDraftModel_LlamaThread();
+			return false;
 		}
-		// --- End of Pre-decoding ---
 
-		// Signal main thread that AIXO is now ready (or after pre-decode)
-		FString msg = "Ready";
-		qLlamaToMain.enqueue([this, msg]() { if (readyCb) readyCb(msg); });
+		// Same context size, so it can hold everything the main context does
+		draft_ctx = llama_init_from_model(draft_model, CtxParams);
+		if (!draft_ctx) {
+			UE_LOG(LogTemp, Warning, TEXT("LlamaThread: Failed to create the draft llama_context, speculative decoding off."));
+			FreeDraftModel_LlamaThread();
+			return false;
+		}
+		if (GenerationThreadpool) llama_attach_threadpool(draft_ctx, GenerationThreadpool, BatchThreadpool); // the two contexts never run at once
+		draft_batch = llama_batch_init(CtxParams.n_batch, 0, 1);
+		draft_sampler = llama_sampler_chain_init(llama_sampler_chain_default_params());
+		llama_sampler_chain_add(draft_sampler, llama_sampler_init_greedy());
+		DraftKvTokens.clear();
+		UE_LOG(LogTemp, Log, TEXT("LlamaThread: Draft model %s loaded, drafting %d tokens per step."), *Config.DraftModelPath, Config.SpeculativeDraftTokens);
+		return true;
+	}
 
-		BroadcastContextVisualUpdate_LlamaThread();
+	void LLInternal::FreeDraftModel_LlamaThread()
+	{
+		if (draft_sampler) { llama_sampler_free(draft_sampler); draft_sampler = nullptr; }
+		if (draft_batch.token) { llama_batch_free(draft_batch); draft_batch = {}; }
+		if (draft_ctx) { llama_free(draft_ctx); draft_ctx = nullptr; }
+		if (draft_model) { llama_model_free(draft_model); draft_model = nullptr; }
+		DraftKvTokens.clear();
+	}
 
-		UE_LOG(LogTemp, Log, TEXT("LlamaThread: Initialization complete. KV cursor at %d. Fixed blocks tokenized and pre-decoded."), MirroredKvCacheTokens.size());
-    }
+	void LLInternal::DraftTokens_LlamaThread(llama_token LastToken, int32 MaxDraft, std::vector<llama_token>& OutDraft)
+	{
+		OutDraft.clear();
+		if (!draft_ctx || MaxDraft <= 0) return;
+
+		// Bring the draft context in line with the main one plus LastToken: keep the shared prefix, decode the rest.
+		// Between steps that is just the tokens accepted since the last draft; on a new turn, the prompt's changes.
+		const size_t Limit = FMath::Min(DraftKvTokens.size(), MirroredKvCacheTokens.size());
+		const int32 Reused = std::mismatch(DraftKvTokens.begin(), DraftKvTokens.begin() + Limit, MirroredKvCacheTokens.begin()).first - DraftKvTokens.begin();
+		if (Reused < (int32)DraftKvTokens.size()) {
+			llama_kv_self_seq_rm(draft_ctx, 0, Reused, -1);
+			DraftKvTokens.resize(Reused);
+		}
+		std::vector<llama_token> ToDecode(MirroredKvCacheTokens.begin() + Reused, MirroredKvCacheTokens.end());
+		ToDecode.push_back(LastToken);
+		const int32 ChunkSize = llama_n_batch(draft_ctx);
+		for (int32 i = 0; i < (int32)ToDecode.size(); i += ChunkSize) {
+			const int32 n_chunk = FMath::Min(ChunkSize, (int32)ToDecode.size() - i);
+			common_batch_clear(draft_batch);
+			for (int32 j = 0; j < n_chunk; j++) {
+				common_batch_add(draft_batch, ToDecode[i + j], (llama_pos)DraftKvTokens.size() + j, {0}, i + j == (int32)ToDecode.size() - 1);
+			}
+			if (llama_decode(draft_ctx, draft_batch) != 0) {
+				UE_LOG(LogTemp, Warning, TEXT("LlamaThread: Draft llama_decode failed, no draft this step."));
+				llama_kv_self_seq_rm(draft_ctx, 0, (llama_pos)DraftKvTokens.size(), -1);
+				return;
+			}
+			DraftKvTokens.insert(DraftKvTokens.end(), ToDecode.begin() + i, ToDecode.begin() + i + n_chunk);
+		}
+
+		// Greedy proposals; each one but the last is decoded so the next can be predicted
+		for (int32 i = 0; i < MaxDraft; i++) {
+			const llama_token Id = llama_sampler_sample(draft_sampler, draft_ctx, -1);
+			if (Id < 0 || Id >= llama_vocab_n_tokens(vocab)) break; // padding id the main model doesn't have
+			OutDraft.push_back(Id);
+			if (llama_vocab_is_eog(vocab, Id) || i + 1 == MaxDraft) break;
+			common_batch_clear(draft_batch);
+			common_batch_add(draft_batch, Id, (llama_pos)DraftKvTokens.size(), {0}, true);
+			if (llama_decode(draft_ctx, draft_batch) != 0) break;
+			DraftKvTokens.push_back(Id);
+		}
+	}
 
 	// Renamed helper to avoid confusion with the public UpdateContextBlock
 	void LLInternal::_TokenizeAndStoreFixedBlockInternal(ELlamaContextBlockType BlockType, const FString& Text, bool bAddBosForThisBlock) {
@@ -288,17 +546,98 @@ MirroredKvCacheTokens.clear();
 
 		FTokenizedContextBlock Block;
 		std::vector<llama_token> StdTokens = my_llama_tokenize(model, StdText, bAddBosForThisBlock, (BlockType == ELlamaContextBlockType::SystemPrompt)); // Special for system prompt
-		Block.Tokens.insert(Block.Tokens.end(), StdTokens.begin(), StdTokens.end());
+		if (IsTailBlock(BlockType)) { // after the conversation it can't just run on from the system prompt
+			const std::vector<llama_token>& SystemPrefix = RolePrefixTokens(TEXT("system"));
+			Block.Tokens.insert(Block.Tokens.end(), SystemPrefix.begin(), SystemPrefix.end());
+			Block.Tokens.insert(Block.Tokens.end(), StdTokens.begin(), StdTokens.end());
+			Block.Tokens.insert(Block.Tokens.end(), ChatTemplate.TurnSuffix.begin(), ChatTemplate.TurnSuffix.end());
+		} else {
+			Block.Tokens.insert(Block.Tokens.end(), StdTokens.begin(), StdTokens.end());
+		}
 		FixedContextBlocks.FindOrAdd(BlockType) = Block;
 		UE_LOG(LogTemp, Log, TEXT("LlamaThread: Tokenized (internal store) block %d, %d tokens."), (int)BlockType, Block.Tokens.size());
 	}
 
+	// Snapshot file name is a hash of everything that determines the decoded KV contents:
+	// the model file (size, timestamp and its head/tail bytes, rather than reading gigabytes), the model
+	// description, the context layout, and the fixed block tokens themselves.
+	FString LLInternal::MakeFixedBlocksSnapshotPath(const FString& ModelPath, const std::vector<llama_token>& FixedTokens) const
+	{
+		uint64 Hash = 0x41495830;	// "AIX0"
+		auto HashBytes = [&Hash](const void* Data, uint64 Len) { Hash = CityHash64WithSeed((const char*)Data, Len, Hash); };
+
+		IFileManager& FileManager = IFileManager::Get();
+		const int64 ModelFileSize = FileManager.FileSize(*ModelPath);
+		const int64 ModelFileTicks = FileManager.GetTimeStamp(*ModelPath).GetTicks();
+		HashBytes(&ModelFileSize, sizeof(ModelFileSize));
+		HashBytes(&ModelFileTicks, sizeof(ModelFileTicks));
+		if (TUniquePtr<IFileHandle> ModelFile(FPlatformFileManager::Get().GetPlatformFile().OpenRead(*ModelPath)); ModelFile && ModelFileSize > 0) {
+			const int64 SampleSize = FMath::Min<int64>(ModelFileSize, 1 << 20);
+			TArray<uint8> Sample;
+			Sample.SetNumUninitialized(SampleSize);
+			if (ModelFile->Read(Sample.GetData(), SampleSize)) HashBytes(Sample.GetData(), SampleSize);
+			if (ModelFile->Seek(ModelFileSize - SampleSize) && ModelFile->Read(Sample.GetData(), SampleSize)) HashBytes(Sample.GetData(), SampleSize);
+		}
+
+		char desc[256] = {0};
+		llama_model_desc(model, desc, sizeof(desc));
+		HashBytes(desc, strlen(desc));
+		const uint64 ModelParams = llama_model_n_params(model);
+		const uint32 ContextSize = llama_n_ctx(ctx);
+		HashBytes(&ModelParams, sizeof(ModelParams));
+		HashBytes(&ContextSize, sizeof(ContextSize));
+		HashBytes(FixedTokens.data(), FixedTokens.size() * sizeof(llama_token));
+
+		FString Dir = Config.KvSnapshotDirectory.IsEmpty() ? FPaths::ProjectSavedDir() / TEXT("LlamaKV") : Config.KvSnapshotDirectory;
+		return Dir / FString::Printf(TEXT("fixed_%016llx.kvs"), Hash);
+	}
+
+	bool LLInternal::TryRestoreFixedBlocksSnapshot(const FString& SnapshotPath, const std::vector<llama_token>& FixedTokens)
+	{
+		if (!IFileManager::Get().FileExists(*SnapshotPath)) {
+			UE_LOG(LogTemp, Log, TEXT("LlamaThread: No KV snapshot at %s, decoding fixed blocks."), *SnapshotPath);
+			return false;
+		}
+		double StartTime = FPlatformTime::Seconds();
+		std::vector<llama_token> LoadedTokens(FixedTokens.size());
+		size_t n_loaded = 0;
+		size_t n_bytes = llama_state_seq_load_file(ctx, TCHAR_TO_UTF8(*SnapshotPath), 0, LoadedTokens.data(), LoadedTokens.size(), &n_loaded);
+		LoadedTokens.resize(n_loaded);
+		// the hash only names the file; the token list stored alongside the KV data is the real check
+		if (n_bytes == 0 || LoadedTokens != FixedTokens || llama_kv_self_seq_pos_max(ctx, 0) != (llama_pos)FixedTokens.size() - 1) {
+			UE_LOG(LogTemp, Warning, TEXT("LlamaThread: KV snapshot %s is stale or unreadable, decoding fixed blocks."), *SnapshotPath);
+			llama_kv_self_seq_rm(ctx, 0, -1, -1);
+			return false;
+		}
+		UE_LOG(LogTemp, Log, TEXT("LlamaThread: Restored %d fixed block tokens (%llu bytes) from KV snapshot in %.1f ms."), n_loaded, (uint64)n_bytes, (FPlatformTime::Seconds() - StartTime) * 1000.0);
+		return true;
+	}
+
+	void LLInternal::SaveFixedBlocksSnapshot(const FString& SnapshotPath, const std::vector<llama_token>& FixedTokens)
+	{
+		IFileManager& FileManager = IFileManager::Get();
+		FileManager.MakeDirectory(*FPaths::GetPath(SnapshotPath), true);
+		// write to a temp name and move into place so an interrupted save never leaves a half-written snapshot
+		FString TempPath = SnapshotPath + TEXT(".tmp");
+		size_t n_bytes = llama_state_seq_save_file(ctx, TCHAR_TO_UTF8(*TempPath), 0, FixedTokens.data(), FixedTokens.size());
+		if (n_bytes == 0 || !FileManager.Move(*SnapshotPath, *TempPath, true)) {
+			UE_LOG(LogTemp, Warning, TEXT("LlamaThread: Failed to save KV snapshot to %s."), *SnapshotPath);
+			FileManager.Delete(*TempPath);
+			return;
+		}
+		UE_LOG(LogTemp, Log, TEXT("LlamaThread: Saved KV snapshot of %d fixed block tokens (%llu bytes) to %s."), FixedTokens.size(), (uint64)n_bytes, *SnapshotPath);
+	}
+
     void LLInternal::ShutdownLlama_LlamaThread()
     {
         UE_LOG(LogTemp, Log, TEXT("LlamaThread: Shutting down..."));
         if (sampler_chain_instance) { llama_sampler_free(sampler_chain_instance); sampler_chain_instance = nullptr; }
+        tool_call_grammar_sampler = nullptr;
         if (batch.token) { /*llama_batch_free(batch);*/ batch.token = nullptr; /* or however you check init */ }
+        FreeAgents_LlamaThread();
         if (ctx) { llama_free(ctx); ctx = nullptr; }
+        FreeDraftModel_LlamaThread();
+        FreeThreadpools_LlamaThread();
         if (model) { llama_model_free(model); model = nullptr; }
 //        FixedContextBlocks.Clear();
         ConversationHistoryTokens.clear();
@@ -308,142 +647,171 @@ MirroredKvCacheTokens.clear();
 
 	void LLInternal::UpdateContextBlock_LlamaThread(ELlamaContextBlockType BlockTypeToUpdate, const FString& NewTextContent)
 	{
-		if (!ctx || !model) {
-			UE_LOG(LogTemp, Error, TEXT("LlamaThread: UpdateContextBlockAndKV called but Llama not ready."));
-			return;
-		}
-		if (bIsGenerating.load(std::memory_order_acquire)) {
-			UE_LOG(LogTemp, Error, TEXT("LlamaThread: UpdateContextBlockAndKV for %d called while Llama is generating. Update deferred or ignored for now."), (int)BlockTypeToUpdate);
-			// Ideally, you'd queue this update to happen after generation.
-			// For now, we'll just skip if busy to prevent interference.
-			FString fs = "AIXO is currently thinking.\nPlease update shortly.\n\n";
-			qLlamaToMain.enqueue([this, fs]() mutable { if (tokenCb) tokenCb(MoveTemp(fs)); });
-			return;
+		StageContextBlock(BlockTypeToUpdate, NewTextContent);
+		ApplyPendingContextBlocks_LlamaThread();
+	}
+
+	int32 LLInternal::SubmitContextBlock(ELlamaContextBlockType BlockType, const FString& NewTextContent)
+	{
+		const int32 Generation = StageContextBlock(BlockType, NewTextContent);
+		// One apply in the queue serves every submission made before it runs
+		if (!bContextBlockApplyQueued.exchange(true)) {
+			qMainToLlama.enqueue([this]() {
+				bContextBlockApplyQueued = false;
+				ApplyPendingContextBlocks_LlamaThread();
+			});
 		}
+		return Generation;
+	}
 
-		UE_LOG(LogTemp, Log, TEXT("LlamaThread: Updating KV for changed BlockType %d."), (int)BlockTypeToUpdate);
+	int32 LLInternal::StageContextBlock(ELlamaContextBlockType BlockType, const FString& NewTextContent)
+	{
+		FScopeLock Lock(&PendingContextBlocksLock);
+		FPendingContextBlock& Slot = PendingContextBlocks[(int32)BlockType];
+		Slot.Text = NewTextContent;
+		Slot.Generation = ++LastContextBlockGeneration;
+		Slot.bPending = true;
+		return Slot.Generation;
+	}
 
-		bIsGenerating = true; // Acquire "generation lock" for this entire operation
-		qLlamaToMain.enqueue([this]() { if (setIsGeneratingCb) setIsGeneratingCb(true); });
-
-		// --- 1. Retokenize the changed fixed block ---
-		// _TokenizeAndStoreFixedBlockInternal just updates the FTokenizedContextBlock in FixedContextBlocks
-		_TokenizeAndStoreFixedBlockInternal(BlockTypeToUpdate, NewTextContent, (BlockTypeToUpdate == ELlamaContextBlockType::SystemPrompt));
-
-		// --- 2. Determine KV Invalidation Point & Roll Back KV Cache and MirroredTokens ---
-		// This calculates the sum of token lengths of fixed blocks *before* BlockTypeToUpdate.
-		int32_t ValidPrefixTokenCount = 0;
-		for (uint8 i = 0; i < (uint8)BlockTypeToUpdate; ++i) {
-			if (const FTokenizedContextBlock* PrevBlock = FixedContextBlocks.Find((ELlamaContextBlockType)i)) {
-				ValidPrefixTokenCount += PrevBlock->Tokens.size();
+	bool LLInternal::TakePendingContextBlocks_LlamaThread()
+	{
+		FPendingContextBlock Taken[(int32)ELlamaContextBlockType::COUNT];
+		{
+			FScopeLock Lock(&PendingContextBlocksLock);
+			for (int32 i = 0; i < (int32)ELlamaContextBlockType::COUNT; ++i) {
+				if (!PendingContextBlocks[i].bPending) continue;
+				Taken[i] = MoveTemp(PendingContextBlocks[i]);
+				PendingContextBlocks[i].bPending = false;
 			}
 		}
-		InvalidateKVCacheFromPosition(ValidPrefixTokenCount); // Rolls back MirroredKvCacheTokens and llama_kv_cache_seq_rm
-															  // kv_cache_token_cursor is now ValidPrefixTokenCount (via MirroredKvCacheTokens.size())
-
-		UE_LOG(LogTemp, Log, TEXT("LlamaThread: KV cache rolled back to %d tokens for BlockType %d update."), MirroredKvCacheTokens.size(), (int)BlockTypeToUpdate);
 
-		BroadcastContextVisualUpdate_LlamaThread();
-
-		// --- 3. Assemble the sequence of ALL tokens that need to be re-decoded to update the KV cache ---
-		// This includes the updated block, all subsequent fixed blocks, the full conversation history, and current HFS.
-		std::vector<llama_token> TokensToReDecodeNow;
-		TokensToReDecodeNow.reserve(n_ctx_from_model); // Pre-allocate
+		bool bAnyTaken = false;
+		for (int32 i = 0; i < (int32)ELlamaContextBlockType::COUNT; ++i) {
+			if (!Taken[i].bPending) continue;
+			const ELlamaContextBlockType BlockType = (ELlamaContextBlockType)i;
+			UE_LOG(LogTemp, Log, TEXT("LlamaThread: Applying BlockType %d generation %d."), i, Taken[i].Generation);
+			// _TokenizeAndStoreFixedBlockInternal just updates the FTokenizedContextBlock in FixedContextBlocks
+			_TokenizeAndStoreFixedBlockInternal(BlockType, Taken[i].Text, (BlockType == ELlamaContextBlockType::SystemPrompt));
+			AppliedContextBlocks.Add(TPair<ELlamaContextBlockType, int32>(BlockType, Taken[i].Generation));
+			PendingBlockUpdates++;
+			bAnyTaken = true;
+		}
+		return bAnyTaken;
+	}
 
-		// Add the updated block and all subsequent fixed blocks
-		bool bPastUpdatedBlock = false;
-		for (uint8 i = 0; i < (uint8)ELlamaContextBlockType::COUNT; ++i) {
-			ELlamaContextBlockType currentEnumBlock = (ELlamaContextBlockType)i;
-			if (currentEnumBlock == BlockTypeToUpdate) {
-				bPastUpdatedBlock = true;
-			}
-			if (bPastUpdatedBlock) { // Add this block (which is the newly tokenized one) and all subsequent fixed blocks
-				if (const FTokenizedContextBlock* Block = FixedContextBlocks.Find(currentEnumBlock)) {
-					TokensToReDecodeNow.insert(TokensToReDecodeNow.end(), Block->Tokens.begin(), Block->Tokens.end());
-				}
-			}
+	void LLInternal::ReportAppliedContextBlocks_LlamaThread()
+	{
+		for (const TPair<ELlamaContextBlockType, int32>& Applied : AppliedContextBlocks) {
+			PostToMain_LlamaThread([this, Applied]() { if (contextBlockAppliedCb) contextBlockAppliedCb(Applied.Key, Applied.Value); });
 		}
+		AppliedContextBlocks.Reset();
+	}
 
-		// Add current full ConversationHistoryTokens (already templated)
-		TokensToReDecodeNow.insert(TokensToReDecodeNow.end(), ConversationHistoryTokens.begin(), ConversationHistoryTokens.end());
+	void LLInternal::ApplyPendingContextBlocks_LlamaThread()
+	{
+		if (!ctx || !model) {
+			UE_LOG(LogTemp, Error, TEXT("LlamaThread: UpdateContextBlockAndKV called but Llama not ready."));
+			return;
+		}
+		if (bIsGenerating.load(std::memory_order_acquire)) {
+			return; // the turn in progress takes the slots at its next boundary
+		}
 
-		// Add current CurrentHighFrequencyStateTokens (formatted as it would be for a prompt)
-		if (!CurrentHighFrequencyStateTokens.empty()) {
-			std::string hfs_prefix_str = "<|im_start|>system\n[Submarine Status:]\n"; // Match your prompt assembly
-			std::string hfs_suffix_str = "\n<|im_end|>\n";
-			std::vector<llama_token> hfs_p_tok = my_llama_tokenize(model, hfs_prefix_str, false, true);
-			std::vector<llama_token> hfs_s_tok = my_llama_tokenize(model, hfs_suffix_str, false, true);
+		const double UpdateStartTime = FPlatformTime::Seconds();
 
-			TokensToReDecodeNow.insert(TokensToReDecodeNow.end(), hfs_p_tok.begin(), hfs_p_tok.end());
-			TokensToReDecodeNow.insert(TokensToReDecodeNow.end(), CurrentHighFrequencyStateTokens.begin(), CurrentHighFrequencyStateTokens.end());
-			TokensToReDecodeNow.insert(TokensToReDecodeNow.end(), hfs_s_tok.begin(), hfs_s_tok.end());
-		}
+		// --- 1. Retokenize every changed fixed block ---
+		if (!TakePendingContextBlocks_LlamaThread()) return;
 
-		// --- 4. Decode `TokensToReDecodeNow` into KV Cache (logits=false for all) ---
-		if (!TokensToReDecodeNow.empty()) {
-			UE_LOG(LogTemp, Log, TEXT("LlamaThread: Background KV Update: Decoding %d tokens to refresh cache starting from (current) KV cursor %d."),
-				TokensToReDecodeNow.size(), MirroredKvCacheTokens.size());
+		bIsGenerating = true; // Acquire "generation lock" for this entire operation
+		PostToMain_LlamaThread([this]() { if (setIsGeneratingCb) setIsGeneratingCb(true); });
 
-			// The kv_cache_token_cursor (from MirroredKvCacheTokens.size()) is already at ValidPrefixTokenCount.
-			// The token positions for llama_batch_add will start from this current MirroredKvCacheTokens.size().
-			int32_t kv_pos_for_this_decode_pass = MirroredKvCacheTokens.size();
-		    double TokenStartTime = FPlatformTime::Seconds();
+		// --- 2. Diff the context as it now reads against what the KV cache holds ---
+		// Only the cached tokens after the first difference are dropped: with an unchanged head of the block (the usual case
+		// for a status block) that is the block's changed suffix plus whatever follows it in the layout.
+		std::vector<llama_token> TokensInContext;
+		TokensInContext.reserve(n_ctx_from_model); // Pre-allocate
+		AppendContextTokens(TokensInContext);
+		const int32_t ReusedTokenCount = SyncKVCacheToTokens(TokensInContext);
 
-			for (int32_t i = 0; i < TokensToReDecodeNow.size(); /* i advanced by batch.n_tokens */ ) {
-				int batch_size_override = 64;
-				common_batch_clear(batch);
-				int32_t n_batch_fill = 0;
-				for (int32_t j = 0; j < batch_size_override/*this->batch_capacity*/ && i + j < TokensToReDecodeNow.size(); ++j) {
-					common_batch_add(batch, TokensToReDecodeNow[i + j], kv_pos_for_this_decode_pass + j, {0}, false); // Logits = false
-					n_batch_fill++;
-				}
+		UE_LOG(LogTemp, Log, TEXT("LlamaThread: KV cache keeps %d of %d context tokens for %d block update(s)."), ReusedTokenCount, TokensInContext.size(), AppliedContextBlocks.Num());
 
-				if (batch.n_tokens == 0) break;
+		BroadcastContextVisualUpdate_LlamaThread();
 
-				if (llama_decode(ctx, batch) != 0) {
-					FString ErrorMsg = FString::Printf(TEXT("LlamaThread: llama_decode failed during background KV update for BlockType %d."), (int)BlockTypeToUpdate);
-					UE_LOG(LogTemp, Error, TEXT("%s"), *ErrorMsg);
-					qLlamaToMain.enqueue([this, ErrorMsg]() { if (errorCb) errorCb(ErrorMsg); });
-					// KV cache might be in a partial state. A full reset might be needed on next ProcessInput.
-					// For now, just stop this background update.
-					return;
-				}
+		// --- 3. Decode the divergent suffix into the KV cache (logits=false for all), once for all blocks ---
+		const int32_t NumTokensToDecode = TokensInContext.size() - ReusedTokenCount;
+		if (NumTokensToDecode > 0) {
+			UE_LOG(LogTemp, Log, TEXT("LlamaThread: Background KV Update: Decoding %d tokens to refresh cache starting from KV cursor %d."),
+				NumTokensToDecode, kv_cache_token_cursor);
 
-				// Append successfully decoded tokens to MirroredKvCacheTokens
-//				for (int32_t k = 0; k < batch.n_tokens; ++k) {
-//					 MirroredKvCacheTokens.push_back(TokensToReDecodeNow[i + k]);
-//				}
-				MirroredKvCacheTokens.insert(MirroredKvCacheTokens.end(), TokensToReDecodeNow.begin()+i, TokensToReDecodeNow.begin()+i+batch.n_tokens);
-				kv_pos_for_this_decode_pass += batch.n_tokens;
-				i += batch.n_tokens;
-
-				// Optional: Send progress if this is a very long background update
-				// float Progress = static_cast<float>(i) / TokensToReDecodeNow.size();
-				// qLlamaToMain.enqueue([this, Progress]() { /* Call OnLlamaLoadingProgress or similar */ });
-				if (i >= TokensToReDecodeNow.size()) {
-					BroadcastContextVisualUpdate_LlamaThread();
-				} else {
-					BroadcastContextVisualUpdate_LlamaThread(batch.n_tokens, FPlatformTime::Seconds()-TokenStartTime);
-				}
-				TokenStartTime = FPlatformTime::Seconds();
+			if (IngestPromptTokens_LlamaThread(TokensInContext.data() + ReusedTokenCount, NumTokensToDecode, false, TEXT("background KV update"))) {
+				PendingRedecodeTokens += NumTokensToDecode;
+				UE_LOG(LogTemp, Log, TEXT("LlamaThread: Background KV Update complete. KV cursor (MirroredKvCacheTokens.size) now at %d."), MirroredKvCacheTokens.size());
 			}
-			kv_cache_token_cursor = MirroredKvCacheTokens.size();
-			BroadcastContextVisualUpdate_LlamaThread();
-			UE_LOG(LogTemp, Log, TEXT("LlamaThread: Background KV Update for BlockType %d complete. KV cursor (MirroredKvCacheTokens.size) now at %d."),
-				(int)BlockTypeToUpdate, MirroredKvCacheTokens.size());
+			// On failure the KV cache holds a partial update; the next prompt's diff only trusts what was actually decoded.
 		} else {
-			UE_LOG(LogTemp, Log, TEXT("LlamaThread: Background KV Update for BlockType %d - no tokens needed re-decoding after invalidation (e.g., last block changed or history empty). KV cursor at %d."),
-				(int)BlockTypeToUpdate, MirroredKvCacheTokens.size());
+			UE_LOG(LogTemp, Log, TEXT("LlamaThread: Background KV Update - no tokens needed re-decoding. KV cursor at %d."), MirroredKvCacheTokens.size());
 		}
 
-		bIsGenerating = false; // Acquire "generation lock" for this entire operation
-		qLlamaToMain.enqueue([this]() { if (setIsGeneratingCb) setIsGeneratingCb(false); });
+		PendingBlockUpdateMs += (FPlatformTime::Seconds() - UpdateStartTime) * 1000.0;
+		ReportAppliedContextBlocks_LlamaThread();
+
+		bIsGenerating = false; // Release the "generation lock"
+		PostToMain_LlamaThread([this]() { if (setIsGeneratingCb) setIsGeneratingCb(false); });
+		RunDeferredAgentTurns_LlamaThread();
 
-		// --- 5. Broadcast Context Visual Update ---
+		// --- 4. Broadcast Context Visual Update ---
 		// It's good to update the visualizer after the KV cache is refreshed.
 		BroadcastContextVisualUpdate_LlamaThread();
 	}
 
+	// Feeds prompt tokens into sequence 0 starting at kv_cache_token_cursor, in chunks of the context's n_batch
+	// (llama_decode splits each chunk further into n_ubatch micro-batches). Keeps MirroredKvCacheTokens and the
+	// cursor in step, and logs the measured ingest rate. Returns false if llama_decode fails or shutdown was requested.
+	bool LLInternal::IngestPromptTokens_LlamaThread(const llama_token* Tokens, int32_t NumTokens, bool bLogitsForLastToken, const TCHAR* Label, bool bReportLoadingProgress)
+	{
+		if (NumTokens <= 0) return true;
+		const int32_t ChunkSize = FMath::Max(1, FMath::Min((int32_t)llama_n_batch(ctx), batch_capacity));
+		const double IngestStartTime = FPlatformTime::Seconds();
+		int32_t NumChunks = 0;
+
+		for (int32_t i = 0; i < NumTokens; /* i advanced by chunk */ ) {
+			const int32_t n_chunk = FMath::Min(ChunkSize, NumTokens - i);
+			common_batch_clear(batch);
+			for (int32_t j = 0; j < n_chunk; ++j) {
+				bool bLogits = bLogitsForLastToken && (i + j == NumTokens - 1);
+				common_batch_add(batch, Tokens[i + j], kv_cache_token_cursor + j, {0}, bLogits);
+			}
+
+			if (llama_decode(ctx, batch) != 0) {
+				FString ErrorMsg = FString::Printf(TEXT("LlamaThread: llama_decode failed during %s prompt ingest."), Label);
+				UE_LOG(LogTemp, Error, TEXT("%s"), *ErrorMsg);
+				PostToMain_LlamaThread([this, ErrorMsg]() { if (errorCb) errorCb(ErrorMsg); });
+				return false;
+			}
+			MirroredKvCacheTokens.insert(MirroredKvCacheTokens.end(), Tokens + i, Tokens + i + n_chunk);
+			kv_cache_token_cursor += n_chunk;
+			i += n_chunk;
+			NumChunks++;
+
+			if (bReportLoadingProgress) {
+				float Progress = static_cast<float>(i) / NumTokens;
+				PostToMain_LlamaThread([this, Progress]() { if (progressCb) progressCb(Progress); });
+			}
+			if (i >= NumTokens) {
+				BroadcastContextVisualUpdate_LlamaThread();
+			} else {
+				RequestContextVisualUpdate_LlamaThread(i, FPlatformTime::Seconds() - IngestStartTime, 0.0f);
+			}
+			if (!bIsRunning) return false;
+		}
+
+		double Elapsed = FPlatformTime::Seconds() - IngestStartTime;
+		UE_LOG(LogTemp, Log, TEXT("LlamaThread: Ingested %d %s tokens in %d chunks (n_batch %d, n_ubatch %d): %.1f ms, %.1f tokens/sec."),
+			NumTokens, Label, NumChunks, ChunkSize, llama_n_ubatch(ctx), Elapsed * 1000.0, Elapsed > 0 ? NumTokens / Elapsed : 0.0);
+		return true;
+	}
+
     // Invalidates KV cache from a certain token position onwards in the logical sequence
     void LLInternal::InvalidateKVCacheFromPosition(int32_t ValidTokenCountBeforeInvalidation) {
         if (!ctx) return;
@@ -452,44 +820,70 @@ MirroredKvCacheTokens.clear();
             llama_kv_self_seq_rm(ctx, 0, ValidTokenCountBeforeInvalidation, kv_cache_token_cursor); // seq_id 0, from pos, to pos (-1 means end)
             kv_cache_token_cursor = ValidTokenCountBeforeInvalidation;
         }
-MirroredKvCacheTokens.resize(ValidTokenCountBeforeInvalidation);
+if (ValidTokenCountBeforeInvalidation < (int32_t)MirroredKvCacheTokens.size()) MirroredKvCacheTokens.resize(ValidTokenCountBeforeInvalidation);
          // If ValidTokenCountBeforeInvalidation >= kv_cache_token_cursor, cache is already valid up to that point or beyond.
     }
 
-	void LLInternal::AssembleFullPromptForTurn(
-		const FString& CurrentInputOriginalTextFStr, // Raw text of the current user/tool input for focus
-		const FString& CurrentInputTypeHintFStr,     // "user" or "tool"
-		std::vector<llama_token>& OutFullPromptTokens)
-	{
-		OutFullPromptTokens.clear();
-		OutFullPromptTokens.reserve(n_ctx_from_model); // Pre-allocate
+	// Token-level diff: MirroredKvCacheTokens is exactly what sequence 0 holds, so the longest common prefix with
+	// TargetTokens can stay and everything after it goes. Returns that prefix length (the new KV cursor).
+	int32_t LLInternal::SyncKVCacheToTokens(const std::vector<llama_token>& TargetTokens) {
+		const size_t Limit = FMath::Min(MirroredKvCacheTokens.size(), TargetTokens.size());
+		const int32_t Reused = std::mismatch(MirroredKvCacheTokens.begin(), MirroredKvCacheTokens.begin() + Limit, TargetTokens.begin()).first - MirroredKvCacheTokens.begin();
+		InvalidateKVCacheFromPosition(Reused);
+		return Reused;
+	}
+
+	bool LLInternal::IsTailBlock(ELlamaContextBlockType BlockType) const {
+		return Config.bVolatileBlocksAfterHistory && BlockType == ELlamaContextBlockType::LowFrequencyState;
+	}
 
-		// 1. Fixed Prefix Blocks (SystemPrompt, StaticWorldInfo, LowFrequencyState)
+	int32 LLInternal::PrefixBlocksTokenCount() const {
+		int32 Count = 0;
 		for (uint8 i = 0; i < (uint8)ELlamaContextBlockType::COUNT; ++i) {
+			if (IsTailBlock((ELlamaContextBlockType)i)) continue;
 			if (const FTokenizedContextBlock* Block = FixedContextBlocks.Find((ELlamaContextBlockType)i)) {
-				OutFullPromptTokens.insert(OutFullPromptTokens.end(), Block->Tokens.begin(), Block->Tokens.end());
+				Count += Block->Tokens.size();
+			}
+		}
+		return Count;
+	}
+
+	void LLInternal::AppendContextTokens(std::vector<llama_token>& OutTokens) const {
+		// 1. Fixed prefix blocks (SystemPrompt, StaticWorldInfo, and LowFrequencyState unless it goes after the history)
+		for (uint8 i = 0; i < (uint8)ELlamaContextBlockType::COUNT; ++i) {
+			if (IsTailBlock((ELlamaContextBlockType)i)) continue;
+			if (const FTokenizedContextBlock* Block = FixedContextBlocks.Find((ELlamaContextBlockType)i)) {
+				OutTokens.insert(OutTokens.end(), Block->Tokens.begin(), Block->Tokens.end());
 			}
 		}
 
 		// 2. Conversation History (already fully formatted with roles and includes the current user/tool input)
-		OutFullPromptTokens.insert(OutFullPromptTokens.end(), ConversationHistoryTokens.begin(), ConversationHistoryTokens.end());
-
-		// 3. Current High Frequency State (Formatted as a system message for this turn)
-		if (!CurrentHighFrequencyStateTokens.empty()) {
-			// Ensure HFS is wrapped in the model's expected system message format
-			// Example for Qwen: <|im_start|>system\n[HFS_CONTENT]<|im_end|>\n
-			// The CurrentHighFrequencyStateTokens should be just the content.
-			std::string hfs_prefix_str = "<|im_start|>system\n[Submarine Status:]\n"; // Be explicit
-			std::string hfs_suffix_str = "\n<|im_end|>\n";
-			
-			std::vector<llama_token> hfs_p_tok = my_llama_tokenize(model, hfs_prefix_str, false, true);
-			std::vector<llama_token> hfs_s_tok = my_llama_tokenize(model, hfs_suffix_str, false, true);
+		OutTokens.insert(OutTokens.end(), ConversationHistoryTokens.begin(), ConversationHistoryTokens.end());
 
-			OutFullPromptTokens.insert(OutFullPromptTokens.end(), hfs_p_tok.begin(), hfs_p_tok.end());
-			OutFullPromptTokens.insert(OutFullPromptTokens.end(), CurrentHighFrequencyStateTokens.begin(), CurrentHighFrequencyStateTokens.end());
-			OutFullPromptTokens.insert(OutFullPromptTokens.end(), hfs_s_tok.begin(), hfs_s_tok.end());
+		// 3. Volatile blocks placed after the history
+		for (uint8 i = 0; i < (uint8)ELlamaContextBlockType::COUNT; ++i) {
+			if (!IsTailBlock((ELlamaContextBlockType)i)) continue;
+			if (const FTokenizedContextBlock* Block = FixedContextBlocks.Find((ELlamaContextBlockType)i)) {
+				OutTokens.insert(OutTokens.end(), Block->Tokens.begin(), Block->Tokens.end());
+			}
 		}
 
+		// 4. Current High Frequency State (Formatted as a system message for this turn)
+		AppendHighFrequencyStateTokens(OutTokens);
+	}
+
+	void LLInternal::AssembleFullPromptForTurn(
+		const FString& CurrentInputOriginalTextFStr, // Raw text of the current user/tool input for focus
+		const FString& CurrentInputTypeHintFStr,     // "user" or "tool"
+		std::vector<llama_token>& OutFullPromptTokens)
+	{
+		OutFullPromptTokens.clear();
+		OutFullPromptTokens.reserve(n_ctx_from_model); // Pre-allocate
+
+		// 1-3. Fixed blocks, conversation history and the current High Frequency State, in the configured layout
+		// Example HFS for Qwen: <|im_start|>system\n[HFS_CONTENT]<|im_end|>\n
+		AppendContextTokens(OutFullPromptTokens);
+
 		// 4. **** ADD FOCUS INSTRUCTION (if current input was from user) ****
 //		if (CurrentInputTypeHintFStr.Equals(TEXT("user"), ESearchCase::IgnoreCase) && !CurrentInputOriginalTextFStr.IsEmpty()) {
 //			std::string clean_user_query_std_str = TCHAR_TO_UTF8(*CurrentInputOriginalTextFStr);
@@ -513,29 +907,55 @@ if (0)    if (CurrentInputTypeHintFStr.Equals(TEXT("user"), ESearchCase::IgnoreC
 		// 5. AI Assistant Prompt Prefix
 		// For Qwen, the assistant turn starts immediately after the last user/system/tool <|im_end|>.
 		// The actual prompt for the assistant to start generating is just "<|im_start|>assistant\n"
-		std::string assistant_prefix_str = "<|im_start|>assistant\n";
+		// (see BuildChatTemplateTokens_LlamaThread)
+		OutFullPromptTokens.insert(OutFullPromptTokens.end(), ChatTemplate.AssistantPrefix.begin(), ChatTemplate.AssistantPrefix.end());
+	}
+
+	// Tokenizes the constant chat-template pieces once per model, so prompt assembly and history
+	// bookkeeping only copy tokens. Qwen format.
+	void LLInternal::BuildChatTemplateTokens_LlamaThread()
+	{
+		ChatTemplate = FChatTemplateTokens();
+		for (const TCHAR* Role : { TEXT("system"), TEXT("user"), TEXT("assistant"), TEXT("tool"), TEXT("tool_response") }) {
+			RolePrefixTokens(Role);
+		}
+		ChatTemplate.TurnSuffix = my_llama_tokenize(model, "<|im_end|>\n", false, true);	// ??? had to remove <|im_end|> or it would wind up twice in convo
+		ChatTemplate.HfsPrefix = my_llama_tokenize(model, "<|im_start|>system\n[Submarine Status:]\n", false, true);
+		ChatTemplate.HfsSuffix = my_llama_tokenize(model, "\n<|im_end|>\n", false, true);
 		// Qwen sometimes expects no newline after "<|im_start|>assistant" if it's immediately generating.
-		// Check Qwen's specific examples. If it's just "<|im_start|>assistant", adjust.
 		// The newline is usually good practice as models are often trained with content on the next line.
+		ChatTemplate.AssistantPrefix = my_llama_tokenize(model, "<|im_start|>assistant\n", false, true);
+	}
 
-		std::vector<llama_token> assistant_prefix_tokens = my_llama_tokenize(model, assistant_prefix_str, false, true);
-		OutFullPromptTokens.insert(OutFullPromptTokens.end(), assistant_prefix_tokens.begin(), assistant_prefix_tokens.end());
+	const std::vector<llama_token>& LLInternal::RolePrefixTokens(const FString& Role)
+	{
+		if (const std::vector<llama_token>* Cached = ChatTemplate.RolePrefixes.Find(Role)) {
+			return *Cached;
+		}
+		std::string role_prefix = "<|im_start|>" + std::string(TCHAR_TO_UTF8(*Role)) + "\n";
+		return ChatTemplate.RolePrefixes.Add(Role, my_llama_tokenize(model, role_prefix, false, true));
+	}
+
+	void LLInternal::AppendTurnToFlatHistory(const FConversationTurn& Turn)
+	{
+		const std::vector<llama_token>& RolePrefix = RolePrefixTokens(Turn.Role);
+		ConversationHistoryTokens.insert(ConversationHistoryTokens.end(), RolePrefix.begin(), RolePrefix.end());
+		ConversationHistoryTokens.insert(ConversationHistoryTokens.end(), Turn.Tokens.begin(), Turn.Tokens.end());
+		ConversationHistoryTokens.insert(ConversationHistoryTokens.end(), ChatTemplate.TurnSuffix.begin(), ChatTemplate.TurnSuffix.end());
+	}
+
+	// HFS is presented as a system message; appends nothing if there is no HFS this turn
+	void LLInternal::AppendHighFrequencyStateTokens(std::vector<llama_token>& OutTokens) const
+	{
+		if (CurrentHighFrequencyStateTokens.empty()) return;
+		OutTokens.insert(OutTokens.end(), ChatTemplate.HfsPrefix.begin(), ChatTemplate.HfsPrefix.end());
+		OutTokens.insert(OutTokens.end(), CurrentHighFrequencyStateTokens.begin(), CurrentHighFrequencyStateTokens.end());
+		OutTokens.insert(OutTokens.end(), ChatTemplate.HfsSuffix.begin(), ChatTemplate.HfsSuffix.end());
 	}
 	
 	void LLInternal::LlamaLogContext(FString Label) {
-		int32_t StablePrefixLength = 0;
-		for (uint8 j = 0; j < (uint8)ELlamaContextBlockType::COUNT; ++j) {
-			if (const FTokenizedContextBlock* Block = FixedContextBlocks.Find((ELlamaContextBlockType)j)) {
-				StablePrefixLength += Block->Tokens.size();
-			}
-		}
-		StablePrefixLength += ConversationHistoryTokens.size();
-		int32 CurrentFixedTokens = 0;
-		for (uint8 i = 0; i < (uint8)ELlamaContextBlockType::COUNT; ++i) {
-			if (const FTokenizedContextBlock* Block = FixedContextBlocks.Find((ELlamaContextBlockType)i)) {
-				CurrentFixedTokens += Block->Tokens.size();
-			}
-		}
+		const int32 CurrentFixedTokens = PrefixBlocksTokenCount();
+		const int32_t StablePrefixLength = CurrentFixedTokens + ConversationHistoryTokens.size();
 		std::string cs;
 		int lim = MirroredKvCacheTokens.size();
 		int i = lim - 1200;
@@ -610,30 +1030,21 @@ if (0)    if (CurrentInputTypeHintFStr.Equals(TEXT("user"), ESearchCase::IgnoreC
 
         eos_reached = false;
         CurrentTurnAIReplyTokens.clear();
+        if (tool_call_grammar_sampler) llama_sampler_reset(tool_call_grammar_sampler); // back to waiting for the trigger
 
         // Determine how many tokens from FullPromptTokensForThisTurn are already in KV cache
         int32_t n_tokens_to_eval_from_prompt = 0;
 //        int32_t prompt_eval_start_index = 0;
     	int32_t prompt_eval_start_index_in_vector = 0; // Index within FullPromptTokensForThisTurn
 
-    // This logic determines how much of FullPromptTokensForThisTurn is "new" compared to what's in KV cache
-        if (kv_cache_token_cursor < FullPromptTokensForThisTurn.size()) {
-			// We expect to append to the existing KV cache.
-			// The first token from FullPromptTokensForThisTurn that needs decoding is at this index in the vector:
-			prompt_eval_start_index_in_vector = kv_cache_token_cursor;
-			n_tokens_to_eval_from_prompt = FullPromptTokensForThisTurn.size() - kv_cache_token_cursor;
-		} else if (kv_cache_token_cursor > FullPromptTokensForThisTurn.size()) {
-			// DESYNC! KV cache thinks it has more than the current total prompt.
-			// This means InvalidateKVCacheFromPosition was not called correctly after a shortening operation.
-			UE_LOG(LogTemp, Error, TEXT("LlamaThread: KV CACHE DESYNC! kv_cursor (%d) > FullPrompt.Num() (%d). Forcing full re-eval."),
-				kv_cache_token_cursor, FullPromptTokensForThisTurn.size());
-			
-			InvalidateKVCacheFromPosition(0); // Resets kv_cache_token_cursor to 0
-			
-			prompt_eval_start_index_in_vector = 0; // Start from the beginning of the vector
-			n_tokens_to_eval_from_prompt = FullPromptTokensForThisTurn.size();
+		// Diff the prompt against what the KV cache actually holds; only the divergent suffix is decoded.
+		prompt_eval_start_index_in_vector = SyncKVCacheToTokens(FullPromptTokensForThisTurn);
+		if (prompt_eval_start_index_in_vector == (int32_t)FullPromptTokensForThisTurn.size()) {
+			// Everything is cached, but sampling needs fresh logits for the last prompt token
+			prompt_eval_start_index_in_vector--;
+			InvalidateKVCacheFromPosition(prompt_eval_start_index_in_vector);
 		}
-        // If kv_cache_token_cursor == FullPromptTokensForThisTurn.size(), all prompt tokens are in cache.
+		n_tokens_to_eval_from_prompt = FullPromptTokensForThisTurn.size() - prompt_eval_start_index_in_vector;
 
 		UE_LOG(LogTemp, Log, TEXT("LlamaThread: Decoding prompt. Total prompt tokens: %d. Current KV cursor: %d. Tokens to eval from prompt: %d, starting at vector index %d."),
 			FullPromptTokensForThisTurn.size(), kv_cache_token_cursor, n_tokens_to_eval_from_prompt, prompt_eval_start_index_in_vector);
@@ -647,46 +1058,16 @@ if (0)    if (CurrentInputTypeHintFStr.Equals(TEXT("user"), ESearchCase::IgnoreC
 DebugContext("DecodeTokensAndSample: Before Prompt Decoded, decoding");
 #endif // TRACK_PARALLEL_CONTEXT_TOKENS
 		if (n_tokens_to_eval_from_prompt > 0) {
-		    double TokenStartTime = FPlatformTime::Seconds();
-			for (int32_t i = 0; i < n_tokens_to_eval_from_prompt;  ) { //i advanced by batch size
-				int batch_size_override = 64;
-				common_batch_clear(batch);
-				int32_t current_batch_fill_count = 0;
-				for (int32_t j = 0; j < batch_size_override/*this->batch_capacity*/ && i + j < n_tokens_to_eval_from_prompt; ++j) {
-					// Token from the vector to be decoded
-					llama_token token_to_decode = FullPromptTokensForThisTurn[prompt_eval_start_index_in_vector + i + j];
-					
-					// Position in the KV cache for this token:
-					// It's the current end of the valid KV cache (kv_cache_token_cursor) + offset within this new chunk (j)
-					int32_t token_kv_pos = kv_cache_token_cursor + j; // THIS IS THE CRITICAL 'pos'
-
-					bool bLogits = bIsFinalPromptTokenLogits && (prompt_eval_start_index_in_vector + i + j == FullPromptTokensForThisTurn.size() - 1);
-					
-					common_batch_add(batch, token_to_decode, token_kv_pos, {0}, bLogits);
-MirroredKvCacheTokens.push_back(token_to_decode);
-					current_batch_fill_count++;
-				}
-
-				if (batch.n_tokens == 0) break; // Should only happen if n_tokens_to_eval_from_prompt was 0 initially
-
-				if (llama_decode(ctx, batch) != 0) {
-					FString ErrorMsg = TEXT("LlamaThread: llama_decode failed during generation.");
-					UE_LOG(LogTemp, Error, TEXT("%s"), *ErrorMsg);
-					qLlamaToMain.enqueue([this, ErrorMsg]() { if (errorCb) errorCb(ErrorMsg); });
-					eos_reached = true;
-					return;
-				}
-				// IMPORTANT: Advance kv_cache_token_cursor by the number of tokens *successfully decoded and added to KV cache*
-				kv_cache_token_cursor += batch.n_tokens;
-				i += batch.n_tokens; // Advance the loop for the source tokens
-				if (i >= n_tokens_to_eval_from_prompt) {
-					BroadcastContextVisualUpdate_LlamaThread();
-				} else {
-					BroadcastContextVisualUpdate_LlamaThread(batch.n_tokens, FPlatformTime::Seconds()-TokenStartTime);
-				}
-				TokenStartTime = FPlatformTime::Seconds();
+			// Positions continue from kv_cache_token_cursor; logits only for the final prompt token
+			const double PromptStartTime = FPlatformTime::Seconds();
+			if (!IngestPromptTokens_LlamaThread(FullPromptTokensForThisTurn.data() + prompt_eval_start_index_in_vector, n_tokens_to_eval_from_prompt, bIsFinalPromptTokenLogits, TEXT("turn prompt"))) {
+				eos_reached = true;
+				llama_perf_context_reset(ctx); // nothing sampled; don't leave this prompt's eval time to the next turn
+				return;
 			}
 			kv_cache_token_cursor = MirroredKvCacheTokens.size();
+			CurrentTurnStats.PromptTokens = n_tokens_to_eval_from_prompt;
+			CurrentTurnStats.PromptMs = (FPlatformTime::Seconds() - PromptStartTime) * 1000.0;
 		}
 		UE_LOG(LogTemp, Log, TEXT("LlamaThread: Prompt decoded. KV cursor now: %d."), kv_cache_token_cursor);
 #ifdef TRACK_PARALLEL_CONTEXT_TOKENS
@@ -696,65 +1077,95 @@ DebugContext("DecodeTokensAndSample: Prompt Decoded, starting generation");
         // Start Generation Loop
 //        LlamaLogContext("DecodeTokensAndSample start generation");
 		double TokenStartTime = FPlatformTime::Seconds();
+		double GenerateStartTime = TokenStartTime;
 		int32 kv_cache_token_cursor_at_gen_start = kv_cache_token_cursor;
-        while (kv_cache_token_cursor < n_ctx_from_model && !eos_reached) { // Check against actual context window
-            if (!bIsRunning) { eos_reached = true; break; } // Check if shutdown requested
-//if ((kv_cache_token_cursor%10) == 0) UE_LOG(LogTemp, Log, TEXT("*"))
-//            float* logits = llama_get_logits_ith(ctx, batch.n_tokens - 1); // Get logits from the last token processed
-            llama_token new_token_id = llama_sampler_sample(sampler_chain_instance, ctx, -1/*logits, nullptr candidates */); // Pass logits explicitly
-            llama_sampler_accept(sampler_chain_instance, new_token_id);
-
-            CurrentTurnAIReplyTokens.push_back(new_token_id);
+		// With a draft model each step decodes the new token plus up to SpeculativeDraftTokens proposed ones in one batch
+		bool bSpeculating = draft_ctx != nullptr && Config.SpeculativeDraftTokens > 0;
+		std::vector<llama_token> Draft;
+
+		// Adds a token to the reply and streams it; true if it ends the turn
+		auto EmitToken = [&](llama_token TokenId) -> bool {
+            CurrentTurnAIReplyTokens.push_back(TokenId);
+            if (CurrentTurnAIReplyTokens.size() == 1) {
+                GenerateStartTime = FPlatformTime::Seconds();
+                CurrentTurnStats.TimeToFirstTokenMs = (GenerateStartTime - TurnStartTime) * 1000.0;
+            }
 
-            if (new_token_id == llama_vocab_eos(llama_model_get_vocab(model)) || CheckStopSequences()) {
+            if (TokenId == llama_vocab_eos(vocab) || CheckStopSequences()) {
                 eos_reached = true;
-                // Check for tool call before finalizing EOS
-                std::string CurrentReplyStr;
-                for(llama_token tk : CurrentTurnAIReplyTokens) {
-                    const char* piece = llama_vocab_get_text(vocab, tk);
-                    if (piece) CurrentReplyStr += piece;
-                }
-//                // TODO: Proper Tool Call Parsing Here based on your chosen format (e.g. ```tool_call...``` or JSON)
-//                // For now, simple placeholder:
-//				if (CurrentReplyStr.find("<tool_call>") != std::string::npos) {
-//                    qLlamaToMain.enqueue([this, CurrentReplyStr]() {
-//                    	FString str = UTF8_TO_TCHAR(CleanString(CurrentReplyStr).c_str());
-//                    	if (toolCallCb) toolCallCb(str);
-//					});
-//                    // Don't send EOS yet, wait for tool response to continue generation
-//                    // Or, if tool call is the *end* of the turn, then set eos_reached.
-//                    // This depends on your AIXO's turn structure. Assuming tool call ends AI's immediate output:
-//                    UE_LOG(LogTemp, Log, TEXT("LlamaThread: Tool call detected. '%hs'"), CleanString(CurrentReplyStr).c_str());
-//                } else {
-//					UE_LOG(LogTemp, Log, TEXT("LlamaThread: EOS or Stop Sequence reached."));
-//                }
-                break; // Exit generation loop
+                return true; // Exit generation loop
             }
 
-            // Send token to main thread
-            std::string piece_str_raw = CleanString(llama_vocab_get_text(vocab, new_token_id));
-            {
-                // (Your UTF-8 char replacement logic for Ġ and Ċ)
-                FString token_fstring = UTF8_TO_TCHAR(piece_str_raw.c_str());
-                qLlamaToMain.enqueue([this, token_fstring]() mutable { if (tokenCb) tokenCb(MoveTemp(token_fstring)); });
+            // Send token to main thread (cleaned into a stack buffer, no allocation)
+            char piece_buf[256];
+            int32 piece_len = CleanTokenPiece(llama_vocab_get_text(vocab, TokenId), piece_buf, sizeof(piece_buf));
+            StreamEvent_LlamaThread(ELlamaStreamEvent::Token, piece_buf, piece_len);
+            return false;
+		};
+
+//            float* logits = llama_get_logits_ith(ctx, batch.n_tokens - 1); // Get logits from the last token processed
+        // llama_sampler_sample also accepts the token, which advances the grammar and the penalty window; don't accept it again
+        llama_token new_token_id = llama_sampler_sample(sampler_chain_instance, ctx, -1/*logits, nullptr candidates */); // Pass logits explicitly
+        while (kv_cache_token_cursor < n_ctx_from_model && !eos_reached) { // Check against actual context window
+            if (!bIsRunning) { eos_reached = true; break; } // Check if shutdown requested
+//if ((kv_cache_token_cursor%10) == 0) UE_LOG(LogTemp, Log, TEXT("*"))
+            if (EmitToken(new_token_id)) break;
+
+            // Propose the tokens after it, within what the context and the batch can take
+            Draft.clear();
+            if (bSpeculating) {
+                const double DraftStartTime = FPlatformTime::Seconds();
+                DraftTokens_LlamaThread(new_token_id, FMath::Min3(Config.SpeculativeDraftTokens, n_ctx_from_model - kv_cache_token_cursor - 1, batch_capacity - 1), Draft);
+                CurrentTurnStats.DraftMs += (FPlatformTime::Seconds() - DraftStartTime) * 1000.0;
             }
 
-            // Prepare for next token: decode the just generated token
+            // Prepare for next token: decode the just generated token, and the draft behind it, with logits at every position
+            const int32_t StepStart = kv_cache_token_cursor;
             common_batch_clear(batch);
             common_batch_add(batch, new_token_id, kv_cache_token_cursor, {0}, true); // Logits for this new token for next prediction
-MirroredKvCacheTokens.push_back(new_token_id);
+            for (int32 i = 0; i < (int32)Draft.size(); i++) {
+                common_batch_add(batch, Draft[i], kv_cache_token_cursor + 1 + i, {0}, true);
+            }
             if (llama_decode(ctx, batch) != 0) {
                 FString ErrorMsg = TEXT("LlamaThread: llama_decode failed during generation.");
                 UE_LOG(LogTemp, Error, TEXT("%s"), *ErrorMsg);
-                qLlamaToMain.enqueue([this, ErrorMsg]() { if (errorCb) errorCb(ErrorMsg); });
+                PostToMain_LlamaThread([this, ErrorMsg]() { if (errorCb) errorCb(ErrorMsg); });
                 eos_reached = true;
                 break;
             }
-            kv_cache_token_cursor++;
-			BroadcastContextVisualUpdate_LlamaThread(kv_cache_token_cursor - kv_cache_token_cursor_at_gen_start, 0.0f, FPlatformTime::Seconds() - TokenStartTime);
+MirroredKvCacheTokens.push_back(new_token_id);
+            MirroredKvCacheTokens.insert(MirroredKvCacheTokens.end(), Draft.begin(), Draft.end());
+            kv_cache_token_cursor += 1 + (int32_t)Draft.size();
+
+            // Sample after each position: drafted tokens are taken for as long as they are what the main model samples,
+            // and the first sample that differs (or the one after the whole draft) is the next new token
+            int32 Accepted = 0;
+            for (int32 i = 0; ; i++) {
+                new_token_id = llama_sampler_sample(sampler_chain_instance, ctx, i);     // accepts it too
+                if (i >= (int32)Draft.size() || new_token_id != Draft[i]) break;
+                Accepted++;
+                if (EmitToken(new_token_id)) break;
+            }
+            if (!Draft.empty()) {
+                InvalidateKVCacheFromPosition(StepStart + 1 + Accepted); // drop the rejected part of the draft
+                CurrentTurnStats.DraftedTokens += (int32)Draft.size();
+                CurrentTurnStats.AcceptedDraftTokens += Accepted;
+                if (CurrentTurnStats.DraftedTokens >= Config.SpeculativeFallbackWindow &&
+                    CurrentTurnStats.AcceptedDraftTokens < Config.SpeculativeMinAcceptance * CurrentTurnStats.DraftedTokens) {
+                    UE_LOG(LogTemp, Log, TEXT("LlamaThread: Draft acceptance %d/%d is below %.2f, speculative decoding off for the rest of this turn."),
+                        CurrentTurnStats.AcceptedDraftTokens, CurrentTurnStats.DraftedTokens, Config.SpeculativeMinAcceptance);
+                    bSpeculating = false;
+                    CurrentTurnStats.bSpeculationFellBack = true;
+                }
+            }
+			RequestContextVisualUpdate_LlamaThread(kv_cache_token_cursor - kv_cache_token_cursor_at_gen_start, 0.0f, FPlatformTime::Seconds() - TokenStartTime);
         } // End of generation loop
 		BroadcastContextVisualUpdate_LlamaThread(kv_cache_token_cursor - kv_cache_token_cursor_at_gen_start, 0.0f, FPlatformTime::Seconds() - TokenStartTime);
 		TokenStartTime = FPlatformTime::Seconds();
+		CurrentTurnStats.GeneratedTokens = CurrentTurnAIReplyTokens.size();
+		CurrentTurnStats.GenerateMs = (TokenStartTime - GenerateStartTime) * 1000.0;
+		CurrentTurnStats.AvgTimePerGeneratedTokenMs = CurrentTurnStats.GeneratedTokens ? CurrentTurnStats.GenerateMs / CurrentTurnStats.GeneratedTokens : 0.0f;
+		CurrentTurnStats.DraftAcceptanceRate = CurrentTurnStats.DraftedTokens ? (float)CurrentTurnStats.AcceptedDraftTokens / CurrentTurnStats.DraftedTokens : 0.0f;
 
 #ifdef TRACK_PARALLEL_CONTEXT_TOKENS
 DebugContext("DecodeTokensAndSample: Ending generation");
@@ -762,8 +1173,8 @@ DebugContext("DecodeTokensAndSample: Ending generation");
 
 //        LlamaLogContext("DecodeTokensAndSample end generation");
 
-// performance data
-if (eos_reached) {
+// performance data, taken and reset at the end of every turn however it ended (EOS, stop, context full, shutdown)
+{
     struct llama_perf_context_data PerfCtxData = llama_perf_context(ctx);
     struct llama_perf_sampler_data PerfSamplerData = llama_perf_sampler(sampler_chain_instance);
 
@@ -771,6 +1182,8 @@ if (eos_reached) {
         (float)PerfCtxData.t_p_eval_ms, PerfCtxData.n_p_eval,
         (float)PerfCtxData.t_eval_ms, PerfCtxData.n_eval,
         (float)PerfSamplerData.t_sample_ms, PerfSamplerData.n_sample);
+    CurrentTurnStats.SamplingTimeMs = PerfSamplerData.t_sample_ms;
+    CurrentTurnStats.SamplesTaken = PerfSamplerData.n_sample;
     
     llama_perf_context_reset(ctx);
     llama_perf_sampler_reset(sampler_chain_instance);
@@ -817,9 +1230,7 @@ if (eos_reached) {
 				ProcessedAIOutputStr.RemoveAt(ToolCallStartTagPos, ToolCallEndTagPos + FString(TEXT("</tool_call>")).Len() - ToolCallStartTagPos);
 
                 bToolCallMadeThisTurn = true;
-                qLlamaToMain.enqueue([this, ToolCallPayloadForMainThread]() {
-                	if (toolCallCb) toolCallCb(ToolCallPayloadForMainThread);
-				});
+                StreamText_LlamaThread(ELlamaStreamEvent::ToolCall, ToolCallPayloadForMainThread);
 
                 UE_LOG(LogTemp, Log, TEXT("LlamaThread: Tool call detected: '%s'"), *ToolCallFullTagForHistory);
             }
@@ -877,33 +1288,11 @@ if (eos_reached) {
 					s = CleanString(s);
 					UE_LOG(LogTemp, Log, TEXT("LlamaThread: DecodeTokensAndSample KV cursor: %d. send to assistant history '%hs'."), kv_cache_token_cursor, s.c_str());
 				}
-				int32_t StablePrefixLength = 0;
-				for (uint8 i = 0; i < (uint8)ELlamaContextBlockType::COUNT; ++i) {
-					if (const FTokenizedContextBlock* Block = FixedContextBlocks.Find((ELlamaContextBlockType)i)) {
-						StablePrefixLength += Block->Tokens.size();
-					}
-				}
-				StablePrefixLength += ConversationHistoryTokens.size(); // ConversationHistoryTokens now includes the latest input with its role tags
-//LlamaLogContext("DecodeTokensAndSample 3");
-
-				if (kv_cache_token_cursor > StablePrefixLength) {
-					UE_LOG(LogTemp, Warning, TEXT("LlamaThread: KV cursor (%d) was beyond current fixed+convo length (%d). Adjusting."),
-						kv_cache_token_cursor, StablePrefixLength);
-					InvalidateKVCacheFromPosition(StablePrefixLength); // This sets kv_cache_token_cursor = StablePrefixLength
-				}
                 AppendTurnToStructuredHistory(TEXT("assistant"), AssistantMessageTokensForStorageInHistory);
-std::string assistant_prefix_str = "<|im_start|>assistant\n";
-std::vector<llama_token> assistant_prefix_tokens = my_llama_tokenize(model, assistant_prefix_str, false, true);
-MirroredKvCacheTokens.insert(MirroredKvCacheTokens.end(), assistant_prefix_tokens.begin(), assistant_prefix_tokens.end());
-kv_cache_token_cursor += assistant_prefix_tokens.size();
-                MirroredKvCacheTokens.insert(MirroredKvCacheTokens.end(), AssistantMessageTokensForStorageInHistory.begin(), AssistantMessageTokensForStorageInHistory.end());
-                kv_cache_token_cursor += AssistantMessageTokensForStorageInHistory.size();
 //LlamaLogContext("DecodeTokensAndSample 3.1");
-                // Note: AppendTurnToStructuredHistory should internally rebuild the flat ConversationHistoryTokens
-                // and PruneConversationHistory (if called from there) should handle KV cache invalidation
-                // if the total length changes significantly or pruning occurs.
-                // The kv_cache_token_cursor *already* reflects the end of the AI's generated tokens.
-                // The main thing is that ConversationHistoryTokens is now longer for the *next* turn.
+                // Note: AppendTurnToStructuredHistory appends the new turn to the flat ConversationHistoryTokens.
+                // The KV cache is left holding what was actually decoded (prompt, HFS, raw reply); the next turn's
+                // prompt diff keeps the shared prefix and re-decodes from the first divergent token.
             } else if (bToolCallMadeThisTurn && ToolCallFullTagForHistory.IsEmpty()) {
                  UE_LOG(LogTemp, Warning, TEXT("LlamaThread: Tool call detected but content for history was empty."));
             } else if (!CaptainDialogueForMainThread.IsEmpty() && AssistantMessageTokensForStorageInHistory.empty()){
@@ -920,23 +1309,10 @@ kv_cache_token_cursor += assistant_prefix_tokens.size();
 
     void LLInternal::AppendTurnToStructuredHistory(const FString& Role, const std::vector<llama_token>& Tokens) {
         StructuredConversationHistory.push_back({Role, Tokens});
-        // Rebuild the flat ConversationHistoryTokens from StructuredConversationHistory
-        ConversationHistoryTokens.clear();
-        for (const auto& turn : StructuredConversationHistory) {
-            // Here you would inject role tokens like "<|im_start|>user\n" before turn.Tokens
-            // and "<|im_end|>\n" after, according to your model's chat template.
-            // This is CRITICAL for the LLM to understand the conversation flow.
-            // Example for Qwen (simplified):
-            std::string role_prefix = "<|im_start|>" + std::string(TCHAR_TO_UTF8(*turn.Role)) + "\n";
-            std::string role_suffix = "<|im_end|>\n";		// ??? had to remove <|im_end|> or it would wind up twice in convo
-
-            std::vector<llama_token> role_prefix_t = my_llama_tokenize(model, role_prefix, false, true);
-            std::vector<llama_token> role_suffix_t = my_llama_tokenize(model, role_suffix, false, true);
-
-			ConversationHistoryTokens.insert(ConversationHistoryTokens.end(), role_prefix_t.begin(), role_prefix_t.end());
-			ConversationHistoryTokens.insert(ConversationHistoryTokens.end(), turn.Tokens.begin(), turn.Tokens.end());
-			ConversationHistoryTokens.insert(ConversationHistoryTokens.end(), role_suffix_t.begin(), role_suffix_t.end());
-        }
+        // The flat ConversationHistoryTokens mirrors StructuredConversationHistory with role tokens
+        // ("<|im_start|>user\n" before turn.Tokens, "<|im_end|>\n" after) per the model's chat template;
+        // only the new turn needs appending.
+        AppendTurnToFlatHistory(StructuredConversationHistory.back());
     }
 
     void LLInternal::PruneConversationHistory() {
@@ -962,42 +1338,67 @@ kv_cache_token_cursor += assistant_prefix_tokens.size();
             while (CurrentTotalConvoTokens > TargetMaxConvoTokens && !StructuredConversationHistory.empty()) {
                 const FConversationTurn& oldest_turn = StructuredConversationHistory.front();
                 // Calculate tokens for this turn including role markers
-                std::string role_prefix = "<|im_start|>" + std::string(TCHAR_TO_UTF8(*oldest_turn.Role)) + "\n";
-                std::string role_suffix = "<|im_end|>\n";
-                std::vector<llama_token> r_p_t = my_llama_tokenize(model, role_prefix, false, true);
-                std::vector<llama_token> r_s_t = my_llama_tokenize(model, role_suffix, false, true);
-                
-                int32 TurnTokenLength = r_p_t.size() + oldest_turn.Tokens.size() + r_s_t.size();
+                int32 TurnTokenLength = RolePrefixTokens(oldest_turn.Role).size() + oldest_turn.Tokens.size() + ChatTemplate.TurnSuffix.size();
                 TokensToTrimCount += TurnTokenLength;
                 CurrentTotalConvoTokens -= TurnTokenLength;
                 StructuredConversationHistory.pop_front();
             }
 
-            // Rebuild ConversationHistoryTokens from the pruned StructuredConversationHistory
-            ConversationHistoryTokens.clear(); // Clear it first
-            for (const auto& turn : StructuredConversationHistory) {
-				std::string role_prefix = "<|im_start|>" + std::string(TCHAR_TO_UTF8(*turn.Role)) + "\n";
-				std::string role_suffix = "<|im_end|>\n";
-				std::vector<llama_token> r_p_t = my_llama_tokenize(model, role_prefix, false, true);
-				std::vector<llama_token> r_s_t = my_llama_tokenize(model, role_suffix, false, true);
-
-				ConversationHistoryTokens.insert(ConversationHistoryTokens.end(), r_p_t.begin(), r_p_t.end());
-				ConversationHistoryTokens.insert(ConversationHistoryTokens.end(), turn.Tokens.begin(), turn.Tokens.end());
-				ConversationHistoryTokens.insert(ConversationHistoryTokens.end(), r_s_t.begin(), r_s_t.end());
-            }
+            // The evicted turns are exactly the leading TokensToTrimCount flat tokens: move them out (kept so the
+            // KV edit can check the cache really holds them) rather than rebuilding the survivors
+            const size_t EvictedCount = FMath::Min<size_t>(TokensToTrimCount, ConversationHistoryTokens.size());
+            std::vector<llama_token> EvictedHistoryTokens(ConversationHistoryTokens.begin(), ConversationHistoryTokens.begin() + EvictedCount);
+            ConversationHistoryTokens.erase(ConversationHistoryTokens.begin(), ConversationHistoryTokens.begin() + EvictedCount);
             
-            // Invalidate KV cache from the start of the conversation history block
-            InvalidateKVCacheFromPosition(CurrentFixedTokens);
-            UE_LOG(LogTemp, Log, TEXT("LlamaThread: Conversation pruned. New convo token count: %d. KV invalidated from: %d"), ConversationHistoryTokens.size(), CurrentFixedTokens);
+            // Either cut just the evicted turns out of the KV cache and slide the survivors down,
+            // or invalidate KV cache from the start of the conversation history block
+            const int32 HistoryStart = PrefixBlocksTokenCount(); // tail blocks sit after the history and shift with it
+            if (Config.bIncrementalHistoryPrune && RemoveKVCacheRangeAndShift(HistoryStart, TokensToTrimCount, EvictedHistoryTokens)) {
+                UE_LOG(LogTemp, Log, TEXT("LlamaThread: Conversation pruned. New convo token count: %d. KV shifted down by %d from: %d"), ConversationHistoryTokens.size(), TokensToTrimCount, HistoryStart);
+            } else {
+                // whatever of the surviving history was cached has to be decoded again
+                CurrentTurnStats.RedecodeTokens += FMath::Max(0, kv_cache_token_cursor - HistoryStart - TokensToTrimCount);
+                InvalidateKVCacheFromPosition(HistoryStart);
+                UE_LOG(LogTemp, Log, TEXT("LlamaThread: Conversation pruned. New convo token count: %d. KV invalidated from: %d"), ConversationHistoryTokens.size(), HistoryStart);
+            }
         }
     }
 
+	// Removes [RangeStart, RangeStart + RangeLength) from sequence 0 and moves every later cell down by RangeLength,
+	// so tokens after the range keep their cached state instead of being re-decoded (the usual context-shift
+	// approximation: survivors keep attention computed against the evicted turns). Returns false, leaving the cache
+	// untouched, if the context can't shift or the mirrored tokens show the range isn't what's actually cached.
+	bool LLInternal::RemoveKVCacheRangeAndShift(int32_t RangeStart, int32_t RangeLength, const std::vector<llama_token>& ExpectedRangeTokens) {
+		if (!ctx || RangeLength <= 0) return false;
+		const int32_t RangeEnd = RangeStart + RangeLength;
+		if (kv_cache_token_cursor < RangeEnd || MirroredKvCacheTokens.size() < (size_t)RangeEnd) {
+			UE_LOG(LogTemp, Log, TEXT("LlamaThread: KV shift skipped, evicted range [%d, %d) not fully cached (cursor %d)."), RangeStart, RangeEnd, kv_cache_token_cursor);
+			return false;
+		}
+		if (!llama_kv_self_can_shift(ctx)) {
+			UE_LOG(LogTemp, Warning, TEXT("LlamaThread: KV shift skipped, context does not support shifting."));
+			return false;
+		}
+		if (ExpectedRangeTokens.size() != (size_t)RangeLength || !std::equal(ExpectedRangeTokens.begin(), ExpectedRangeTokens.end(), MirroredKvCacheTokens.begin() + RangeStart)) {
+			UE_LOG(LogTemp, Warning, TEXT("LlamaThread: KV shift skipped, mirrored tokens in [%d, %d) do not match the evicted turns."), RangeStart, RangeEnd);
+			return false;
+		}
+
+		double StartTime = FPlatformTime::Seconds();
+		llama_kv_self_seq_rm(ctx, 0, RangeStart, RangeEnd);
+		llama_kv_self_seq_add(ctx, 0, RangeEnd, kv_cache_token_cursor, -RangeLength);
+		MirroredKvCacheTokens.erase(MirroredKvCacheTokens.begin() + RangeStart, MirroredKvCacheTokens.begin() + RangeEnd);
+		kv_cache_token_cursor -= RangeLength;
+		UE_LOG(LogTemp, Log, TEXT("LlamaThread: KV Cache: Removed [%d, %d) and shifted %d tokens down in %.2f ms. Cursor now %d."),
+			RangeStart, RangeEnd, kv_cache_token_cursor - RangeStart, (FPlatformTime::Seconds() - StartTime) * 1000.0, kv_cache_token_cursor);
+		return true;
+	}
+
+	// Full rebuild, for when the flat list may have drifted from the structured one; normal turns append incrementally
 	void LLInternal::RebuildFlatConversationHistoryTokensFromStructured() {
 		ConversationHistoryTokens.clear();
 		for (const FConversationTurn& turn : StructuredConversationHistory) {
-			std::string role_prefix_str = "<|im_start|>" + std::string(TCHAR_TO_UTF8(*turn.Role)) + "\n";
-			std::string role_suffix_str = "<|im_end|>\n";
-			// ... tokenize prefix, turn.Tokens, suffix and append to ConversationHistoryTokens ...
+			AppendTurnToFlatHistory(turn);
 		}
 	}
 	void LLInternal::StopSeqHelper(const FString& stopSeqFStr)
@@ -1089,6 +1490,76 @@ kv_cache_token_cursor += assistant_prefix_tokens.size();
 		return p_str;
 	}
 
+	// Same replacements as CleanString, for a single token piece written into a caller buffer (always shrinks or keeps length)
+	int32 LLInternal::CleanTokenPiece(const char* Piece, char* Out, int32 OutCapacity) {
+		int32 n = 0;
+		if (!Piece) return 0;
+		for (const char* p = Piece; *p && n < OutCapacity; ) {
+			if ((unsigned char)p[0] == 0xC4 && ((unsigned char)p[1] == 0xA0 || (unsigned char)p[1] == 0x83)) { Out[n++] = ' '; p += 2; }
+			else if ((unsigned char)p[0] == 0xC4 && ((unsigned char)p[1] == 0x8A || (unsigned char)p[1] == 0x80)) { Out[n++] = '\n'; p += 2; }
+			else Out[n++] = *p++;
+		}
+		return n;
+	}
+
+	// Pushes one record into TokenStream, blocking until the game thread drains if the rings are full
+	void LLInternal::StreamEvent_LlamaThread(ELlamaStreamEvent Type, const char* Data, uint32 Length) {
+		if (TokenStream.Push(Type, Data, Length)) return;
+		UE_LOG(LogTemp, Warning, TEXT("LlamaThread: Token stream full (%d records pending), waiting for game thread."), TokenStream.NumPending());
+		std::unique_lock<std::mutex> Lock(TokenStreamSpaceMutex);
+		TokenStreamSpaceCv.wait(Lock, [&]() { return !bIsRunning || TokenStream.Push(Type, Data, Length); });
+	}
+
+	// Everything the Llama thread sends through qLlamaToMain goes through here: the item first drains the stream up to
+	// what had been pushed when it was posted, so its callback never runs ahead of the tokens, tool calls and end of
+	// turn that came before it (the per-tick drain budget only applies to records no item is waiting behind).
+	void LLInternal::PostToMain_LlamaThread(std::function<void()> Fn) {
+		const uint32 StreamPosition = TokenStream.NumPushed();
+		qLlamaToMain.enqueue([this, StreamPosition, Fn = std::move(Fn)]() {
+			const int32 Behind = (int32)(StreamPosition - TokenStream.NumDrained());
+			if (Behind > 0) DrainTokenStream_MainThread(Behind);
+			Fn();
+		});
+	}
+
+	void LLInternal::StreamText_LlamaThread(ELlamaStreamEvent Type, const FString& Text) {
+		FTCHARToUTF8 Utf8(*Text);
+		StreamEvent_LlamaThread(Type, Utf8.Get(), Utf8.Length());
+	}
+
+	// Game thread: dispatches up to MaxRecords stream records (<= 0 = all) to the callbacks
+	int32 LLInternal::DrainTokenStream_MainThread(int32 MaxRecords) {
+		const int32 Drained = TokenStream.Drain(MaxRecords, [this](ELlamaStreamEvent Type, const char* Data, uint32 Length) {
+			switch (Type) {
+				case ELlamaStreamEvent::Token:
+					if (tokenCb) tokenCb(FString(FUTF8ToTCHAR(Data, Length)));
+					break;
+				case ELlamaStreamEvent::ToolCall:
+					if (toolCallCb) toolCallCb(FString(FUTF8ToTCHAR(Data, Length)));
+					break;
+				case ELlamaStreamEvent::ContextChanged: {
+					FContextVisPayload Delta;
+					{
+						FScopeLock Lock(&PendingContextPayloadLock);
+						Delta = MoveTemp(PendingContextPayload);
+						bContextPayloadPending = false;
+					}
+					ApplyContextVisDelta(MergedContextPayload, MoveTemp(Delta));
+					if (contextChangedCb) contextChangedCb(MergedContextPayload);
+					break;
+				}
+				case ELlamaStreamEvent::EndOfTurn:
+					if (endOfTurnCb) endOfTurnCb();
+					break;
+			}
+		});
+		if (Drained > 0) {
+			std::lock_guard<std::mutex> Lock(TokenStreamSpaceMutex); // orders the wake after a producer's failed Push under the lock
+			TokenStreamSpaceCv.notify_one();
+		}
+		return Drained;
+	}
+
 	// Helper function to de-tokenize a std::vector<llama_token> and append to a string
 	void LLInternal::DetokenizeAndAppend(std::string& TargetString, const std::vector<llama_token>& TokensToDetokenize, const llama_model* ModelHandle) {
 		if (!ModelHandle) return;
@@ -1182,13 +1653,23 @@ kv_cache_token_cursor += assistant_prefix_tokens.size();
 		// Your existing FString post-processing for special characters can go here if needed,
 		// though the DetokenizeAndAppend helper now handles some of it.
 
-		qLlamaToMain.enqueue([this, context_dump_fstr]() mutable {
+		PostToMain_LlamaThread([this, context_dump_fstr]() mutable {
 			if (fullContextDumpCb) {
 				fullContextDumpCb(MoveTemp(context_dump_fstr));
 			}
 		});
 	}
 
+	// For the per-token and per-chunk call sites: drops the update if one went out less than 1/ContextVisUpdateHz ago.
+	// Callers pass cumulative figures, and follow up with an unthrottled broadcast when the burst ends.
+	void LLInternal::RequestContextVisualUpdate_LlamaThread(int32 nTokens, float sDecode, float sGenerate)
+	{
+		if (Config.ContextVisUpdateHz > 0.0f && FPlatformTime::Seconds() - LastContextVisBroadcastTime < 1.0 / Config.ContextVisUpdateHz) {
+			return;
+		}
+		BroadcastContextVisualUpdate_LlamaThread(nTokens, sDecode, sGenerate);
+	}
+
 	void LLInternal::BroadcastContextVisualUpdate_LlamaThread(int32 nTokens, float sDecode, float sGenerate)
 	{
 		if (!model || !ctx) {
@@ -1214,9 +1695,28 @@ kv_cache_token_cursor += assistant_prefix_tokens.size();
 		int32 AccumulatedTokensForVisualizedPromptStructure = 0;
 		float CurrentNormalizedPosition = 0.0f; // Tracks the bottom of the next block to draw
 
+		// After the first full snapshot only blocks whose extents differ from what was last sent are included
+		// (with their indices); colors and tooltips are only built for those.
+		const bool bFullSnapshot = !bContextVisFullSnapshotSent;
+		Payload.bIsFullSnapshot = bFullSnapshot;
+		int32 NumBlocks = 0;
+		auto IsUnchangedBlock = [&](int32 BlockIndex, EContextVisBlockType Type, int32 LengthInTokens, float NormalizedStart, float NormalizedHeight) {
+			if (bFullSnapshot || !LastSentContextBlocks.IsValidIndex(BlockIndex)) return false;
+			const FContextVisBlock& Sent = LastSentContextBlocks[BlockIndex];
+			return Sent.BlockType == Type && Sent.NormalizedStartInTokens == AccumulatedTokensForVisualizedPromptStructure &&
+				Sent.LengthInTokens == LengthInTokens && Sent.NormalizedStart == NormalizedStart && Sent.NormalizedHeight == NormalizedHeight;
+		};
+		auto EmitBlock = [&](FContextVisBlock&& Block) {
+			const int32 BlockIndex = NumBlocks - 1;
+			if (LastSentContextBlocks.Num() <= BlockIndex) LastSentContextBlocks.SetNum(BlockIndex + 1);
+			LastSentContextBlocks[BlockIndex] = Block;
+			Payload.Blocks.Add(MoveTemp(Block));
+			Payload.ChangedBlockIndices.Add(BlockIndex);
+		};
+
 		// Helper lambda to add blocks to the payload
 		auto AddBlockToPayload = 
-			[&](EContextVisBlockType Type, const std::vector<llama_token>& Tokens, const FString& TooltipPrefix = TEXT(""))
+			[&](EContextVisBlockType Type, const std::vector<llama_token>& Tokens, const TCHAR* TooltipPrefix = TEXT(""), int32 TurnIndex = INDEX_NONE)
 		{
 			if (Tokens.empty() || Payload.TotalTokenCapacity == 0) return;
 
@@ -1225,6 +1725,13 @@ kv_cache_token_cursor += assistant_prefix_tokens.size();
 			if (NormalizedHeight < 0.0005f && NormalizedHeight > 0.0f) NormalizedHeight = 0.0005f; 
 			if (NormalizedHeight <= 0.0f) return; // Don't draw zero-height blocks
 
+			const int32 BlockIndex = NumBlocks++;
+			if (IsUnchangedBlock(BlockIndex, Type, Tokens.size(), CurrentNormalizedPosition, NormalizedHeight)) {
+				CurrentNormalizedPosition += NormalizedHeight;
+				AccumulatedTokensForVisualizedPromptStructure += Tokens.size();
+				return;
+			}
+
 			FLinearColor Color = FLinearColor::Black;
 			FString TypeName = UEnum::GetValueAsString(Type);
 			if (TypeName.IsEmpty()) TypeName = TEXT("UnknownBlockType");
@@ -1240,8 +1747,12 @@ kv_cache_token_cursor += assistant_prefix_tokens.size();
 			// Add color for FocusInstruction if you make it a distinct EContextVisBlockType
 			// else if (Type == EContextVisBlockType::FocusInstruction) Color = FLinearColor::FromSRGBColor(FColor(0xFF,0xFF,0x00)); // Yellow (example)
 
-			FText Tooltip = FText::FromString(FString::Printf(TEXT("%s%s (%d tokens)"), *TooltipPrefix, *TypeName, Tokens.size()));
-			Payload.Blocks.Add(FContextVisBlock(Type, AccumulatedTokensForVisualizedPromptStructure, CurrentNormalizedPosition, NormalizedHeight, Color, Tooltip));
+			FText Tooltip = (TurnIndex == INDEX_NONE)
+				? FText::FromString(FString::Printf(TEXT("%s%s (%d tokens)"), TooltipPrefix, *TypeName, Tokens.size()))
+				: FText::FromString(FString::Printf(TEXT("Turn %d (%s): %s (%d tokens)"), TurnIndex, TooltipPrefix, *TypeName, Tokens.size()));
+			FContextVisBlock Block(Type, AccumulatedTokensForVisualizedPromptStructure, CurrentNormalizedPosition, NormalizedHeight, Color, Tooltip);
+			Block.LengthInTokens = Tokens.size();
+			EmitBlock(MoveTemp(Block));
 			
 			CurrentNormalizedPosition += NormalizedHeight;
 			AccumulatedTokensForVisualizedPromptStructure += Tokens.size();
@@ -1249,9 +1760,11 @@ kv_cache_token_cursor += assistant_prefix_tokens.size();
 
 		// --- Populate Payload.Blocks based on the current logical prompt structure ---
 
-		// 1. Fixed Blocks
+		// 1. Fixed Blocks (those placed after the history are drawn after it, as laid out in the KV cache)
+		auto AddFixedBlocksToPayload = [&](bool bTailBlocks) {
 		for (uint8 i = 0; i < (uint8)ELlamaContextBlockType::COUNT; ++i) {
 			ELlamaContextBlockType InternalBlockType = (ELlamaContextBlockType)i;
+			if (IsTailBlock(InternalBlockType) != bTailBlocks) continue;
 			if (const FTokenizedContextBlock* Block = FixedContextBlocks.Find(InternalBlockType)) {
 				EContextVisBlockType VisBlockType = EContextVisBlockType::Unknown; // Default
 				switch (InternalBlockType) {
@@ -1269,6 +1782,8 @@ kv_cache_token_cursor += assistant_prefix_tokens.size();
 				}
 			}
 		}
+		};
+		AddFixedBlocksToPayload(false);
 
 		// 2. Conversation History (visualize each turn from StructuredConversationHistory)
 		//    This shows the logical turns. The flat ConversationHistoryTokens (which includes template markers)
@@ -1277,7 +1792,7 @@ kv_cache_token_cursor += assistant_prefix_tokens.size();
 		int TurnCounter = 0;
 		for (const FConversationTurn& Turn : StructuredConversationHistory) {
 			EContextVisBlockType VisTurnType = EContextVisBlockType::Unknown;
-			FString RoleDisplayName = Turn.Role; // Default to actual role
+			const TCHAR* RoleDisplayName = *Turn.Role; // Default to actual role
 
 			if (Turn.Role.Equals(TEXT("user"), ESearchCase::IgnoreCase)) VisTurnType = EContextVisBlockType::ConversationTurnUser;
 			else if (Turn.Role.Equals(TEXT("assistant"), ESearchCase::IgnoreCase)) VisTurnType = EContextVisBlockType::ConversationTurnAssistant;
@@ -1293,9 +1808,10 @@ kv_cache_token_cursor += assistant_prefix_tokens.size();
 			// The chat template tokens (<|im_start|>, etc.) are part of MirroredKvCacheTokens
 			// but we might not draw them as separate tiny blocks in the visualizer for clarity.
 			// The AddBlockToPayload will use Turn.Tokens.size().
-			AddBlockToPayload(VisTurnType, Turn.Tokens, FString::Printf(TEXT("Turn %d (%s): "), TurnCounter, *RoleDisplayName));
+			AddBlockToPayload(VisTurnType, Turn.Tokens, RoleDisplayName, TurnCounter);
 			TurnCounter++;
 		}
+		AddFixedBlocksToPayload(true);
 
 		// 3. Current High Frequency State (visualize its content tokens)
 		//    This represents the HFS that *would be* added to the next prompt.
@@ -1314,21 +1830,37 @@ kv_cache_token_cursor += assistant_prefix_tokens.size();
 		// 5. Free Space (remainder of the bar)
 		if (CurrentNormalizedPosition < 1.0f && CurrentNormalizedPosition >= 0.0f) {
 			float FreeHeight = 1.0f - CurrentNormalizedPosition;
-			if (FreeHeight > 0.00001f) { // Only add if there's actual space
-				 Payload.Blocks.Add(FContextVisBlock(
+			const int32 FreeTokens = FMath::Max(0, Payload.TotalTokenCapacity - AccumulatedTokensForVisualizedPromptStructure);
+			if (FreeHeight > 0.00001f && !IsUnchangedBlock(NumBlocks++, EContextVisBlockType::FreeSpace, FreeTokens, CurrentNormalizedPosition, FreeHeight)) { // Only add if there's actual space
+				FContextVisBlock FreeBlock(
 					EContextVisBlockType::FreeSpace, 
 					AccumulatedTokensForVisualizedPromptStructure,
 					CurrentNormalizedPosition, 
 					FreeHeight, 
 					FLinearColor(0.1f, 0.1f, 0.1f, 0.5f), // Dark semi-transparent gray
 					FText::FromString(FString::Printf(TEXT("Free Space (%.2f%%)"), FreeHeight * 100.0f))
-				));
+				);
+				FreeBlock.LengthInTokens = FreeTokens;
+				EmitBlock(MoveTemp(FreeBlock));
 			}
 		}
+		Payload.TotalBlockCount = NumBlocks;
+		LastSentContextBlocks.SetNum(NumBlocks);
+		bContextVisFullSnapshotSent = true;
+		LastContextVisBroadcastTime = FPlatformTime::Seconds();
 
-		// Marshal to main thread
-		FContextVisPayload PayloadCopy = Payload;
-		qLlamaToMain.enqueue([this, PayloadCopy]() { if (contextChangedCb) contextChangedCb(PayloadCopy); });
+		// Marshal to main thread: a delta not yet consumed absorbs this one, and only one event is in flight
+		{
+			FScopeLock Lock(&PendingContextPayloadLock);
+			if (bContextPayloadPending && !Payload.bIsFullSnapshot) {
+				MergeContextVisDelta(PendingContextPayload, MoveTemp(Payload));
+			} else {
+				PendingContextPayload = MoveTemp(Payload);
+			}
+		}
+		if (!bContextPayloadPending.exchange(true)) {
+			StreamEvent_LlamaThread(ELlamaStreamEvent::ContextChanged);
+		}
 
 //  UE_LOG(LogTemp, Warning, TEXT("LlamaThread: Broadcasting Context Update. TotalTokenCapacity: %d, KvCacheDecodedTokenCount: %d, NumVisualBlocks: %d, decodems: %g, genms: %g"), Payload.TotalTokenCapacity, Payload.KvCacheDecodedTokenCount, Payload.Blocks.Num(), Payload.fFmsPerTokenDecode, Payload.fFmsPerTokenGenerate);
 }
@@ -1344,23 +1876,36 @@ kv_cache_token_cursor += assistant_prefix_tokens.size();
 		if (!ctx || !model) {
 			UE_LOG(LogTemp, Error, TEXT("LlamaThread: ProcessInput called but Llama not ready."));
 			FString ErrorMsg = TEXT("Llama model or context not initialized.");
-			qLlamaToMain.enqueue([this, ErrorMsg]() { if (errorCb) errorCb(ErrorMsg); });
-			FString fs = "AIXO is currently thinking.\nPlease try again shortly.\n\n";
-			qLlamaToMain.enqueue([this, fs]() mutable { if (tokenCb) tokenCb(MoveTemp(fs)); });
+			PostToMain_LlamaThread([this, ErrorMsg]() { if (errorCb) errorCb(ErrorMsg); });
+			StreamText_LlamaThread(ELlamaStreamEvent::Token, TEXT("AIXO is currently thinking.\nPlease try again shortly.\n\n"));
 			return;
 		}
 
 		if (bIsGenerating.load(std::memory_order_acquire)) {
 			UE_LOG(LogTemp, Warning, TEXT("LlamaThread: ProcessInput called while already generating. Input '%s' ignored."), *InputTextFStr);
 			// Optionally, queue this input or inform the user. For now, ignoring.
-			FString fs = "AIXO is currently generating.\nPlease try again shortly.\n\n";
-			qLlamaToMain.enqueue([this, fs]() mutable { if (tokenCb) tokenCb(MoveTemp(fs)); });
+			StreamText_LlamaThread(ELlamaStreamEvent::Token, TEXT("AIXO is currently generating.\nPlease try again shortly.\n\n"));
 			return;
 		}
 		bIsGenerating = true; // Acquire "generation lock" for this entire operation
-		qLlamaToMain.enqueue([this]() { if (setIsGeneratingCb) setIsGeneratingCb(true); });
+		PostToMain_LlamaThread([this]() { if (setIsGeneratingCb) setIsGeneratingCb(true); });
 		// This flag will be reset at the very end of this function, or in DecodeTokensAndSample if it errors early.
 
+		TurnStartTime = FPlatformTime::Seconds();
+		CurrentTurnStats = FLlamaPerformanceMetrics();
+		CurrentTurnStats.InputType = InputTypeHintFStr;
+		CurrentTurnStats.InputQueueWaitMs = qMainToLlama.getLastWaitMs();
+		const Q::WaitWindow InputQueueWindow = qMainToLlama.takeWaitWindow();
+		CurrentTurnStats.MainToLlamaQueueWaitAvgMs = InputQueueWindow.avgMs;
+		CurrentTurnStats.MainToLlamaQueueWaitMaxMs = InputQueueWindow.maxMs;
+		// Block updates submitted since the last turn boundary ride along with this prompt; its diff decodes them once
+		TakePendingContextBlocks_LlamaThread();
+		CurrentTurnStats.BlockUpdates = PendingBlockUpdates;
+		CurrentTurnStats.BlockUpdateMs = PendingBlockUpdateMs;
+		CurrentTurnStats.RedecodeTokens = PendingRedecodeTokens;
+		PendingBlockUpdates = PendingRedecodeTokens = 0;
+		PendingBlockUpdateMs = 0.0;
+
 		UE_LOG(LogTemp, Log, TEXT("LlamaThread: BEGIN ProcessInput: '%s', HFS: '%s', Hint: '%s'"), *InputTextFStr, *HighFrequencyContextTextFStr, *InputTypeHintFStr);
 
 		// --- 1. Tokenize new High-Frequency State and New User/Tool Input ---
@@ -1368,14 +1913,7 @@ kv_cache_token_cursor += assistant_prefix_tokens.size();
 		std::vector<llama_token> NewHFS_Tokens = my_llama_tokenize(model, hfs_std, false, false);
 		CurrentHighFrequencyStateTokens = NewHFS_Tokens; // Store for AssembleFullPromptForTurn
 
-		qLlamaToMain.enqueue([this, InputTextFStr]() mutable { 
-//			if (tokenCb) tokenCb("\n"+MoveTemp(InputTextFStr));
-			if (tokenCb) {
-				tokenCb(TEXT("\n"));
-				tokenCb(InputTextFStr);
-				tokenCb(TEXT("\n"));
-			}
-		});
+		StreamText_LlamaThread(ELlamaStreamEvent::Token, TEXT("\n") + InputTextFStr + TEXT("\n"));
 
 		std::string input_content_std = TCHAR_TO_UTF8(*InputTextFStr); // This is the *content* of the input
 //        input_content_std += "<|im_end|>\n";		// ??? this token was just missing
@@ -1392,30 +1930,13 @@ kv_cache_token_cursor += assistant_prefix_tokens.size();
 		// If pruning occurs, PruneConversationHistory internally calls InvalidateKVCacheFromPosition(LengthOfFixedBlocks),
 		// which correctly resets kv_cache_token_cursor to LengthOfFixedBlocks.
 		// If no pruning occurs, kv_cache_token_cursor remains at its value from the end of the last AI generation.
+		const double PruneStartTime = FPlatformTime::Seconds();
 		PruneConversationHistory();
+		CurrentTurnStats.PruneMs = (FPlatformTime::Seconds() - PruneStartTime) * 1000.0;
 
-		// --- 4. Adjust kv_cache_token_cursor if it's "ahead" of the current fixed+conversation history ---
-		// This handles the case where the previous turn's HFS might have made the old kv_cache_token_cursor
-		// longer than the current sum of fixed blocks + full conversation history.
-		int32_t StablePrefixLength = 0;
-		for (uint8 i = 0; i < (uint8)ELlamaContextBlockType::COUNT; ++i) {
-			if (const FTokenizedContextBlock* Block = FixedContextBlocks.Find((ELlamaContextBlockType)i)) {
-				StablePrefixLength += Block->Tokens.size();
-			}
-		}
-		StablePrefixLength += ConversationHistoryTokens.size(); // ConversationHistoryTokens now includes the latest input with its role tags
-
-		if (kv_cache_token_cursor > StablePrefixLength) {
-			UE_LOG(LogTemp, Warning, TEXT("LlamaThread: KV cursor (%d) was beyond current fixed+convo length (%d). Adjusting."),
-				kv_cache_token_cursor, StablePrefixLength);
-			InvalidateKVCacheFromPosition(StablePrefixLength); // This sets kv_cache_token_cursor = StablePrefixLength
-		}
-
-//        LlamaLogContext("ProcessInputAndGenerate_LlamaThread cut back");
-
-		// Now, kv_cache_token_cursor accurately reflects the end of the portion of the upcoming
-		// prompt that consists of (Fixed Blocks + Full Formatted Conversation History).
-		// The HFS, Focus Instruction, and AI Prefix will be new tokens to decode.
+		// --- 4. No cursor adjustment needed here ---
+		// DecodeTokensAndSample diffs the assembled prompt against MirroredKvCacheTokens, so the previous turn's
+		// HFS and raw reply are dropped from the first divergent token and everything before it is reused.
 
 		// --- 5. Assemble the full prompt for this turn's generation ---
 		std::vector<llama_token> FullPromptForTurn;
@@ -1435,39 +1956,294 @@ kv_cache_token_cursor += assistant_prefix_tokens.size();
 		// DecodeTokensAndSample should set bIsGenerating = false upon its completion or error.
 		// This is a final check.
 		bIsGenerating = false; 
-		qLlamaToMain.enqueue([this]() { if (setIsGeneratingCb) setIsGeneratingCb(false); });
+		PostToMain_LlamaThread([this]() { if (setIsGeneratingCb) setIsGeneratingCb(false); });
+		RunDeferredAgentTurns_LlamaThread();
+		ReportAppliedContextBlocks_LlamaThread();
 
 		BroadcastContextVisualUpdate_LlamaThread();
+		CurrentTurnStats.KvCellsUsed = llama_kv_self_used_cells(ctx);
+		CurrentTurnStats.ContextSize = llama_n_ctx(ctx);
+		CurrentTurnStats.TurnMs = (FPlatformTime::Seconds() - TurnStartTime) * 1000.0;
+		PostToMain_LlamaThread([this, Stats = CurrentTurnStats]() mutable {
+			// the reverse direction's waits are only known here, on its consumer thread
+			const Q::WaitWindow ResultQueueWindow = qLlamaToMain.takeWaitWindow();
+			Stats.LlamaToMainQueueWaitAvgMs = ResultQueueWindow.avgMs;
+			Stats.LlamaToMainQueueWaitMaxMs = ResultQueueWindow.maxMs;
+			if (turnStatsCb) turnStatsCb(Stats);
+		});
+		StreamEvent_LlamaThread(ELlamaStreamEvent::EndOfTurn);
 //        LlamaLogContext("ProcessInputAndGenerate_LlamaThread finished");
 
 		UE_LOG(LogTemp, Log, TEXT("LlamaThread: END ProcessInput: '%s'. kv_cache_token_cursor at %d"), *InputTextFStr, kv_cache_token_cursor);
 	}
 
+	// --- Agents ---
+
+	void LLInternal::CreateAgent_LlamaThread(int32 AgentId, const FString& PersonaText)
+	{
+		if (!ctx || !model) {
+			UE_LOG(LogTemp, Error, TEXT("LlamaThread: CreateAgent called but Llama not ready."));
+			return;
+		}
+		if (AgentId < 1 || AgentId >= (int32)llama_n_seq_max(ctx)) {
+			UE_LOG(LogTemp, Error, TEXT("LlamaThread: Agent id %d is outside 1..%d (MaxAgents)."), AgentId, (int32)llama_n_seq_max(ctx) - 1);
+			return;
+		}
+		FLlamaAgent& Agent = Agents.FindOrAdd(AgentId);
+		Agent.SeqId = AgentId;
+		Agent.PersonaTokens = my_llama_tokenize(model, TCHAR_TO_UTF8(*PersonaText), false, false);
+		if (!Agent.Sampler) {
+			// Same chain as AIXO's, minus the tool call grammar; seeded per agent so they don't answer in lockstep
+			Agent.Sampler = llama_sampler_chain_init(llama_sampler_chain_default_params());
+			llama_sampler_chain_add(Agent.Sampler, llama_sampler_init_penalties(64, 1.10f, 0.0f, 0.0f));
+			llama_sampler_chain_add(Agent.Sampler, llama_sampler_init_top_k(40));
+			llama_sampler_chain_add(Agent.Sampler, llama_sampler_init_typical(1.00f, 1));
+			llama_sampler_chain_add(Agent.Sampler, llama_sampler_init_top_p(0.95f, 1));
+			llama_sampler_chain_add(Agent.Sampler, llama_sampler_init_temp(0.80f));
+			llama_sampler_chain_add(Agent.Sampler, llama_sampler_init_dist(4242 + AgentId));
+		}
+		UE_LOG(LogTemp, Log, TEXT("LlamaThread: Agent %d persona set, %d tokens."), AgentId, Agent.PersonaTokens.size());
+	}
+
+	void LLInternal::RemoveAgent_LlamaThread(int32 AgentId)
+	{
+		FLlamaAgent* Agent = Agents.Find(AgentId);
+		if (!Agent) return;
+		if (ctx) llama_kv_self_seq_rm(ctx, Agent->SeqId, -1, -1); // cells still used by sequence 0 (the forked prefix) stay
+		if (Agent->Sampler) llama_sampler_free(Agent->Sampler);
+		Agents.Remove(AgentId);
+		UE_LOG(LogTemp, Log, TEXT("LlamaThread: Agent %d removed."), AgentId);
+	}
+
+	void LLInternal::FreeAgents_LlamaThread()
+	{
+		for (TPair<int32, FLlamaAgent>& Pair : Agents) {
+			if (Pair.Value.Sampler) llama_sampler_free(Pair.Value.Sampler);
+		}
+		Agents.Empty();
+	}
+
+	void LLInternal::QueueAgentInput_LlamaThread(int32 AgentId, const FString& InputText, const FString& HighFrequencyContextText, const FString& InputTypeHint)
+	{
+		FLlamaAgent* Agent = Agents.Find(AgentId);
+		if (!Agent || !model) {
+			UE_LOG(LogTemp, Error, TEXT("LlamaThread: Input for unknown agent %d ignored."), AgentId);
+			return;
+		}
+		const bool bAllowSpecial = InputTypeHint.Equals(TEXT("tool"), ESearchCase::IgnoreCase) || InputText.Contains(TEXT("<"));
+		Agent->History.push_back({ InputTypeHint, my_llama_tokenize(model, TCHAR_TO_UTF8(*InputText), false, bAllowSpecial) });
+		Agent->HfsTokens = my_llama_tokenize(model, TCHAR_TO_UTF8(*HighFrequencyContextText), false, false);
+		Agent->bHasPendingInput = true;
+		QueueAgentTurns_LlamaThread();
+	}
+
+	// Every agent input queued ahead of the pass runs in it
+	void LLInternal::QueueAgentTurns_LlamaThread()
+	{
+		if (bAgentTurnsQueued) return;
+		bAgentTurnsQueued = true;
+		qMainToLlama.enqueue([this]() { RunAgentTurns_LlamaThread(); });
+	}
+
+	// Called wherever the generation lock is released
+	void LLInternal::RunDeferredAgentTurns_LlamaThread()
+	{
+		if (!bAgentTurnsDeferred) return;
+		bAgentTurnsDeferred = false;
+		QueueAgentTurns_LlamaThread();
+	}
+
+	// Prefix blocks (shared with sequence 0), persona, history, HFS, assistant cue
+	void LLInternal::AppendAgentContextTokens(const FLlamaAgent& Agent, std::vector<llama_token>& OutTokens)
+	{
+		for (uint8 i = 0; i < (uint8)ELlamaContextBlockType::COUNT; ++i) {
+			if (IsTailBlock((ELlamaContextBlockType)i)) continue;
+			if (const FTokenizedContextBlock* Block = FixedContextBlocks.Find((ELlamaContextBlockType)i)) {
+				OutTokens.insert(OutTokens.end(), Block->Tokens.begin(), Block->Tokens.end());
+			}
+		}
+		const std::vector<llama_token>& SystemPrefix = RolePrefixTokens(TEXT("system"));
+		OutTokens.insert(OutTokens.end(), SystemPrefix.begin(), SystemPrefix.end());
+		OutTokens.insert(OutTokens.end(), Agent.PersonaTokens.begin(), Agent.PersonaTokens.end());
+		OutTokens.insert(OutTokens.end(), ChatTemplate.TurnSuffix.begin(), ChatTemplate.TurnSuffix.end());
+		for (const FConversationTurn& Turn : Agent.History) {
+			const std::vector<llama_token>& RolePrefix = RolePrefixTokens(Turn.Role);
+			OutTokens.insert(OutTokens.end(), RolePrefix.begin(), RolePrefix.end());
+			OutTokens.insert(OutTokens.end(), Turn.Tokens.begin(), Turn.Tokens.end());
+			OutTokens.insert(OutTokens.end(), ChatTemplate.TurnSuffix.begin(), ChatTemplate.TurnSuffix.end());
+		}
+		if (!Agent.HfsTokens.empty()) {
+			OutTokens.insert(OutTokens.end(), ChatTemplate.HfsPrefix.begin(), ChatTemplate.HfsPrefix.end());
+			OutTokens.insert(OutTokens.end(), Agent.HfsTokens.begin(), Agent.HfsTokens.end());
+			OutTokens.insert(OutTokens.end(), ChatTemplate.HfsSuffix.begin(), ChatTemplate.HfsSuffix.end());
+		}
+		OutTokens.insert(OutTokens.end(), ChatTemplate.AssistantPrefix.begin(), ChatTemplate.AssistantPrefix.end());
+	}
+
+	void LLInternal::RunAgentTurns_LlamaThread()
+	{
+		bAgentTurnsQueued = false;
+		if (!ctx || !model) return;
+		if (bIsGenerating.load(std::memory_order_acquire)) {
+			UE_LOG(LogTemp, Log, TEXT("LlamaThread: Agent turns deferred until the generation in progress finishes."));
+			bAgentTurnsDeferred = true;
+			return;
+		}
+
+		bIsGenerating = true; // Acquire "generation lock" for this entire operation
+		PostToMain_LlamaThread([this]() { if (setIsGeneratingCb) setIsGeneratingCb(true); });
+		const double StartTime = FPlatformTime::Seconds();
+		const int32 PrefixTokens = PrefixBlocksTokenCount();
+
+		// --- 1. Line each pending agent's sequence up with its prompt ---
+		// Keep what the sequence already holds; the prefix blocks sequence 0 has decoded are forked (cells shared, not copied
+		// or decoded again); only the rest is left to decode.
+		TArray<int32> Active;
+		int32 ForkedTokens = 0, PromptTokensTotal = 0;
+		for (TPair<int32, FLlamaAgent>& Pair : Agents) {
+			FLlamaAgent& Agent = Pair.Value;
+			if (!Agent.bHasPendingInput) continue;
+			Agent.bHasPendingInput = false;
+
+			std::vector<llama_token> Target;
+			AppendAgentContextTokens(Agent, Target);
+			while ((int32)Target.size() > PrefixTokens + Config.AgentMaxTokens && Agent.History.size() > 1) {
+				Agent.History.pop_front(); // oldest turn goes; the diff below drops it from the sequence
+				Target.clear();
+				AppendAgentContextTokens(Agent, Target);
+			}
+
+			const size_t KeepLimit = FMath::Min(Agent.KvTokens.size(), Target.size());
+			const int32 Kept = std::mismatch(Agent.KvTokens.begin(), Agent.KvTokens.begin() + KeepLimit, Target.begin()).first - Agent.KvTokens.begin();
+			if (Kept < (int32)Agent.KvTokens.size()) {
+				llama_kv_self_seq_rm(ctx, Agent.SeqId, Kept, -1);
+				Agent.KvTokens.resize(Kept);
+			}
+			const size_t SharedLimit = FMath::Min3(MirroredKvCacheTokens.size(), Target.size(), (size_t)PrefixTokens);
+			const int32 Shared = std::mismatch(MirroredKvCacheTokens.begin(), MirroredKvCacheTokens.begin() + SharedLimit, Target.begin()).first - MirroredKvCacheTokens.begin();
+			if (Shared > Kept) {
+				llama_kv_self_seq_cp(ctx, 0, Agent.SeqId, Kept, Shared);
+				Agent.KvTokens.insert(Agent.KvTokens.end(), Target.begin() + Kept, Target.begin() + Shared);
+				ForkedTokens += Shared - Kept;
+			}
+			if (Agent.KvTokens.size() == Target.size()) {
+				// all cached; decode the last token again for its logits
+				llama_kv_self_seq_rm(ctx, Agent.SeqId, (llama_pos)Agent.KvTokens.size() - 1, -1);
+				Agent.KvTokens.pop_back();
+			}
+			Agent.PromptTokens.assign(Target.begin() + Agent.KvTokens.size(), Target.end());
+			Agent.PromptCursor = 0;
+			Agent.ReplyTokens.clear();
+			llama_sampler_reset(Agent.Sampler);
+			PromptTokensTotal += Agent.PromptTokens.size();
+			Active.Add(Pair.Key);
+		}
+		const int32 AgentCount = Active.Num();
+
+		// --- 2. One llama_decode per step for all of them: prompt chunks first, then one token each ---
+		int32 Steps = 0;
+		while (Active.Num() > 0 && bIsRunning) {
+			common_batch_clear(batch);
+			for (int32 AgentId : Active) {
+				FLlamaAgent& Agent = Agents[AgentId];
+				Agent.TokensInBatch = 0;
+				Agent.LogitsIndex = -1;
+				const int32 Room = batch_capacity - batch.n_tokens;
+				if (Room <= 0) continue; // waits for the next step
+				const int32 PromptLeft = (int32)Agent.PromptTokens.size() - Agent.PromptCursor;
+				if (PromptLeft > 0) {
+					Agent.TokensInBatch = FMath::Min(Room, PromptLeft);
+					for (int32 j = 0; j < Agent.TokensInBatch; j++) {
+						const bool bLastPromptToken = (j == PromptLeft - 1);
+						common_batch_add(batch, Agent.PromptTokens[Agent.PromptCursor + j], (llama_pos)Agent.KvTokens.size() + j, { Agent.SeqId }, bLastPromptToken);
+						if (bLastPromptToken) Agent.LogitsIndex = batch.n_tokens - 1;
+					}
+				} else {
+					Agent.TokensInBatch = 1;
+					common_batch_add(batch, Agent.ReplyTokens.back(), (llama_pos)Agent.KvTokens.size(), { Agent.SeqId }, true);
+					Agent.LogitsIndex = batch.n_tokens - 1;
+				}
+			}
+			if (llama_decode(ctx, batch) != 0) {
+				FString ErrorMsg = FString::Printf(TEXT("LlamaThread: llama_decode failed for %d agent(s); the context may be full."), Active.Num());
+				UE_LOG(LogTemp, Error, TEXT("%s"), *ErrorMsg);
+				PostToMain_LlamaThread([this, ErrorMsg]() { if (errorCb) errorCb(ErrorMsg); });
+				// No reply: the partial one isn't added to History. The input stays there and is answered with the agent's next input.
+				for (int32 AgentId : Active) {
+					FLlamaAgent& Agent = Agents[AgentId];
+					llama_kv_self_seq_rm(ctx, Agent.SeqId, -1, -1); // unknown state after a failed decode; rebuilt next turn
+					Agent.KvTokens.clear();
+					Agent.ReplyTokens.clear();
+					PostToMain_LlamaThread([this, AgentId, ErrorMsg]() { if (agentErrorCb) agentErrorCb(AgentId, ErrorMsg); });
+				}
+				break;
+			}
+			Steps++;
+
+			for (int32 i = Active.Num() - 1; i >= 0; --i) {
+				FLlamaAgent& Agent = Agents[Active[i]];
+				if (Agent.TokensInBatch == 0) continue;
+				if (Agent.PromptCursor < (int32)Agent.PromptTokens.size()) {
+					Agent.KvTokens.insert(Agent.KvTokens.end(), Agent.PromptTokens.begin() + Agent.PromptCursor, Agent.PromptTokens.begin() + Agent.PromptCursor + Agent.TokensInBatch);
+					Agent.PromptCursor += Agent.TokensInBatch;
+				} else {
+					Agent.KvTokens.push_back(Agent.ReplyTokens.back());
+				}
+				if (Agent.LogitsIndex < 0) continue; // more prompt to go
+
+				const llama_token NewToken = llama_sampler_sample(Agent.Sampler, ctx, Agent.LogitsIndex); // accepts it too
+				if (llama_vocab_is_eog(vocab, NewToken) || (int32)Agent.ReplyTokens.size() >= Config.AgentMaxReplyTokens ||
+					(int32)Agent.KvTokens.size() >= n_ctx_from_model) {
+					FinishAgentTurn_LlamaThread(Active[i], Agent);
+					Active.RemoveAt(i);
+					continue;
+				}
+				Agent.ReplyTokens.push_back(NewToken); // decoded in the next step
+			}
+		}
+
+		UE_LOG(LogTemp, Log, TEXT("LlamaThread: %d agent turn(s) in %d batched decodes, %.1f ms. Prompt tokens %d, forked from sequence 0 %d, KV cells used %d."),
+			AgentCount, Steps, (FPlatformTime::Seconds() - StartTime) * 1000.0, PromptTokensTotal, ForkedTokens, llama_kv_self_used_cells(ctx));
+
+		bIsGenerating = false;
+		PostToMain_LlamaThread([this]() { if (setIsGeneratingCb) setIsGeneratingCb(false); });
+	}
+
+	void LLInternal::FinishAgentTurn_LlamaThread(int32 AgentId, FLlamaAgent& Agent)
+	{
+		std::string Reply;
+		for (llama_token tk : Agent.ReplyTokens) {
+			const char* piece = llama_vocab_get_text(vocab, tk);
+			if (piece) Reply += piece;
+		}
+		Agent.History.push_back({ TEXT("assistant"), Agent.ReplyTokens });
+		FString ReplyStr = UTF8_TO_TCHAR(CleanString(Reply).c_str());
+		PostToMain_LlamaThread([this, AgentId, ReplyStr]() { if (agentReplyCb) agentReplyCb(AgentId, ReplyStr); });
+	}
+
     // --- Main Llama Thread Loop ---
     void LLInternal::ThreadRun_LlamaThread()
     {
-        // Initial wait for InitializeLlama_LlamaThread to be called
+        // Block until commands arrive; SignalStopRunning() wakes the wait so shutdown never waits on a poll interval.
+        // The first command is normally InitializeLlama_LlamaThread.
         while (bIsRunning && (!model || !ctx)) {
-            qMainToLlama.processQ(); // Process init command
-            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            if (!qMainToLlama.waitAndProcessQ()) break;
         }
 
         UE_LOG(LogTemp, Log, TEXT("LlamaThread %p: Starting main loop."), this);
 
         while (bIsRunning)
         {
-            // Process any pending commands from the main thread
+            // Process commands from the main thread as they arrive
             // This is where UpdateContextBlock, ProcessInputAndGenerate_LlamaThread, etc., are actually invoked.
-            qMainToLlama.processQ();
-
-            // If not actively generating, sleep a bit to yield CPU
-            if (!bIsGenerating.load(std::memory_order_acquire)) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(10));
-            }
-            // The actual generation logic is now part of DecodeTokensAndSample,
+            // The actual generation logic is part of DecodeTokensAndSample,
             // which is called by ProcessInputAndGenerate_LlamaThread.
+            if (!qMainToLlama.waitAndProcessQ()) break;
         }
-        UE_LOG(LogTemp, Log, TEXT("LlamaThread %p: Exiting main loop."), this);
+        UE_LOG(LogTemp, Log, TEXT("LlamaThread %p: Exiting main loop. Queue: %llu commands, wait %.2f ms avg, %.2f ms max."), this,
+            (uint64)qMainToLlama.getProcessedCount(),
+            qMainToLlama.getProcessedCount() ? qMainToLlama.getTotalWaitMs() / qMainToLlama.getProcessedCount() : 0.0,
+            qMainToLlama.getMaxWaitMs());
         ShutdownLlama_LlamaThread(); // Clean up llama resources
     }
 
@@ -0,0 +1,328 @@
+// LlamaBenchCommandlet.cpp
+#include "LlamaBenchCommandlet.h"
+#include "LLInternal.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "HAL/PlatformMemory.h"
+#include "Dom/JsonObject.h"
+#include "Serialization/JsonReader.h"
+#include "Serialization/JsonSerializer.h"
+
+namespace
+{
+	struct FBenchTurn {
+		FString Input;
+		FString Hfs;
+	};
+
+	// Built-in script, used when no -session file is given: the crew asking the kind of things they ask in play
+	const TCHAR* DefaultInputs[] = {
+		TEXT("Status report."),
+		TEXT("What is our current depth and heading?"),
+		TEXT("Query the battery charge level."),
+		TEXT("Bring us to periscope depth."),
+		TEXT("Are any systems reporting faults?"),
+		TEXT("Rig for silent running."),
+		TEXT("What is drawing the most power right now?"),
+		TEXT("Come left to heading two seven zero, ahead two thirds."),
+	};
+
+	FString MakeBenchHfs(int32 Turn)
+	{
+		return FString::Printf(TEXT("DEPTH: %d m\nHEADING: %03d\nSPEED: %d kt\nBATTERY: %d%%\nALERTS: %s"),
+			40 + Turn * 5, (90 + Turn * 20) % 360, 4 + (Turn % 3) * 2, 96 - Turn, (Turn % 4 == 3) ? TEXT("BILGE_HIGH") : TEXT("NONE"));
+	}
+
+	FString MakeBenchLowFreq(int32 Update)
+	{
+		return FString::Printf(TEXT("MISSION PHASE: %d\nTHREAT LEVEL: %s\nCONTACTS: %d"),
+			Update + 1, (Update % 2) ? TEXT("ELEVATED") : TEXT("LOW"), Update % 3);
+	}
+
+	struct FBenchTurnResult {
+		FString Kind;
+		FLlamaPerformanceMetrics Stats;
+		double WallMs = 0.0;
+		int32 ToolCalls = 0;
+	};
+
+	double Rate(int32 Tokens, double Ms) { return (Ms > 0.0) ? Tokens * 1000.0 / Ms : 0.0; }
+}
+
+ULlamaBenchCommandlet::ULlamaBenchCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+}
+
+int32 ULlamaBenchCommandlet::Main(const FString& Params)
+{
+	FString ModelPath;
+	if (!FParse::Value(*Params, TEXT("model="), ModelPath) || ModelPath.IsEmpty()) {
+		UE_LOG(LogTemp, Error, TEXT("LlamaBench: -model=<path to gguf> is required"));
+		return 1;
+	}
+	FString PromptFile = TEXT("Prompts/1.txt");
+	FString SessionFile, OutFile;
+	int32 NumTurns = 8, UpdateEvery = 2, ToolEvery = 3;
+	float TimeoutSeconds = 600.0f;
+	FLlamaRuntimeConfig RuntimeConfig;
+	FParse::Value(*Params, TEXT("prompt="), PromptFile);
+	FParse::Value(*Params, TEXT("session="), SessionFile);
+	FParse::Value(*Params, TEXT("out="), OutFile);
+	FParse::Value(*Params, TEXT("turns="), NumTurns);
+	FParse::Value(*Params, TEXT("updateevery="), UpdateEvery);
+	FParse::Value(*Params, TEXT("toolevery="), ToolEvery);
+	FParse::Value(*Params, TEXT("timeout="), TimeoutSeconds);
+	FParse::Value(*Params, TEXT("batch="), RuntimeConfig.PromptBatchSize);
+	FParse::Value(*Params, TEXT("ubatch="), RuntimeConfig.PromptMicroBatchSize);
+	FParse::Value(*Params, TEXT("threads="), RuntimeConfig.GenerationThreads);
+	FParse::Value(*Params, TEXT("batchthreads="), RuntimeConfig.BatchThreads);
+	FParse::Value(*Params, TEXT("affinity="), RuntimeConfig.GenerationCpuAffinity);
+	RuntimeConfig.bUseDedicatedThreadpools = FParse::Param(*Params, TEXT("threadpool")) || !RuntimeConfig.GenerationCpuAffinity.IsEmpty();
+	RuntimeConfig.bUseKvSnapshots = !FParse::Param(*Params, TEXT("nosnapshot"));
+	RuntimeConfig.bVolatileBlocksAfterHistory = FParse::Param(*Params, TEXT("volatiletail"));
+	FParse::Value(*Params, TEXT("draft="), RuntimeConfig.DraftModelPath);
+	FParse::Value(*Params, TEXT("draftk="), RuntimeConfig.SpeculativeDraftTokens);
+	FParse::Value(*Params, TEXT("draftmin="), RuntimeConfig.SpeculativeMinAcceptance);
+	FParse::Value(*Params, TEXT("agents="), RuntimeConfig.MaxAgents);
+	RuntimeConfig.ContextVisUpdateHz = 1.0f; // nobody is watching
+
+	FString SystemPrompt;
+	const FString PromptPath = FPaths::ProjectContentDir() / PromptFile;
+	if (!FFileHelper::LoadFileToString(SystemPrompt, *PromptPath)) {
+		UE_LOG(LogTemp, Error, TEXT("LlamaBench: failed to load system prompt from %s"), *PromptPath);
+		return 1;
+	}
+
+	// --- Script ---
+	TArray<FBenchTurn> Turns;
+	FString Systems = TEXT("SYSTEMS: BATTERY, BALLAST, PROPULSION, SONAR, PERISCOPE, LIGHTS, PUMPS");
+	FString LowFreq = MakeBenchLowFreq(0);
+	FString ToolResponse = TEXT("{\"system\": \"BATTERY\", \"charge\": 0.91, \"status\": \"NORMAL\"}");
+	if (!SessionFile.IsEmpty()) {
+		FString SessionText;
+		TSharedPtr<FJsonObject> Session;
+		if (!FFileHelper::LoadFileToString(SessionText, *SessionFile)
+			|| !FJsonSerializer::Deserialize(TJsonReaderFactory<>::Create(SessionText), Session) || !Session.IsValid()) {
+			UE_LOG(LogTemp, Error, TEXT("LlamaBench: failed to read session %s"), *SessionFile);
+			return 1;
+		}
+		Session->TryGetStringField(TEXT("systems"), Systems);
+		Session->TryGetStringField(TEXT("lowfreq"), LowFreq);
+		Session->TryGetStringField(TEXT("toolresponse"), ToolResponse);
+		const TArray<TSharedPtr<FJsonValue>>* TurnValues = nullptr;
+		if (Session->TryGetArrayField(TEXT("turns"), TurnValues)) {
+			for (const TSharedPtr<FJsonValue>& Value : *TurnValues) {
+				const TSharedPtr<FJsonObject>* TurnObject = nullptr;
+				if (!Value->TryGetObject(TurnObject)) continue;
+				FBenchTurn Turn;
+				(*TurnObject)->TryGetStringField(TEXT("input"), Turn.Input);
+				if (!(*TurnObject)->TryGetStringField(TEXT("hfs"), Turn.Hfs)) Turn.Hfs = MakeBenchHfs(Turns.Num());
+				Turns.Add(Turn);
+			}
+		}
+	} else {
+		for (int32 i = 0; i < NumTurns; i++) {
+			Turns.Add({ DefaultInputs[i % UE_ARRAY_COUNT(DefaultInputs)], MakeBenchHfs(i) });
+		}
+	}
+	if (Turns.Num() == 0) {
+		UE_LOG(LogTemp, Error, TEXT("LlamaBench: no turns to run"));
+		return 1;
+	}
+
+	// --- Llama ---
+	LLInternal* Llama = new LLInternal();
+	bool bReady = false, bTurnDone = false, bStatsReceived = false, bFailed = false;
+	int32 ToolCallsThisTurn = 0;
+	FLlamaPerformanceMetrics LastStats;
+	FString LastError;
+	Llama->readyCb = [&](FString) { bReady = true; };
+	Llama->errorCb = [&](FString Message) { LastError = Message; bFailed = true; UE_LOG(LogTemp, Error, TEXT("LlamaBench: %s"), *Message); };
+	Llama->toolCallCb = [&](FString) { ToolCallsThisTurn++; };
+	Llama->endOfTurnCb = [&]() { bTurnDone = true; };
+	Llama->turnStatsCb = [&](const FLlamaPerformanceMetrics& Stats) { LastStats = Stats; bStatsReceived = true; };
+
+	// Plays the game thread's part (ULlamaComponent::TickComponent) until Done() or an error/timeout
+	auto Pump = [&](const TCHAR* What, TFunctionRef<bool()> Done) -> bool {
+		const double Deadline = FPlatformTime::Seconds() + TimeoutSeconds;
+		while (!Done()) {
+			while (Llama->qLlamaToMain.processQ());
+			Llama->DrainTokenStream_MainThread(0);
+			if (bFailed) return false;
+			if (FPlatformTime::Seconds() > Deadline) {
+				UE_LOG(LogTemp, Error, TEXT("LlamaBench: timed out waiting for %s"), What);
+				bFailed = true;
+				return false;
+			}
+			FPlatformProcess::Sleep(0.001f);
+		}
+		return true;
+	};
+
+	auto RunTurn = [&](const FString& Kind, const FString& Input, const FString& Hfs, FBenchTurnResult& Out) -> bool {
+		bTurnDone = bStatsReceived = false;
+		ToolCallsThisTurn = 0;
+		const double Start = FPlatformTime::Seconds();
+		Llama->qMainToLlama.enqueue([Llama, Input, Hfs, Kind]() {
+			Llama->ProcessInputAndGenerate_LlamaThread(Input, Hfs, Kind);
+		});
+		if (!Pump(TEXT("end of turn"), [&]() { return bTurnDone && bStatsReceived; })) return false;
+		Out.Kind = Kind;
+		Out.Stats = LastStats;
+		Out.WallMs = (FPlatformTime::Seconds() - Start) * 1000.0;
+		Out.ToolCalls = ToolCallsThisTurn;
+		return true;
+	};
+
+	TArray<FBenchTurnResult> Results;
+	TArray<double> UpdateMs;
+	int32 AppliedGeneration = 0;	// newest context block generation the Llama thread reported as decoded
+	Llama->contextBlockAppliedCb = [&AppliedGeneration](ELlamaContextBlockType, int32 Generation) { AppliedGeneration = Generation; };
+	double ColdStartMs = 0.0;
+	int32 AgentReplies = 0;
+	double AgentRoundMs = 0.0;
+	Llama->agentReplyCb = [&AgentReplies](int32, FString) { AgentReplies++; };
+
+	const double ColdStart = FPlatformTime::Seconds();
+	Llama->qMainToLlama.enqueue([Llama, ModelPath, SystemPrompt, Systems, LowFreq, RuntimeConfig]() {
+		Llama->SetRuntimeConfig_LlamaThread(RuntimeConfig);
+		Llama->InitializeLlama_LlamaThread(ModelPath, SystemPrompt, Systems, LowFreq);
+	});
+	if (Pump(TEXT("model load"), [&]() { return bReady; })) {
+		ColdStartMs = (FPlatformTime::Seconds() - ColdStart) * 1000.0;
+		UE_LOG(LogTemp, Display, TEXT("LlamaBench: ready in %.0f ms"), ColdStartMs);
+
+		for (int32 i = 0; i < Turns.Num() && !bFailed; i++) {
+			if (UpdateEvery > 0 && i > 0 && i % UpdateEvery == 0) {
+				const FString NewLowFreq = MakeBenchLowFreq(UpdateMs.Num() + 1);
+				const double Start = FPlatformTime::Seconds();
+				const int32 Expected = Llama->SubmitContextBlock(ELlamaContextBlockType::LowFrequencyState, NewLowFreq);
+				if (!Pump(TEXT("context update"), [&]() { return AppliedGeneration >= Expected; })) break;
+				UpdateMs.Add((FPlatformTime::Seconds() - Start) * 1000.0);
+			}
+
+			FBenchTurnResult& Result = Results.AddDefaulted_GetRef();
+			if (!RunTurn(TEXT("user"), Turns[i].Input, Turns[i].Hfs, Result)) break;
+
+			// round-trip a tool response when the model asked for one, or on schedule so every run exercises the path
+			if (Result.ToolCalls > 0 || (ToolEvery > 0 && (i + 1) % ToolEvery == 0)) {
+				FBenchTurnResult& ToolResult = Results.AddDefaulted_GetRef();
+				if (!RunTurn(TEXT("tool"), ToolResponse, Turns[i].Hfs, ToolResult)) break;
+			}
+		}
+
+		// one round for every agent at once, all forking the prefix blocks decoded above
+		if (RuntimeConfig.MaxAgents > 0 && !bFailed) {
+			const int32 NumAgents = RuntimeConfig.MaxAgents;
+			const FString AgentHfs = Turns[0].Hfs;
+			const double Start = FPlatformTime::Seconds();
+			Llama->qMainToLlama.enqueue([Llama, NumAgents, AgentHfs]() {
+				for (int32 AgentId = 1; AgentId <= NumAgents; AgentId++) {
+					Llama->CreateAgent_LlamaThread(AgentId, FString::Printf(TEXT("You are the captain of rival submarine %d. Answer in one or two sentences."), AgentId));
+					Llama->QueueAgentInput_LlamaThread(AgentId, DefaultInputs[AgentId % UE_ARRAY_COUNT(DefaultInputs)], AgentHfs, TEXT("user"));
+				}
+			});
+			if (Pump(TEXT("agent replies"), [&]() { return AgentReplies >= NumAgents; })) {
+				AgentRoundMs = (FPlatformTime::Seconds() - Start) * 1000.0;
+			}
+		}
+	}
+
+	// --- Report ---
+	TSharedRef<FJsonObject> Report = MakeShared<FJsonObject>();
+	Report->SetStringField(TEXT("model"), ModelPath);
+	Report->SetStringField(TEXT("prompt"), PromptFile);
+	Report->SetNumberField(TEXT("cold_start_ms"), ColdStartMs);
+	Report->SetBoolField(TEXT("kv_snapshots"), RuntimeConfig.bUseKvSnapshots);
+	Report->SetNumberField(TEXT("threads"), RuntimeConfig.GenerationThreads);
+	Report->SetNumberField(TEXT("batch_threads"), RuntimeConfig.BatchThreads);
+	Report->SetBoolField(TEXT("threadpool"), RuntimeConfig.bUseDedicatedThreadpools);
+	Report->SetStringField(TEXT("draft_model"), RuntimeConfig.DraftModelPath);
+	Report->SetNumberField(TEXT("draft_k"), RuntimeConfig.SpeculativeDraftTokens);
+	Report->SetNumberField(TEXT("agents"), RuntimeConfig.MaxAgents);
+	Report->SetNumberField(TEXT("agent_round_ms"), AgentRoundMs);
+
+	TArray<TSharedPtr<FJsonValue>> TurnValues;
+	int32 TotalPromptTokens = 0, TotalGeneratedTokens = 0, TotalDraftedTokens = 0, TotalAcceptedDraftTokens = 0;
+	double TotalPromptMs = 0.0, TotalGenerateMs = 0.0, MaxTtftMs = 0.0, MaxPruneMs = 0.0, SumTtftMs = 0.0;
+	int32 CompletedTurns = 0;
+	for (const FBenchTurnResult& Result : Results) {
+		if (Result.Kind.IsEmpty()) continue; // failed before it finished
+		const FLlamaPerformanceMetrics& S = Result.Stats;
+		TSharedRef<FJsonObject> Turn = MakeShared<FJsonObject>();
+		Turn->SetStringField(TEXT("kind"), Result.Kind);
+		Turn->SetNumberField(TEXT("prompt_tokens"), S.PromptTokens);
+		Turn->SetNumberField(TEXT("prompt_ms"), S.PromptMs);
+		Turn->SetNumberField(TEXT("prompt_tok_per_s"), Rate(S.PromptTokens, S.PromptMs));
+		Turn->SetNumberField(TEXT("generated_tokens"), S.GeneratedTokens);
+		Turn->SetNumberField(TEXT("generate_ms"), S.GenerateMs);
+		Turn->SetNumberField(TEXT("gen_tok_per_s"), Rate(S.GeneratedTokens, S.GenerateMs));
+		Turn->SetNumberField(TEXT("ttft_ms"), S.TimeToFirstTokenMs);
+		Turn->SetNumberField(TEXT("prune_ms"), S.PruneMs);
+		Turn->SetNumberField(TEXT("sampling_ms"), S.SamplingTimeMs);
+		if (S.DraftedTokens > 0) {
+			Turn->SetNumberField(TEXT("drafted_tokens"), S.DraftedTokens);
+			Turn->SetNumberField(TEXT("draft_acceptance"), S.DraftAcceptanceRate);
+			Turn->SetNumberField(TEXT("draft_ms"), S.DraftMs);
+			Turn->SetBoolField(TEXT("draft_fell_back"), S.bSpeculationFellBack);
+		}
+		Turn->SetNumberField(TEXT("redecode_tokens"), S.RedecodeTokens);
+		Turn->SetNumberField(TEXT("block_update_ms"), S.BlockUpdateMs);
+		Turn->SetNumberField(TEXT("input_queue_wait_ms"), S.InputQueueWaitMs);
+		Turn->SetNumberField(TEXT("kv_cells_used"), S.KvCellsUsed);
+		Turn->SetNumberField(TEXT("n_ctx"), S.ContextSize);
+		Turn->SetNumberField(TEXT("tool_calls"), Result.ToolCalls);
+		Turn->SetNumberField(TEXT("wall_ms"), Result.WallMs);
+		TurnValues.Add(MakeShared<FJsonValueObject>(Turn));
+
+		TotalPromptTokens += S.PromptTokens;
+		TotalPromptMs += S.PromptMs;
+		TotalGeneratedTokens += S.GeneratedTokens;
+		TotalGenerateMs += S.GenerateMs;
+		TotalDraftedTokens += S.DraftedTokens;
+		TotalAcceptedDraftTokens += S.AcceptedDraftTokens;
+		SumTtftMs += S.TimeToFirstTokenMs;
+		MaxTtftMs = FMath::Max(MaxTtftMs, (double)S.TimeToFirstTokenMs);
+		MaxPruneMs = FMath::Max(MaxPruneMs, (double)S.PruneMs);
+		CompletedTurns++;
+	}
+	Report->SetArrayField(TEXT("turns"), TurnValues);
+
+	TArray<TSharedPtr<FJsonValue>> UpdateValues;
+	for (double Ms : UpdateMs) UpdateValues.Add(MakeShared<FJsonValueNumber>(Ms));
+	Report->SetArrayField(TEXT("context_update_ms"), UpdateValues);
+
+	TSharedRef<FJsonObject> Totals = MakeShared<FJsonObject>();
+	Totals->SetNumberField(TEXT("turns"), CompletedTurns);
+	Totals->SetNumberField(TEXT("prompt_tok_per_s"), Rate(TotalPromptTokens, TotalPromptMs));
+	Totals->SetNumberField(TEXT("gen_tok_per_s"), Rate(TotalGeneratedTokens, TotalGenerateMs));
+	Totals->SetNumberField(TEXT("mean_ttft_ms"), CompletedTurns > 0 ? SumTtftMs / CompletedTurns : 0.0);
+	Totals->SetNumberField(TEXT("max_ttft_ms"), MaxTtftMs);
+	Totals->SetNumberField(TEXT("max_prune_ms"), MaxPruneMs);
+	Totals->SetNumberField(TEXT("draft_acceptance"), TotalDraftedTokens > 0 ? (double)TotalAcceptedDraftTokens / TotalDraftedTokens : 0.0);
+	Report->SetObjectField(TEXT("totals"), Totals);
+
+	Report->SetNumberField(TEXT("peak_rss_bytes"), static_cast<double>(FPlatformMemory::GetStats().PeakUsedPhysical));
+	Report->SetBoolField(TEXT("ok"), !bFailed);
+	if (bFailed && !LastError.IsEmpty()) Report->SetStringField(TEXT("error"), LastError);
+
+	// stop the Llama thread before the locals its callbacks capture go out of scope
+	Llama->SignalStopRunning();
+	delete Llama;
+
+	FString ReportText;
+	FJsonSerializer::Serialize(Report, TJsonWriterFactory<>::Create(&ReportText));
+	if (OutFile.IsEmpty()) {
+		UE_LOG(LogTemp, Display, TEXT("LlamaBench report:\n%s"), *ReportText);
+	} else if (FFileHelper::SaveStringToFile(ReportText, *OutFile)) {
+		UE_LOG(LogTemp, Display, TEXT("LlamaBench: report written to %s"), *OutFile);
+	} else {
+		UE_LOG(LogTemp, Error, TEXT("LlamaBench: failed to write %s"), *OutFile);
+		return 1;
+	}
+	return bFailed ? 1 : 0;
+}
@@ -47,11 +47,19 @@ ULlamaComponent::ULlamaComponent(const FObjectInitializer& ObjectInitializer)
             OnLlamaReady.Broadcast(ReadyMessage);
         }
     };
-    LlamaImpl->contextChangedCb = [this](const FContextVisPayload& contextBlocks) {
+    LlamaImpl->contextChangedCb = [this](FContextVisPayload& contextBlocks) {
         {
-        	FContextVisPayload FinalPayload = (FContextVisPayload&)contextBlocks;
-			FinalPayload.bIsStaticWorldInfoUpToDate = contextBlocks.KvCacheDecodedTokenCount >= contextBlocks.Blocks[((int)EContextVisBlockType::StaticWorldInfo)+1].NormalizedStartInTokens;	// if the cursor is at or past the end of the block
-			FinalPayload.bIsLowFrequencyStateUpToDate = contextBlocks.KvCacheDecodedTokenCount >= contextBlocks.Blocks[((int)EContextVisBlockType::LowFrequencyState)+1].NormalizedStartInTokens;	// if the cursor is at or past the end of the block
+        	FContextVisPayload& FinalPayload = contextBlocks;	// LLInternal's merged copy; filled in place rather than copying the block list
+			// Up to date if the cursor is at or past the end of the block; blocks can be reordered, so find them by type
+			auto IsBlockDecoded = [&contextBlocks](EContextVisBlockType Type) {
+				const FContextVisBlock* Block = contextBlocks.Blocks.FindByPredicate([Type](const FContextVisBlock& B) { return B.BlockType == Type; });
+				return !Block || contextBlocks.KvCacheDecodedTokenCount >= Block->NormalizedStartInTokens + Block->LengthInTokens;
+			};
+			auto IsBlockApplied = [this](ELlamaContextBlockType Type) {
+				return AppliedContextBlockGenerations[(int32)Type] >= SubmittedContextBlockGenerations[(int32)Type];
+			};
+			FinalPayload.bIsStaticWorldInfoUpToDate = IsBlockDecoded(EContextVisBlockType::StaticWorldInfo) && IsBlockApplied(ELlamaContextBlockType::StaticWorldInfo);
+			FinalPayload.bIsLowFrequencyStateUpToDate = IsBlockDecoded(EContextVisBlockType::LowFrequencyState) && IsBlockApplied(ELlamaContextBlockType::LowFrequencyState);
 			FinalPayload.bIsLlamaCoreActuallyReady = bIsLlamaCoreReady;
 			FinalPayload.bIsLlamaCurrentlyIdle = bIsLlamaCoreReady && !bIsLlamaGenerating;
 			//
@@ -64,6 +72,26 @@ ULlamaComponent::ULlamaComponent(const FObjectInitializer& ObjectInitializer)
         	bIsLlamaGenerating = isGen;
         }
     };
+    LlamaImpl->endOfTurnCb = [this]() {
+        {
+            OnLlamaTurnComplete.Broadcast();
+        }
+    };
+    LlamaImpl->turnStatsCb = [this](const FLlamaPerformanceMetrics& Metrics) {
+        RecordPerformanceMetrics(Metrics);
+    };
+    LlamaImpl->contextBlockAppliedCb = [this](ELlamaContextBlockType BlockType, int32 Generation) {
+        {
+            AppliedContextBlockGenerations[(int32)BlockType] = Generation;
+            OnLlamaContextBlockApplied.Broadcast(BlockType, Generation);
+        }
+    };
+    LlamaImpl->agentReplyCb = [this](int32 AgentId, FString Reply) {
+        OnLlamaAgentReply.Broadcast(AgentId, Reply);
+    };
+    LlamaImpl->agentErrorCb = [this](int32 AgentId, FString ErrorMessage) {
+        OnLlamaAgentError.Broadcast(AgentId, ErrorMessage);
+    };
 }
 
 ULlamaComponent::~ULlamaComponent()
@@ -100,8 +128,32 @@ void ULlamaComponent::ActivateLlamaComponent(FString SystemsContextBlock, FStrin
         // Marshal the initialization call to the Llama thread
         FString ModelPathCopy = PathToModel;
         FString SystemPromptCopy = LoadedSystemPrompt;
+        FLlamaRuntimeConfig RuntimeConfig;
+        RuntimeConfig.bUseKvSnapshots = bUseKvSnapshots;
+        RuntimeConfig.KvSnapshotDirectory = KvSnapshotDirectory;
+        RuntimeConfig.PromptBatchSize = PromptBatchSize;
+        RuntimeConfig.PromptMicroBatchSize = PromptMicroBatchSize;
+        RuntimeConfig.bIncrementalHistoryPrune = bIncrementalHistoryPrune;
+        RuntimeConfig.bVolatileBlocksAfterHistory = bVolatileBlocksAfterHistory;
+        RuntimeConfig.ContextVisUpdateHz = ContextVisUpdateHz;
+        RuntimeConfig.GenerationThreads = GenerationThreads;
+        RuntimeConfig.BatchThreads = BatchThreads;
+        RuntimeConfig.bUseDedicatedThreadpools = bUseDedicatedThreadpools;
+        RuntimeConfig.ThreadpoolPriority = ThreadpoolPriority;
+        RuntimeConfig.GenerationCpuAffinity = GenerationCpuAffinity;
+        RuntimeConfig.BatchCpuAffinity = BatchCpuAffinity;
+        RuntimeConfig.bStrictCpuPlacement = bStrictCpuPlacement;
+        RuntimeConfig.ThreadpoolPoll = ThreadpoolPoll;
+        RuntimeConfig.DraftModelPath = DraftModelPath;
+        RuntimeConfig.SpeculativeDraftTokens = SpeculativeDraftTokens;
+        RuntimeConfig.SpeculativeMinAcceptance = SpeculativeMinAcceptance;
+        RuntimeConfig.SpeculativeFallbackWindow = SpeculativeFallbackWindow;
+        RuntimeConfig.MaxAgents = MaxAgents;
+        RuntimeConfig.AgentMaxTokens = AgentMaxTokens;
+        RuntimeConfig.AgentMaxReplyTokens = AgentMaxReplyTokens;
 
-        LlamaImpl->qMainToLlama.enqueue([this, ModelPathCopy, SystemPromptCopy, SystemsContextBlock, LowFreqContextBlock]() {
+        LlamaImpl->qMainToLlama.enqueue([this, ModelPathCopy, SystemPromptCopy, SystemsContextBlock, LowFreqContextBlock, RuntimeConfig]() {
+            LlamaImpl->SetRuntimeConfig_LlamaThread(RuntimeConfig);
             LlamaImpl->InitializeLlama_LlamaThread(ModelPathCopy, SystemPromptCopy, SystemsContextBlock, LowFreqContextBlock /*, other params */);
         });
     } else {
@@ -122,14 +174,13 @@ void ULlamaComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
     Super::EndPlay(EndPlayReason);
 }
 
-void ULlamaComponent::UpdateContextBlock(ELlamaContextBlockType BlockType, const FString& NewTextContent)
+int32 ULlamaComponent::UpdateContextBlock(ELlamaContextBlockType BlockType, const FString& NewTextContent)
 {
-    if (LlamaImpl) {
-        FString TextCopy = NewTextContent; // Ensure lifetime for lambda
-        LlamaImpl->qMainToLlama.enqueue([this, BlockType, TextCopy]() {
-            LlamaImpl->UpdateContextBlock_LlamaThread(BlockType, TextCopy);
-        });
-    }
+    if (!LlamaImpl) return 0;
+    // Replaces any update of this block not yet applied; the Llama thread decodes it between turns
+    const int32 Generation = LlamaImpl->SubmitContextBlock(BlockType, NewTextContent);
+    SubmittedContextBlockGenerations[(int32)BlockType] = Generation;
+    return Generation;
 }
 
 void ULlamaComponent::ProcessInput(const FString& InputText, const FString& HighFrequencyContextText, const FString& InputTypeHint)
@@ -155,6 +206,27 @@ void ULlamaComponent::ProcessInput(const FString& InputText, const FString& High
     }
 }
 
+void ULlamaComponent::SetToolCallGrammar(const FString& GrammarGbnf)
+{
+    if (LlamaImpl) {
+        FString GrammarCopy = GrammarGbnf;
+        LlamaImpl->qMainToLlama.enqueue([this, GrammarCopy]() {
+            LlamaImpl->SetToolCallGrammar_LlamaThread(GrammarCopy);
+        });
+    }
+}
+
+void ULlamaComponent::SetThreadCounts(int32 NewGenerationThreads, int32 NewBatchThreads)
+{
+    GenerationThreads = NewGenerationThreads;
+    BatchThreads = NewBatchThreads;
+    if (LlamaImpl) {
+        LlamaImpl->qMainToLlama.enqueue([this, NewGenerationThreads, NewBatchThreads]() {
+            LlamaImpl->SetThreadCounts_LlamaThread(NewGenerationThreads, NewBatchThreads);
+        });
+    }
+}
+
 void ULlamaComponent::TriggerFullContextDump()
 {
     if (LlamaImpl) {
@@ -164,51 +236,98 @@ void ULlamaComponent::TriggerFullContextDump()
     }
 }
 
+int32 ULlamaComponent::CreateAgent(const FString& PersonaText)
+{
+    if (!LlamaImpl) return INDEX_NONE;
+    int32 AgentId = 1;
+    while (AgentIds.Contains(AgentId)) AgentId++;
+    if (AgentId > MaxAgents) {
+        UE_LOG(LogTemp, Warning, TEXT("ULlamaComponent: CreateAgent failed, all %d agent slots in use."), MaxAgents);
+        return INDEX_NONE;
+    }
+    AgentIds.Add(AgentId);
+    FString PersonaCopy = PersonaText;
+    LlamaImpl->qMainToLlama.enqueue([this, AgentId, PersonaCopy]() {
+        LlamaImpl->CreateAgent_LlamaThread(AgentId, PersonaCopy);
+    });
+    return AgentId;
+}
+
+void ULlamaComponent::RemoveAgent(int32 AgentId)
+{
+    if (!LlamaImpl || AgentIds.Remove(AgentId) == 0) return;
+    LlamaImpl->qMainToLlama.enqueue([this, AgentId]() {
+        LlamaImpl->RemoveAgent_LlamaThread(AgentId);
+    });
+}
+
+void ULlamaComponent::ProcessAgentInput(int32 AgentId, const FString& InputText, const FString& HighFrequencyContextText, const FString& InputTypeHint)
+{
+    if (!bIsLlamaCoreReady || !AgentIds.Contains(AgentId)) {
+        UE_LOG(LogTemp, Warning, TEXT("ULlamaComponent: ProcessAgentInput for agent %d ignored (not ready or no such agent)."), AgentId);
+        return;
+    }
+    if (LlamaImpl) {
+        FString InputCopy = InputText;
+        FString HFSCopy = HighFrequencyContextText;
+        FString HintCopy = InputTypeHint;
+        LlamaImpl->qMainToLlama.enqueue([this, AgentId, InputCopy, HFSCopy, HintCopy]() {
+            LlamaImpl->QueueAgentInput_LlamaThread(AgentId, InputCopy, HFSCopy, HintCopy);
+        });
+    }
+}
+
 void ULlamaComponent::TickComponent(float DeltaTime,
                                enum ELevelTick TickType,
                                FActorComponentTickFunction* ThisTickFunction) {
 //    UE_LOG(LogTemp, Verbose, TEXT("ULlamaComponent::TickComponent CALLED")); // Check if this appears
     Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
 
+	const double LlamaTickStartTime = FPlatformTime::Seconds();
 	if (LlamaImpl) {
 		// UE_LOG(LogTemp, Verbose, TEXT("ULlamaComponent::TickComponent - LlamaImpl is VALID. Processing qLlamaToMain."));
 		while(LlamaImpl->qLlamaToMain.processQ());
+		LlamaImpl->DrainTokenStream_MainThread(TokenDrainBudgetPerTick);
 	} else {
 		UE_LOG(LogTemp, Error, TEXT("ULlamaComponent::TickComponent - LlamaImpl IS NULL!"));
 	}
 
-    if (bIsLlamaCoreReady) { // Or some other condition to start broadcasting perf
-//        FPerformanceUIPayload PerfPayload;
-//        PerfPayload.LlamaMetrics = LastLlamaMetrics; // Use the latest received
-//
-//        PerfPayload.GameMetrics.FrameTimeMs = GetWorld()->GetDeltaSeconds() * 1000.0f;
-//        // Getting accurate GameThread, RenderThread, GpuTime can be complex and involve stats system
-//        // For a start, FrameTimeMs is good.
-//        // For more detailed stats, look into FEnginePerformanceTimers or the "Stat Unit" data.
-//        // Example for GPU time (can be latent):
-//        PerfPayload.GameMetrics.GpuTimeMs = FPlatformTime::ToMilliseconds(RHIGetGPUFrameCycles(0)); // Might need specific RHI
-//
-//        if (OnPerformanceDataUpdatedDelegate.IsBound()) {
-//            OnPerformanceDataUpdatedDelegate.Broadcast(PerfPayload);
-//        }
-
-
-// TODO: update the PerfPayload with per-tick measurements
-/*
-        FPerformanceUIPayload PerfPayload;
-        PerfPayload.LlamaMetrics = LastLlamaMetrics; // LastLlamaMetrics is updated by ForwardLlamaMetricsToGameThread
-
-        PerfPayload.GameMetrics.FrameTimeMs = GetWorld()->GetDeltaSeconds() * 1000.0f;
-        // For GPU time, ensure RHIGetGPUFrameCycles is giving non-zero results if used.
-        PerfPayload.GameMetrics.GpuTimeMs = FPlatformTime::ToMilliseconds(RHIGetGPUFrameCycles()); // Pass GFrameNumber or 0
-
-        // **** LOG PerfPayload BEFORE BROADCAST ****
-        UE_LOG(LogTemp, Warning, TEXT("ULlamaComponent::Tick - Broadcasting Perf - Frame:%.2f, PromptEval:%.2f, LLMTokensGen: %d"),
-            PerfPayload.GameMetrics.FrameTimeMs,
-            PerfPayload.LlamaMetrics.PromptEvalTimeMs,
-            PerfPayload.LlamaMetrics.TokensGenerated);
-*/
+	// per-tick game side of the performance payload; it is broadcast when a turn's metrics arrive
+	PerformancePayload.GameMetrics.FrameTimeMs = DeltaTime * 1000.0f;
+	PerformancePayload.GameMetrics.LlamaTickMs = (FPlatformTime::Seconds() - LlamaTickStartTime) * 1000.0;
+}
+
+void ULlamaComponent::RecordPerformanceMetrics(const FLlamaPerformanceMetrics& Metrics)
+{
+    const int32 HistoryLength = FMath::Max(1, PerformanceHistoryLength);
+    if (PerformanceHistory.Num() > HistoryLength) {
+        PerformanceHistory.Reset();
+        PerformanceHistoryNext = 0;
     }
+    if (PerformanceHistory.Num() < HistoryLength) {
+        PerformanceHistory.Add(Metrics);
+    } else {
+        PerformanceHistory[PerformanceHistoryNext] = Metrics;
+    }
+    PerformanceHistoryNext = (PerformanceHistoryNext + 1) % HistoryLength;
 
-}
+    PerformancePayload.LlamaMetrics = Metrics;
+    PerformancePayload.TurnsInWindow = PerformanceHistory.Num();
+
+    TArray<float> Samples;
+    Samples.Reserve(PerformanceHistory.Num());
+    auto BuildHistogram = [this, &Samples](FLlamaLatencyHistogram& Histogram, float FLlamaPerformanceMetrics::* Field, bool bOnlyIfGenerated) {
+        Samples.Reset();
+        for (const FLlamaPerformanceMetrics& Turn : PerformanceHistory) {
+            if (bOnlyIfGenerated && Turn.GeneratedTokens == 0) continue;
+            Samples.Add(Turn.*Field);
+        }
+        Histogram.Build(Samples);
+    };
+    BuildHistogram(PerformancePayload.TimeToFirstToken, &FLlamaPerformanceMetrics::TimeToFirstTokenMs, true);
+    BuildHistogram(PerformancePayload.PromptDecode, &FLlamaPerformanceMetrics::PromptMs, false);
+    BuildHistogram(PerformancePayload.MsPerGeneratedToken, &FLlamaPerformanceMetrics::AvgTimePerGeneratedTokenMs, true);
+    BuildHistogram(PerformancePayload.InputQueueWait, &FLlamaPerformanceMetrics::InputQueueWaitMs, false);
 
+    OnLlamaPerformanceUpdated.Broadcast(PerformancePayload);
+}
@@ -7,7 +7,7 @@
 
 void SLLContextVisualizer::Construct(const FArguments& InArgs)
 {
-    CurrentContextBlocks = InArgs._ContextBlocks;
+    ContextBlocksSource = InArgs._ContextBlocksSource;
     TotalTokenCapacityInternal = InArgs._TotalTokenCapacity;
     KvCacheDecodedTokenCountInternal = InArgs._KvCacheDecodedTokenCount;
     IsStaticWorldInfoUpToDateInternal = InArgs._IsStaticWorldInfoUpToDate;
@@ -19,9 +19,9 @@ void SLLContextVisualizer::Construct(const FArguments& InArgs)
     SetCanTick(false);
 }
 
-void SLLContextVisualizer::SetContextBlocks(TAttribute<TArray<FContextVisBlock>> InBlocks)
+void SLLContextVisualizer::SetContextBlocksSource(const TArray<FContextVisBlock>* InBlocks)
 {
-    CurrentContextBlocks = InBlocks;
+    ContextBlocksSource = InBlocks;
     Invalidate(EInvalidateWidget::Paint);
 }
 
@@ -75,7 +75,8 @@ int32 SLLContextVisualizer::OnPaint(const FPaintArgs& Args, const FGeometry& All
     int32 CurrentLayer = LayerId;
 
     // --- 1. Draw Bar Gauge on the Left Side ---
-    const TArray<FContextVisBlock>& BlocksToDraw = CurrentContextBlocks.Get();
+    static const TArray<FContextVisBlock> NoBlocks;
+    const TArray<FContextVisBlock>& BlocksToDraw = ContextBlocksSource ? *ContextBlocksSource : NoBlocks;
     const int32 CurrentTotalCapacity = TotalTokenCapacityInternal.Get();
     const int32 CurrentKvCacheCount = KvCacheDecodedTokenCountInternal.Get();
     const FVector2D BarGaugeLocalSize = BarGaugeGeometry.GetLocalSize();
@@ -25,74 +25,188 @@ enum class EContextVisBlockType : uint8
     Unknown             UMETA(DisplayName = "Unknown Block")
 };
 
-//USTRUCT(BlueprintType)
-//struct FLlamaPerformanceMetrics
-//{
-//    GENERATED_BODY()
-//
-////    UPROPERTY(BlueprintReadWrite, Category = "Perf")
-////    float PromptEvalTimeMs = 0.0f; // Time to process prompt tokens
-////
-////    UPROPERTY(BlueprintReadWrite, Category = "Perf")
-////    float TokenGenerationTimeMs = 0.0f; // Time for the last generation pass (all tokens)
-////
-////    UPROPERTY(BlueprintReadWrite, Category = "Perf")
-////    int32 TokensGenerated = 0;
-////
-////    UPROPERTY(BlueprintReadWrite, Category = "Perf")
-////    float AvgTimePerTokenMs = 0.0f; // TokenGenerationTimeMs / TokensGenerated
-//    UPROPERTY(BlueprintReadWrite, Category = "Perf")
-//    float PromptEvalTimeMs = 0.0f; // From llama_perf_context_data.t_p_eval_ms
-//
-//    UPROPERTY(BlueprintReadWrite, Category = "Perf")
-//    float TokenGenerationTimeMs = 0.0f; // From llama_perf_context_data.t_eval_ms
-//
-//    UPROPERTY(BlueprintReadWrite, Category = "Perf")
-//    int32 PromptTokensEvaluated = 0; // From llama_perf_context_data.n_p_eval
-//
-//    UPROPERTY(BlueprintReadWrite, Category = "Perf")
-//    int32 TokensGenerated = 0; // From llama_perf_context_data.n_eval (or your manual count)
-//
-//    UPROPERTY(BlueprintReadWrite, Category = "Perf")
-//    float SamplingTimeMs = 0.0f; // From llama_perf_sampler_data.t_sample_ms
-//
-//    UPROPERTY(BlueprintReadWrite, Category = "Perf")
-//    int32 SamplesTaken = 0; // From llama_perf_sampler_data.n_sample
-//
-//    UPROPERTY(BlueprintReadWrite, Category = "Perf")
-//    float AvgTimePerGeneratedTokenMs = 0.0f;
-//};
-//
-//USTRUCT(BlueprintType)
-//struct FGamePerformanceMetrics
-//{
-//    GENERATED_BODY()
-//
-////    UPROPERTY(BlueprintReadWrite, Category = "Perf")
-////    float FrameTimeMs = 0.0f;
-////
-////    UPROPERTY(BlueprintReadWrite, Category = "Perf")
-////    float GameThreadTimeMs = 0.0f;
-////
-////    UPROPERTY(BlueprintReadWrite, Category = "Perf")
-////    float RenderThreadTimeMs = 0.0f;
-////
-////    UPROPERTY(BlueprintReadWrite, Category = "Perf")
-////    float GpuTimeMs = 0.0f;
-//};
-//
-//// Modify FContextVisPayload or create a new one for performance
-//USTRUCT(BlueprintType)
-//struct FPerformanceUIPayload // New dedicated payload
-//{
-//    GENERATED_BODY()
-//
-////    UPROPERTY(BlueprintReadWrite, Category = "Perf")
-////    FLlamaPerformanceMetrics LlamaMetrics;
-////
-////    UPROPERTY(BlueprintReadWrite, Category = "Perf")
-////    FGamePerformanceMetrics GameMetrics;
-//};
+// Llama thread measurements for one ProcessInputAndGenerate call, plus what happened to the context since the previous one
+USTRUCT(BlueprintType)
+struct FLlamaPerformanceMetrics
+{
+    GENERATED_BODY()
+
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    FString InputType; // "user", "tool"
+
+    // Turn prompt tokens decoded (the part not already in the KV cache) and how long that took
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    int32 PromptTokens = 0;
+
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    float PromptMs = 0.0f;
+
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    int32 GeneratedTokens = 0;
+
+    // First sampled token to the end of generation
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    float GenerateMs = 0.0f;
+
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    float AvgTimePerGeneratedTokenMs = 0.0f;
+
+    // From the start of the turn on the Llama thread, so it includes pruning and the prompt decode but not the input's queue wait
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    float TimeToFirstTokenMs = 0.0f;
+
+    // Whole turn on the Llama thread
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    float TurnMs = 0.0f;
+
+    // From llama_perf_sampler: time inside the sampler chain (grammar included) and the number of samples
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    float SamplingTimeMs = 0.0f;
+
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    int32 SamplesTaken = 0;
+
+    // Speculative decoding: tokens the draft model proposed, how many the main model accepted, and the draft's own time
+    // (including bringing its context up to date). bSpeculationFellBack: acceptance was too low and the turn finished without it.
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    int32 DraftedTokens = 0;
+
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    int32 AcceptedDraftTokens = 0;
+
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    float DraftAcceptanceRate = 0.0f;
+
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    float DraftMs = 0.0f;
+
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    bool bSpeculationFellBack = false;
+
+    // PruneConversationHistory, including any KV shift it did
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    float PruneMs = 0.0f;
+
+    // Tokens already in the KV cache that had to be decoded again: by context block updates since the previous turn,
+    // and by this turn's prune when it invalidated the surviving history rather than shifting it
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    int32 RedecodeTokens = 0;
+
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    int32 BlockUpdates = 0;
+
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    float BlockUpdateMs = 0.0f;
+
+    // How long this input waited in the game -> Llama queue, and the average/max over everything that queue ran since the previous turn
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    float InputQueueWaitMs = 0.0f;
+
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    float MainToLlamaQueueWaitAvgMs = 0.0f;
+
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    float MainToLlamaQueueWaitMaxMs = 0.0f;
+
+    // Same for the Llama -> game queue, measured on the game thread when these metrics arrive
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    float LlamaToMainQueueWaitAvgMs = 0.0f;
+
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    float LlamaToMainQueueWaitMaxMs = 0.0f;
+
+    // KV cells in use at the end of the turn, against the context size
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    int32 KvCellsUsed = 0;
+
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    int32 ContextSize = 0;
+};
+
+USTRUCT(BlueprintType)
+struct FGamePerformanceMetrics
+{
+    GENERATED_BODY()
+
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    float FrameTimeMs = 0.0f;
+
+    // Time ULlamaComponent spent draining the Llama queue and token stream in its last tick
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    float LlamaTickMs = 0.0f;
+};
+
+// Distribution of one latency over the recent turns; the last count is everything above the last bound
+USTRUCT(BlueprintType)
+struct FLlamaLatencyHistogram
+{
+    GENERATED_BODY()
+
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    TArray<float> BucketUpperBoundsMs;
+
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    TArray<int32> Counts;
+
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    int32 SampleCount = 0;
+
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    float P50Ms = 0.0f;
+
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    float P95Ms = 0.0f;
+
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    float MaxMs = 0.0f;
+
+    void Build(TArray<float>& SamplesMs) // sorts SamplesMs
+    {
+        static const float Bounds[] = { 5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000 };
+        const int32 NumBounds = UE_ARRAY_COUNT(Bounds);
+        BucketUpperBoundsMs = TArray<float>(Bounds, NumBounds);
+        Counts.Init(0, NumBounds + 1);
+        SampleCount = SamplesMs.Num();
+        for (float Ms : SamplesMs) {
+            int32 Bucket = 0;
+            while (Bucket < NumBounds && Ms > Bounds[Bucket]) Bucket++;
+            Counts[Bucket]++;
+        }
+        SamplesMs.Sort();
+        P50Ms = SampleCount ? SamplesMs[(SampleCount - 1) / 2] : 0.0f;
+        P95Ms = SampleCount ? SamplesMs[FMath::Min(SampleCount - 1, FMath::CeilToInt(SampleCount * 0.95f) - 1)] : 0.0f;
+        MaxMs = SampleCount ? SamplesMs.Last() : 0.0f;
+    }
+};
+
+// Broadcast by ULlamaComponent after every turn: the latest turn, the game side, and histograms over the recent window
+USTRUCT(BlueprintType)
+struct FPerformanceUIPayload
+{
+    GENERATED_BODY()
+
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    FLlamaPerformanceMetrics LlamaMetrics;
+
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    FGamePerformanceMetrics GameMetrics;
+
+    // Turns the histograms cover (ULlamaComponent::PerformanceHistoryLength at most)
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    int32 TurnsInWindow = 0;
+
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    FLlamaLatencyHistogram TimeToFirstToken;
+
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    FLlamaLatencyHistogram PromptDecode;
+
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    FLlamaLatencyHistogram MsPerGeneratedToken;
+
+    UPROPERTY(BlueprintReadOnly, Category = "Perf")
+    FLlamaLatencyHistogram InputQueueWait;
+};
 
 // Represents a single colored segment in the visualization bar
 USTRUCT(BlueprintType)
@@ -121,6 +235,10 @@ struct FContextVisBlock
     UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ContextVis")
     FText TooltipText; // Optional: Text to show on hover
 
+    // Length of this block, in tokens (NormalizedHeight is clamped for visibility, so it can't be compared exactly)
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "ContextVis")
+    int32 LengthInTokens = 0;
+
     FContextVisBlock() = default;
 
     FContextVisBlock(EContextVisBlockType InType, int32 InTokenCursor, float InStart, float InHeight, FLinearColor InColor, FText InTooltip = FText())
@@ -134,10 +252,25 @@ struct FContextVisPayload
 {
     GENERATED_BODY()
 
-    // All the colored blocks to draw, in order from bottom to top
+    // All the colored blocks to draw, in order from bottom to top.
+    // Between the Llama thread and LLInternal's game-thread side this holds only the changed blocks (see ChangedBlockIndices);
+    // by the time it reaches OnLlamaContextChangedDelegate it is always the full, merged list.
     UPROPERTY(BlueprintReadWrite, Category = "ContextVis")
     TArray<FContextVisBlock> Blocks;
 
+    // Indices of the blocks that changed since the previous payload. After merging these index into Blocks,
+    // so a consumer holding a copy of Blocks only needs to patch these entries.
+    UPROPERTY(BlueprintReadWrite, Category = "ContextVis")
+    TArray<int32> ChangedBlockIndices;
+
+    // Number of blocks in the full list
+    UPROPERTY(BlueprintReadWrite, Category = "ContextVis")
+    int32 TotalBlockCount = 0;
+
+    // True when every block is included (the first payload); consumers should replace rather than patch
+    UPROPERTY(BlueprintReadWrite, Category = "ContextVis")
+    bool bIsFullSnapshot = true;
+
     // The total token capacity of the LLM's context window (e.g., llama_n_ctx())
     UPROPERTY(BlueprintReadWrite, Category = "ContextVis")
     int32 TotalTokenCapacity = 32768;
@@ -47,7 +47,7 @@ private:
     TSharedPtr<SLLContextVisualizer> SlateVisualizerWidget;
 
     // Cached data received from the LlamaComponent's delegate.
-    // The Slate widget's attributes will bind to getters for these.
+    // The Slate widget reads CachedBlocks in place; the scalar attributes bind to getters for the rest.
     UPROPERTY() // Keep UPROPERTY for GC
     TArray<FContextVisBlock> CachedBlocks;
     UPROPERTY()
@@ -66,7 +66,6 @@ private:
     void HandleLlamaContextChanged(const FContextVisPayload& NewContextState);
 
     // Getter functions for Slate attribute binding
-    TArray<FContextVisBlock> GetCachedBlocks() const;
     int32 GetCachedTotalCapacity() const;
     int32 GetCachedKvCacheCount() const;
     bool GetCachedStaticWorldInfoUpToDate() const;
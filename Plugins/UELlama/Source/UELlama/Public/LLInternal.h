@@ -7,9 +7,12 @@
 #include <thread>
 #include <functional>
 #include <mutex>
+#include <condition_variable>
+#include <chrono>
 #include "llama.h"
 
 #include "LLContextVisualizationData.h"
+#include "LLTokenStream.h"
 
 #include "LLInternal.generated.h"
 
@@ -22,38 +25,103 @@ using namespace std;
 
 namespace
 {
+	// Work queue between the game thread and the Llama thread. Consumers either poll (processQ, game thread tick)
+	// or block on a condition variable until work or shutdown arrives (waitAndProcessQ, Llama thread).
 	class Q
 	{
 	public:
 		void enqueue(function<void()>);
 		bool processQ();
+		bool waitAndProcessQ();		// blocks; returns false once shutdown() has been called
+		void shutdown();
+
+		// Queue wait = time an item sat in the queue between enqueue and the start of its execution
+		uint64_t getProcessedCount() const { return processedCount.load(std::memory_order_relaxed); }
+		double getTotalWaitMs() const { return totalWaitUs.load(std::memory_order_relaxed) / 1000.0; }
+		double getMaxWaitMs() const { return maxWaitUs.load(std::memory_order_relaxed) / 1000.0; }
+
+		// Consumer thread only: the wait of the item now running, and the waits of everything run since the previous takeWaitWindow
+		struct WaitWindow { uint64_t count = 0; double avgMs = 0.0; double maxMs = 0.0; };
+		double getLastWaitMs() const { return lastWaitUs / 1000.0; }
+		WaitWindow takeWaitWindow();
 
 	private:
-		deque<function<void()>> q;
+		struct Item {
+			function<void()> fn;
+			chrono::steady_clock::time_point enqueuedAt;
+		};
+		bool popAndRun(unique_lock<mutex>& l);
+
+		deque<Item> q;
 		mutex mutex_;
+		condition_variable cv_;
+		bool bShutdown = false;
+		atomic<uint64_t> processedCount = 0;
+		atomic<uint64_t> totalWaitUs = 0;
+		atomic<uint64_t> maxWaitUs = 0;
+		uint64_t lastWaitUs = 0, windowCount = 0, windowTotalUs = 0, windowMaxUs = 0; // consumer thread
 	};
 
 	void Q::enqueue(function<void()> v)
 	{
-		lock_guard l(mutex_);
-		q.emplace_back(std::move(v));
+		{
+			lock_guard l(mutex_);
+			q.push_back({std::move(v), chrono::steady_clock::now()});
+		}
+		cv_.notify_one();
+	}
+
+	// called with the lock held and q non-empty; runs the item unlocked
+	bool Q::popAndRun(unique_lock<mutex>& l) {
+		Item item = std::move(q.front());
+		q.pop_front();
+		l.unlock();
+		uint64_t waitUs = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - item.enqueuedAt).count();
+		processedCount.fetch_add(1, std::memory_order_relaxed);
+		totalWaitUs.fetch_add(waitUs, std::memory_order_relaxed);
+		if (waitUs > maxWaitUs.load(std::memory_order_relaxed)) maxWaitUs.store(waitUs, std::memory_order_relaxed);
+		lastWaitUs = waitUs;
+		windowCount++;
+		windowTotalUs += waitUs;
+		if (waitUs > windowMaxUs) windowMaxUs = waitUs;
+		item.fn();
+		return true;
 	}
 
 	bool Q::processQ() {
-		function<void()> v;
+		unique_lock l(mutex_);
+		if (q.empty()) {
+			return false;
+		}
+		return popAndRun(l);
+	}
+
+	bool Q::waitAndProcessQ() {
+		unique_lock l(mutex_);
+		cv_.wait(l, [this]() { return bShutdown || !q.empty(); });
+		if (bShutdown) {
+			return false;
+		}
+		return popAndRun(l);
+	}
+
+	Q::WaitWindow Q::takeWaitWindow() {
+		WaitWindow w;
+		w.count = windowCount;
+		w.avgMs = windowCount ? windowTotalUs / 1000.0 / windowCount : 0.0;
+		w.maxMs = windowMaxUs / 1000.0;
+		windowCount = windowTotalUs = windowMaxUs = 0;
+		return w;
+	}
+
+	void Q::shutdown()
+	{
 		{
 			lock_guard l(mutex_);
-			if (q.empty()) {
-				return false;
-			}
-			v = std::move(q.front());
-			q.pop_front();
+			bShutdown = true;
 		}
-		v();
-		return true;
+		cv_.notify_all();
 	}
-
-	constexpr int n_threads = 4;
 } // namespace
 
 
@@ -70,6 +138,70 @@ enum class ELlamaContextBlockType : uint8
     COUNT UMETA(Hidden) // For iterating if needed
 };
 
+// Scheduling priority for dedicated inference threadpool threads (ggml_sched_priority)
+UENUM(BlueprintType)
+enum class ELlamaThreadPriority : uint8
+{
+	Normal,
+	Medium,
+	High,
+	Realtime
+};
+
+// Per-deployment settings, copied from ULlamaComponent to the Llama thread before InitializeLlama_LlamaThread
+struct FLlamaRuntimeConfig
+{
+	// KV snapshots: the decoded fixed blocks are saved to disk, keyed by model + block tokens,
+	// so a later start with the same prompt restores the cache instead of re-evaluating it
+	bool bUseKvSnapshots = true;
+	FString KvSnapshotDirectory;		// empty = <ProjectSaved>/LlamaKV
+
+	// Prompt ingest: tokens per llama_decode call (n_batch) and the physical micro-batch it is split into (n_ubatch)
+	int32 PromptBatchSize = 2048;
+	int32 PromptMicroBatchSize = 512;
+
+	// History pruning: cut evicted turns out of the KV cache and shift the rest down, rather than re-decoding all survivors
+	bool bIncrementalHistoryPrune = true;
+
+	// Context layout: place the volatile LowFrequencyState block after the conversation (as its own system message)
+	// instead of before it, so a status change re-decodes only that block and the HFS rather than the whole history.
+	// The cost is that each new turn re-decodes the block, since the history it follows has grown.
+	bool bVolatileBlocksAfterHistory = false;
+
+	// Context visualization: per-token/per-chunk updates are coalesced to at most this many per second (0 = every update)
+	float ContextVisUpdateHz = 10.0f;
+
+	// Inference threads: generation (one token per decode, memory bound) and batch (prompt ingest, compute bound).
+	// 0 = one less than the physical core count, leaving a core for the game thread.
+	int32 GenerationThreads = 0;
+	int32 BatchThreads = 0;
+
+	// Dedicated ggml threadpools attached to the context instead of ggml's own; these are what carry affinity and priority.
+	// Thread counts can still be changed at runtime (SetThreadCounts_LlamaThread), up to the size the pool was created with.
+	bool bUseDedicatedThreadpools = false;
+	ELlamaThreadPriority ThreadpoolPriority = ELlamaThreadPriority::Normal;
+	FString GenerationCpuAffinity;		// CPU list such as "0-7,16-23"; empty = no affinity
+	FString BatchCpuAffinity;			// empty = same as GenerationCpuAffinity
+	bool bStrictCpuPlacement = false;	// pin each thread to one CPU of the list rather than letting it float over all of them
+	int32 ThreadpoolPoll = 0;			// 0 = workers sleep between graphs; up to 100 = spin for lower latency at the cost of idle CPU
+
+	// Speculative decoding: a small draft model with the same vocabulary proposes SpeculativeDraftTokens tokens after each
+	// generated one, and the main model checks them all in one batched decode. Empty path = off. Once
+	// SpeculativeFallbackWindow tokens have been drafted in a turn, an acceptance rate below SpeculativeMinAcceptance
+	// switches the rest of that turn back to one decode per token.
+	FString DraftModelPath;
+	int32 SpeculativeDraftTokens = 4;
+	float SpeculativeMinAcceptance = 0.4f;
+	int32 SpeculativeFallbackWindow = 32;
+
+	// Agents: extra conversations (rival submarines, other crew personalities) on sequences 1..MaxAgents of the same
+	// context. Each forks the decoded prefix blocks from sequence 0 instead of decoding its own copy, and agents with
+	// pending input share every llama_decode. AgentMaxTokens bounds one agent's persona + history + HFS.
+	int32 MaxAgents = 0;
+	int32 AgentMaxTokens = 4096;
+	int32 AgentMaxReplyTokens = 256;
+};
+
 class LLInternal
 {
 public:
@@ -79,44 +211,115 @@ public:
 	// MODIFIED/NEW API for Llama thread
 	void InitializeLlama_LlamaThread(const FString& ModelPath, const FString& InitialSystemPrompt, const FString& Systems, const FString& LowFreq /*, other params */);
 	void ShutdownLlama_LlamaThread();
-	void UpdateContextBlock_LlamaThread(ELlamaContextBlockType BlockType, const FString& NewTextContent);
+	void UpdateContextBlock_LlamaThread(ELlamaContextBlockType BlockType, const FString& NewTextContent); // applies now unless a turn is running
+	int32 SubmitContextBlock(ELlamaContextBlockType BlockType, const FString& NewTextContent); // any thread; returns the block's generation number
 	void ProcessInputAndGenerate_LlamaThread(const FString& InputText, const FString& HighFrequencyContextText, const FString& InputTypeHint);
 	void RequestFullContextDump_LlamaThread(); // Renamed for clarity
-	void SignalStopRunning() { bIsRunning = false; }
+	void SignalStopRunning() {
+		bIsRunning = false;
+		qMainToLlama.shutdown();
+		{ std::lock_guard<std::mutex> Lock(TokenStreamSpaceMutex); }
+		TokenStreamSpaceCv.notify_all(); // a producer blocked on a full stream
+	}
+	void SetRuntimeConfig_LlamaThread(const FLlamaRuntimeConfig& InConfig) { Config = InConfig; }
+	void SetToolCallGrammar_LlamaThread(const FString& GrammarGbnf);
+	void SetThreadCounts_LlamaThread(int32 GenerationThreads, int32 BatchThreads); // 0 = auto; takes effect on the next decode
+
+	// Agents, AgentId 1..Config.MaxAgents (it is also the agent's sequence id). Input queued for several agents before
+	// their turns run is decoded and generated in the same batches; each reply arrives through agentReplyCb.
+	void CreateAgent_LlamaThread(int32 AgentId, const FString& PersonaText); // replaces the persona if the agent exists
+	void RemoveAgent_LlamaThread(int32 AgentId);
+	void QueueAgentInput_LlamaThread(int32 AgentId, const FString& InputText, const FString& HighFrequencyContextText, const FString& InputTypeHint);
 
 	// these generally send a broadcast to Unreal blueprints; only two do anything else
 	std::function<void(FString)> tokenCb;
 	std::function<void(FString)> fullContextDumpCb;
 	std::function<void(FString)> errorCb;    // For errors
 	std::function<void(float)> progressCb;   // For loading
-	std::function<void(const FContextVisPayload&)> contextChangedCb;    // For context change update
+	std::function<void(FContextVisPayload&)> contextChangedCb;    // For context change update; gets the merged full payload, may fill in flags
 	std::function<void(FString)> readyCb;    // For ready, sets bIsLlamaCoreReady and broadcasts
 	std::function<void(FString)> toolCallCb; // For tool calls, DO THE TOOL CALL PROCESS, call SendToolResponseToLlama (no broadcast)
 	std::function<void(bool)> setIsGeneratingCb; // copy the busy flag up the chain
+	std::function<void()> endOfTurnCb;       // generation for the last input has finished
+	std::function<void(const FLlamaPerformanceMetrics&)> turnStatsCb; // measurements for the last input (via qLlamaToMain, ahead of its end of turn)
+	std::function<void(ELlamaContextBlockType, int32)> contextBlockAppliedCb; // a submitted block generation is now in the KV cache
+	std::function<void(int32, FString)> agentReplyCb; // an agent's finished reply
+	std::function<void(int32, FString)> agentErrorCb; // an agent's turn failed; no reply comes for that input
+
+	// Token text, tool calls, context changes and end-of-turn arrive through TokenStream rather than qLlamaToMain;
+	// the game thread calls this each tick with its per-tick record budget. qLlamaToMain items drain the records
+	// pushed before them first, so the two arrive in the order the Llama thread sent them.
+	int32 DrainTokenStream_MainThread(int32 MaxRecords);
 
 private:
 	std::string AssembleFullContextForDump();
 	void DetokenizeAndAppend(std::string& TargetString, const std::vector<llama_token>& TokensToDetokenize, const llama_model* ModelHandle);
 	std::string CleanString(std::string p_str);
+	static int32 CleanTokenPiece(const char* Piece, char* Out, int32 OutCapacity);
+	void StreamEvent_LlamaThread(ELlamaStreamEvent Type, const char* Data = nullptr, uint32 Length = 0);
+	void StreamText_LlamaThread(ELlamaStreamEvent Type, const FString& Text);
+	void PostToMain_LlamaThread(std::function<void()> Fn);
 	void RebuildFlatConversationHistoryTokensFromStructured();
 	void BroadcastContextVisualUpdate_LlamaThread(int32 nTokens=0, float msDecode=0.0f, float msGenerate=0.0f);
+	void RequestContextVisualUpdate_LlamaThread(int32 nTokens, float sDecode, float sGenerate); // rate-limited by Config.ContextVisUpdateHz
 	void LlamaLogContext(FString Label);
 
 	// --- Threading & Queues ---
 public:
 	Q qMainToLlama;
 	Q qLlamaToMain;
+	FLlamaTokenStream TokenStream;
 
 private:
+	// the Llama thread blocks here when TokenStream is full; DrainTokenStream_MainThread wakes it
+	std::mutex TokenStreamSpaceMutex;
+	std::condition_variable TokenStreamSpaceCv;
+
+	// newest context visualization delta, handed over by a ContextChanged record; deltas that arrive
+	// before the game thread consumes it are merged into it
+	FCriticalSection PendingContextPayloadLock;
+	FContextVisPayload PendingContextPayload;
+	std::atomic<bool> bContextPayloadPending = false;
+
+	// Llama thread: the blocks as last sent, to diff against; and the throttle clock
+	TArray<FContextVisBlock> LastSentContextBlocks;
+	bool bContextVisFullSnapshotSent = false;
+	double LastContextVisBroadcastTime = 0.0;
+
+	// Game thread: the full block list with every delta applied
+	FContextVisPayload MergedContextPayload;
+
+private:
+	FLlamaRuntimeConfig Config;
+
 	// --- Core Llama State ---
 	llama_model* model = nullptr;
 	llama_context* ctx = nullptr;
 	llama_batch batch;
 	int32_t batch_capacity; // store the capacity
 	llama_sampler* sampler_chain_instance = nullptr;
+	llama_sampler* tool_call_grammar_sampler = nullptr; // lazy GBNF sampler inside the chain (not separately owned)
+	std::string ToolCallGrammar;
 	const llama_vocab* vocab = nullptr;
 	int32_t n_ctx_from_model = 0; // Actual context window size
 
+	// --- Threading (Llama Thread) ---
+	ggml_threadpool_t GenerationThreadpool = nullptr;	// only with Config.bUseDedicatedThreadpools
+	ggml_threadpool_t BatchThreadpool = nullptr;		// may be the same pool as GenerationThreadpool
+	static int32 ResolveThreadCount(int32 Requested);
+	void CreateThreadpools_LlamaThread(int32 GenerationThreads, int32 BatchThreads);
+	void FreeThreadpools_LlamaThread(); // after the context that uses them is freed
+
+	// --- Speculative decoding (Llama Thread, only with Config.DraftModelPath) ---
+	llama_model* draft_model = nullptr;
+	llama_context* draft_ctx = nullptr;
+	llama_batch draft_batch = {};
+	llama_sampler* draft_sampler = nullptr;		// greedy
+	std::vector<llama_token> DraftKvTokens;		// what the draft context's sequence 0 holds
+	bool InitializeDraftModel_LlamaThread(const llama_model_params& ModelParams, const llama_context_params& CtxParams);
+	void FreeDraftModel_LlamaThread();
+	void DraftTokens_LlamaThread(llama_token LastToken, int32 MaxDraft, std::vector<llama_token>& OutDraft); // proposes tokens to follow LastToken
+
 	// --- Context Block Management (Llama Thread Owned) ---
 	struct FTokenizedContextBlock {
 		std::vector<llama_token> Tokens;
@@ -140,6 +343,20 @@ private:
 		std::vector<llama_token> Tokens;
 	};
 	std::deque<FConversationTurn> StructuredConversationHistory; // For logical turn management
+
+	// --- Chat template tokens (tokenized once per loaded model) ---
+	struct FChatTemplateTokens {
+		TMap<FString, std::vector<llama_token>> RolePrefixes; // "<|im_start|>{role}\n", keyed by role; unknown roles are added on first use
+		std::vector<llama_token> TurnSuffix;      // "<|im_end|>\n"
+		std::vector<llama_token> HfsPrefix;       // "<|im_start|>system\n[Submarine Status:]\n"
+		std::vector<llama_token> HfsSuffix;       // "\n<|im_end|>\n"
+		std::vector<llama_token> AssistantPrefix; // "<|im_start|>assistant\n", cues generation
+	};
+	FChatTemplateTokens ChatTemplate;
+	void BuildChatTemplateTokens_LlamaThread();
+	const std::vector<llama_token>& RolePrefixTokens(const FString& Role);
+	void AppendTurnToFlatHistory(const FConversationTurn& Turn); // prefix + tokens + suffix onto ConversationHistoryTokens
+	void AppendHighFrequencyStateTokens(std::vector<llama_token>& OutTokens) const;
 	const int32 MAX_CONVERSATION_TOKENS_TARGET = 16384; // Target, will try to stay below this. Adjust based on n_ctx and fixed blocks.
 													   // Example: if n_ctx=32k, fixed=4k, HFS=1k, AI response buffer=1k, then convo can be ~26k
 													   // This should be calculated dynamically based on n_ctx and other blocks.
@@ -155,6 +372,7 @@ private:
 
 	// --- Helper Methods (Llama Thread) ---
 	void ThreadRun_LlamaThread(); // Renamed for clarity
+	void BuildSamplerChain_LlamaThread();
 	void _TokenizeAndStoreFixedBlockInternal(ELlamaContextBlockType BlockType, const FString& Text, bool bAddBosForThisBlock);
 	void AssembleFullPromptForTurn(const FString& CurrentInputOriginalTextFStr, const FString& InputTypeHint, std::vector<llama_token>& OutFullPromptTokens);
 	void DecodeTokensAndSample(std::vector<llama_token>& TokensToDecode, bool bIsFinalPromptTokenLogits);
@@ -164,9 +382,74 @@ private:
 	std::string AssembleFullContextForDump_LlamaThread(); // Renamed
 	void StopSeqHelper(const FString& stopSeqFStr);
 	void InvalidateKVCacheFromPosition(int32_t ValidTokenCount);
+	int32_t SyncKVCacheToTokens(const std::vector<llama_token>& TargetTokens); // keeps the cached prefix TargetTokens starts with, drops the rest
+
+	// --- Agents (Llama Thread) ---
+	struct FLlamaAgent {
+		llama_seq_id SeqId = 0;
+		std::vector<llama_token> PersonaTokens;	// content only; sent as a system message after the prefix blocks
+		std::deque<FConversationTurn> History;
+		std::vector<llama_token> HfsTokens;
+		std::vector<llama_token> KvTokens;		// what its sequence holds, the forked prefix included
+		llama_sampler* Sampler = nullptr;		// own chain, so penalties only see this agent's tokens
+		bool bHasPendingInput = false;
+		// turn in progress
+		std::vector<llama_token> PromptTokens;	// not yet decoded
+		int32 PromptCursor = 0;
+		std::vector<llama_token> ReplyTokens;
+		int32 TokensInBatch = 0;
+		int32 LogitsIndex = -1;				// row of its last batched token, if that one has logits
+	};
+	TMap<int32, FLlamaAgent> Agents;
+	bool bAgentTurnsQueued = false;
+	bool bAgentTurnsDeferred = false;		// a pass found the generation lock taken; rerun when it is released
+	void AppendAgentContextTokens(const FLlamaAgent& Agent, std::vector<llama_token>& OutTokens);
+	void QueueAgentTurns_LlamaThread();
+	void RunDeferredAgentTurns_LlamaThread();
+	void RunAgentTurns_LlamaThread();
+	void FinishAgentTurn_LlamaThread(int32 AgentId, FLlamaAgent& Agent);
+	void FreeAgents_LlamaThread();
+
+	// --- Pending context block updates ---
+	// One slot per block holds the newest submitted text; a submission while a turn is running (or while an apply is
+	// already queued) just replaces it. Slots are taken at the start of each turn, where the prompt diff decodes them,
+	// or by a queued apply between turns that re-decodes all of them at once.
+	struct FPendingContextBlock {
+		FString Text;
+		int32 Generation = 0;
+		bool bPending = false;
+	};
+	FCriticalSection PendingContextBlocksLock;
+	FPendingContextBlock PendingContextBlocks[(int32)ELlamaContextBlockType::COUNT];
+	int32 LastContextBlockGeneration = 0;			// under PendingContextBlocksLock
+	std::atomic<bool> bContextBlockApplyQueued = false;
+	TArray<TPair<ELlamaContextBlockType, int32>> AppliedContextBlocks; // Llama thread: retokenized, reported once decoded
+	int32 StageContextBlock(ELlamaContextBlockType BlockType, const FString& NewTextContent);
+	bool TakePendingContextBlocks_LlamaThread();	// retokenizes every pending block; true if any
+	void ApplyPendingContextBlocks_LlamaThread();	// between turns: take, then one diff and re-decode
+	void ReportAppliedContextBlocks_LlamaThread();
+
+	// --- Context layout (Llama Thread) ---
+	bool IsTailBlock(ELlamaContextBlockType BlockType) const; // sits after the conversation history (Config.bVolatileBlocksAfterHistory)
+	int32 PrefixBlocksTokenCount() const;	// fixed block tokens before the conversation history
+	void AppendContextTokens(std::vector<llama_token>& OutTokens) const; // prefix blocks, history, tail blocks, HFS: what every prompt starts with
+	bool RemoveKVCacheRangeAndShift(int32_t RangeStart, int32_t RangeLength, const std::vector<llama_token>& ExpectedRangeTokens);
+	bool IngestPromptTokens_LlamaThread(const llama_token* Tokens, int32_t NumTokens, bool bLogitsForLastToken, const TCHAR* Label, bool bReportLoadingProgress = false);
+
+	// --- Fixed block KV snapshots (Llama Thread) ---
+	FString MakeFixedBlocksSnapshotPath(const FString& ModelPath, const std::vector<llama_token>& FixedTokens) const;
+	bool TryRestoreFixedBlocksSnapshot(const FString& SnapshotPath, const std::vector<llama_token>& FixedTokens);
+	void SaveFixedBlocksSnapshot(const FString& SnapshotPath, const std::vector<llama_token>& FixedTokens);
 
 	// Temporary buffer for tokens generated in the current AI response
 	std::vector<llama_token> CurrentTurnAIReplyTokens;
+
+	// Measurements for the input being processed, and the block updates that will be charged to the next one
+	FLlamaPerformanceMetrics CurrentTurnStats;
+	double TurnStartTime = 0.0;
+	int32 PendingBlockUpdates = 0;
+	int32 PendingRedecodeTokens = 0;
+	double PendingBlockUpdateMs = 0.0;
 };
 
 
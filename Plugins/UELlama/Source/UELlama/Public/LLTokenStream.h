@@ -0,0 +1,103 @@
+// LLTokenStream.h
+// Single-producer (Llama thread) / single-consumer (game thread) stream of generated text and small events.
+// Token bytes go into a fixed byte ring and each event is a fixed-size record pointing into it, so streaming
+// a long generation does no heap allocation on the Llama thread and no locking on either side.
+
+#pragma once
+
+#include <CoreMinimal.h>
+#include <atomic>
+#include <vector>
+
+enum class ELlamaStreamEvent : uint8
+{
+	Token,            // UTF-8 text for the dialogue output
+	ToolCall,         // UTF-8 JSON payload of a <tool_call>
+	ContextChanged,   // no bytes; the payload itself is coalesced elsewhere (see LLInternal::PendingContextPayload)
+	EndOfTurn         // no bytes; generation for the current input has finished
+};
+
+class FLlamaTokenStream
+{
+public:
+	// capacities must be powers of two
+	explicit FLlamaTokenStream(uint32 InByteCapacity = 1 << 16, uint32 InRecordCapacity = 1 << 12)
+		: Bytes(InByteCapacity), Records(InRecordCapacity)
+	{
+		check(FMath::IsPowerOfTwo(InByteCapacity) && FMath::IsPowerOfTwo(InRecordCapacity));
+	}
+
+	// --- Producer (Llama thread) ---
+
+	// Returns false (writing nothing) if either ring is full; the caller decides whether to wait and retry.
+	bool Push(ELlamaStreamEvent Type, const char* Data = nullptr, uint32 Length = 0)
+	{
+		const uint64 ByteHeadNow = ByteHead.load(std::memory_order_relaxed);
+		const uint32 RecordHeadNow = RecordHead.load(std::memory_order_relaxed);
+		if (Length > Bytes.size()) return false; // can never fit
+		if (ByteHeadNow + Length - ByteTail.load(std::memory_order_acquire) > Bytes.size()) return false;
+		if (RecordHeadNow - RecordTail.load(std::memory_order_acquire) >= Records.size()) return false;
+
+		const uint32 Mask = Bytes.size() - 1;
+		for (uint32 i = 0; i < Length; i++) Bytes[(ByteHeadNow + i) & Mask] = Data[i];
+		Records[RecordHeadNow & (Records.size() - 1)] = { ByteHeadNow, Length, Type };
+
+		ByteHead.store(ByteHeadNow + Length, std::memory_order_release);
+		RecordHead.store(RecordHeadNow + 1, std::memory_order_release);
+		return true;
+	}
+
+	// --- Consumer (game thread) ---
+
+	// Calls Handler(ELlamaStreamEvent, const char* Data, uint32 Length) for up to MaxRecords records (<= 0 means all
+	// available). Data is only valid during the call. Returns the number of records handled.
+	template <typename FuncType>
+	int32 Drain(int32 MaxRecords, FuncType&& Handler)
+	{
+		const uint32 Available = RecordHead.load(std::memory_order_acquire) - RecordTail.load(std::memory_order_relaxed);
+		const uint32 Count = (MaxRecords > 0) ? FMath::Min<uint32>(Available, MaxRecords) : Available;
+		uint32 Tail = RecordTail.load(std::memory_order_relaxed);
+		for (uint32 n = 0; n < Count; n++, Tail++) {
+			const FRecord Record = Records[Tail & (Records.size() - 1)];
+			const uint32 Mask = Bytes.size() - 1;
+			const uint32 Start = Record.ByteStart & Mask;
+			if (Start + Record.Length <= Bytes.size()) {
+				Handler(Record.Type, Bytes.data() + Start, Record.Length);
+			} else {
+				// record wraps the end of the byte ring; stitch it in a scratch buffer that is reused between calls
+				Scratch.resize(FMath::Max<size_t>(Scratch.size(), Record.Length));
+				const uint32 FirstPart = Bytes.size() - Start;
+				FMemory::Memcpy(Scratch.data(), Bytes.data() + Start, FirstPart);
+				FMemory::Memcpy(Scratch.data() + FirstPart, Bytes.data(), Record.Length - FirstPart);
+				Handler(Record.Type, Scratch.data(), Record.Length);
+			}
+			ByteTail.store(Record.ByteStart + Record.Length, std::memory_order_release);
+			RecordTail.store(Tail + 1, std::memory_order_release);
+		}
+		return Count;
+	}
+
+	// Producer: records pushed so far. Consumer: records drained so far. Both wrap at 2^32.
+	uint32 NumPushed() const { return RecordHead.load(std::memory_order_relaxed); }
+	uint32 NumDrained() const { return RecordTail.load(std::memory_order_relaxed); }
+
+	bool IsEmpty() const { return RecordHead.load(std::memory_order_acquire) == RecordTail.load(std::memory_order_acquire); }
+	uint32 NumPending() const { return RecordHead.load(std::memory_order_acquire) - RecordTail.load(std::memory_order_acquire); }
+
+private:
+	struct FRecord {
+		uint64 ByteStart;
+		uint32 Length;
+		ELlamaStreamEvent Type;
+	};
+
+	std::vector<char> Bytes;
+	std::vector<FRecord> Records;
+	std::vector<char> Scratch;	// consumer only
+
+	// producer-owned heads, consumer-owned tails, kept on separate cache lines
+	alignas(64) std::atomic<uint64> ByteHead = 0;
+	alignas(64) std::atomic<uint32> RecordHead = 0;
+	alignas(64) std::atomic<uint64> ByteTail = 0;
+	alignas(64) std::atomic<uint32> RecordTail = 0;
+};
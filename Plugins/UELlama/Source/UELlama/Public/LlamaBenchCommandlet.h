@@ -0,0 +1,42 @@
+// LlamaBenchCommandlet.h
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "LlamaBenchCommandlet.generated.h"
+
+/**
+ * Headless benchmark: drives LLInternal directly against a local GGUF file, with no world or ULlamaComponent.
+ *
+ *   UnrealEditor-Cmd AIXO.uproject -run=LlamaBench -model=/models/aixo.gguf -out=bench.json -nullrhi -unattended
+ *
+ * Options (all optional except -model):
+ *   -prompt=Prompts/1.txt   system prompt, relative to Content/
+ *   -session=file.json      scripted session: {"systems":"...", "lowfreq":"...", "toolresponse":"...",
+ *                           "turns":[{"input":"...", "hfs":"..."}, ...]}; without it a built-in script is used
+ *   -turns=8                user turns for the built-in script
+ *   -updateevery=2          UpdateContextBlock(LowFrequencyState) before every Nth turn (0 = never)
+ *   -toolevery=3            send a tool response after every Nth turn, as well as after any real tool call (0 = only real ones)
+ *   -batch=2048 -ubatch=512 FLlamaRuntimeConfig prompt batch sizes
+ *   -threads=0 -batchthreads=0  generation / prompt threads (0 = physical cores minus one)
+ *   -threadpool -affinity=0-7   run on dedicated threadpools, optionally pinned to a CPU list
+ *   -nosnapshot             don't restore/save KV snapshots, so the cold start includes the fixed block decode
+ *   -volatiletail           place LowFrequencyState after the history (FLlamaRuntimeConfig::bVolatileBlocksAfterHistory)
+ *   -draft=/models/small.gguf -draftk=4 -draftmin=0.4   speculative decoding with a draft model, tokens per step, fallback acceptance
+ *   -agents=4               after the turns, one batched round of replies from that many agents (FLlamaRuntimeConfig::MaxAgents)
+ *   -timeout=600            seconds to wait for any one step
+ *   -out=file.json          where to write the report (default: the log)
+ *
+ * The report is one JSON object: cold start, per-turn prompt and generation tokens/sec, time to first token,
+ * prune stall, context update times, totals and the process's peak RSS. Returns non-zero if any step failed.
+ */
+UCLASS()
+class UELLAMA_API ULlamaBenchCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	ULlamaBenchCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
@@ -17,6 +17,11 @@ DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnLlamaErrorOccurred, const FString
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnLlamaLoadingProgressDelegate, float, Progress);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnLlamaReady, const FString&, ReadyMessage);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnLlamaContextChangedDelegate, const FContextVisPayload&, ContextMessage);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE(FOnLlamaTurnComplete);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnLlamaPerformanceUpdated, const FPerformanceUIPayload&, PerformancePayload);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnLlamaContextBlockApplied, ELlamaContextBlockType, BlockType, int32, Generation);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnLlamaAgentReply, int32, AgentId, const FString&, Reply);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnLlamaAgentError, int32, AgentId, const FString&, ErrorMessage);
 
 
 UCLASS(Category = "LLM", BlueprintType, meta = (BlueprintSpawnableComponent))
@@ -57,6 +62,25 @@ public:
     UPROPERTY(BlueprintAssignable, Category = "Llama")
     FOnLlamaContextChangedDelegate OnLlamaContextChangedDelegate;
 
+    UPROPERTY(BlueprintAssignable, Category = "Llama")
+    FOnLlamaTurnComplete OnLlamaTurnComplete;
+
+    // A generation returned by UpdateContextBlock is now in the KV cache (later generations supersede earlier ones unapplied)
+    UPROPERTY(BlueprintAssignable, Category = "Llama")
+    FOnLlamaContextBlockApplied OnLlamaContextBlockApplied;
+
+    // An agent's whole reply to its last input (agent replies are not streamed through OnNewTokenGenerated)
+    UPROPERTY(BlueprintAssignable, Category = "Llama|Agents")
+    FOnLlamaAgentReply OnLlamaAgentReply;
+
+    // An agent's turn failed and no reply will come for its last input
+    UPROPERTY(BlueprintAssignable, Category = "Llama|Agents")
+    FOnLlamaAgentError OnLlamaAgentError;
+
+    // After every input: that turn's metrics, the game side, and histograms over the last PerformanceHistoryLength turns
+    UPROPERTY(BlueprintAssignable, Category = "Llama|Perf")
+    FOnLlamaPerformanceUpdated OnLlamaPerformanceUpdated;
+
 	// setup variables
     UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Llama|Config")
     FString PathToModel;
@@ -64,16 +88,134 @@ public:
     UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Llama|Config", meta = (MultiLine = true))
     FString SystemPromptFileName;
 
+    // Save the decoded fixed context blocks to disk and restore them on the next start with the same model and prompt
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Llama|Config")
+    bool bUseKvSnapshots = true;
+
+    // Where KV snapshots are written; empty uses <ProjectSaved>/LlamaKV
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Llama|Config")
+    FString KvSnapshotDirectory;
+
+    // Prompt tokens per llama_decode call (llama n_batch); larger chunks amortize per-call overhead on CPU
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Llama|Config", meta = (ClampMin = "1"))
+    int32 PromptBatchSize = 2048;
+
+    // Physical micro-batch each chunk is split into (llama n_ubatch); bounded by PromptBatchSize
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Llama|Config", meta = (ClampMin = "1"))
+    int32 PromptMicroBatchSize = 512;
+
+    // When the conversation outgrows the context, remove the oldest turns from the KV cache and shift the rest down instead of re-decoding them
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Llama|Config")
+    bool bIncrementalHistoryPrune = true;
+
+    // Place LowFrequencyState after the conversation so a status update re-decodes only it and the HFS; each new turn then re-decodes it instead
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Llama|Config")
+    bool bVolatileBlocksAfterHistory = false;
+
+    // Max rate of context visualization updates while tokens are being decoded or generated; 0 = every token/chunk
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Llama|Config", meta = (ClampMin = "0"))
+    float ContextVisUpdateHz = 10.0f;
+
+    // Threads for token generation; 0 = physical cores minus one. Can be changed while running with SetThreadCounts.
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Llama|Threads", meta = (ClampMin = "0"))
+    int32 GenerationThreads = 0;
+
+    // Threads for prompt ingest (batch decode); 0 = physical cores minus one
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Llama|Threads", meta = (ClampMin = "0"))
+    int32 BatchThreads = 0;
+
+    // Run inference on dedicated threadpools, which is what applies the affinity, priority and polling settings below
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Llama|Threads")
+    bool bUseDedicatedThreadpools = false;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Llama|Threads", meta = (EditCondition = "bUseDedicatedThreadpools"))
+    ELlamaThreadPriority ThreadpoolPriority = ELlamaThreadPriority::Normal;
+
+    // CPUs for the generation threads, e.g. "0-7,16-23"; empty = no affinity
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Llama|Threads", meta = (EditCondition = "bUseDedicatedThreadpools"))
+    FString GenerationCpuAffinity;
+
+    // CPUs for the batch threads; empty = same as GenerationCpuAffinity
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Llama|Threads", meta = (EditCondition = "bUseDedicatedThreadpools"))
+    FString BatchCpuAffinity;
+
+    // Pin each thread to a single CPU from its list
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Llama|Threads", meta = (EditCondition = "bUseDedicatedThreadpools"))
+    bool bStrictCpuPlacement = false;
+
+    // How long idle pool threads spin before sleeping, 0-100; 0 keeps them off the CPU between decodes
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Llama|Threads", meta = (EditCondition = "bUseDedicatedThreadpools", ClampMin = "0", ClampMax = "100"))
+    int32 ThreadpoolPoll = 0;
+
+    // Small GGUF with the same vocabulary as PathToModel; when set, it drafts tokens for the main model to verify in batches
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Llama|Speculative")
+    FString DraftModelPath;
+
+    // Tokens drafted per step
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Llama|Speculative", meta = (ClampMin = "1", ClampMax = "16"))
+    int32 SpeculativeDraftTokens = 4;
+
+    // Below this share of drafted tokens accepted (after SpeculativeFallbackWindow drafted), the rest of the turn decodes one token at a time
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Llama|Speculative", meta = (ClampMin = "0", ClampMax = "1"))
+    float SpeculativeMinAcceptance = 0.4f;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Llama|Speculative", meta = (ClampMin = "1"))
+    int32 SpeculativeFallbackWindow = 32;
+
+    // Extra conversations sharing AIXO's context (one sequence each); they reuse its decoded prefix blocks. 0 = none.
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Llama|Agents", meta = (ClampMin = "0", ClampMax = "63"))
+    int32 MaxAgents = 0;
+
+    // Per-agent budget for persona + history + HFS, on top of the shared prefix blocks; oldest turns are dropped past it
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Llama|Agents", meta = (ClampMin = "256"))
+    int32 AgentMaxTokens = 4096;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Llama|Agents", meta = (ClampMin = "1"))
+    int32 AgentMaxReplyTokens = 256;
+
+    // Max token-stream records (tokens, tool calls, context updates) handled per tick; 0 = drain everything.
+    // A burst beyond the budget is spread over the following frames instead of landing in one.
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Llama|Config", meta = (ClampMin = "0"))
+    int32 TokenDrainBudgetPerTick = 64;
+
+    // Turns kept for the performance histograms
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Llama|Perf", meta = (ClampMin = "1"))
+    int32 PerformanceHistoryLength = 64;
+
 public:	// functions
+    // Never rejected: the newest text per block waits in a slot until the next turn boundary. Returns its generation number.
     UFUNCTION(BlueprintCallable, Category = "Llama")
-    void UpdateContextBlock(ELlamaContextBlockType BlockType, const FString& NewTextContent);
+    int32 UpdateContextBlock(ELlamaContextBlockType BlockType, const FString& NewTextContent);
+
+    // Latest generation of the block that has reached the KV cache (0 = only the initial text)
+    UFUNCTION(BlueprintPure, Category = "Llama")
+    int32 GetAppliedContextBlockGeneration(ELlamaContextBlockType BlockType) const { return AppliedContextBlockGenerations[(int32)BlockType]; }
 
     UFUNCTION(BlueprintCallable, Category = "Llama")
     void ProcessInput(const FString& InputText, const FString& HighFrequencyContextText, const FString& InputTypeHint);
 
+    // GBNF grammar applied to tool calls once the model emits <tool_call>; empty disables the constraint
+    UFUNCTION(BlueprintCallable, Category = "Llama")
+    void SetToolCallGrammar(const FString& GrammarGbnf);
+
+    // Change the inference thread counts without restarting (0 = default); with dedicated threadpools, capped at the pool sizes
+    UFUNCTION(BlueprintCallable, Category = "Llama|Threads")
+    void SetThreadCounts(int32 NewGenerationThreads, int32 NewBatchThreads);
+
     UFUNCTION(BlueprintCallable, Category = "Llama|Debug")
     void TriggerFullContextDump();
 
+    // Returns the new agent's id, or INDEX_NONE when all MaxAgents are in use
+    UFUNCTION(BlueprintCallable, Category = "Llama|Agents")
+    int32 CreateAgent(const FString& PersonaText);
+
+    UFUNCTION(BlueprintCallable, Category = "Llama|Agents")
+    void RemoveAgent(int32 AgentId);
+
+    // Inputs for several agents given in the same tick are generated together; each reply comes back via OnLlamaAgentReply
+    UFUNCTION(BlueprintCallable, Category = "Llama|Agents")
+    void ProcessAgentInput(int32 AgentId, const FString& InputText, const FString& HighFrequencyContextText, const FString& InputTypeHint);
+
 private:
     LLInternal* LlamaImpl;
 
@@ -84,8 +226,23 @@ public:
     UFUNCTION(BlueprintPure, Category = "Llama")
     bool IsLlamaReady() const { return bIsLlamaCoreReady; }
 
+    UFUNCTION(BlueprintPure, Category = "Llama|Perf")
+    FPerformanceUIPayload GetPerformancePayload() const { return PerformancePayload; }
+
 private:
     bool bIsLlamaGenerating; // This is set by Llama thread via a callback when it starts/stops generation.
     bool bIsLlamaCoreReady = false; // Set by callback from Llama thread
+
+    // Per block: the last generation handed to UpdateContextBlock and the last one reported applied
+    int32 SubmittedContextBlockGenerations[(int32)ELlamaContextBlockType::COUNT] = {};
+    int32 AppliedContextBlockGenerations[(int32)ELlamaContextBlockType::COUNT] = {};
+
+    TSet<int32> AgentIds;
+
+    // Rolling window of per-turn metrics behind the histograms (a ring once full)
+    void RecordPerformanceMetrics(const FLlamaPerformanceMetrics& Metrics);
+    TArray<FLlamaPerformanceMetrics> PerformanceHistory;
+    int32 PerformanceHistoryNext = 0;
+    FPerformanceUIPayload PerformancePayload;
 };
 
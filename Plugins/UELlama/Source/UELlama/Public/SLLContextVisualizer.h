@@ -9,7 +9,8 @@ class UELLAMA_API SLLContextVisualizer : public SLeafWidget
 {
 public:
     SLATE_BEGIN_ARGS(SLLContextVisualizer)
-        : _TotalTokenCapacity(32768)
+        : _ContextBlocksSource(nullptr)
+        , _TotalTokenCapacity(32768)
         , _KvCacheDecodedTokenCount(0)
         , _IsStaticWorldInfoUpToDate(true)
 		, _IsLowFrequencyStateUpToDate(true)
@@ -19,7 +20,8 @@ public:
 		, _FmsPerTokenGenerate(0.0f)
     {}
         SLATE_ATTRIBUTE(int32, TotalTokenCapacity)
-        SLATE_ATTRIBUTE(TArray<FContextVisBlock>, ContextBlocks)
+        // Read in place at paint time (no per-frame copy); the owner keeps the array alive for the widget's lifetime
+        SLATE_ARGUMENT(const TArray<FContextVisBlock>*, ContextBlocksSource)
         SLATE_ATTRIBUTE(int32, KvCacheDecodedTokenCount)
 		SLATE_ATTRIBUTE(bool, IsStaticWorldInfoUpToDate)
 		SLATE_ATTRIBUTE(bool, IsLowFrequencyStateUpToDate)
@@ -36,12 +38,12 @@ public:
     virtual FVector2D ComputeDesiredSize(float LayoutScaleMultiplier) const override;
 
     // Attribute setters
-    void SetContextBlocks(TAttribute<TArray<FContextVisBlock>> InBlocks);
+    void SetContextBlocksSource(const TArray<FContextVisBlock>* InBlocks);
     void SetTotalTokenCapacity(TAttribute<int32> InCapacity);
     void SetKvCacheDecodedTokenCount(TAttribute<int32> InKvCacheCount);
 
 private:
-    TAttribute<TArray<FContextVisBlock>> CurrentContextBlocks;
+    const TArray<FContextVisBlock>* ContextBlocksSource = nullptr;
     TAttribute<int32> TotalTokenCapacityInternal;
     TAttribute<int32> KvCacheDecodedTokenCountInternal;
 
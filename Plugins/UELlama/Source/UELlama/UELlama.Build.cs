@@ -1,5 +1,6 @@
 using UnrealBuildTool;
 using System.IO; // Required for Path.Combine
+using System.Security.Cryptography;
 
 public class UELlama : ModuleRules // Ensure this class name matches your actual file
 {
@@ -40,6 +41,9 @@ public class UELlama : ModuleRules // Ensure this class name matches your actual
         // If common.h/cpp are in a subfolder like llama.cpp/common/ and you put them in include/common/
         // PublicIncludePaths.Add(Path.Combine(LlamaCppSourcePath, "include", "common"));
 
+        // CPU-only builds (Linux servers) keep every layer on the CPU, see LLInternal::InitializeLlama_LlamaThread
+        PublicDefinitions.Add(Target.Platform == UnrealTargetPlatform.Linux ? "LLAMA_CPU_ONLY=1" : "LLAMA_CPU_ONLY=0");
+
 
 
         if (Target.Platform == UnrealTargetPlatform.IOS)
@@ -162,12 +166,23 @@ public class UELlama : ModuleRules // Ensure this class name matches your actual
         }
         else if (Target.Platform == UnrealTargetPlatform.Linux)
         {
-            // Example for Linux
-            // string LlamaLibDir = Path.Combine(LlamaCppSourcePath, "lib", "Linux");
-            // PublicAdditionalLibraries.Add(Path.Combine(LlamaLibDir, "libllama.a"));
-            // PublicDefinitions.Add("GGML_USE_CLBLAST=1"); // If built with OpenCL/CLBlast
-            // Or: PublicDefinitions.Add("GGML_USE_OPENBLAS=1"); // If built with OpenBLAS
-            // PublicSystemLibraries.Add("openblas"); // If linking system OpenBLAS
+            // x86_64, CPU backend only (AVX2/AVX-512, ggml threadpool, no OpenMP); see README.md for how the libs are built
+            if (Target.Architecture != UnrealArch.X64)
+            {
+                throw new BuildException("UELlama: only Linux x86_64 is supported (got " + Target.Architecture + ")");
+            }
+            string LlamaLibDir = Path.Combine(LlamaCppSourcePath, "lib", "Linux");
+            CheckLlamaHeadersMatchLibs(Path.Combine(LlamaCppSourcePath, "include"), LlamaLibDir);
+            foreach (string Lib in new string[] { "libllama.a", "libggml.a", "libggml-cpu.a", "libggml-base.a", "libcommon.a" })
+            {
+                string LibPath = Path.Combine(LlamaLibDir, Lib);
+                if (!File.Exists(LibPath))
+                {
+                    throw new BuildException("UELlama: missing " + LibPath + " (build llama.cpp for Linux CPU as described in Plugins/UELlama/README.md)");
+                }
+                PublicAdditionalLibraries.Add(LibPath);
+            }
+            PublicSystemLibraries.AddRange(new string[] { "pthread", "dl", "m" });
         }
 
         // If you need to compile llama.cpp source files directly (more complex, less recommended for llama.cpp)
@@ -208,6 +223,50 @@ public class UELlama : ModuleRules // Ensure this class name matches your actual
         // Suppress specific warnings if headers from llama.cpp generate them and are noisy
         // ModuleRules.UndefinedIdentifierWarningLevel = false;
     }
+
+    // The libs in LibDir must have been built from the same llama.cpp as the headers we compile against
+    // (ThirdParty/llama.cpp/include, not the stale Plugins/UELlama/Includes or ThirdParty/WORKSllama.cpp copies).
+    // LibDir/include.sha256 is written in the llama.cpp checkout the libs were built from (see README.md): a
+    // "# llama.cpp <commit>" line, then `sha256sum` of that checkout's headers. Every header listed there must match
+    // ours byte for byte.
+    private void CheckLlamaHeadersMatchLibs(string IncludeDir, string LibDir)
+    {
+        string ManifestPath = Path.Combine(LibDir, "include.sha256");
+        if (!File.Exists(ManifestPath))
+        {
+            throw new BuildException("UELlama: missing " + ManifestPath + ", can't verify the llama.cpp libs match " + IncludeDir);
+        }
+        int Checked = 0;
+        string BuiltFrom = "an unrecorded llama.cpp commit";
+        using (SHA256 Hasher = SHA256.Create())
+        {
+            foreach (string Line in File.ReadAllLines(ManifestPath))
+            {
+                if (Line.StartsWith("# llama.cpp "))
+                {
+                    BuiltFrom = "llama.cpp " + Line.Substring("# llama.cpp ".Length).Trim();
+                    continue;
+                }
+                string[] Parts = Line.Split(new char[] { ' ', '*' }, System.StringSplitOptions.RemoveEmptyEntries);
+                if (Parts.Length != 2) continue;
+                string HeaderPath = Path.Combine(IncludeDir, Path.GetFileName(Parts[1]));
+                if (!File.Exists(HeaderPath))
+                {
+                    throw new BuildException("UELlama: " + HeaderPath + " is listed in " + ManifestPath + " but missing");
+                }
+                string Hash = System.BitConverter.ToString(Hasher.ComputeHash(File.ReadAllBytes(HeaderPath))).Replace("-", "").ToLowerInvariant();
+                if (Hash != Parts[0].ToLowerInvariant())
+                {
+                    throw new BuildException("UELlama: " + HeaderPath + " doesn't match the header the libs in " + LibDir + " were built with (" + BuiltFrom + "); copy the headers from that checkout");
+                }
+                Checked++;
+            }
+        }
+        if (Checked == 0)
+        {
+            throw new BuildException("UELlama: " + ManifestPath + " lists no headers");
+        }
+    }
 }
 
 
@@ -25,6 +25,14 @@ public:
     float GetTargetAngle() const { return TargetAngle; }
     void SetTargetAngle(float Angle) { TargetAngle = Angle; }
 
+    // Actual angle as well as the target, so a restore doesn't replay the travel
+    virtual void SerializeState(FArchive& Ar) override
+    {
+        int32 Version;
+        if (!SerializeStateVersion(Ar, 1, Version)) return;
+        Ar << CurrentAngle << TargetAngle << bIsFouled << bActive;
+    }
+
     virtual void Tick(float DeltaTime) override
     {
 		if (Owner && !Owner->HasPower()) return;
@@ -61,6 +69,26 @@ public:
         return ECommandResult::NotHandled;
     }
 
+    // Same as HandleCommand, on interned ids and the parsed float
+    virtual ECommandResult HandleCompiledCommand(const FCompiledCommand& Cmd) override
+    {
+        static const int32 AngleId = CommandNames::Intern(TEXT("ANGLE"));
+        static const int32 ActuatorId = CommandNames::Intern(TEXT("ACTUATOR"));
+        static const int32 SetId = CommandNames::Intern(TEXT("SET"));
+        static const int32 ActivateId = CommandNames::Intern(TEXT("ACTIVATE"));
+        static const int32 DeactivateId = CommandNames::Intern(TEXT("DEACTIVATE"));
+        if (Cmd.AspectId == AngleId)
+        {
+            if (Cmd.VerbId == SetId) { TargetAngle = Cmd.GetFloat(); UpdateChange(); return ECommandResult::Handled; }
+        }
+        else if (Cmd.AspectId == ActuatorId)
+        {
+            if (Cmd.VerbId == DeactivateId) { bActive = false; UpdateChange(); return ECommandResult::Handled; }
+            if (Cmd.VerbId == ActivateId) { bActive = true; UpdateChange(); return ECommandResult::Handled; }
+        }
+        return ECommandResult::NotHandled;
+    }
+
     virtual FString QueryState(const FString& Aspect) const override
     {
 //if (Aspect == "ANGLE") UE_LOG(LogTemp, Warning, TEXT("ICH_Actuator::QueryState %s returns %s"), *Aspect, *FString::Printf(TEXT("%.2f"), CurrentAngle));
@@ -41,6 +41,26 @@ public:
         return ECommandResult::NotHandled;
     }
 
+    // Same order as HandleCommand, through each handler's compiled dispatch
+    virtual ECommandResult HandleCompiledCommand(const FCompiledCommand& Cmd) override
+    {
+        if (PrimaryHandler)
+        {
+            ECommandResult Result = PrimaryHandler->HandleCompiledCommand(Cmd);
+            if (Result != ECommandResult::NotHandled)
+            {
+                return Result;
+            }
+        }
+
+        if (SecondaryHandler)
+        {
+            return SecondaryHandler->HandleCompiledCommand(Cmd);
+        }
+
+        return ECommandResult::NotHandled;
+    }
+
     virtual bool CanHandleCommand(const FString& Aspect, const FString& Command, const FString& Value) const override
     {
         return (PrimaryHandler && PrimaryHandler->CanHandleCommand(Aspect, Command, Value)) ||
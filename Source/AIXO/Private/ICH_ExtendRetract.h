@@ -26,6 +26,15 @@ public:
     	if (Owner) Owner->PostHandleCommand();
     }
 
+    virtual void SerializeState(FArchive& Ar) override
+    {
+        int32 Version;
+        if (!SerializeStateVersion(Ar, 1, Version)) return;
+        uint8 SavedState = (uint8)State;
+        Ar << SavedState << Extension << MoveTimer << bTargetOut;
+        if (Ar.IsLoading()) State = (EExtendState)SavedState;
+    }
+
     virtual void Tick(float DeltaTime) override
     {
 		if (Owner && !Owner->HasPower()) return;
@@ -57,21 +66,35 @@ public:
             {
 // TODO: checking for power while reading the JSON is causing some commands to fail
 //	        	if (Owner && !Owner->HasPower()) return ECommandResult::NotHandled;
-                bool bExtend = Value.ToBool();
-                if (bExtend && State == EExtendState::OUT_POS) return ECommandResult::Handled;
-                if (!bExtend && State == EExtendState::IN_POS) return ECommandResult::Handled;
-                {
-                    State = EExtendState::MOVING;
-                    MoveTimer = 0.f;
-                    bTargetOut = bExtend;
-					UpdateChange();
-                    return ECommandResult::Handled;
-                }
+                return HandleExtendSet(Value.ToBool());
             }
         }
         return ECommandResult::NotHandled;
     }
 
+    // Same as HandleCommand, on interned ids and the parsed bool
+    virtual ECommandResult HandleCompiledCommand(const FCompiledCommand& Cmd) override
+    {
+        static const int32 ExtendId = CommandNames::Intern(TEXT("EXTEND"));
+        static const int32 SetId = CommandNames::Intern(TEXT("SET"));
+        if (Cmd.AspectId == ExtendId && Cmd.VerbId == SetId)
+        {
+            return HandleExtendSet(Cmd.GetBool());
+        }
+        return ECommandResult::NotHandled;
+    }
+
+    ECommandResult HandleExtendSet(bool bExtend)
+    {
+        if (bExtend && State == EExtendState::OUT_POS) return ECommandResult::Handled;
+        if (!bExtend && State == EExtendState::IN_POS) return ECommandResult::Handled;
+        State = EExtendState::MOVING;
+        MoveTimer = 0.f;
+        bTargetOut = bExtend;
+        UpdateChange();
+        return ECommandResult::Handled;
+    }
+
     virtual bool CanHandleCommand(const FString& Aspect, const FString& Command, const FString& Value) const override
     {
         return Aspect == "EXTEND" && Command == "SET";
@@ -34,6 +34,16 @@ public:
         return Result;
     }
 
+    // Same order as HandleCommand, through the parts' compiled dispatch
+    virtual ECommandResult HandleCompiledCommand(const FCompiledCommand& Cmd) override {
+        auto Result = ExtendPart->HandleCompiledCommand(Cmd);
+        if (Result == ECommandResult::Handled) UpdateChange();
+        if (Result != ECommandResult::NotHandled) return Result;
+        Result = PowerPart->HandleCompiledCommand(Cmd);
+        if (Result == ECommandResult::Handled) UpdateChange();
+        return Result;
+    }
+
     virtual bool CanHandleCommand(const FString& Aspect, const FString& Command, const FString& Value) const override {
         return ExtendPart->CanHandleCommand(Aspect, Command, Value) ||
         	PowerPart->CanHandleCommand(Aspect, Command, Value);
@@ -64,6 +74,12 @@ public:
         return Queries;
     }
 
+    virtual void SerializeState(FArchive& Ar) override
+    {
+        ExtendPart->SerializeState(Ar);
+        PowerPart->SerializeState(Ar);
+    }
+
     virtual void Tick(float DeltaTime) override
     {
 		if (Owner && !Owner->HasPower()) return;
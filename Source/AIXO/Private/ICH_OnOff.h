@@ -42,6 +42,20 @@ public:
         return ECommandResult::NotHandled;
     }
 
+    // Same as HandleCommand, on interned ids and the parsed bool
+    virtual ECommandResult HandleCompiledCommand(const FCompiledCommand& Cmd) override
+    {
+        static const int32 OnId = CommandNames::Intern(TEXT("ON"));
+        static const int32 SetId = CommandNames::Intern(TEXT("SET"));
+        if (Cmd.AspectId == OnId && Cmd.VerbId == SetId)
+        {
+            bIsOn = Cmd.GetBool();
+            UpdateChange();
+            return ECommandResult::Handled;
+        }
+        return ECommandResult::NotHandled;
+    }
+
     /** Checks if the handler can process ON SET commands. */
     virtual bool CanHandleCommand(const FString& Aspect, const FString& Command, const FString& Value) const override
     {
@@ -76,6 +90,13 @@ public:
         // Base OnOff has no tick logic
     }
 
+    virtual void SerializeState(FArchive& Ar) override
+    {
+        int32 Version;
+        if (!SerializeStateVersion(Ar, 1, Version)) return;
+        Ar << bIsOn;
+    }
+
     bool IsOn() const { return bIsOn; }
 };
 
@@ -28,6 +28,15 @@ public:
     	if (Owner) Owner->PostHandleCommand();
     }
 
+    virtual void SerializeState(FArchive& Ar) override
+    {
+        int32 Version;
+        if (!SerializeStateVersion(Ar, 1, Version)) return;
+        uint8 SavedState = (uint8)State;
+        Ar << SavedState << MoveTimer << bTargetOpen;
+        if (Ar.IsLoading()) State = (EOpenState)SavedState;
+    }
+
     virtual void Tick(float DeltaTime) override
     {
     	if (Owner && !Owner->HasPower()) {
@@ -66,25 +75,39 @@ public:
             if (Command == "SET") {
 // TODO: checking for power while reading the JSON is causing some commands to fail
 //	        	if (Owner && !Owner->HasPower()) return ECommandResult::NotHandled;
-                bool bOpen = Value.ToBool();
-                if (bOpen && State == EOpenState::OPEN) return ECommandResult::Handled;
-                if (!bOpen && State == EOpenState::CLOSED) return ECommandResult::Handled;
-                {
-		        	if (bOpen) {
-						bTargetOpen = true;
-						State = EOpenState::MOVING;
-		        	} else {
-						bTargetOpen = false;
-						State = EOpenState::MOVING;
-		        	}
-                    UpdateChange();
-                    return ECommandResult::Handled;
-                }
+                return HandleOpenSet(Value.ToBool());
             }
         }
         return ECommandResult::NotHandled;
     }
 
+    // Same as HandleCommand, on interned ids and the parsed bool
+    virtual ECommandResult HandleCompiledCommand(const FCompiledCommand& Cmd) override
+    {
+        static const int32 OpenId = CommandNames::Intern(TEXT("OPEN"));
+        static const int32 SetId = CommandNames::Intern(TEXT("SET"));
+        if (Cmd.AspectId == OpenId && Cmd.VerbId == SetId)
+        {
+            return HandleOpenSet(Cmd.GetBool());
+        }
+        return ECommandResult::NotHandled;
+    }
+
+    ECommandResult HandleOpenSet(bool bOpen)
+    {
+        if (bOpen && State == EOpenState::OPEN) return ECommandResult::Handled;
+        if (!bOpen && State == EOpenState::CLOSED) return ECommandResult::Handled;
+        if (bOpen) {
+            bTargetOpen = true;
+            State = EOpenState::MOVING;
+        } else {
+            bTargetOpen = false;
+            State = EOpenState::MOVING;
+        }
+        UpdateChange();
+        return ECommandResult::Handled;
+    }
+
     virtual bool CanHandleCommand(const FString& Aspect, const FString& Command, const FString& Value) const override
     {
         return Aspect == "OPEN";
@@ -27,6 +27,20 @@ public:
         }
         return ECommandResult::NotHandled;
     }
+
+    // Same as HandleCommand, on interned ids and the parsed float
+    virtual ECommandResult HandleCompiledCommand(const FCompiledCommand& Cmd) override
+    {
+        static const int32 PumpRateId = CommandNames::Intern(TEXT("PUMPRATE"));
+        static const int32 SetId = CommandNames::Intern(TEXT("SET"));
+        if (Cmd.AspectId == PumpRateId && Cmd.VerbId == SetId)
+        {
+            PumpRate = Cmd.GetFloat();
+            UpdateChange();
+            return ECommandResult::Handled;
+        }
+        return ECommandResult::NotHandled;
+    }
     
     virtual void SetPumpRate(float InPumpRate) { PumpRate = InPumpRate; }
 
@@ -53,6 +67,13 @@ public:
     }
 
     /** Performs per-frame updates (currently none needed for base pump). */
+    virtual void SerializeState(FArchive& Ar) override
+    {
+        int32 Version;
+        if (!SerializeStateVersion(Ar, 1, Version)) return;
+        Ar << PumpRate;
+    }
+
     virtual void Tick(float DeltaTime) override
     {
         // Base pump has no tick logic by itself
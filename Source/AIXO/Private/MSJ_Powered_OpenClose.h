@@ -43,6 +43,24 @@ public:
         return Result;
     }
 
+    // Same order as HandleCommand, on ids: the OpenClose part, then POWERSELECT; the rest (subclasses' own aspects) through HandleCommand
+    virtual ECommandResult HandleCompiledCommand(const FCompiledCommand& Cmd) override
+    {
+        ECommandResult Result = OpenClosePart->HandleCompiledCommand(Cmd);
+        if (Result == ECommandResult::Handled) UpdateChange();
+        if (Result != ECommandResult::NotHandled)
+        {
+            return Result;
+        }
+        Result = HandleCompiledPowerSelectCommand(Cmd);
+        if (Result == ECommandResult::Handled) UpdateChange();
+        if (Result != ECommandResult::NotHandled)
+        {
+            return Result;
+        }
+        return HandleCommand(Cmd.Aspect, Cmd.Verb, Cmd.Value);
+    }
+
     virtual bool CanHandleCommand(const FString& Aspect, const FString& Command, const FString& Value) const override
     {
         return OpenClosePart->CanHandleCommand(Aspect, Command, Value) ||
@@ -102,6 +120,12 @@ public:
         return (IsShutdown() || !OpenClosePart->IsMoving()) ? 0.0f : DefaultNoiseLevel;
     }
 
+    virtual void SerializeState(FArchive& Ar) override
+    {
+        PWRJ_MultiSelectJunction::SerializeState(Ar);
+        OpenClosePart->SerializeState(Ar);
+    }
+
     virtual void Tick(float InDeltaTime) override
     {
 		if (Owner && !Owner->HasPower()) return;
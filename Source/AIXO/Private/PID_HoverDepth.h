@@ -103,6 +103,14 @@ public:
         LastDepth = CurrentDepth;
     }
 
+    // Integrator and stall-detection memory, so a restored controller doesn't kick
+    virtual void SerializeState(FArchive& Ar) override
+    {
+        int32 Version;
+        if (!SerializeStateVersion(Ar, 1, Version)) return;
+        Ar << TargetDepth << bEnabled << LastError << Integral << StableTime << LastDepth;
+    }
+
 private:
     ASubmarineState& SubState;
     SS_FTBTPump* FTBT;
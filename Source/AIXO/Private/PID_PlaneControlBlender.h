@@ -65,6 +65,13 @@ public:
     friend class PID_PlaneDepthRate;
     friend class PID_PlanePitch;
 
+    virtual void SerializeState(FArchive& Ar) override
+    {
+        int32 Version;
+        if (!SerializeStateVersion(Ar, 1, Version)) return;
+        Ar << PitchOut << DepthOut << bPitchActive << bDepthActive;
+    }
+
 private:
     ASubmarineState& SubState;
     SS_Elevator* Elevator;
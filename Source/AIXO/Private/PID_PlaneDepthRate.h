@@ -89,6 +89,13 @@ public:
         LastDepth = SubState.SubmarineLocation.Z;
     }
 
+    virtual void SerializeState(FArchive& Ar) override
+    {
+        int32 Version;
+        if (!SerializeStateVersion(Ar, 1, Version)) return;
+        Ar << TargetRate << bEnabled << LastError << Integral << StableTime << LastDepth;
+    }
+
 private:
     ASubmarineState& SubState;
     PID_PlaneControlBlender* Blender;
@@ -89,6 +89,13 @@ public:
         LastPitch = CurrentPitch;
     }
 
+    virtual void SerializeState(FArchive& Ar) override
+    {
+        int32 Version;
+        if (!SerializeStateVersion(Ar, 1, Version)) return;
+        Ar << TargetPitch << bEnabled << LastError << Integral << StableTime << LastPitch;
+    }
+
 private:
     ASubmarineState* SubState;
     PID_PlaneControlBlender* Blender;
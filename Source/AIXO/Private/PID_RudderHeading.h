@@ -100,6 +100,13 @@ public:
         LastHeading = ActualHeading;
     }
 
+    virtual void SerializeState(FArchive& Ar) override
+    {
+        int32 Version;
+        if (!SerializeStateVersion(Ar, 1, Version)) return;
+        Ar << DesiredHeading << bEnabled << LastError << Integral << HeadingStableTime << LastHeading;
+    }
+
 private:
     ASubmarineState* SubState;
     SS_Rudder* Rudder;
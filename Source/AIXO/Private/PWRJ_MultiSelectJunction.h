@@ -27,6 +27,7 @@ protected:
         if (Port >= 0 && Port < EnabledPorts.Num())
         {
             EnabledPorts[Port] = bEnabled;
+            MarkPowerDirty();
         }
     }
 
@@ -38,6 +39,14 @@ public:
     }
 	virtual FString GetTypeString() const override { return TEXT("PWRJ_MultiSelectJunction"); }
 
+    virtual void SerializeState(FArchive& Ar) override
+    {
+        ICH_PowerJunction::SerializeState(Ar);
+        int32 Version;
+        if (!SerializeStateVersion(Ar, 1, Version)) return;
+        Ar << SelectedPort;
+    }
+
     /**
      * Sets the currently selected port by its 1-based index.
      * -1 indicates no port is selected (disconnected).
@@ -101,32 +110,61 @@ public:	// this is an example of a ICommandHandler implementation that blocks ou
 //        if (Ports.Num() <= 1) 
         if (Aspect == "POWERSELECT" && Command == "SET")
         {
-			if (Value == "OFF")
-			{
-				SetPortEnabled(-1, true);
-				return ECommandResult::Handled;
-			}
-            int32 Index = FCString::Atoi(*Value);
-#ifdef ZERO_SLOT_ALWAYS_ENABLE
-            if ((Index >= 0 && Index < Ports.Num()) || (Index == -1))
-            {
-				SetPortEnabled(Index, true);
-                return ECommandResult::Handled;
-            }
-#else // !ZERO_SLOT_ALWAYS_ENABLE
-            if ((Index >= 0 && Index < Ports.Num()) || (Index == -1))
-            {
-				SetPortEnabled(Index, true);
-                return ECommandResult::Handled;
-            }
-#endif // !ZERO_SLOT_ALWAYS_ENABLE
-            return ECommandResult::HandledWithError;
+            return HandlePowerSelectCommand(Value);
         }
         // If not handled here, delegate to the base ICH_PowerJunction
 		if (Aspect.StartsWith(TEXT("POWERPORT"))) return ECommandResult::NotHandled;		// can't mess with underlying implementation
         return ICH_PowerJunction::HandleCommand(Aspect, Command, Value);
     }
 
+    // Same as HandleCommand, on ids: POWERSELECT SET, POWERPORT blocked, the rest (subclasses' own aspects) through HandleCommand
+    virtual ECommandResult HandleCompiledCommand(const FCompiledCommand& Cmd) override
+    {
+        const ECommandResult Result = HandleCompiledPowerSelectCommand(Cmd);
+        if (Result != ECommandResult::NotHandled)
+        {
+            return Result;
+        }
+		if (Cmd.Aspect.StartsWith(TEXT("POWERPORT"))) return ECommandResult::NotHandled;		// can't mess with underlying implementation
+        return HandleCommand(Cmd.Aspect, Cmd.Verb, Cmd.Value);
+    }
+
+    // POWERSELECT SET on ids, for HandleCompiledCommand overrides; NotHandled for anything else
+    ECommandResult HandleCompiledPowerSelectCommand(const FCompiledCommand& Cmd)
+    {
+        static const int32 PowerSelectId = CommandNames::Intern(TEXT("POWERSELECT"));
+        static const int32 SetId = CommandNames::Intern(TEXT("SET"));
+        if (Cmd.AspectId != PowerSelectId || Cmd.VerbId != SetId)
+        {
+            return ECommandResult::NotHandled;
+        }
+        return HandlePowerSelectCommand(Cmd.Value);
+    }
+
+    ECommandResult HandlePowerSelectCommand(const FString& Value)
+    {
+		if (Value == "OFF")
+		{
+			SetPortEnabled(-1, true);
+			return ECommandResult::Handled;
+		}
+        int32 Index = FCString::Atoi(*Value);
+#ifdef ZERO_SLOT_ALWAYS_ENABLE
+        if ((Index >= 0 && Index < Ports.Num()) || (Index == -1))
+        {
+			SetPortEnabled(Index, true);
+            return ECommandResult::Handled;
+        }
+#else // !ZERO_SLOT_ALWAYS_ENABLE
+        if ((Index >= 0 && Index < Ports.Num()) || (Index == -1))
+        {
+			SetPortEnabled(Index, true);
+            return ECommandResult::Handled;
+        }
+#endif // !ZERO_SLOT_ALWAYS_ENABLE
+        return ECommandResult::HandledWithError;
+    }
+
     bool CanHandleCommand(const FString& Aspect, const FString& Command, const FString& Value) const override
     {
 		if (Aspect.StartsWith(TEXT("POWERPORT"))) return false;		// can't mess with underlying implementation
@@ -45,6 +45,14 @@ public:
     	}
     }
 
+    virtual void SerializeState(FArchive& Ar) override
+    {
+        ICH_PowerJunction::SerializeState(Ar);
+        int32 Version;
+        if (!SerializeStateVersion(Ar, 1, Version)) return;
+        Ar << bConnectAB << bConnectAC << bConnectBC;
+    }
+
     TArray<PWR_PowerSegment*> GetConnectedSegments(PWR_PowerSegment* IgnoreSegment = nullptr) const override
     {
         TArray<PWR_PowerSegment*> Result;
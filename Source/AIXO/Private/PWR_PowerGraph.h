@@ -0,0 +1,288 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include <atomic>
+#include "PWR_PowerSegment.h"
+#include "ICH_PowerJunction.h"
+
+/**
+ * Per-solve flag bits kept in PWR_PowerGraph::JunctionFlags / SegmentFlags.
+ */
+enum EPowerGraphFlag : uint8
+{
+    PGF_Shorted = 1,
+    PGF_Overenergized = 2,
+    PGF_UnderPowered = 4,
+    PGF_Shutdown = 8
+};
+
+/**
+ * PWR_PowerGraph is a compiled copy of the grid topology for PWR_PowerPropagation.
+ *
+ * Junctions and segments get integer ids (their index in the arrays given to Compile()). Every segment end
+ * becomes a "slot" of the junction it's attached to, stored compressed-sparse-row: junction j owns slots
+ * [SlotStart[j], SlotStart[j+1]), sorted by port number so traversal order matches GetConnectedSegments().
+ * The junction's internal switching (the virtual GetConnectedSegments() of SS_Battery, PWR_BusTapJunction,
+ * the multi-select junctions...) is captured as bit masks over its own slots, so a solve never calls it:
+ *   SlotExitMask[s]  - slots you can leave by after arriving through slot s
+ *   DepartMask[j]    - slots you can leave by when starting at j
+ * The masks and enable bits are re-derived only by RefreshJunction(), on topology changes and for junctions that
+ * raised bPowerInputsDirty. Solve state lives in SoA arrays sized at compile time, so solving allocates nothing.
+ *
+ * Everything indexed by a junction or segment id may be written by concurrent solves of different components (they
+ * touch disjoint ids). What a traversal needs for itself lives in an FScratch, one per concurrent solve, and visited
+ * marks come from a shared atomic stamp so two traversals never mistake each other's marks for their own.
+ */
+class PWR_PowerGraph
+{
+public:
+    static constexpr int32 MaxSlotsPerJunction = 64;    // one uint64 mask per slot
+
+    struct FFrame
+    {
+        int32 Junction;
+        uint64 Remaining;
+    };
+
+    /** Per-solve working memory; keep one per concurrently solved component and reuse it between solves. */
+    struct FScratch
+    {
+        uint32 Stamp = 0;
+        TArray<FFrame> Stack;
+        TArray<int32> Order;    // BFS order of the shortest-path tree
+    };
+
+    // --- topology, rebuilt by Compile() ---
+    TArray<ICH_PowerJunction*> JunctionObjects;
+    TArray<PWR_PowerSegment*> SegmentObjects;
+    TArray<int32> SlotStart;            // NumJunctions + 1 entries
+    TArray<int32> SlotJunction;         // owning junction
+    TArray<int32> SlotSegment;          // segment attached at this slot
+    TArray<int32> SlotPort;             // port number on the owning junction
+    TArray<int32> SlotOther;            // slot at the segment's other end, INDEX_NONE if that junction isn't in the graph
+    TArray<int32> SegmentSlotA;         // slot at the segment's JunctionA / JunctionB end, INDEX_NONE if not in the graph
+    TArray<int32> SegmentSlotB;
+    TArray<int32> AllJunctionIds;
+    TArray<int32> AllSegmentIds;
+
+    // --- per-edge switching, refreshed by RefreshJunction() ---
+    TArray<uint8> SlotEnabled;          // owning junction's port is enabled
+    TArray<uint8> SlotCharging;         // owning junction treats this port as its charging pin
+    TArray<uint64> SlotExitMask;
+    TArray<uint64> DepartMask;
+
+    // --- SoA solve state, indexed by id ---
+    TArray<float> JunctionUsage;
+    TArray<float> JunctionAvailable;
+    TArray<uint8> JunctionIsSource;
+    TArray<uint8> JunctionHasCharging;
+    TArray<uint8> JunctionFlags;        // EPowerGraphFlag
+    TArray<float> SegmentLevel;
+    TArray<EPowerSegmentStatus> SegmentStatus;
+    TArray<uint8> SegmentFlags;         // EPowerGraphFlag
+
+    // --- scratch for PWR_PowerPropagation's graph solve ---
+    TArray<int32> TreeRoot, TreeDepth, TreeParent, TreeEntrySlot, FeedParent, FeedSlot;
+    TArray<float> SubtreeLoad;
+
+    bool IsValid() const { return bValid; }
+    int32 NumJunctions() const { return JunctionObjects.Num(); }
+    int32 NumSegments() const { return SegmentObjects.Num(); }
+    int32 FindJunction(ICH_PowerJunction* Junction) const { const int32* Id = JunctionIds.Find(Junction); return Id ? *Id : INDEX_NONE; }
+    int32 FindSegment(PWR_PowerSegment* Segment) const { const int32* Id = SegmentIds.Find(Segment); return Id ? *Id : INDEX_NONE; }
+
+    /** Rebuilds the graph for these arrays. Returns false (IsValid() false) if a junction has too many ports for the masks. */
+    bool Compile(const TArray<PWR_PowerSegment*>& Segments, const TArray<ICH_PowerJunction*>& Junctions)
+    {
+        const int32 NJ = Junctions.Num();
+        const int32 NS = Segments.Num();
+        JunctionObjects = Junctions;
+        SegmentObjects = Segments;
+        JunctionIds.Reset();
+        SegmentIds.Reset();
+        for (int32 j = 0; j < NJ; ++j) if (Junctions[j]) JunctionIds.Add(Junctions[j], j);
+        for (int32 s = 0; s < NS; ++s) if (Segments[s]) SegmentIds.Add(Segments[s], s);
+
+        // count slots per junction, then fill each junction's range and sort it by port
+        SlotStart.Init(0, NJ + 1);
+        for (PWR_PowerSegment* Segment : Segments)
+        {
+            if (!Segment) continue;
+            if (const int32* A = JunctionIds.Find(Segment->GetJunctionA())) SlotStart[*A + 1]++;
+            if (const int32* B = JunctionIds.Find(Segment->GetJunctionB())) SlotStart[*B + 1]++;
+        }
+        bValid = true;
+        for (int32 j = 0; j < NJ; ++j)
+        {
+            if (SlotStart[j + 1] > MaxSlotsPerJunction)
+            {
+                UE_LOG(LogTemp, Warning, TEXT("PWR_PowerGraph: %s has %d ports (max %d), using the uncompiled solver"),
+                    *Junctions[j]->GetSystemName(), SlotStart[j + 1], MaxSlotsPerJunction);
+                bValid = false;
+            }
+            SlotStart[j + 1] += SlotStart[j];
+        }
+        const int32 NumSlots = SlotStart[NJ];
+        SlotJunction.SetNumUninitialized(NumSlots);
+        SlotSegment.SetNumUninitialized(NumSlots);
+        SlotPort.SetNumUninitialized(NumSlots);
+        SlotOther.SetNumUninitialized(NumSlots);
+        TArray<int32> Fill(SlotStart.GetData(), NJ);
+        for (int32 s = 0; s < NS; ++s)
+        {
+            PWR_PowerSegment* Segment = Segments[s];
+            if (!Segment) continue;
+            for (int32 End = 0; End < 2; ++End)
+            {
+                const int32* J = JunctionIds.Find(End == 0 ? Segment->GetJunctionA() : Segment->GetJunctionB());
+                if (!J) continue;
+                const int32 Slot = Fill[*J]++;
+                SlotJunction[Slot] = *J;
+                SlotSegment[Slot] = s;
+                SlotPort[Slot] = (End == 0) ? Segment->GetPortA() : Segment->GetPortB();
+            }
+        }
+        for (int32 j = 0; j < NJ; ++j)
+        {
+            // insertion sort by port; junctions have a handful of ports
+            for (int32 a = SlotStart[j] + 1; a < SlotStart[j + 1]; ++a)
+            {
+                for (int32 b = a; b > SlotStart[j] && SlotPort[b - 1] > SlotPort[b]; --b)
+                {
+                    Swap(SlotSegment[b - 1], SlotSegment[b]);
+                    Swap(SlotPort[b - 1], SlotPort[b]);
+                }
+            }
+        }
+        // pair up the two ends of each segment
+        SegmentSlotA.Init(INDEX_NONE, NS);
+        SegmentSlotB.Init(INDEX_NONE, NS);
+        for (int32 Slot = 0; Slot < NumSlots; ++Slot)
+        {
+            const int32 s = SlotSegment[Slot];
+            const bool bIsEndA = SegmentSlotA[s] == INDEX_NONE && Junctions[SlotJunction[Slot]] == Segments[s]->GetJunctionA() &&
+                SlotPort[Slot] == Segments[s]->GetPortA();
+            (bIsEndA ? SegmentSlotA[s] : SegmentSlotB[s]) = Slot;
+        }
+        for (int32 Slot = 0; Slot < NumSlots; ++Slot)
+        {
+            const int32 s = SlotSegment[Slot];
+            SlotOther[Slot] = (SegmentSlotA[s] == Slot) ? SegmentSlotB[s] : SegmentSlotA[s];
+        }
+
+        AllJunctionIds.SetNumUninitialized(NJ);
+        for (int32 j = 0; j < NJ; ++j) AllJunctionIds[j] = j;
+        AllSegmentIds.SetNumUninitialized(NS);
+        for (int32 s = 0; s < NS; ++s) AllSegmentIds[s] = s;
+
+        SlotEnabled.Init(0, NumSlots);
+        SlotCharging.Init(0, NumSlots);
+        SlotExitMask.Init(0, NumSlots);
+        DepartMask.Init(0, NJ);
+        JunctionUsage.Init(0.0f, NJ);
+        JunctionAvailable.Init(0.0f, NJ);
+        JunctionIsSource.Init(0, NJ);
+        JunctionHasCharging.Init(0, NJ);
+        JunctionFlags.Init(0, NJ);
+        SegmentLevel.Init(0.0f, NS);
+        SegmentStatus.Init(EPowerSegmentStatus::NORMAL, NS);
+        SegmentFlags.Init(0, NS);
+        for (TArray<int32>* Scratch : { &TreeRoot, &TreeDepth, &TreeParent, &TreeEntrySlot, &FeedParent, &FeedSlot })
+        {
+            Scratch->Init(INDEX_NONE, NJ);
+        }
+        SubtreeLoad.Init(0.0f, NJ);
+        VisitStamp.Init(0, NJ);
+        NextStamp = 0;
+
+        for (int32 j = 0; j < NJ; ++j) RefreshJunction(j);
+        return bValid;
+    }
+
+    /** Re-reads a junction's port enables, charging pin and internal connections. */
+    void RefreshJunction(int32 j)
+    {
+        ICH_PowerJunction* Junction = JunctionObjects[j];
+        if (!Junction) return;
+        for (int32 Slot = SlotStart[j]; Slot < SlotStart[j + 1]; ++Slot)
+        {
+            SlotEnabled[Slot] = Junction->IsPortEnabled(SlotPort[Slot]);
+            SlotCharging[Slot] = Junction->IsChargingPort(SlotPort[Slot]);
+            SlotExitMask[Slot] = MaskOf(j, Junction->GetConnectedSegments(SegmentObjects[SlotSegment[Slot]]));
+        }
+        DepartMask[j] = MaskOf(j, Junction->GetConnectedSegments());
+    }
+
+    // --- traversal ---
+
+    /** Starts a new visited set for Traverse() with this scratch. Safe to call from concurrent solves. */
+    void BeginTraversal(FScratch& Scratch)
+    {
+        Scratch.Stamp = NextStamp.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    /** Call between solves (never during one): clears the visited marks before the stamp counter can wrap. */
+    void ResetStampsIfNeeded()
+    {
+        if (NextStamp.load(std::memory_order_relaxed) < 0xF0000000u) return;
+        for (uint32& V : VisitStamp) V = 0;
+        NextStamp = 0;
+    }
+
+    /**
+     * Depth-first walk in the same order as the recursive PWR_PowerPropagation helpers: a junction is visited once per
+     * BeginTraversal(Scratch), entered through EntrySlot (INDEX_NONE at the start). OnJunction(j, EntrySlot) returns true to stop
+     * the whole walk. OnSlot(Slot) is called for each exit the junction allows and returns whether to cross it; the
+     * walk then only enters the far junction if its port is enabled (and, with bSkipChargingEntry, isn't a charging pin).
+     * Returns true if OnJunction stopped it.
+     */
+    template <typename JunctionFuncType, typename SlotFuncType>
+    bool Traverse(FScratch& Scratch, int32 Start, int32 EntrySlot, bool bSkipChargingEntry, JunctionFuncType&& OnJunction, SlotFuncType&& OnSlot)
+    {
+        TArray<FFrame>& Stack = Scratch.Stack;
+        auto Enter = [&](int32 j, int32 Entry) -> bool {
+            if (VisitStamp[j] == Scratch.Stamp) return false;
+            VisitStamp[j] = Scratch.Stamp;
+            if (OnJunction(j, Entry)) return true;
+            Stack.Add({ j, Entry == INDEX_NONE ? DepartMask[j] : SlotExitMask[Entry] });
+            return false;
+        };
+
+        Stack.Reset();
+        if (Enter(Start, EntrySlot)) return true;
+        while (Stack.Num() > 0)
+        {
+            FFrame& Top = Stack.Last();
+            if (Top.Remaining == 0) { Stack.Pop(EAllowShrinking::No); continue; }
+            const int32 Bit = FMath::CountTrailingZeros64(Top.Remaining);
+            Top.Remaining &= Top.Remaining - 1;
+            const int32 Slot = SlotStart[Top.Junction] + Bit;
+            if (!OnSlot(Slot)) continue;
+            const int32 Other = SlotOther[Slot];
+            if (Other == INDEX_NONE || !SlotEnabled[Other]) continue;
+            if (bSkipChargingEntry && SlotCharging[Other]) continue;
+            if (Enter(SlotJunction[Other], Other)) return true;    // Top may be stale after this; it isn't used again
+        }
+        return false;
+    }
+
+private:
+    TMap<ICH_PowerJunction*, int32> JunctionIds;
+    TMap<PWR_PowerSegment*, int32> SegmentIds;
+    TArray<uint32> VisitStamp;
+    std::atomic<uint32> NextStamp = 0;
+    bool bValid = false;
+
+    uint64 MaskOf(int32 j, const TArray<PWR_PowerSegment*>& Connected) const
+    {
+        uint64 Mask = 0;
+        for (PWR_PowerSegment* Segment : Connected)
+        {
+            for (int32 Slot = SlotStart[j]; Slot < FMath::Min(SlotStart[j + 1], SlotStart[j] + MaxSlotsPerJunction); ++Slot)
+            {
+                if (SegmentObjects[SlotSegment[Slot]] == Segment) Mask |= uint64(1) << (Slot - SlotStart[j]);
+            }
+        }
+        return Mask;
+    }
+};
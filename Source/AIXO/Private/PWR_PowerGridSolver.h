@@ -0,0 +1,334 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "PWR_PowerPropagation.h"
+#include "PWR_PowerGraph.h"
+#include "Async/ParallelFor.h"
+
+/**
+ * Kinds of change that make part of the grid need re-solving.
+ */
+enum class EPowerGridChange : uint8
+{
+    SegmentStatus,      // NORMAL / SHORTED / OPENED
+    PortEnable,         // a junction port or internal connection was switched
+    PowerUsage,         // a junction's GetCurrentPowerUsage() changed
+    SourceToggle,       // IsPowerSource, GetPowerAvailable or the charging segment changed
+    Topology            // junctions/segments added or removed
+};
+
+/**
+ * PWR_PowerGridSolver runs PWR_PowerPropagation incrementally.
+ * Change events come from Notify*() calls and from a cheap per-frame scan (the dirty flags that
+ * segment/junction setters raise, plus sampled usage/availability values). Only the connected
+ * components containing a changed element are reset and re-solved; a frame with no events costs
+ * one pass over the samples and no solve.
+ *
+ * The topology is compiled once into a PWR_PowerGraph (integer ids, CSR slots, switching masks) and both the
+ * component search and the solve run on it, so a steady-state update allocates nothing. Junctions that raise
+ * bPowerInputsDirty get their masks re-read from the objects.
+ *
+ * Dirty components are solved together in one call, or, on big enough grids with several of them, each on its own
+ * task through ParallelFor. Components share no element, so both give the same result.
+ *
+ * Components are built over "live" links: a segment that isn't OPENED is joined to an end junction
+ * whose port is enabled or which lists it in GetConnectedSegments(). That is a superset of what any
+ * PWR_PowerPropagation traversal can cross, so solving a component on its own gives the same result
+ * as the full solve. Changed elements also dirty their neighbours, so a link that was just cut
+ * re-solves both sides.
+ */
+class PWR_PowerGridSolver
+{
+public:
+    void NotifyTopologyChanged() { bTopologyDirty = true; }
+    void NotifySegmentChanged(PWR_PowerSegment* Segment, EPowerGridChange Change = EPowerGridChange::SegmentStatus)
+    {
+        const int32 Index = Graph.FindSegment(Segment);
+        if (Index != INDEX_NONE && !bTopologyDirty) MarkSegmentDirty(Index, Change);
+        else bTopologyDirty = true;
+    }
+    void NotifyJunctionChanged(ICH_PowerJunction* Junction, EPowerGridChange Change)
+    {
+        const int32 Index = Graph.FindJunction(Junction);
+        if (Index != INDEX_NONE && !bTopologyDirty) MarkJunctionDirty(Index, Change);
+        else bTopologyDirty = true;
+    }
+
+    /** Re-solves whatever changed since the last call. Returns false if nothing did (no solve ran). */
+    bool Update(TArray<PWR_PowerSegment*>& Segments, TArray<ICH_PowerJunction*>& Junctions)
+    {
+        const bool bSolveAll = bTopologyDirty || Segments.Num() != Graph.NumSegments() || Junctions.Num() != Graph.NumJunctions();
+        if (bSolveAll)
+        {
+            RebuildTopology(Segments, Junctions);
+        }
+        else
+        {
+            CollectChanges();
+            if (DirtyNodes.Num() == 0) return false;
+        }
+
+        // group nodes (junctions 0..NJ-1, segments NJ..) into live connected components
+        BuildComponents();
+        if (bSolveAll)
+        {
+            for (int32 Node = 0; Node < Parent.Num(); ++Node) RootIsDirty[FindRoot(Node)] = 1;
+        }
+        for (int32 Node : DirtyNodes) RootIsDirty[FindRoot(Node)] = 1;
+        DirtyNodes.Reset();
+        CollectDirtyComponents();
+
+        Graph.ResetStampsIfNeeded();
+        const int32 NumComponents = ComponentJunctionStart.Num() - 1;
+        if (bParallelComponents && NumComponents > 1 && SolveJunctionIds.Num() >= ParallelMinJunctions && CanSolveCompiled())
+        {
+            // each component touches only its own ids and objects, so the result is the same as solving them in turn
+            if (ComponentScratch.Num() < NumComponents) ComponentScratch.SetNum(NumComponents);
+            ParallelFor(NumComponents, [this](int32 c)
+            {
+                PWR_PowerPropagation::PropagatePower(Graph,
+                    TConstArrayView<int32>(ComponentJunctions.GetData() + ComponentJunctionStart[c], ComponentJunctionStart[c + 1] - ComponentJunctionStart[c]),
+                    TConstArrayView<int32>(ComponentSegments.GetData() + ComponentSegmentStart[c], ComponentSegmentStart[c + 1] - ComponentSegmentStart[c]),
+                    ComponentScratch[c]);
+            }, EParallelForFlags::Unbalanced);
+        }
+        else
+        {
+            // components never share an element or a traversal, so one call over their union solves each independently
+            Solve(SolveJunctionIds, SolveSegmentIds);
+        }
+
+        // the solve changes shutdown flags, which feed GetCurrentPowerUsage; sample after it so that isn't seen as a new event
+        for (int32 j : SolveJunctionIds) ResampleJunction(j);
+        for (int32 s : SolveSegmentIds) ResampleSegment(s);
+
+//UE_LOG(LogTemp, Warning, TEXT("PWR_PowerGridSolver: re-solved %d components, %d junctions, %d segments"), NumComponents, SolveJunctionIds.Num(), SolveSegmentIds.Num());
+        return true;
+    }
+
+    /** Solve dirty components on the task graph when there are several and the grid is big enough to pay for it. */
+    bool bParallelComponents = true;
+    int32 ParallelMinJunctions = 256;
+
+private:
+    struct FJunctionSample
+    {
+        float PowerUsage = 0.0f;
+        float PowerAvailable = 0.0f;
+        bool bIsPowerSource = false;
+        PWR_PowerSegment* ChargingSegment = nullptr;
+    };
+
+    PWR_PowerGraph Graph;                       // ids, slots and switching masks; rebuilt on topology changes
+    TArray<FJunctionSample> JunctionSamples;
+    TArray<EPowerSegmentStatus> SegmentSamples;
+    bool bTopologyDirty = true;
+
+    TArray<int32> DirtyNodes;
+    TArray<int32> Parent;                       // union-find over nodes
+    TArray<uint8> RootIsDirty;
+    TArray<int32> RootComponent;                // dirty root -> index into the Component* arrays
+    TArray<int32> SolveJunctionIds;             // all dirty components, ascending ids; reused between updates
+    TArray<int32> SolveSegmentIds;
+    TArray<int32> ComponentJunctionStart;       // component c owns ComponentJunctions[Start[c], Start[c+1]), ascending
+    TArray<int32> ComponentJunctions;
+    TArray<int32> ComponentSegmentStart;
+    TArray<int32> ComponentSegments;
+    TArray<int32> ComponentFill;
+    TArray<PWR_PowerGraph::FScratch> ComponentScratch;
+    PWR_PowerGraph::FScratch SerialScratch;
+    TArray<PWR_PowerSegment*> SolveSegments;    // only for the uncompiled fallback
+    TArray<ICH_PowerJunction*> SolveJunctions;
+
+    void RebuildTopology(TArray<PWR_PowerSegment*>& Segments, TArray<ICH_PowerJunction*>& Junctions)
+    {
+        Graph.Compile(Segments, Junctions);
+        JunctionSamples.SetNum(Junctions.Num());
+        SegmentSamples.SetNum(Segments.Num());
+        const int32 NumNodes = Junctions.Num() + Segments.Num();
+        Parent.SetNumUninitialized(NumNodes);
+        RootIsDirty.Init(0, NumNodes);
+        RootComponent.Init(INDEX_NONE, NumNodes);
+        DirtyNodes.Reset(NumNodes);
+        SolveJunctionIds.Reset(Junctions.Num());
+        SolveSegmentIds.Reset(Segments.Num());
+        ComponentJunctions.Reset(Junctions.Num());
+        ComponentSegments.Reset(Segments.Num());
+        bTopologyDirty = false;
+    }
+
+    // lays out the nodes of every dirty component, both as one ascending list and grouped per component
+    void CollectDirtyComponents()
+    {
+        const int32 NumJunctions = Graph.NumJunctions();
+        SolveJunctionIds.Reset();
+        SolveSegmentIds.Reset();
+        ComponentJunctionStart.Reset();
+        ComponentSegmentStart.Reset();
+        int32 NumComponents = 0;
+        for (int32 Node = 0; Node < Parent.Num(); ++Node)
+        {
+            const int32 Root = FindRoot(Node);
+            if (!RootIsDirty[Root]) continue;
+            if (RootComponent[Root] == INDEX_NONE) RootComponent[Root] = NumComponents++;
+            if (Node < NumJunctions) SolveJunctionIds.Add(Node);
+            else SolveSegmentIds.Add(Node - NumJunctions);
+        }
+        // counting sort into per-component ranges, keeping ids ascending inside each
+        ComponentJunctionStart.SetNumZeroed(NumComponents + 1);
+        ComponentSegmentStart.SetNumZeroed(NumComponents + 1);
+        for (int32 j : SolveJunctionIds) ComponentJunctionStart[RootComponent[FindRoot(j)] + 1]++;
+        for (int32 s : SolveSegmentIds) ComponentSegmentStart[RootComponent[FindRoot(NumJunctions + s)] + 1]++;
+        for (int32 c = 0; c < NumComponents; ++c)
+        {
+            ComponentJunctionStart[c + 1] += ComponentJunctionStart[c];
+            ComponentSegmentStart[c + 1] += ComponentSegmentStart[c];
+        }
+        ComponentJunctions.SetNumUninitialized(SolveJunctionIds.Num());
+        ComponentSegments.SetNumUninitialized(SolveSegmentIds.Num());
+        ComponentFill.SetNumUninitialized(NumComponents);
+        for (int32 c = 0; c < NumComponents; ++c) ComponentFill[c] = ComponentJunctionStart[c];
+        for (int32 j : SolveJunctionIds) ComponentJunctions[ComponentFill[RootComponent[FindRoot(j)]]++] = j;
+        for (int32 c = 0; c < NumComponents; ++c) ComponentFill[c] = ComponentSegmentStart[c];
+        for (int32 s : SolveSegmentIds) ComponentSegments[ComponentFill[RootComponent[FindRoot(NumJunctions + s)]]++] = s;
+    }
+    // the compiled graph only implements the shortest-path tree; anything else (a junction past 64 slots, Exhaustive)
+    // goes through the object solver, which runs the same SolveShortestPathTree unless Exhaustive was asked for
+    bool CanSolveCompiled() const
+    {
+        return Graph.IsValid() && PWR_PowerPropagation::PathMode == EPowerPathMode::ShortestPathTree;
+    }
+
+    void Solve(const TArray<int32>& JunctionIds, const TArray<int32>& SegmentIds)
+    {
+        if (CanSolveCompiled())
+        {
+            PWR_PowerPropagation::PropagatePower(Graph, JunctionIds, SegmentIds, SerialScratch);
+            return;
+        }
+        SolveJunctions.Reset();
+        SolveSegments.Reset();
+        for (int32 j : JunctionIds) SolveJunctions.Add(Graph.JunctionObjects[j]);
+        for (int32 s : SegmentIds) SolveSegments.Add(Graph.SegmentObjects[s]);
+        PWR_PowerPropagation::PropagatePower(SolveSegments, SolveJunctions);
+    }
+
+    void ResampleJunction(int32 j)
+    {
+        ICH_PowerJunction* Junction = Graph.JunctionObjects[j];
+        if (!Junction) return;
+        FJunctionSample& Sample = JunctionSamples[j];
+        Sample.PowerUsage = Junction->GetCurrentPowerUsage();
+        Sample.PowerAvailable = Junction->GetPowerAvailable();
+        Sample.bIsPowerSource = Junction->IsPowerSource();
+        Sample.ChargingSegment = Junction->GetChargingSegment();
+        Junction->bPowerInputsDirty = false;
+    }
+
+    void ResampleSegment(int32 s)
+    {
+        PWR_PowerSegment* Segment = Graph.SegmentObjects[s];
+        if (!Segment) return;
+        SegmentSamples[s] = Segment->GetStatus();
+        Segment->bPowerInputsDirty = false;
+    }
+
+    // turns raised flags and changed samples into events
+    void CollectChanges()
+    {
+        for (int32 j = 0; j < Graph.NumJunctions(); ++j)
+        {
+            ICH_PowerJunction* Junction = Graph.JunctionObjects[j];
+            if (!Junction) continue;
+            const FJunctionSample& Sample = JunctionSamples[j];
+            if (Junction->bPowerInputsDirty)
+            {
+                MarkJunctionDirty(j, EPowerGridChange::PortEnable);
+            }
+            else if (Sample.bIsPowerSource != Junction->IsPowerSource() || Sample.PowerAvailable != Junction->GetPowerAvailable() ||
+                     Sample.ChargingSegment != Junction->GetChargingSegment())
+            {
+                MarkJunctionDirty(j, EPowerGridChange::SourceToggle);
+            }
+            else if (Sample.PowerUsage != Junction->GetCurrentPowerUsage())
+            {
+                MarkJunctionDirty(j, EPowerGridChange::PowerUsage);
+            }
+        }
+        for (int32 s = 0; s < Graph.NumSegments(); ++s)
+        {
+            PWR_PowerSegment* Segment = Graph.SegmentObjects[s];
+            if (Segment && (Segment->bPowerInputsDirty || SegmentSamples[s] != Segment->GetStatus()))
+            {
+                MarkSegmentDirty(s, EPowerGridChange::SegmentStatus);
+            }
+        }
+    }
+
+    void MarkJunctionDirty(int32 j, EPowerGridChange Change)
+    {
+        DirtyNodes.Add(j);
+        if (Change == EPowerGridChange::PowerUsage) return;     // load changes don't alter connectivity
+        Graph.RefreshJunction(j);     // re-read its masks and charging pins: switching or a new charging segment moves them
+        // a switched port may have split this junction's component: re-solve whatever is across each segment too
+        for (int32 Slot = Graph.SlotStart[j]; Slot < Graph.SlotStart[j + 1]; ++Slot)
+        {
+            DirtyNodes.Add(Graph.NumJunctions() + Graph.SlotSegment[Slot]);
+            AddSegmentEnds(Graph.SlotSegment[Slot]);
+        }
+    }
+
+    void MarkSegmentDirty(int32 s, EPowerGridChange Change)
+    {
+        DirtyNodes.Add(Graph.NumJunctions() + s);
+        AddSegmentEnds(s);
+    }
+
+    void AddSegmentEnds(int32 s)
+    {
+        if (Graph.SegmentSlotA[s] != INDEX_NONE) DirtyNodes.Add(Graph.SlotJunction[Graph.SegmentSlotA[s]]);
+        if (Graph.SegmentSlotB[s] != INDEX_NONE) DirtyNodes.Add(Graph.SlotJunction[Graph.SegmentSlotB[s]]);
+    }
+
+    int32 FindRoot(int32 Node)
+    {
+        while (Parent[Node] != Node)
+        {
+            Parent[Node] = Parent[Parent[Node]];
+            Node = Parent[Node];
+        }
+        return Node;
+    }
+
+    void Union(int32 NodeA, int32 NodeB)
+    {
+        const int32 RootA = FindRoot(NodeA);
+        const int32 RootB = FindRoot(NodeB);
+        if (RootA != RootB) Parent[RootB] = RootA;
+    }
+
+    void BuildComponents()
+    {
+        const int32 NumJunctions = Graph.NumJunctions();
+        for (int32 i = 0; i < Parent.Num(); ++i)
+        {
+            Parent[i] = i;
+            RootIsDirty[i] = 0;
+            RootComponent[i] = INDEX_NONE;
+        }
+
+        for (int32 j = 0; j < NumJunctions; ++j)
+        {
+            for (int32 Slot = Graph.SlotStart[j]; Slot < Graph.SlotStart[j + 1]; ++Slot)
+            {
+                const int32 s = Graph.SlotSegment[Slot];
+                if (Graph.SegmentObjects[s]->GetStatus() == EPowerSegmentStatus::OPENED) continue;
+                const bool bDeparts = (Graph.DepartMask[j] >> (Slot - Graph.SlotStart[j])) & 1;
+                if (Graph.SlotEnabled[Slot] || bDeparts)
+                {
+                    Union(j, NumJunctions + s);
+                }
+            }
+        }
+    }
+};
@@ -3,6 +3,19 @@
 #include "CoreMinimal.h"
 #include "SubmarineState.h"
 #include "ICommandHandler.h"
+#include "PWR_PowerGraph.h"
+
+/**
+ * How step 2c/3 find each junction's feed path.
+ * Exhaustive enumerates every simple path from each source (exponential in bus ties and loops);
+ * ShortestPathTree runs one multi-source BFS and sums loads bottom-up over the resulting tree.
+ * Both keep the shortest path; they can differ only in which of several equally short paths is kept.
+ */
+enum class EPowerPathMode : uint8
+{
+    Exhaustive,
+    ShortestPathTree
+};
 
 /**
  * PWR_PowerPropagation handles network-wide power distribution.
@@ -12,11 +25,16 @@
  * 2b. Detect and shut down power sources that connect to another power source
  * 2c. Traverse and memoize segment paths to sources.
  * 3. Apply power load back to segments if valid path and not faulted.
+ *    (with PathMode == ShortestPathTree, 2c and 3 are done together by SolveShortestPathTree, shared by the object
+ *    and compiled solves)
  * 4. Reset unpowered segments power levels to 0 (still at 999999, not visited by above steps)
  * 5. Detect and shut down power sources that are overloaded by power sinks
  */
 class PWR_PowerPropagation
 {
+public:
+    static inline EPowerPathMode PathMode = EPowerPathMode::ShortestPathTree;
+
 private:
     static void RecursiveMarkShorted(ICH_PowerJunction* Junction, TSet<ICH_PowerJunction*>& Visited, PWR_PowerSegment* FromSegment = nullptr)
     {
@@ -143,6 +161,179 @@ private:
         }
     }
 
+    // What a junction draws from the tree it hangs off: its usage, or for a source only its charging current
+    static float TreeLoad(bool bIsSource, bool bHasCharging, float Usage)
+    {
+        // TODO: battery node consumes current through a charging pin
+        if (!bIsSource) return Usage;
+        return bHasCharging ? Usage : 0.0f;
+    }
+
+    /**
+     * Steps 2c + 3 of both shortest-path-tree solves (object and compiled), over junction ids.
+     * Order arrives holding the live sources, with Root[j] == j; every other id in Ids has Root INDEX_NONE.
+     * ForEachExit(j, Visit) calls Visit(n, Link) for each junction n reachable from j over a NORMAL segment,
+     * leaving j the way it was entered; Link is the caller's handle for that segment (a slot, a segment index).
+     * The BFS takes sources in order, so ties go to the earlier source like the exhaustive walk. A source reached
+     * from another source's tree (a battery through its charging pin) stays a root for its own outputs, but its
+     * charging load rides the link it was first reached by (FeedParent/FeedLink).
+     * Loads are then summed bottom-up: SetLevel(Link, Level) sets that link's segment level.
+     * Last, each junction's paths are rewritten in place, reusing its arrays; SegmentOf(Link) and JunctionOf(j)
+     * give the objects.
+     */
+    template <typename ExitsFn, typename LoadFn, typename SetLevelFn, typename SegmentFn, typename JunctionFn>
+    static void SolveShortestPathTree(TConstArrayView<int32> Ids, TArray<int32>& Order,
+        TArray<int32>& Root, TArray<int32>& Depth, TArray<int32>& Parent, TArray<int32>& Link,
+        TArray<int32>& FeedParent, TArray<int32>& FeedLink, TArray<float>& SubtreeLoad,
+        ExitsFn&& ForEachExit, LoadFn&& Load, SetLevelFn&& SetLevel, SegmentFn&& SegmentOf, JunctionFn&& JunctionOf)
+    {
+        for (int32 j : Ids)
+        {
+            Depth[j] = 0;
+            Parent[j] = INDEX_NONE;
+            Link[j] = INDEX_NONE;
+            FeedParent[j] = INDEX_NONE;
+            FeedLink[j] = INDEX_NONE;
+            SubtreeLoad[j] = 0.0f;
+        }
+
+        // Step 2c: multi-source BFS, so depth is non-decreasing along Order
+        for (int32 Head = 0; Head < Order.Num(); ++Head)
+        {
+            const int32 j = Order[Head];
+            ForEachExit(j, [&](int32 n, int32 NextLink)
+            {
+                if (Root[n] == INDEX_NONE)
+                {
+                    Root[n] = Root[j];
+                    Depth[n] = Depth[j] + 1;
+                    Parent[n] = j;
+                    Link[n] = NextLink;
+                    Order.Add(n);
+                }
+                else if (Root[n] == n && Root[j] != n && FeedParent[n] == INDEX_NONE)
+                {
+                    FeedParent[n] = j;
+                    FeedLink[n] = NextLink;
+                }
+            });
+        }
+
+        // Step 3: Apply power load back to segments, deepest junctions first
+        for (int32 j : Order)
+        {
+            if (Root[j] != j)
+            {
+                SubtreeLoad[j] += Load(j);
+            }
+            else if (FeedParent[j] != INDEX_NONE)
+            {
+                const float Level = Load(j);
+                SetLevel(FeedLink[j], Level);
+                SubtreeLoad[FeedParent[j]] += Level;
+            }
+        }
+        for (int32 Head = Order.Num() - 1; Head >= 0; --Head)
+        {
+            const int32 j = Order[Head];
+            if (Parent[j] == INDEX_NONE) continue;
+            SetLevel(Link[j], SubtreeLoad[j]);
+            SubtreeLoad[Parent[j]] += SubtreeLoad[j];
+        }
+
+        // Per-junction paths; a root's segment path is its charging feed, if any
+        for (int32 j : Ids)
+        {
+            ICH_PowerJunction* Junction = JunctionOf(j);
+            if (!Junction) continue;
+            TArray<PWR_PowerSegment*>& Path = Junction->PathToSourceSegments;
+            TArray<ICH_PowerJunction*>& JPath = Junction->PathToSourceJunction;
+            Path.Reset();
+            JPath.Reset();
+            const int32 JRoot = Root[j];
+            if (JRoot == INDEX_NONE) continue;
+            if (JRoot == j)
+            {
+                JPath.Add(Junction);
+                const int32 f = FeedParent[j];
+                if (f == INDEX_NONE) continue;
+                const int32 Length = ((Root[f] == f) ? 0 : Depth[f]) + 1;
+                Path.SetNumUninitialized(Length);
+                Path[Length - 1] = SegmentOf(FeedLink[j]);
+                for (int32 k = f, i = Length - 1; i > 0; k = Parent[k], --i)
+                {
+                    Path[i - 1] = SegmentOf(Link[k]);
+                }
+                continue;
+            }
+            const int32 JDepth = Depth[j];
+            Path.SetNumUninitialized(JDepth);
+            JPath.SetNumUninitialized(JDepth + 1);
+            for (int32 k = j, i = JDepth; i > 0; k = Parent[k], --i)
+            {
+                Path[i - 1] = SegmentOf(Link[k]);
+                JPath[i] = JunctionOf(k);
+            }
+            JPath[0] = JunctionOf(JRoot);
+        }
+    }
+
+    // Steps 2c + 3 over the objects, in O(junctions + segments); links are indices into Segments
+    static void SolvePathsShortestPathTree(TArray<PWR_PowerSegment*>& Segments, TArray<ICH_PowerJunction*>& Junctions)
+    {
+        const int32 NumJunctions = Junctions.Num();
+        TMap<ICH_PowerJunction*, int32> Index;
+        Index.Reserve(NumJunctions);
+        for (int32 j = 0; j < NumJunctions; ++j) if (Junctions[j]) Index.Add(Junctions[j], j);
+        TMap<PWR_PowerSegment*, int32> SegmentIndex;
+        SegmentIndex.Reserve(Segments.Num());
+        for (int32 s = 0; s < Segments.Num(); ++s) if (Segments[s]) SegmentIndex.Add(Segments[s], s);
+
+        TArray<int32> Ids, Order, Root, Depth, Parent, Link, FeedParent, FeedLink;
+        TArray<float> SubtreeLoad;
+        Ids.Reserve(NumJunctions);
+        Order.Reserve(NumJunctions);
+        Root.Init(INDEX_NONE, NumJunctions);
+        Depth.SetNumUninitialized(NumJunctions);
+        Parent.SetNumUninitialized(NumJunctions);
+        Link.SetNumUninitialized(NumJunctions);
+        FeedParent.SetNumUninitialized(NumJunctions);
+        FeedLink.SetNumUninitialized(NumJunctions);
+        SubtreeLoad.SetNumUninitialized(NumJunctions);
+        for (int32 j = 0; j < NumJunctions; ++j)
+        {
+            Ids.Add(j);
+            ICH_PowerJunction* Junction = Junctions[j];
+            if (Junction && Junction->IsPowerSource() && !Junction->IsShutdown() && (Junction->GetPowerAvailable()>0))
+            {
+                Root[j] = j;
+                Order.Add(j);
+            }
+        }
+
+        SolveShortestPathTree(Ids, Order, Root, Depth, Parent, Link, FeedParent, FeedLink, SubtreeLoad,
+            [&](int32 j, auto&& Visit)
+            {
+                ICH_PowerJunction* Junction = Junctions[j];
+                PWR_PowerSegment* EntrySegment = (Link[j] == INDEX_NONE) ? nullptr : Segments[Link[j]];
+                for (PWR_PowerSegment* Segment : Junction->GetConnectedSegments(EntrySegment))
+                {
+                    if (!Segment || Segment->GetStatus() != EPowerSegmentStatus::NORMAL) continue;
+                    ICH_PowerJunction* Next = (Segment->GetJunctionA() == Junction) ? Segment->GetJunctionB() : Segment->GetJunctionA();
+                    int32 NextPort = (Segment->GetJunctionA() == Junction) ? Segment->GetPortB() : Segment->GetPortA();
+                    if (!Next->EnabledPorts[NextPort]) continue;
+                    const int32* NextIndex = Index.Find(Next);
+                    const int32* SegIndex = SegmentIndex.Find(Segment);
+                    if (!NextIndex || !SegIndex) continue;
+                    Visit(*NextIndex, *SegIndex);
+                }
+            },
+            [&Junctions](int32 j) { ICH_PowerJunction* J = Junctions[j]; return TreeLoad(J->IsPowerSource(), J->GetChargingSegment() != nullptr, J->GetCurrentPowerUsage()); },
+            [&Segments](int32 s, float Level) { Segments[s]->SetPowerLevel(Level); },
+            [&Segments](int32 s) { return Segments[s]; },
+            [&Junctions](int32 j) { return Junctions[j]; });
+    }
+
 public:
     static void PropagatePower(TArray<PWR_PowerSegment*>& Segments, TArray<ICH_PowerJunction*>& Junctions)
     {
@@ -209,55 +400,63 @@ public:
             }
         }
 
-        // Step 2c: Traverse and memoize segment paths to sources
-        for (ICH_PowerJunction* Junction : Junctions)
+        if (PathMode == EPowerPathMode::ShortestPathTree)
         {
-            if (Junction && Junction->IsPowerSource() && !Junction->IsShutdown() && (Junction->GetPowerAvailable()>0))
+            // Steps 2c + 3 in one pass
+            SolvePathsShortestPathTree(Segments, Junctions);
+        }
+        else
+        {
+            // Step 2c: Traverse and memoize segment paths to sources
+            for (ICH_PowerJunction* Junction : Junctions)
             {
-                // TODO: don't exit a battery node through a charging pin
-//UE_LOG(LogTemp, Warning, TEXT("Step 2c: Starting at %s memoize"), *Junction->GetSystemName());
-                TSet<ICH_PowerJunction*> Visited;
-                TArray<PWR_PowerSegment*> Path;
-                TArray<ICH_PowerJunction*> JPath;
-                RecursiveMemoizePaths(Junction, JPath, Path, Visited);
+                if (Junction && Junction->IsPowerSource() && !Junction->IsShutdown() && (Junction->GetPowerAvailable()>0))
+                {
+                    // TODO: don't exit a battery node through a charging pin
+    //UE_LOG(LogTemp, Warning, TEXT("Step 2c: Starting at %s memoize"), *Junction->GetSystemName());
+                    TSet<ICH_PowerJunction*> Visited;
+                    TArray<PWR_PowerSegment*> Path;
+                    TArray<ICH_PowerJunction*> JPath;
+                    RecursiveMemoizePaths(Junction, JPath, Path, Visited);
+                }
             }
-        }
 
-        // Step 3: Apply power load back to segments if valid path and not faulted
-        for (ICH_PowerJunction* Junction : Junctions)
-        {
-//UE_LOG(LogTemp, Warning, TEXT("Step 3: Starting at %s add up power"), *Junction->GetSystemName());
-			// TODO: battery node consumes current through a charging pin
-            if (!Junction->IsPowerSource())
+            // Step 3: Apply power load back to segments if valid path and not faulted
+            for (ICH_PowerJunction* Junction : Junctions)
             {
-            	// add Junction->GetPowerLevel() to all segments and junctions in the path to the source
-				for (PWR_PowerSegment* PathSegment : Junction->GetPathToSourceSegments())
-				{
-					if (PathSegment->GetPowerLevel() != 999999)
-					{
-						PathSegment->SetPowerLevel(Junction->GetCurrentPowerUsage() + PathSegment->GetPowerLevel());
-					}
-					else
-					{
-						PathSegment->SetPowerLevel(Junction->GetCurrentPowerUsage());
-					}
-				}
-            } else {
-				PWR_PowerSegment* PathSegmentCharge = Junction->GetChargingSegment();
-//if (PathSegment) UE_LOG(LogTemp, Warning, TEXT("Step 3: power usage for charging: %.2f"), Junction->GetCurrentPowerUsage());
-				if (PathSegmentCharge) {
-					for (PWR_PowerSegment* PathSegment : Junction->GetPathToSourceSegments())
-					{
-						if (PathSegment->GetPowerLevel() != 999999)
-						{
-							PathSegment->SetPowerLevel(Junction->GetCurrentPowerUsage() + PathSegment->GetPowerLevel());
-						}
-						else
-						{
-							PathSegment->SetPowerLevel(Junction->GetCurrentPowerUsage());
-						}
-					}
-				}
+    //UE_LOG(LogTemp, Warning, TEXT("Step 3: Starting at %s add up power"), *Junction->GetSystemName());
+    			// TODO: battery node consumes current through a charging pin
+                if (!Junction->IsPowerSource())
+                {
+                	// add Junction->GetPowerLevel() to all segments and junctions in the path to the source
+    				for (PWR_PowerSegment* PathSegment : Junction->GetPathToSourceSegments())
+    				{
+    					if (PathSegment->GetPowerLevel() != 999999)
+    					{
+    						PathSegment->SetPowerLevel(Junction->GetCurrentPowerUsage() + PathSegment->GetPowerLevel());
+    					}
+    					else
+    					{
+    						PathSegment->SetPowerLevel(Junction->GetCurrentPowerUsage());
+    					}
+    				}
+                } else {
+    				PWR_PowerSegment* PathSegmentCharge = Junction->GetChargingSegment();
+    //if (PathSegment) UE_LOG(LogTemp, Warning, TEXT("Step 3: power usage for charging: %.2f"), Junction->GetCurrentPowerUsage());
+    				if (PathSegmentCharge) {
+    					for (PWR_PowerSegment* PathSegment : Junction->GetPathToSourceSegments())
+    					{
+    						if (PathSegment->GetPowerLevel() != 999999)
+    						{
+    							PathSegment->SetPowerLevel(Junction->GetCurrentPowerUsage() + PathSegment->GetPowerLevel());
+    						}
+    						else
+    						{
+    							PathSegment->SetPowerLevel(Junction->GetCurrentPowerUsage());
+    						}
+    					}
+    				}
+                }
             }
         }
 
@@ -297,6 +496,156 @@ public:
             }
         }
     }
-};
 
+    /**
+     * The same steps over a compiled PWR_PowerGraph, limited to the given ids, which must cover whole live components
+     * (see PWR_PowerGridSolver). Steps 2c/3 always use the shortest-path tree. Solves of different components may run
+     * concurrently on the same graph, each with its own Scratch. Inputs are read into the graph's SoA arrays,
+     * the traversals run on its CSR slots and masks, and results are written back to the objects at the end; once the
+     * path arrays have grown to size, a solve allocates nothing.
+     */
+    static void PropagatePower(PWR_PowerGraph& Graph, TConstArrayView<int32> JunctionIds, TConstArrayView<int32> SegmentIds, PWR_PowerGraph::FScratch& Scratch)
+    {
+        // Step 1: Reset power levels and fault flags, read this solve's inputs
+        for (int32 s : SegmentIds)
+        {
+            if (!Graph.SegmentObjects[s]) continue;
+            Graph.SegmentLevel[s] = 999999;
+            Graph.SegmentStatus[s] = Graph.SegmentObjects[s]->GetStatus();
+            Graph.SegmentFlags[s] = 0;
+        }
+        for (int32 j : JunctionIds)
+        {
+            ICH_PowerJunction* Junction = Graph.JunctionObjects[j];
+            if (!Junction) continue;
+            Junction->SetShutdown(false);
+            Graph.JunctionFlags[j] = 0;
+            Graph.JunctionIsSource[j] = Junction->IsPowerSource();
+            Graph.JunctionHasCharging[j] = Junction->GetChargingSegment() != nullptr;
+            Graph.JunctionAvailable[j] = Junction->GetPowerAvailable();
+            for (int32 Slot = Graph.SlotStart[j]; Slot < Graph.SlotStart[j + 1]; ++Slot)
+            {
+                Graph.SlotEnabled[Slot] = Junction->IsPortEnabled(Graph.SlotPort[Slot]);
+            }
+        }
+        // shutdown goes to the object straight away: GetCurrentPowerUsage() depends on it
+        auto Shutdown = [&Graph](int32 j) { Graph.JunctionFlags[j] |= PGF_Shutdown; Graph.JunctionObjects[j]->SetShutdown(true); };
+        auto CrossMarking = [&Graph](uint8 Flag) {
+            return [&Graph, Flag](int32 Slot) {
+                const int32 s = Graph.SlotSegment[Slot];
+                if (Graph.SegmentStatus[s] == EPowerSegmentStatus::OPENED) return false;
+                Graph.SegmentFlags[s] |= Flag;
+                return true;
+            };
+        };
+
+        // Step 2a: Detect and shut down power sources that connect to shorted segments
+        for (int32 s : SegmentIds)
+        {
+            if (!Graph.SegmentObjects[s] || Graph.SegmentStatus[s] != EPowerSegmentStatus::SHORTED) continue;
+            Graph.BeginTraversal(Scratch);
+            for (int32 Slot : { Graph.SegmentSlotA[s], Graph.SegmentSlotB[s] })
+            {
+                if (Slot == INDEX_NONE || !Graph.SlotEnabled[Slot]) continue;
+                Graph.Traverse(Scratch, Graph.SlotJunction[Slot], Slot, false,
+                    [&Graph, &Shutdown](int32 k, int32) { Graph.JunctionFlags[k] |= PGF_Shorted; Shutdown(k); return false; },
+                    CrossMarking(PGF_Shorted));
+            }
+        }
 
+        // Step 2b: Detect and shut down power sources that connect to another power source (not through its charging pin)
+        for (int32 j : JunctionIds)
+        {
+            if (!Graph.JunctionObjects[j] || !Graph.JunctionIsSource[j] || (Graph.JunctionFlags[j] & PGF_Shutdown)) continue;
+            Graph.BeginTraversal(Scratch);
+            const bool bFound = Graph.Traverse(Scratch, j, INDEX_NONE, true,
+                [&Graph, j](int32 k, int32) { return k != j && Graph.JunctionIsSource[k]; },
+                [&Graph](int32 Slot) { return Graph.SegmentStatus[Graph.SlotSegment[Slot]] != EPowerSegmentStatus::OPENED; });
+            if (bFound)
+            {
+                Shutdown(j);
+                Graph.BeginTraversal(Scratch);
+                Graph.Traverse(Scratch, j, INDEX_NONE, false,
+                    [&Graph](int32 k, int32) { Graph.JunctionFlags[k] |= PGF_Overenergized; return false; },
+                    CrossMarking(PGF_Overenergized));
+            }
+        }
+
+        // Steps 2c + 3: shortest-path tree from the live sources, loads summed bottom-up; links are slots
+        TArray<int32>& Order = Scratch.Order;
+        Order.Reset();
+        for (int32 j : JunctionIds)
+        {
+            Graph.TreeRoot[j] = INDEX_NONE;
+            ICH_PowerJunction* Junction = Graph.JunctionObjects[j];
+            if (!Junction) continue;
+            Graph.JunctionUsage[j] = Junction->GetCurrentPowerUsage();
+            if (Graph.JunctionIsSource[j] && !(Graph.JunctionFlags[j] & PGF_Shutdown) && Graph.JunctionAvailable[j] > 0)
+            {
+                Graph.TreeRoot[j] = j;
+                Order.Add(j);
+            }
+        }
+        SolveShortestPathTree(JunctionIds, Order, Graph.TreeRoot, Graph.TreeDepth, Graph.TreeParent, Graph.TreeEntrySlot,
+            Graph.FeedParent, Graph.FeedSlot, Graph.SubtreeLoad,
+            [&Graph](int32 j, auto&& Visit)
+            {
+                const int32 Entry = Graph.TreeEntrySlot[j];
+                for (uint64 Mask = (Entry == INDEX_NONE) ? Graph.DepartMask[j] : Graph.SlotExitMask[Entry]; Mask; Mask &= Mask - 1)
+                {
+                    const int32 Slot = Graph.SlotStart[j] + FMath::CountTrailingZeros64(Mask);
+                    if (Graph.SegmentStatus[Graph.SlotSegment[Slot]] != EPowerSegmentStatus::NORMAL) continue;
+                    const int32 Other = Graph.SlotOther[Slot];
+                    if (Other == INDEX_NONE || !Graph.SlotEnabled[Other]) continue;
+                    Visit(Graph.SlotJunction[Other], Other);
+                }
+            },
+            [&Graph](int32 j) { return TreeLoad(Graph.JunctionIsSource[j] != 0, Graph.JunctionHasCharging[j] != 0, Graph.JunctionUsage[j]); },
+            [&Graph](int32 Slot, float Level) { Graph.SegmentLevel[Graph.SlotSegment[Slot]] = Level; },
+            [&Graph](int32 Slot) { return Graph.SegmentObjects[Graph.SlotSegment[Slot]]; },
+            [&Graph](int32 j) { return Graph.JunctionObjects[j]; });
+
+        // Step 4: Reset unpowered segment power levels to 0
+        for (int32 s : SegmentIds)
+        {
+            if (Graph.SegmentLevel[s] == 999999) Graph.SegmentLevel[s] = 0;
+        }
+
+        // Step 5: Detect and shut down power sources that are overloaded by power sinks
+        for (int32 j : JunctionIds)
+        {
+            if (!Graph.JunctionObjects[j] || !Graph.JunctionIsSource[j] || (Graph.JunctionFlags[j] & PGF_Shutdown)) continue;
+            float TotalPowerDraw = 0.0f;
+            for (uint64 Mask = Graph.DepartMask[j]; Mask; Mask &= Mask - 1)
+            {
+                const int32 s = Graph.SlotSegment[Graph.SlotStart[j] + FMath::CountTrailingZeros64(Mask)];
+                if (Graph.SegmentStatus[s] == EPowerSegmentStatus::NORMAL) TotalPowerDraw += Graph.SegmentLevel[s];
+            }
+            if (TotalPowerDraw > 0.0f && TotalPowerDraw > Graph.JunctionAvailable[j])
+            {
+                Shutdown(j);
+                Graph.BeginTraversal(Scratch);
+                Graph.Traverse(Scratch, j, INDEX_NONE, false, [](int32, int32) { return false; }, CrossMarking(PGF_UnderPowered));
+            }
+        }
+
+        // write back
+        for (int32 s : SegmentIds)
+        {
+            PWR_PowerSegment* Segment = Graph.SegmentObjects[s];
+            if (!Segment) continue;
+            Segment->SetPowerLevel(Graph.SegmentLevel[s]);
+            Segment->SetShorted((Graph.SegmentFlags[s] & PGF_Shorted) != 0);
+            Segment->SetOverenergized((Graph.SegmentFlags[s] & PGF_Overenergized) != 0);
+            Segment->SetUnderPowered((Graph.SegmentFlags[s] & PGF_UnderPowered) != 0);
+        }
+        for (int32 j : JunctionIds)
+        {
+            ICH_PowerJunction* Junction = Graph.JunctionObjects[j];
+            if (!Junction) continue;
+            Junction->SetShorted((Graph.JunctionFlags[j] & PGF_Shorted) != 0);
+            Junction->SetOverenergized((Graph.JunctionFlags[j] & PGF_Overenergized) != 0);
+            Junction->SetUnderPowered((Graph.JunctionFlags[j] & PGF_UnderPowered) != 0);
+        }
+    }
+};
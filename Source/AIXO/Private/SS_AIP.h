@@ -27,6 +27,12 @@ public:
     }
 	virtual FString GetTypeString() const override { return TEXT("SS_AIP"); }
 
+    virtual void SerializeState(FArchive& Ar) override
+    {
+        PWRJ_MultiFeederJunction::SerializeState(Ar);
+        OnOffPart->SerializeState(Ar);
+    }
+
     // --- ICommandHandler Overrides: Delegate to OnOffPart or PWR base ---
 
     virtual ECommandResult HandleCommand(const FString& Aspect, const FString& Command, const FString& Value) override
@@ -41,6 +47,17 @@ public:
         return PWRJ_MultiFeederJunction::HandleCommand(Aspect, Command, Value);
     }
 
+    // Same order as HandleCommand, on ids: the OnOff part, then POWERPORT_<n> (all the base handles)
+    virtual ECommandResult HandleCompiledCommand(const FCompiledCommand& Cmd) override
+    {
+        ECommandResult Result = OnOffPart->HandleCompiledCommand(Cmd);
+        if (Result != ECommandResult::NotHandled)
+        {
+            return Result;
+        }
+        return HandleCompiledPowerPortCommand(Cmd);
+    }
+
     virtual bool CanHandleCommand(const FString& Aspect, const FString& Command, const FString& Value) const override
     {
         return OnOffPart->CanHandleCommand(Aspect, Command, Value) ||
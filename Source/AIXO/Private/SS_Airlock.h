@@ -39,18 +39,44 @@ public:
 		  }
 	virtual FString GetTypeString() const override { return TEXT("SS_Airlock"); }
 
+    // Cycle phase and how long it has been in it
+    virtual void SerializeState(FArchive& Ar) override
+    {
+        PWRJ_MultiSelectJunction::SerializeState(Ar);
+        int32 Version;
+        if (!SerializeStateVersion(Ar, 1, Version)) return;
+        uint8 SavedCurrentState = (uint8)CurrentState;
+        Ar << SavedCurrentState << StateTimer;
+        if (Ar.IsLoading()) CurrentState = (EAirlockState)SavedCurrentState;
+    }
+
     virtual ECommandResult HandleCommand(const FString& Aspect, const FString& Command, const FString& Value) override {
         if (Aspect == "CYCLE" && Command == "START") {
-            if (Value == "EXIT")       { InitiateCycle(EAirlockState::ClosingInnerDoor, 1.0f); return ECommandResult::Handled; }
-            else if (Value == "ENTER") { InitiateCycle(EAirlockState::ClosingOuterHatch, 1.0f); return ECommandResult::Handled; }
-            else if (Value == "QUICKREADY") { InitiateCycle(EAirlockState::Flooding, 1.0f); return ECommandResult::Handled; }
-            else if (Value == "QUICKRESET") { InitiateCycle(EAirlockState::Draining, 1.0f); return ECommandResult::Handled; }
-            else if (Value == "OPEN") { InitiateCycle(EAirlockState::OpeningOuterHatch, 1.0f); return ECommandResult::Handled; }
-            else if (Value == "CLOSE") { InitiateCycle(EAirlockState::ClosingOuterHatch, 1.0f); return ECommandResult::Handled; }
+            if (HandleCycleStart(Value)) return ECommandResult::Handled;
         }
         return PWRJ_MultiSelectJunction::HandleCommand(Aspect, Command, Value);
     }
 
+    // Same as HandleCommand, on ids: CYCLE START, then the PWR base
+    virtual ECommandResult HandleCompiledCommand(const FCompiledCommand& Cmd) override {
+        static const int32 CycleId = CommandNames::Intern(TEXT("CYCLE"));
+        static const int32 StartId = CommandNames::Intern(TEXT("START"));
+        if (Cmd.AspectId == CycleId && Cmd.VerbId == StartId) {
+            if (HandleCycleStart(Cmd.Value)) return ECommandResult::Handled;
+        }
+        return PWRJ_MultiSelectJunction::HandleCompiledCommand(Cmd);
+    }
+
+    bool HandleCycleStart(const FString& Value) {
+        if (Value == "EXIT")       { InitiateCycle(EAirlockState::ClosingInnerDoor, 1.0f); return true; }
+        else if (Value == "ENTER") { InitiateCycle(EAirlockState::ClosingOuterHatch, 1.0f); return true; }
+        else if (Value == "QUICKREADY") { InitiateCycle(EAirlockState::Flooding, 1.0f); return true; }
+        else if (Value == "QUICKRESET") { InitiateCycle(EAirlockState::Draining, 1.0f); return true; }
+        else if (Value == "OPEN") { InitiateCycle(EAirlockState::OpeningOuterHatch, 1.0f); return true; }
+        else if (Value == "CLOSE") { InitiateCycle(EAirlockState::ClosingOuterHatch, 1.0f); return true; }
+        return false;
+    }
+
     virtual bool CanHandleCommand(const FString& Aspect, const FString& Command, const FString& Value) const override {
         if (Aspect == "CYCLE" && Command == "START") {
             return Value == "EXIT" || Value == "ENTER" || Value == "QUICKREADY" || Value == "QUICKRESET" || Value == "OPEN" || Value == "CLOSE";
@@ -25,6 +25,16 @@ public:
         bBattery1 = true;
     }
 
+    // Charge level lives in ASubmarineState; this is just which pin charges it
+    virtual void SerializeState(FArchive& Ar) override
+    {
+        PWRJ_MultiFeederJunction::SerializeState(Ar);
+        int32 Version;
+        if (!SerializeStateVersion(Ar, 1, Version)) return;
+        Ar << iChargingPin;
+        InputPart->SerializeState(Ar);
+    }
+
     virtual PWR_PowerSegment *GetChargingSegment() const override {
     	if (iChargingPin == -1) return nullptr;
     	return Ports[iChargingPin];
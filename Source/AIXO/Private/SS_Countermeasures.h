@@ -31,6 +31,14 @@ public:
     }
 	virtual FString GetTypeString() const override { return TEXT("SS_Countermeasures"); }
 
+    virtual void SerializeState(FArchive& Ar) override
+    {
+        PWRJ_MultiSelectJunction::SerializeState(Ar);
+        int32 Version;
+        if (!SerializeStateVersion(Ar, 1, Version)) return;
+        Ar << Jamming << Degauss << AudioMasking;
+    }
+
     virtual ECommandResult HandleCommand(const FString& Aspect, const FString& Command, const FString& Value) override {
         FString UAspect = Aspect.ToUpper();
         if (UAspect.StartsWith("EMP") && Command == "FIRE") {
@@ -25,6 +25,12 @@ public:
     }
 	virtual FString GetTypeString() const override { return TEXT("SS_Electrolysis"); }
 
+    virtual void SerializeState(FArchive& Ar) override
+    {
+        PWRJ_MultiSelectJunction::SerializeState(Ar);
+        OnOffPart.SerializeState(Ar);
+    }
+
     virtual ECommandResult HandleCommand(const FString& Aspect, const FString& Command, const FString& Value) override
     {
 //UE_LOG(LogTemp, Warning, TEXT("SS_Electrolysis::HandleCommand: %s %s %s"), *Aspect, *Command, *Value);
@@ -27,6 +27,15 @@ public:
     }
 	virtual FString GetTypeString() const override { return TEXT("SS_Elevator"); }
 
+    virtual void SerializeState(FArchive& Ar) override
+    {
+        PWRJ_MultiSelectJunction::SerializeState(Ar);
+        int32 Version;
+        if (!SerializeStateVersion(Ar, 1, Version)) return;
+        ActuatorPart.SerializeState(Ar);
+        Ar << bIsMoving;
+    }
+
     virtual ECommandResult HandleCommand(const FString& Aspect, const FString& Command, const FString& Value) override
     {
         auto Result = ActuatorPart.HandleCommand(Aspect, Command, Value);
@@ -35,6 +44,15 @@ public:
         return PWRJ_MultiSelectJunction::HandleCommand(Aspect, Command, Value);
     }
 
+    // Same order as HandleCommand, on ids: the actuator part, then the PWR base
+    virtual ECommandResult HandleCompiledCommand(const FCompiledCommand& Cmd) override
+    {
+        auto Result = ActuatorPart.HandleCompiledCommand(Cmd);
+        if (Result != ECommandResult::NotHandled)
+            return Result;
+        return PWRJ_MultiSelectJunction::HandleCompiledCommand(Cmd);
+    }
+
     virtual bool CanHandleCommand(const FString& Aspect, const FString& Command, const FString& Value) const override
     {
         return ActuatorPart.CanHandleCommand(Aspect, Command, Value) || PWRJ_MultiSelectJunction::CanHandleCommand(Aspect, Command, Value);
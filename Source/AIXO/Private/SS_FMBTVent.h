@@ -24,6 +24,14 @@ public:
 		SubState->ForwardMBTLevel = val;
     }
 
+    virtual void SerializeState(FArchive& Ar) override
+    {
+        MSJ_Powered_OpenClose::SerializeState(Ar);
+        int32 Version;
+        if (!SerializeStateVersion(Ar, 1, Version)) return;
+        Ar << bIsBlowing;
+    }
+
 	bool bIsBlowing = false;
 
     virtual ECommandResult HandleCommand(const FString& Aspect, const FString& Command, const FString& Value) override
@@ -95,6 +103,7 @@ public:
     	if (!HasPower()) {
     		if (bIsBlowing) {
                 HandleCommand("BLOW", "SET", "false");
+                MarkStateChanged();
 			}
     		return;
     	}
@@ -25,6 +25,15 @@ public:
     }
 	virtual FString GetTypeString() const override { return TEXT("SS_FTBTPump"); }
 
+    virtual void SerializeState(FArchive& Ar) override
+    {
+        PWRJ_MultiSelectJunction::SerializeState(Ar);
+        int32 Version;
+        if (!SerializeStateVersion(Ar, 1, Version)) return;
+        PumpPart->SerializeState(Ar);
+        Ar << bTargetingLevel << bTargetLevel;
+    }
+
     virtual float GetLevel()
     {
     	return SubState->ForwardTBTLevel;
@@ -25,6 +25,15 @@ public:
 	}
 	virtual FString GetTypeString() const override { return TEXT("SS_MBT"); }
 
+    virtual void SerializeState(FArchive& Ar) override
+    {
+        PWRJ_MultiSelectJunction::SerializeState(Ar);
+        int32 Version;
+        if (!SerializeStateVersion(Ar, 1, Version)) return;
+        OpenClosePart->SerializeState(Ar);
+        Ar << bIsBlowing << bIsEBlowing;
+    }
+
     virtual float GetLevel()
     {
     	if (SystemName == "RMBT") return SubState->RearMBTLevel;
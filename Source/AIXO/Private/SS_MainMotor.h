@@ -29,6 +29,14 @@ public:
     }
 	virtual FString GetTypeString() const override { return TEXT("SS_MainMotor"); }
 
+    virtual void SerializeState(FArchive& Ar) override
+    {
+        PWRJ_MultiSelectJunction::SerializeState(Ar);
+        int32 Version;
+        if (!SerializeStateVersion(Ar, 1, Version)) return;
+        Ar << Throttle << bSilentRunning;
+    }
+
     virtual ECommandResult HandleCommand(const FString& Aspect, const FString& Command, const FString& Value) override
     {
 //UE_LOG(LogTemp, Warning, TEXT("SS_MainMotor::HandleCommand: %s %s %s"), *Aspect, *Command, *Value);
@@ -27,6 +27,15 @@ public:
     }
 	virtual FString GetTypeString() const override { return TEXT("SS_Rudder"); }
 
+    virtual void SerializeState(FArchive& Ar) override
+    {
+        PWRJ_MultiSelectJunction::SerializeState(Ar);
+        int32 Version;
+        if (!SerializeStateVersion(Ar, 1, Version)) return;
+        ActuatorPart.SerializeState(Ar);
+        Ar << bIsMoving;
+    }
+
     // --- ICommandHandler Overrides: Delegate to ActuatorPart or PWR base ---
 
     virtual ECommandResult HandleCommand(const FString& Aspect, const FString& Command, const FString& Value) override
@@ -39,6 +48,15 @@ public:
         return PWRJ_MultiSelectJunction::HandleCommand(Aspect, Command, Value);
     }
 
+    // Same order as HandleCommand, on ids: the actuator part, then the PWR base
+    virtual ECommandResult HandleCompiledCommand(const FCompiledCommand& Cmd) override
+    {
+        auto Result = ActuatorPart.HandleCompiledCommand(Cmd);
+        if (Result != ECommandResult::NotHandled)
+            return Result;
+        return PWRJ_MultiSelectJunction::HandleCompiledCommand(Cmd);
+    }
+
     virtual bool CanHandleCommand(const FString& Aspect, const FString& Command, const FString& Value) const override
     {
         // Check if either the actuator part or the power part can handle it
@@ -27,6 +27,15 @@ public:
     }
 	virtual FString GetTypeString() const override { return TEXT("SS_TBT"); }
 
+    virtual void SerializeState(FArchive& Ar) override
+    {
+        PWRJ_MultiSelectJunction::SerializeState(Ar);
+        int32 Version;
+        if (!SerializeStateVersion(Ar, 1, Version)) return;
+        PumpPart->SerializeState(Ar);
+        Ar << bTargetingLevel << bTargetLevel << bIsBlowing;
+    }
+
     virtual float GetLevel()
     {
     	if (SystemName == "RTBT") return SubState->RearTBTLevel;
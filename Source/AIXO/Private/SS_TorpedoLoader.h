@@ -50,6 +50,40 @@ public:
     }
 	virtual FString GetTypeString() const override { return TEXT("SS_TorpedoLoader"); }
 
+    // Stack contents and whatever is on the conveyors
+    virtual void SerializeState(FArchive& Ar) override
+    {
+        PWRJ_MultiSelectJunction::SerializeState(Ar);
+        int32 Version;
+        if (!SerializeStateVersion(Ar, 1, Version)) return;
+        int32 NumSaved = Stacks.Num();
+        Ar << NumSaved;
+        if (Ar.IsLoading())
+        {
+            if (NumSaved < 0 || NumSaved > NumStacks) { Ar.SetError(); return; }
+            Stacks.SetNum(NumSaved);
+        }
+        for (Stack& S : Stacks)
+        {
+            TArray<uint8> Types;
+            for (ETorpedoType T : S.Torpedoes) Types.Add((uint8)T);
+            Ar << Types;
+            if (Ar.IsLoading())
+            {
+                S.Torpedoes.Reset();
+                for (uint8 T : Types) S.Torpedoes.Add((ETorpedoType)T);
+            }
+        }
+        uint8 SavedConveyor = (uint8)ConveyorTorpedo;
+        uint8 SavedLoadConveyor = (uint8)LoadConveyorTorpedo;
+        Ar << CentralConveyorPosition << SavedConveyor << SavedLoadConveyor << LoadProgress;
+        if (Ar.IsLoading())
+        {
+            ConveyorTorpedo = (ETorpedoType)SavedConveyor;
+            LoadConveyorTorpedo = (ETorpedoType)SavedLoadConveyor;
+        }
+    }
+
     virtual void Tick(float DeltaTime) override
     {
         if (!HasPower()) return;
@@ -74,6 +74,23 @@ public:
 	}
 	virtual FString GetTypeString() const override { return TEXT("SS_TorpedoTube"); }
 
+    // Where the launch sequence is and how far along, doors, flooding and RAM included
+    virtual void SerializeState(FArchive& Ar) override
+    {
+        PWRJ_MultiSelectJunction::SerializeState(Ar);
+        int32 Version;
+        if (!SerializeStateVersion(Ar, 1, Version)) return;
+        uint8 SavedTubeState = (uint8)TubeState;
+        uint8 SavedRAMValve = (uint8)RAMValve;
+        Ar << bTorpedoLoaded << InnerDoorClosedAmount << OuterDoorClosedAmount << WaterLevel << TubePressure << bRAMCharged;
+        Ar << SavedTubeState << SavedRAMValve << LoadingProgress << TimeLeftToWait;
+        if (Ar.IsLoading())
+        {
+            TubeState = (ETorpedoTubeState)SavedTubeState;
+            RAMValve = (ERAMValvePosition)SavedRAMValve;
+        }
+    }
+
 	virtual void Tick(float DeltaTime) override
 	{
 		if (!HasPower()) return;
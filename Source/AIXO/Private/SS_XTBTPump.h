@@ -22,6 +22,12 @@ public:
     }
 	virtual FString GetTypeString() const override { return TEXT("SS_XTBTPump"); }
 
+    virtual void SerializeState(FArchive& Ar) override
+    {
+        PWRJ_MultiSelectJunction::SerializeState(Ar);
+        PumpPart->SerializeState(Ar);
+    }
+
     virtual ECommandResult HandleCommand(const FString& Aspect, const FString& Command, const FString& Value) override
     {
         auto Result = PumpPart->HandleCommand(Aspect, Command, Value);
@@ -32,6 +38,15 @@ public:
 
     virtual void SetPumpRate(float InPumpRate) { PumpPart->SetPumpRate(InPumpRate); }
 
+    // Same order as HandleCommand, on ids: the pump part, then the PWR base
+    virtual ECommandResult HandleCompiledCommand(const FCompiledCommand& Cmd) override
+    {
+        auto Result = PumpPart->HandleCompiledCommand(Cmd);
+        if (Result != ECommandResult::NotHandled)
+            return Result;
+        return PWRJ_MultiSelectJunction::HandleCompiledCommand(Cmd);
+    }
+
     virtual bool CanHandleCommand(const FString& Aspect, const FString& Command, const FString& Value) const override
     {
         return PumpPart->CanHandleCommand(Aspect, Command, Value) || PWRJ_MultiSelectJunction::CanHandleCommand(Aspect, Command, Value);
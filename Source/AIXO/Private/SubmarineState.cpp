@@ -57,6 +57,19 @@ void ASubmarineState::ApplyPhysics()
 	}
 }
 
+void ASubmarineState::SerializeState(FArchive& Ar)
+{
+    int32 Version;
+    if (!SerializeStateLayerVersion(Ar, 1, Version)) return;
+    Ar << SubmarineLocation << SubmarineRotation << Velocity;
+    Ar << H2Level << LOXLevel << Flask1Level << Flask2Level << Battery1Level << Battery2Level << AlertLevel;
+    Ar << RudderAngle << ElevatorAngle << RightBowPlanesAngle << LeftBowPlanesAngle;
+    Ar << ForwardMBTLevel << RearMBTLevel << ForwardTBTLevel << RearTBTLevel;
+    Ar << Occupied << WaterLevel << Pressure << OuterHatchOpen << InnerDoorOpen;
+    Ar << HullIntegrity << bIsFlooding << FloodingRate;
+    Ar << bSonarPingActive << bEngineRunning;
+}
+
 void ASubmarineState::UpdateRendering()
 {
     if (bSonarPingActive)
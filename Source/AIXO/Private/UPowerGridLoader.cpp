@@ -554,14 +554,20 @@ bool UPowerGridLoader::LoadPowerGridFromJson(
     UE_LOG(LogTemp, Log, TEXT("LoadPowerGridFromJson: Successfully created %d segments."), OutSegments.Num());
 
     // --- 4. Apply deferred InitialCommands now that all segments exist ---
+    // The junctions aren't registered with a CommandDistributor yet, so this batches by hand the way
+    // CommandDistributor::CommitTransaction does: every command first, then one PostHandleCommand per junction.
+    const double CommandsStartTime = FPlatformTime::Seconds();
+    int32 NumCommands = 0, NumHandled = 0;
     for (auto& Pair : PendingCommands)
     {
         ICH_PowerJunction* Junction = Pair.Key;
         const TArray<FString>& CmdList = Pair.Value;
 
+        bool bChanged = false;
         for (const FString& CmdStr : CmdList)
         {
             FString Aspect, Command, Value;
+            NumCommands++;
             if (ParseCommandString(CmdStr, Aspect, Command, Value))
             {
                 ECommandResult Result = Junction->HandleCommand(Aspect, Command, Value);
@@ -569,14 +575,21 @@ bool UPowerGridLoader::LoadPowerGridFromJson(
                 {
                     UE_LOG(LogTemp, Warning, TEXT("LoadPowerGridFromJson: Deferred command '%s' not handled by junction '%s'."), *CmdStr, *Junction->GetSystemName());
                 }
-                Junction->PostHandleCommand();
+                else
+                {
+                    bChanged = true;
+                    if (Result == ECommandResult::Handled) NumHandled++;
+                }
             }
             else
             {
                 UE_LOG(LogTemp, Error, TEXT("LoadPowerGridFromJson: Failed to parse deferred command '%s' for junction '%s'."), *CmdStr, *Junction->GetSystemName());
             }
         }
+        if (bChanged) Junction->PostHandleCommand();
     }
+    UE_LOG(LogTemp, Log, TEXT("LoadPowerGridFromJson: Applied %d/%d deferred commands to %d junctions in %.3f ms."),
+        NumHandled, NumCommands, PendingCommands.Num(), (FPlatformTime::Seconds() - CommandsStartTime) * 1000.0);
 
     UE_LOG(LogTemp, Log, TEXT("LoadPowerGridFromJson: Finished loading grid from %s"), *JsonFilePath);
     return true;
@@ -20,6 +20,8 @@ protected:
     FString StateValueRepresented;  // The state value this button corresponds to (e.g., 1 for ON, -1 for OFF)
     FString DisplayText;          // Text to display on the button (e.g., "ON", "OFF")
     FString QueryAspect;
+    TArray<FCompiledCommand> CompiledCommands;
+    bool bCommandCompiled = false;
 
 public:
     VE_CommandButton(ICH_PowerJunction* InOwner, 
@@ -100,15 +102,16 @@ public:
 				{
 					if (isInside)
 					{
-						// Send the command(s)
-						TArray<FString> CommandLines;
-						CommandToSend.ParseIntoArray(CommandLines, TEXT("\n"), true);
-
+						// Send the command(s), compiled on the first tap
+						if (!bCommandCompiled)
+						{
+							Distributor->CompileCommandLines(Owner->GetSystemName(), CommandToSend, CompiledCommands);
+							bCommandCompiled = true;
+						}
 						ECommandResult Result = ECommandResult::NotHandled;
-						for (const FString& Line : CommandLines)
+						for (const FCompiledCommand& Cmd : CompiledCommands)
 						{
-							FString OneCommand = FString::Printf(TEXT("%s.%s"), *Owner->GetSystemName(), *Line);
-							Result = Distributor->ProcessCommand(OneCommand);
+							Result = Distributor->ExecuteCommand(Cmd);
 							if (Result == ECommandResult::HandledWithError) {
 								return true; // Handled the touch event
 							}
@@ -27,6 +27,21 @@ protected:
     FString TextOn = "ON";        // Display text when ON
     FString TextOff = "OFF";      // Display text when OFF
 
+    // Both fragments compiled on first use; a button sends the same lines every time
+    TArray<FCompiledCommand> CompiledOn;
+    TArray<FCompiledCommand> CompiledOff;
+    bool bCommandsCompiled = false;
+    const TArray<FCompiledCommand>& GetCompiledCommands(CommandDistributor* Distributor, bool bOn)
+    {
+        if (!bCommandsCompiled)
+        {
+            Distributor->CompileCommandLines(Owner->GetSystemName(), CommandToSendOn, CompiledOn);
+            Distributor->CompileCommandLines(Owner->GetSystemName(), CommandToSendOff, CompiledOff);
+            bCommandsCompiled = true;
+        }
+        return bOn ? CompiledOn : CompiledOff;
+    }
+
 public:
     VE_MomentaryButton(ICH_PowerJunction* InOwner, 
                      const FBox2D& InRelativeBounds,
@@ -126,18 +141,11 @@ public:
 				{
 					if (isInside)
 					{
-						// Determine the command to send (toggle to the *opposite* state)
-						const FString& CommandFragment = CommandToSendOn;
-						
 						// Send the command(s)
-						TArray<FString> CommandLines;
-						CommandFragment.ParseIntoArray(CommandLines, TEXT("\n"), true);
-
 						ECommandResult Result = ECommandResult::NotHandled;
-						for (const FString& Line : CommandLines)
+						for (const FCompiledCommand& Cmd : GetCompiledCommands(Distributor, true))
 						{
-							FString OneCommand = FString::Printf(TEXT("%s.%s"), *Owner->GetSystemName(), *Line);
-							Result = Distributor->ProcessCommand(OneCommand);
+							Result = Distributor->ExecuteCommand(Cmd);
 							if (Result == ECommandResult::HandledWithError) {
 								return true; // Handled the touch event
 							}
@@ -160,18 +168,11 @@ public:
 				{
 					if (isInside)
 					{
-						// Determine the command to send (toggle to the *opposite* state)
-						const FString& CommandFragment = CommandToSendOff;
-						
 						// Send the command(s)
-						TArray<FString> CommandLines;
-						CommandFragment.ParseIntoArray(CommandLines, TEXT("\n"), true);
-
 						ECommandResult Result = ECommandResult::NotHandled;
-						for (const FString& Line : CommandLines)
+						for (const FCompiledCommand& Cmd : GetCompiledCommands(Distributor, false))
 						{
-							FString OneCommand = FString::Printf(TEXT("%s.%s"), *Owner->GetSystemName(), *Line);
-							Result = Distributor->ProcessCommand(OneCommand);
+							Result = Distributor->ExecuteCommand(Cmd);
 							if (Result == ECommandResult::HandledWithError) {
 								return true; // Handled the touch event
 							}
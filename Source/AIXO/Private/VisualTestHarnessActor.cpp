@@ -220,6 +220,27 @@ void AVisualTestHarnessActor::BeginPlay()
     InitializeTestSystems();
     InitializeVisualization();
 	if (VizManager) VizManager->ClearSelections();
+
+	// a committed batch of commands is solved and reflected in the context blocks once, right away,
+	// so a multi-command tool call answers with post-solve state instead of waiting for the next Tick
+	CmdDistributor.SetCommitHook([this]()
+	{
+		if (VizManager) VizManager->UpdatePower();
+		ContextBlocks.Update(CmdDistributor);
+	});
+
+	CmdDistributor.SetCommandObserver([this](const FCompiledCommand& Cmd, ECommandResult Result)
+	{
+		Journal.RecordCommand(Cmd, Result);		// no-op unless recording
+	});
+	CmdDistributor.SetTransactionObserver([this](bool bBegin) { Journal.RecordTransaction(bBegin); });
+	if (bRecordJournal)
+	{
+		const FString Path = FPaths::ProjectSavedDir() + TEXT("Journals/Session_") + FDateTime::Now().ToString() + TEXT(".aixj");
+		Journal.Begin(Path);
+		RecordJournalKeyframe();
+		UE_LOG(LogTemp, Log, TEXT("Recording journal %s"), *Path);
+	}
 	
 	for (ICommandHandler* Handler : CmdDistributor.GetCommandHandlers())
 	{
@@ -240,9 +261,10 @@ void AVisualTestHarnessActor::BeginPlay()
     {
 		FString SystemsContextBlock = MakeSystemsBlock();
 		FString LowFreqContextBlock = MakeStatusBlock();
-		SystemsContextBlockRecent = SystemsContextBlock;
-		LowFreqContextBlockRecent = LowFreqContextBlock;
+		SystemsContextBlockVersionSent = ContextBlocks.GetSystemsBlockVersion();
+		LowFreqContextBlockVersionSent = ContextBlocks.GetStatusBlockVersion();
         LlamaAIXOComponent->ActivateLlamaComponent(SystemsContextBlock, LowFreqContextBlock);
+        LlamaAIXOComponent->SetToolCallGrammar(MakeToolCallGrammar());
     }
     else
     {
@@ -261,11 +283,13 @@ void AVisualTestHarnessActor::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
 
+    Journal.RecordTick(DeltaTime);		// commands after this point carry this frame's time
+
     UpdateStateDisplay();
 
     if (RenderContext && VizManager)
     {
-		PWR_PowerPropagation::PropagatePower(VizManager->Segments, VizManager->Junctions);
+		VizManager->UpdatePower();		// no-op on frames where nothing on the grid changed
 
         if (RenderContext->BeginDrawing()) 
         {
@@ -346,43 +370,54 @@ void AVisualTestHarnessActor::Tick(float DeltaTime)
 
     CmdDistributor.TickAll(DeltaTime);
 
-    if (LlamaAIXOComponent->IsLlamaReady()) {
-        FString CurrentSystemsBlock = MakeSystemsBlock();
-        if (SystemsContextBlockRecent != CurrentSystemsBlock) {
-            bPendingStaticWorldInfoUpdate = true;
-            PendingStaticWorldInfoText = CurrentSystemsBlock;
+    if (RewindHistoryLength > 0 && RewindSnapshotInterval > 0.0f)
+    {
+        RewindSnapshotTimer += DeltaTime;
+        if (RewindSnapshotTimer >= RewindSnapshotInterval)
+        {
+            RewindSnapshotTimer = 0.0f;
+            if (RewindHistory.Num() >= RewindHistoryLength)
+            {
+                SimulationSnapshot Oldest = MoveTemp(RewindHistory[0]);
+                RewindHistory.RemoveAt(0, 1, EAllowShrinking::No);
+                RewindHistory.Add(MoveTemp(Oldest));
+            }
+            else
+            {
+                RewindHistory.AddDefaulted();
+            }
+            RewindHistory.Last().Capture(CmdDistributor, SubmarineState.Get());
         }
+    }
+
+    if (Journal.IsRecording() && Journal.GetTime() - LastJournalKeyframeTime >= JournalKeyframeInterval)
+    {
+        RecordJournalKeyframe();
+    }
 
-        FString CurrentLowFreqBlock = MakeStatusBlock();
-        if (LowFreqContextBlockRecent != CurrentLowFreqBlock) {
-            bPendingLowFrequencyStateUpdate = true;
-            PendingLowFrequencyStateText = CurrentLowFreqBlock;
+    if (LlamaAIXOComponent->IsLlamaReady()) {
+        // Send each change once; while Llama is busy the component keeps only the newest text per block
+        // and applies it at the next turn boundary. The builder only touches strings for handlers whose version moved.
+        ContextBlocks.Update(CmdDistributor);
+        if (SystemsContextBlockVersionSent != ContextBlocks.GetSystemsBlockVersion()) {
+            const int32 Generation = LlamaAIXOComponent->UpdateContextBlock(ELlamaContextBlockType::StaticWorldInfo, MakeSystemsBlock());
+            UE_LOG(LogTemp, Log, TEXT("ULlamaComponent: StaticWorldInfo changed. Submitted generation %d."), Generation);
+            SystemsContextBlockVersionSent = ContextBlocks.GetSystemsBlockVersion(); // Mark as sent
         }
 
-        // Attempt to send pending updates if Llama is not busy
-        if (!LlamaAIXOComponent->IsLlamaBusy()) { // Check the flag
-            if (bPendingStaticWorldInfoUpdate) {
-                UE_LOG(LogTemp, Log, TEXT("ULlamaComponent: StaticWorldInfo changed. Queuing update NOW."));
-                LlamaAIXOComponent->UpdateContextBlock(ELlamaContextBlockType::StaticWorldInfo, PendingStaticWorldInfoText);
-                SystemsContextBlockRecent = PendingStaticWorldInfoText; // Mark as sent
-                bPendingStaticWorldInfoUpdate = false;
-            }
-            if (bPendingLowFrequencyStateUpdate) {
-                UE_LOG(LogTemp, Log, TEXT("ULlamaComponent: LowFrequencyState changed. Queuing update NOW."));
-                LlamaAIXOComponent->UpdateContextBlock(ELlamaContextBlockType::LowFrequencyState, PendingLowFrequencyStateText);
-                LowFreqContextBlockRecent = PendingLowFrequencyStateText; // Mark as sent
-                bPendingLowFrequencyStateUpdate = false;
-            }
-        } else {
-            if (bPendingStaticWorldInfoUpdate || bPendingLowFrequencyStateUpdate) {
-//                UE_LOG(LogTemp, Log, TEXT("ULlamaComponent: Llama is busy, context updates deferred."));
-            }
+        if (LowFreqContextBlockVersionSent != ContextBlocks.GetStatusBlockVersion()) {
+            const int32 Generation = LlamaAIXOComponent->UpdateContextBlock(ELlamaContextBlockType::LowFrequencyState, MakeStatusBlock());
+            UE_LOG(LogTemp, Log, TEXT("ULlamaComponent: LowFrequencyState changed. Submitted generation %d."), Generation);
+            LowFreqContextBlockVersionSent = ContextBlocks.GetStatusBlockVersion(); // Mark as sent
         }
     }
 }
 
 void AVisualTestHarnessActor::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
+    Journal.Stop();
+    CmdDistributor.SetCommandObserver(nullptr);
+    CmdDistributor.SetTransactionObserver(nullptr);
     delete VizManager;  // Clean up
     VizManager = nullptr;
     RenderContext.Reset();
@@ -1454,7 +1489,102 @@ sol->SetSelectedPort(-1);
 void AVisualTestHarnessActor::ProcessCommandString(const FString& Command)
 {
     UE_LOG(LogTemp, Log, TEXT("Processing Command: %s"), *Command);
-    CmdDistributor.ProcessCommandBlock(Command);
+    const FCommandTransactionResult Result = CmdDistributor.ProcessCommandBlock(Command);
+    UE_LOG(LogTemp, Log, TEXT("  %d handled, %d failed, %d systems changed, %.3f ms (apply %.3f, commit %.3f)"),
+        Result.NumHandled, Result.NumFailed, Result.NumHandlers, Result.GetTotalMs(), Result.ApplyMs, Result.CommitMs);
+}
+
+bool AVisualTestHarnessActor::SaveSimulationSnapshot(const FString& FileName)
+{
+    SimulationSnapshot Snapshot;
+    const FString Path = FPaths::ProjectSavedDir() + TEXT("Snapshots/") + FileName;
+    if (!Snapshot.Capture(CmdDistributor, SubmarineState.Get()) || !Snapshot.SaveToFile(Path))
+    {
+        AddLogMessage(FString::Printf(TEXT("ERROR saving snapshot %s"), *Path));
+        return false;
+    }
+    AddLogMessage(FString::Printf(TEXT("Saved snapshot %s (%d bytes, %.3f ms)"), *FileName, Snapshot.GetData().Num(), Snapshot.GetCaptureMs()));
+    return true;
+}
+
+bool AVisualTestHarnessActor::LoadSimulationSnapshot(const FString& FileName)
+{
+    SimulationSnapshot Snapshot;
+    const FString Path = FPaths::ProjectSavedDir() + TEXT("Snapshots/") + FileName;
+    if (!Snapshot.LoadFromFile(Path) || !RestoreSimulationSnapshot(Snapshot))
+    {
+        AddLogMessage(FString::Printf(TEXT("ERROR loading snapshot %s"), *Path));
+        return false;
+    }
+    RewindHistory.Reset();		// the history belongs to the timeline we just left
+    RewindSnapshotTimer = 0.0f;
+    AddLogMessage(FString::Printf(TEXT("Loaded snapshot %s"), *FileName));
+    return true;
+}
+
+bool AVisualTestHarnessActor::RewindSimulation(float Seconds)
+{
+    if (RewindHistory.Num() == 0 || RewindSnapshotInterval <= 0.0f) return false;
+    // the newest snapshot is RewindSnapshotTimer old, each one before it RewindSnapshotInterval older
+    const int32 Back = FMath::Max(0, FMath::CeilToInt((Seconds - RewindSnapshotTimer) / RewindSnapshotInterval));
+    const int32 Index = FMath::Max(0, RewindHistory.Num() - 1 - Back);
+    const float Rewound = (RewindHistory.Num() - 1 - Index) * RewindSnapshotInterval + RewindSnapshotTimer;
+    if (!RestoreSimulationSnapshot(RewindHistory[Index])) return false;
+    RewindHistory.SetNum(Index + 1, EAllowShrinking::No);
+    RewindSnapshotTimer = 0.0f;
+    AddLogMessage(FString::Printf(TEXT("Rewound %.1f seconds"), Rewound));
+    return true;
+}
+
+// Restores, then re-solves the grid and refreshes the context blocks right away rather than on the next Tick
+bool AVisualTestHarnessActor::RestoreSimulationSnapshot(const SimulationSnapshot& Snapshot)
+{
+    if (!Snapshot.Restore(CmdDistributor, SubmarineState.Get())) return false;
+    if (VizManager) VizManager->UpdatePower();
+    ContextBlocks.Update(CmdDistributor);
+    if (Journal.IsRecording()) RecordJournalKeyframe(true);		// replay jumps here too
+    return true;
+}
+
+// A keyframe is a snapshot in the journal; writing one also flushes the records before it to disk
+void AVisualTestHarnessActor::RecordJournalKeyframe(bool bRestore)
+{
+    if (!JournalKeyframe.Capture(CmdDistributor, SubmarineState.Get())) return;
+    Journal.RecordKeyframe(JournalKeyframe, bRestore);
+    Journal.Flush();
+    LastJournalKeyframeTime = Journal.GetTime();
+}
+
+bool AVisualTestHarnessActor::ReplayJournal(const FString& FileName, float Time)
+{
+    Journal.Stop();		// replaying runs commands through the distributor the journal observes
+    CommandJournal Loaded;
+    const CommandJournal* Source = &Journal;
+    if (!FileName.IsEmpty())
+    {
+        const FString Path = FPaths::ProjectSavedDir() + TEXT("Journals/") + FileName;
+        if (!Loaded.LoadFromFile(Path))
+        {
+            AddLogMessage(FString::Printf(TEXT("ERROR loading journal %s"), *Path));
+            return false;
+        }
+        Source = &Loaded;
+    }
+
+    JournalReplay Replay(*Source, CmdDistributor, SubmarineState.Get());
+    Replay.SolvePower = [this]() { if (VizManager) VizManager->UpdatePower(); };
+    if (!Replay.Seek(Time))
+    {
+        AddLogMessage(FString::Printf(TEXT("ERROR replaying journal to %.1f s"), Time));
+        return false;
+    }
+    if (VizManager) VizManager->UpdatePower();
+    ContextBlocks.Update(CmdDistributor);
+    RewindHistory.Reset();
+    RewindSnapshotTimer = 0.0f;
+    AddLogMessage(FString::Printf(TEXT("Replayed to %.1f s: %d ticks, %d commands in %.1f ms; %d of %d checkpoints diverged"),
+        Replay.GetTime(), Replay.GetNumTicks(), Replay.GetNumCommands(), Replay.GetLastSeekMs(), Replay.GetNumMismatches(), Replay.GetNumCheckpoints()));
+    return true;
 }
 
 TArray<FString> AVisualTestHarnessActor::GetAvailableCommandsList()
@@ -1612,146 +1742,132 @@ FString AVisualTestHarnessActor::MakeHFSString()
 	return UTF8_TO_TCHAR(str.c_str());
 }
 
-#define FULL_SYSTEMS_DESC_IN_CONTEXT
-FString AVisualTestHarnessActor::MakeSystemsBlock()
+// GBNF helpers for MakeToolCallGrammar
+static FString GbnfLiteral(const FString& Text)
 {
-#ifdef FULL_SYSTEMS_DESC_IN_CONTEXT
-	FString str = "\nSUBMARINE SYSTEMS:\n";		// StaticWorldInfo
+	FString Escaped = Text.Replace(TEXT("\\"), TEXT("\\\\")).Replace(TEXT("\""), TEXT("\\\""));
+	return TEXT("\"") + Escaped + TEXT("\"");
+}
+
+// "POWERPORT_<n>" / "EMP%d" -> "POWERPORT_" num / "EMP" num
+static FString GbnfAspectTemplate(const FString& Aspect)
+{
+	FString Out;
+	FString Literal;
+	for (int32 i = 0; i < Aspect.Len(); i++) {
+		int32 PlaceholderEnd = INDEX_NONE;
+		if (Aspect[i] == '<') PlaceholderEnd = Aspect.Find(TEXT(">"), ESearchCase::CaseSensitive, ESearchDir::FromStart, i);
+		else if (Aspect[i] == '%' && i + 1 < Aspect.Len() && Aspect[i+1] == 'd') PlaceholderEnd = i + 1;
+		if (PlaceholderEnd == INDEX_NONE) {
+			Literal.AppendChar(Aspect[i]);
+			continue;
+		}
+		if (Literal.Len() > 0) Out += GbnfLiteral(Literal) + TEXT(" ");
+		Out += TEXT("num ");
+		Literal.Empty();
+		i = PlaceholderEnd;
+	}
+	if (Literal.Len() > 0) Out += GbnfLiteral(Literal);
+	return Out.TrimEnd();
+}
+
+// "ENABLE/DISABLE" -> ("ENABLE" | "DISABLE")
+static FString GbnfAlternatives(const FString& Words)
+{
+	TArray<FString> Alts;
+	Words.ParseIntoArray(Alts, TEXT("/"), true);
+	for (FString& Alt : Alts) Alt = GbnfLiteral(Alt);
+	return TEXT("(") + FString::Join(Alts, TEXT(" | ")) + TEXT(")");
+}
+
+// Grammar for the <tool_call> JSON the system prompt declares. Tool names and argument keys are fixed;
+// system names, aspects and verbs come from the live handlers so a constrained call always targets
+// something ProcessToolCall can dispatch. Applied lazily by the llama sampler once "<tool_call>" appears.
+FString AVisualTestHarnessActor::MakeToolCallGrammar()
+{
+	FString Systems;
+	FString Commands;
+	FString Queries;
+	FString Rules;
+	int32 idx = 0;
 	for (const ICommandHandler* Handler : CmdDistributor.CommandHandlers)
 	{
-		if (Handler)
-		{
-			const ICH_PowerJunction *pj = Handler->GetAsPowerJunction();
-			if (!pj) continue;
-			if (pj && pj->IsPowerSource()) str += "**" + Handler->GetSystemName() + " IS A POWER SOURCE\n";
-			else str += "**" + Handler->GetSystemName() + "\n";
-			FString gd = Handler->GetSystemGuidance();
-			if (gd.Len() > 0) str += "*GUIDANCE: " + gd + "\n";
-			FString st = Handler->GetSystemStatus();
-			if (st.Len() > 0) str += "*STATUS: " + st + "\n";
-			TArray<FString> cm = Handler->GetAvailableCommands();
-			if (cm.Num() > 0) {
-				str += "*AVAILABLE COMMANDS:\n";
-				for (FString& s : cm) str += s + "\n";
-			}
-			TArray<FString> qr = Handler->GetAvailableQueries();
-			if (qr.Num() > 0) {
-				str += "*AVAILABLE QUERIES:";
-				for (FString& s : qr) str += " " + s;
-				str += "\n";
-			}
-			//
-			if (pj) {
-				str += "*CONNECTS TO:";
-				for (int i=0; i<pj->Ports.Num(); i++) {
-					str += " " + pj->Ports[i]->GetName();
-				}
-				str += "\n";
+		if (!Handler) continue;
+		const FString SystemName = Handler->GetSystemName();
+		Systems += (Systems.IsEmpty() ? TEXT("") : TEXT(" | ")) + GbnfLiteral(SystemName);
+
+		TArray<FString> CommandAlts;
+		for (const FString& Cmd : Handler->GetAvailableCommands()) {
+			TArray<FString> Parts;
+			Cmd.ParseIntoArrayWS(Parts);
+			if (Parts.Num() == 0) continue;
+			FString Alt = GbnfAspectTemplate(Parts[0]);
+			if (Parts.Num() > 1) Alt += TEXT(" \" \" ") + GbnfAlternatives(Parts[1]);
+			if (Parts.Num() > 2) {
+				FString Rest = Parts[2];
+				for (int32 i = 3; i < Parts.Num(); i++) Rest += TEXT(" ") + Parts[i];
+				Alt += TEXT(" \" \" ") + (Rest.Contains(TEXT("<")) ? FString(TEXT("value")) : GbnfAlternatives(Rest));
 			}
+			CommandAlts.Add(Alt);
 		}
-//break;		// TESTING because this is too long
-	}
-	str += "\nPOWER GRID SEGMENTS:\n";
-	for (const PWR_PowerSegment* seg : CmdDistributor.GetSegments())
-	{
-		if (seg->GetJunctionA()) str += FString::Printf(TEXT("%s.A->%s.%d\n"), *seg->GetName(), *seg->GetJunctionA()->GetSystemName(), seg->GetPortA());
-		else str += FString::Printf(TEXT("%s.A: NULL.%d\n"), *seg->GetName(), seg->GetPortA());
-		if (seg->GetJunctionB()) str += FString::Printf(TEXT("%s.B->%s.%d\n"), *seg->GetName(), *seg->GetJunctionB()->GetSystemName(), seg->GetPortB());
-		else str += FString::Printf(TEXT("%s.B: NULL.%d\n"), *seg->GetName(), seg->GetPortB());
-	
+		if (CommandAlts.Num() > 0) {
+			Rules += FString::Printf(TEXT("cmd-%d ::= %s \".\" (%s)\n"), idx, *GbnfLiteral(SystemName), *FString::Join(CommandAlts, TEXT(" | ")));
+			Commands += (Commands.IsEmpty() ? TEXT("") : TEXT(" | ")) + FString::Printf(TEXT("cmd-%d"), idx);
+		}
+
+		TArray<FString> QueryAlts;
+		for (const FString& Query : Handler->GetAvailableQueries()) {
+			if (!Query.TrimStartAndEnd().IsEmpty()) QueryAlts.Add(GbnfAspectTemplate(Query.TrimStartAndEnd()));
+		}
+		if (QueryAlts.Num() > 0) {
+			Rules += FString::Printf(TEXT("qry-%d ::= %s \".\" (%s)\n"), idx, *GbnfLiteral(SystemName), *FString::Join(QueryAlts, TEXT(" | ")));
+			Queries += (Queries.IsEmpty() ? TEXT("") : TEXT(" | ")) + FString::Printf(TEXT("qry-%d"), idx);
+		}
+		idx++;
 	}
+	// keep every rule defined even with an empty grid
+	if (Systems.IsEmpty()) Systems = TEXT("[A-Z0-9_]+");
+	if (Commands.IsEmpty()) Commands = TEXT("[A-Z0-9_.]+ \" \" [A-Z_]+ (\" \" value)?");
+	if (Queries.IsEmpty()) Queries = TEXT("[A-Z0-9_]+ \".\" [A-Z0-9_]+");
+
+	FString str;
+	str += TEXT("root ::= \"<tool_call>\" ws \"{\" ws \"\\\"name\\\"\" ws \":\" ws call ws \"}\" ws \"</tool_call>\"\n");
+	str += TEXT("call ::= get-system-info | execute-command | query-aspect\n");
+	str += TEXT("get-system-info ::= \"\\\"get_system_info\\\"\" ws \",\" ws \"\\\"arguments\\\"\" ws \":\" ws \"{\" ws \"\\\"system_name\\\"\" ws \":\" ws \"\\\"\" system \"\\\"\" ws \"}\"\n");
+	str += TEXT("execute-command ::= \"\\\"execute_submarine_command\\\"\" ws \",\" ws \"\\\"arguments\\\"\" ws \":\" ws \"{\" ws \"\\\"command_string\\\"\" ws \":\" ws \"\\\"\" command (\"\\\\n\" command)* \"\\\"\" ws \"}\"\n");
+	str += TEXT("query-aspect ::= \"\\\"query_submarine_system_aspect\\\"\" ws \",\" ws \"\\\"arguments\\\"\" ws \":\" ws \"{\" ws \"\\\"query_string\\\"\" ws \":\" ws \"\\\"\" query \"\\\"\" ws \"}\"\n");
+	str += TEXT("system ::= ") + Systems + TEXT("\n");
+	str += TEXT("command ::= ") + Commands + TEXT("\n");
+	str += TEXT("query ::= ") + Queries + TEXT("\n");
+	str += Rules;
+	str += TEXT("value ::= [^\"\\\\\\n ] [^\"\\\\\\n]*\n");
+	str += TEXT("num ::= [0-9]+\n");
+	str += TEXT("ws ::= [ ]?\n");
+	return str;
+}
+
+#define FULL_SYSTEMS_DESC_IN_CONTEXT
+// Both blocks come from ContextBlocks, which caches each handler's text by state version (see ContextBlockBuilder.h)
+FString AVisualTestHarnessActor::MakeSystemsBlock()
+{
+#ifdef FULL_SYSTEMS_DESC_IN_CONTEXT
+	ContextBlocks.Update(CmdDistributor);
+	return ContextBlocks.GetSystemsBlock();
 #else // !FULL_SYSTEMS_DESC_IN_CONTEXT
 	FString str = "\nSUBMARINE SYSTEMS:";
 	for (const ICommandHandler* Handler : CmdDistributor.CommandHandlers)
 	{
 		str += " " + Handler->GetSystemName();
 	}
-#endif // !FULL_SYSTEMS_DESC_IN_CONTEXT
 	return str;
+#endif // !FULL_SYSTEMS_DESC_IN_CONTEXT
 }
 
 FString AVisualTestHarnessActor::MakeStatusBlock()
 {
 #ifdef FULL_SYSTEMS_DESC_IN_CONTEXT
-	FString str = "\nSUBMARINE SYSTEMS STATUS:\n";
-// & queryEntireState - changes by command
-// & per-junction status, power usage and noise - changes by command or damage or auto
-// & & GetSystemStatus(): projected battery/LOX depletion times - GetSystemStatus()
-// & & the entire path to the power source, to avoid hallucinations
-	for (const ICommandHandler* Handler : CmdDistributor.CommandHandlers)
-	{
-		if (Handler)
-		{
-			const ICH_PowerJunction *pj = Handler->GetAsPowerJunction();
-			if (!pj) continue;
-			str += "**" + Handler->GetSystemName();
-			switch (pj->GetStatus()) {
-				case EPowerJunctionStatus::NORMAL:
-					str += " NORMAL";
-					break;
-				case EPowerJunctionStatus::DAMAGED50:
-					str += " 50%% DAMAGED";
-					break;
-				case EPowerJunctionStatus::DAMAGED100:
-					str += " DAMAGED";
-					break;
-				case EPowerJunctionStatus::DESTROYED:
-					str += " DESTROYED";
-					break;
-			}
-			if (pj->IsPowerSource()) {
-				str += FString::Printf(TEXT(" POWER AVAILABLE=%g"), pj->GetPowerAvailable());
-			} else {
-				str += FString::Printf(TEXT(" POWER USAGE=%g"), pj->GetCurrentPowerUsage());
-			}
-			str += FString::Printf(TEXT(" NOISE=%g"), pj->GetCurrentNoiseLevel());
-			str += "\n";
-			// queried state
-			TArray<FString> qs = Handler->QueryEntireState();
-			if (qs.Num() > 0) {
-//						str += Handler->GetSystemName() + " ENTIRE STATE:\n";
-				for (FString& s : qs) str += "    " + s + "\n";
-			}
-			// TODO: status: projected battery/LOX depletion times
-			FString sts = Handler->GetSystemStatus();
-			if (sts.Len() > 0) {
-				str += Handler->GetSystemName() + " STATUS:\n" + sts + "\n";
-			}
-			// entire path to the power source
-			str += Handler->GetSystemName() + " POWER PATH: ";
-			const TArray<PWR_PowerSegment*> PPath = pj->GetPathToSourceSegments();
-			const TArray<ICH_PowerJunction*> JPath = pj->GetPathToSourceJunction();
-			for (int i=0; i < JPath.Num(); i++) {
-				if (i > 0) str += ":";
-				str += JPath[i]->GetSystemName();
-				if (PPath.Num() > i) str += ":" + PPath[i]->GetName();
-				else if (PPath.Num() < i) str += "<PATH MISSING>";
-			}
-			str += "\n";
-		}
-//break;		// TESTING because this is too long
-	}
-// & per-segment status and power usage/direction - changes by command or damage or auto
-	str += "\nPOWER GRID SEGMENTS STATUS:\n";
-	for (const PWR_PowerSegment* seg : CmdDistributor.GetSegments())
-	{
-		str += "**" + seg->GetName();
-		switch (seg->GetStatus()) {
-			case EPowerSegmentStatus::NORMAL:
-				str += " NORMAL";
-				break;
-			case EPowerSegmentStatus::SHORTED:
-				str += " SHORTED";
-				break;
-			case EPowerSegmentStatus::OPENED:
-				str += " OPENED";
-				break;
-		}
-		str += FString::Printf(TEXT(" POWER=%g"), seg->GetPowerLevel());
-//		str += FString::Printf(TEXT(" DIRECTION=%g"), seg->GetPowerFlowDirection());
-		str += "\n";
-	}
-	return str;
+	ContextBlocks.Update(CmdDistributor);
+	return ContextBlocks.GetStatusBlock();
 #else // !FULL_SYSTEMS_DESC_IN_CONTEXT
 	return "SUBMARINE SYSTEMS STATUS CONTAINED IN SYSTEMS INFO\n";
 #endif // !FULL_SYSTEMS_DESC_IN_CONTEXT
@@ -1820,56 +1936,51 @@ void AVisualTestHarnessActor::HandleToolCall_CommandSubmarineSystem(const FStrin
 	TArray<FString> Cmds;
 	QueryString.ParseIntoArray(Cmds, TEXT("\n"), true);
 
-	for (FString TempQueryString: Cmds) {
+	// All lines run as one transaction: the grid is re-solved and the context blocks rebuilt once at commit.
+	// The first bad line stops the batch, but the lines before it stay applied (and committed).
+	FString Error;
+	CmdDistributor.BeginTransaction();
+	for (const FString& Line : Cmds) {
+		const FString TempQueryString = Line.TrimStartAndEnd();
 		FString SystemName;
-		FString Aspect;
-		FString Verb;
-		FString Value;
-
-		if (!TempQueryString.Split(TEXT("."), &SystemName, &Aspect, ESearchCase::IgnoreCase, ESearchDir::FromStart)) {
-			SendToolResponseToLlama(TEXT("execute_submarine_command"), TEXT("{\"error\": \"Invalid format. Expected 'SYSTEM_NAME.ASPECT'.\"}"));
-			return;
-		}
-		Aspect = Aspect.TrimStartAndEnd().ToUpper(); // Normalize query type
-		// split Aspect into Aspect Verb[ Value]
-		if (!TempQueryString.Split(TEXT(" "), &Aspect, &Verb, ESearchCase::IgnoreCase, ESearchDir::FromStart)) {
-			SendToolResponseToLlama(TEXT("execute_submarine_command"), TEXT("{\"error\": \"Invalid format. Expected 'SYSTEM_NAME.ASPECT VERB'.\"}"));
-			return;
+		FString Rest;
+		if (!TempQueryString.Split(TEXT("."), &SystemName, &Rest, ESearchCase::IgnoreCase, ESearchDir::FromStart)) {
+			Error = TEXT("{\"error\": \"Invalid format. Expected 'SYSTEM_NAME.ASPECT'.\"}");
+			break;
 		}
-		TempQueryString.Split(TEXT(" "), &Verb, &Value, ESearchCase::IgnoreCase, ESearchDir::FromStart);
-
-		ICommandHandler* FoundHandler = nullptr;
-		for (ICommandHandler* Handler : CmdDistributor.CommandHandlers) {
-			if (Handler && Handler->GetSystemName().Equals(SystemName, ESearchCase::IgnoreCase)) {
-				FoundHandler = Handler;
-				break;
-			}
+		if (!Rest.Contains(TEXT(" "))) {
+			Error = TEXT("{\"error\": \"Invalid format. Expected 'SYSTEM_NAME.ASPECT VERB'.\"}");
+			break;
 		}
 
-		if (!FoundHandler) {
-			SendToolResponseToLlama(TEXT("execute_submarine_command"), 
-				FString::Printf(TEXT("{\"error\": \"System '%s' not found.\"}"), *SystemName));
-			return;
+		// parsed once into ids and a typed value, then dispatched like any other command
+		FCompiledCommand Cmd;
+		if (!CmdDistributor.CompileCommand(TempQueryString, Cmd)) {
+			Error = FString::Printf(TEXT("{\"error\": \"System '%s' not found.\"}"), *SystemName);
+			break;
 		}
 
-		ECommandResult r = FoundHandler->HandleCommand(Aspect, Verb, Value);
+		ECommandResult r = CmdDistributor.ExecuteCommand(Cmd);
 		if (r == ECommandResult::Blocked) {
-			SendToolResponseToLlama(TEXT("execute_submarine_command"), 
-				FString::Printf(TEXT("{\"error\": \"Command blocked.\"}")));
-			return;
+			Error = TEXT("{\"error\": \"Command blocked.\"}");
+			break;
 		}
 		if (r == ECommandResult::NotHandled) {
-			SendToolResponseToLlama(TEXT("execute_submarine_command"), 
-				FString::Printf(TEXT("{\"error\": \"Command not handled.\"}")));
-			return;
+			Error = TEXT("{\"error\": \"Command not handled.\"}");
+			break;
 		}
 		if (r == ECommandResult::HandledWithError) {
-			SendToolResponseToLlama(TEXT("execute_submarine_command"), 
-				FString::Printf(TEXT("{\"error\": \"Command handled with error.\"}")));
-			return;
+			Error = TEXT("{\"error\": \"Command handled with error.\"}");
+			break;
 		}
-//		SendToolResponseToLlama(TEXT("execute_submarine_command"), 
-//			FString::Printf(TEXT("{\"accepted\": \"Command processed.\"}")));
+	}
+	const FCommandTransactionResult Result = CmdDistributor.CommitTransaction();
+	UE_LOG(LogTemp, Log, TEXT("execute_submarine_command: %d of %d lines handled, %d systems changed, %.3f ms (apply %.3f, commit %.3f)"),
+		Result.NumHandled, Cmds.Num(), Result.NumHandlers, Result.GetTotalMs(), Result.ApplyMs, Result.CommitMs);
+
+	if (Error.Len() > 0) {
+		SendToolResponseToLlama(TEXT("execute_submarine_command"), Error);
+		return;
 	}
 	SendToolResponseToLlama(TEXT("execute_submarine_command"), 
 		FString::Printf(TEXT("{\"error\": \"Command completed.\"}")));
@@ -1930,6 +2041,7 @@ void AVisualTestHarnessActor::SendToolResponseToLlama(const FString& ToolName, c
     // This is the CONTENT that goes inside the tool role tags.
     // The ProcessInputAndGenerate_LlamaThread will wrap it with <|im_start|>tool ... <|im_end|>
     UE_LOG(LogTemp, Log, TEXT("Sending Tool Response for '%s': %s"), *ToolName, *JsonResponseContent);
+    Journal.RecordToolResult(ToolName, JsonResponseContent);
     LlamaAIXOComponent->ProcessInput(JsonResponseContent, MakeHFSString(), TEXT("tool"));
 }
 
@@ -1939,8 +2051,6 @@ void AVisualTestHarnessActor::SendToolResponseToLlama(const FString& ToolName, c
 
 FContextVisPayload AVisualTestHarnessActor::AugmentContextVisPayload(FContextVisPayload p)
 {
-	p.bIsStaticWorldInfoUpToDate &= !bPendingStaticWorldInfoUpdate;
-	p.bIsLowFrequencyStateUpToDate &= !bPendingLowFrequencyStateUpdate;
-
+	// blocks submitted but not yet applied are already marked stale by ULlamaComponent
 	return p;
 }
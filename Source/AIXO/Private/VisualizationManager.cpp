@@ -2,6 +2,7 @@
 #include "ICH_PowerJunction.h"
 #include "PWR_PowerSegment.h"
 #include "PWR_PowerPropagation.h"
+#include "PWR_PowerGridSolver.h"
 // #include "RenderingContext.h" // REMOVE THIS
 #include "IVisualElement.h" // Includes RenderingContext definition
 #include "CommandDistributor.h"
@@ -13,6 +14,7 @@
 //class ULlamaComponent;
 
 VisualizationManager::VisualizationManager()
+	: PowerSolver(MakeUnique<PWR_PowerGridSolver>())
 {
 	ClickedOnJunction = nullptr;
 }
@@ -30,6 +32,7 @@ void VisualizationManager::AddJunction(ICH_PowerJunction* Junction)
     if (Junction)
     {
         Junctions.AddUnique(Junction);
+        PowerSolver->NotifyTopologyChanged();
     }
 }
 
@@ -38,6 +41,7 @@ void VisualizationManager::AddSegment(PWR_PowerSegment* Segment)
     if (Segment)
     {
         Segments.AddUnique(Segment);
+        PowerSolver->NotifyTopologyChanged();
     }
 }
 
@@ -177,11 +181,16 @@ void VisualizationManager::RefreshSelection()
 	}
 	ClearSelections();
 	// run one cycle in case things changed
-	PWR_PowerPropagation::PropagatePower(Segments, Junctions);
+	UpdatePower();
 	// show the (new) route
 	if (CurrentSelectedJunction) SetupSelection(CurrentSelectedJunction);
 }
 
+bool VisualizationManager::UpdatePower()
+{
+	return PowerSolver->Update(Segments, Junctions);
+}
+
 bool VisualizationManager::HandleTouchEvent(const TouchEvent& Event, CommandDistributor* Distributor)
 {
 	switch (Event.Type) {
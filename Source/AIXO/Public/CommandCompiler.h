@@ -0,0 +1,136 @@
+#pragma once
+
+#include "CoreMinimal.h"
+
+class ICommandHandler;
+
+/**
+ * Type of a command's value, taken from the placeholder in the handler's GetAvailableCommands()
+ * ("ON SET <bool>", "ANGLE SET <float>", "CHARGE ENABLE <pin>"); anything else keeps the text.
+ */
+enum class ECommandValueType : uint8
+{
+    None,
+    Bool,
+    Int,
+    Float,
+    Text
+};
+
+/**
+ * Process-wide table of interned system, aspect and verb names.
+ * Case-insensitive, like the FString == compares in the handlers. Names are only added at registration
+ * (from GetAvailableCommands() and system names) or by handlers asking for their own ids, never by
+ * compiling arbitrary text, so a bad LLM command can't grow it.
+ */
+class CommandNames
+{
+public:
+    static int32 Intern(const FString& Name)
+    {
+        if (const int32* Id = GetIds().Find(Name)) return *Id;
+        const int32 Id = GetNames().Add(Name);
+        GetIds().Add(Name, Id);
+        return Id;
+    }
+
+    static int32 Find(const FString& Name)
+    {
+        const int32* Id = GetIds().Find(Name);
+        return Id ? *Id : INDEX_NONE;
+    }
+
+    static const FString& GetName(int32 Id)
+    {
+        static const FString Empty;
+        return GetNames().IsValidIndex(Id) ? GetNames()[Id] : Empty;
+    }
+
+private:
+    static TMap<FString, int32>& GetIds() { static TMap<FString, int32> Ids; return Ids; }
+    static TArray<FString>& GetNames() { static TArray<FString> Names; return Names; }
+};
+
+/**
+ * A "SYSTEM.ASPECT VERB VALUE" command parsed once: the target handler, interned ids and the value
+ * converted to the type the handler advertised. Indexed aspects ("POWERPORT_3") get the id of their
+ * pattern ("POWERPORT_<n>") plus AspectIndex. The original text stays alongside for handlers that still
+ * dispatch on strings (see ICommandHandler::HandleCompiledCommand).
+ */
+struct FCompiledCommand
+{
+    ICommandHandler* Handler = nullptr;
+    int32 SystemId = INDEX_NONE;
+    int32 AspectId = INDEX_NONE;
+    int32 AspectIndex = INDEX_NONE;
+    int32 VerbId = INDEX_NONE;
+    ECommandValueType ValueType = ECommandValueType::None;
+    bool bValue = false;
+    int32 IntValue = 0;
+    float FloatValue = 0.0f;
+
+    FString Aspect;
+    FString Verb;
+    FString Value;
+
+    bool IsValid() const { return Handler != nullptr; }
+
+    /** The value as the type a part expects: the parsed one if the handler advertised that type, else from the text. */
+    bool GetBool() const { return ValueType == ECommandValueType::Bool ? bValue : Value.ToBool(); }
+    float GetFloat() const { return ValueType == ECommandValueType::Float ? FloatValue : FCString::Atof(*Value); }
+};
+
+/**
+ * Per-handler table of the (aspect, verb) pairs a handler advertises and the value type each takes.
+ * Built at registration from GetAvailableCommands().
+ */
+class FCommandTable
+{
+public:
+    void Reset() { Entries.Reset(); }
+
+    /** Adds every entry of GetAvailableCommands(): "ASPECT VERB[/VERB...] [<placeholder>|LITERAL]". */
+    void Build(const TArray<FString>& AvailableCommands)
+    {
+        Reset();
+        for (const FString& Line : AvailableCommands)
+        {
+            TArray<FString> Parts;
+            Line.ParseIntoArrayWS(Parts);
+            if (Parts.Num() < 2) continue;
+            const int32 AspectId = CommandNames::Intern(Parts[0]);
+            const ECommandValueType Type = Parts.Num() > 2 ? ValueTypeFromPlaceholder(Parts[2]) : ECommandValueType::None;
+            TArray<FString> Verbs;
+            Parts[1].ParseIntoArray(Verbs, TEXT("/"), true);
+            for (const FString& Verb : Verbs)
+            {
+                Entries.Add(MakeKey(AspectId, CommandNames::Intern(Verb)), Type);
+            }
+        }
+    }
+
+    /** Value type for the pair, or false if the handler doesn't advertise it. */
+    bool Find(int32 AspectId, int32 VerbId, ECommandValueType& OutType) const
+    {
+        const ECommandValueType* Type = Entries.Find(MakeKey(AspectId, VerbId));
+        if (!Type) return false;
+        OutType = *Type;
+        return true;
+    }
+
+    int32 Num() const { return Entries.Num(); }
+
+private:
+    TMap<uint64, ECommandValueType> Entries;
+
+    static uint64 MakeKey(int32 AspectId, int32 VerbId) { return ((uint64)(uint32)AspectId << 32) | (uint32)VerbId; }
+
+    static ECommandValueType ValueTypeFromPlaceholder(const FString& Placeholder)
+    {
+        if (!Placeholder.StartsWith(TEXT("<"))) return ECommandValueType::Text;  // literal, e.g. "ALERT SET NORMAL"
+        if (Placeholder.Contains(TEXT("bool"))) return ECommandValueType::Bool;
+        if (Placeholder.Contains(TEXT("|"))) return ECommandValueType::Text;    // choice, e.g. "<OFF|VENT|RAM>"
+        if (Placeholder == TEXT("<pin>") || Placeholder == TEXT("<n>") || Placeholder == TEXT("<int>")) return ECommandValueType::Int;
+        return ECommandValueType::Float;                                        // <float>, <-1.0..1.0>, <level 0-100>
+    }
+};
@@ -5,6 +5,23 @@
 
 class PWR_PowerSegment;
 
+/**
+ * What one CommitTransaction() did: the result of every command applied since BeginTransaction(), in order,
+ * and where the time went.
+ */
+struct FCommandTransactionResult
+{
+    TArray<ECommandResult> Results;
+    int32 NumHandled = 0;       // ECommandResult::Handled
+    int32 NumFailed = 0;        // everything else, including lines that didn't compile
+    int32 NumHandlers = 0;      // distinct handlers whose state changed
+    double ApplyMs = 0.0;       // compiling and running the commands
+    double CommitMs = 0.0;      // PostHandleCommand per handler plus the commit hook (power solve, context blocks)
+
+    double GetTotalMs() const { return ApplyMs + CommitMs; }
+    bool AllHandled() const { return NumFailed == 0; }
+};
+
 /**
  * Command Distributor for processing commands through multiple handlers.
  */
@@ -15,6 +32,14 @@ private:
     TMap<FString, ICommandHandler*> HandlerMap;
     TArray<PWR_PowerSegment*> Segments;
 
+    // Open transaction: handlers touched so far get PostHandleCommand()/MarkStateChanged() once at commit
+    int32 TransactionDepth = 0;
+    TArray<ICommandHandler*> TransactionHandlers;
+    FCommandTransactionResult TransactionResult;
+    TFunction<void()> CommitHook;
+    TFunction<void(const FCompiledCommand&, ECommandResult)> CommandObserver;
+    TFunction<void(bool)> TransactionObserver;
+
 public:
     TArray<ICommandHandler*> GetCommandHandlers() const { return CommandHandlers; }
     TArray<PWR_PowerSegment*> GetSegments() const { return Segments; }
@@ -28,6 +53,7 @@ public:
         if (Handler)
         {
             HandlerMap.Add(Handler->GetSystemName(), Handler);
+            Handler->BuildCommandTable();
         }
     }
 
@@ -51,10 +77,78 @@ public:
      */
     ECommandResult ProcessCommand(const FString& FullCommand)
     {
+        FCompiledCommand Cmd;
+        const double StartTime = TransactionDepth > 0 ? FPlatformTime::Seconds() : 0.0;
+        CompileCommand(FullCommand, Cmd);
+        if (TransactionDepth > 0) TransactionResult.ApplyMs += (FPlatformTime::Seconds() - StartTime) * 1000.0;
+        return ExecuteCommand(Cmd);
+    }
+
+    /**
+     * Starts batching commands. Until the matching CommitTransaction(), ExecuteCommand/ProcessCommand run the
+     * handlers and record each result, but the per-handler PostHandleCommand() and state version bump wait for
+     * the commit, so N commands to one system cost one power-dirty mark and one context-block fragment rebuild.
+     * Transactions nest; only the outermost commit does the work.
+     */
+    void BeginTransaction()
+    {
+        if (TransactionDepth++ > 0) return;
+        TransactionHandlers.Reset();
+        TransactionResult = FCommandTransactionResult();
+        if (TransactionObserver) TransactionObserver(true);
+    }
+
+    bool IsInTransaction() const { return TransactionDepth > 0; }
+
+    /**
+     * Finishes the outermost transaction: PostHandleCommand() and MarkStateChanged() once per touched handler,
+     * then the commit hook (the owner's power solve and context-block update) once for the whole batch.
+     * An inner commit returns the results recorded so far and does nothing else.
+     */
+    FCommandTransactionResult CommitTransaction()
+    {
+        if (TransactionDepth == 0)
+        {
+            UE_LOG(LogTemp, Warning, TEXT("CommandDistributor: CommitTransaction without BeginTransaction"));
+            return FCommandTransactionResult();
+        }
+        if (--TransactionDepth > 0) return TransactionResult;
+        if (TransactionObserver) TransactionObserver(false);
+
+        const double StartTime = FPlatformTime::Seconds();
+        for (ICommandHandler* Handler : TransactionHandlers)
+        {
+            Handler->MarkStateChanged();
+            Handler->PostHandleCommand();
+        }
+        TransactionResult.NumHandlers = TransactionHandlers.Num();
+        TransactionHandlers.Reset();
+        if (CommitHook && TransactionResult.NumHandlers > 0) CommitHook();
+        TransactionResult.CommitMs = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+        return MoveTemp(TransactionResult);
+    }
+
+    /** Called once at the end of every outermost commit that changed something (e.g. VisualizationManager::UpdatePower). */
+    void SetCommitHook(TFunction<void()> Hook) { CommitHook = MoveTemp(Hook); }
+
+    /** Called after every command that reached a handler, with its result (e.g. CommandJournal::RecordCommand). */
+    void SetCommandObserver(TFunction<void(const FCompiledCommand&, ECommandResult)> Observer) { CommandObserver = MoveTemp(Observer); }
+
+    /** Called with true at every outermost BeginTransaction() and false at its CommitTransaction(), before the commit work. */
+    void SetTransactionObserver(TFunction<void(bool)> Observer) { TransactionObserver = MoveTemp(Observer); }
+
+    /**
+     * Parses "SYSTEM.ASPECT VERB VALUE" once into Out: target handler, interned ids and typed value.
+     * Callers that send the same command repeatedly (buttons, scripts) keep the result and call ExecuteCommand.
+     * @return False (Out not valid) for comments and unknown systems; executing it returns NotHandled.
+     */
+    bool CompileCommand(const FString& FullCommand, FCompiledCommand& Out) const
+    {
+        Out = FCompiledCommand();
         // Ignore C++ style comments
         if (FullCommand.StartsWith("//"))
         {
-            return ECommandResult::NotHandled;
+            return false;
         }
 
         FString Destination, Aspect, Command, Value;
@@ -78,15 +172,83 @@ public:
             Value = "";
         }
 
-        // Find the correct handler and process the command
-        ICommandHandler* Handler = FindCommandHandler(Destination);
-        if (Handler)
+        // Find the correct handler
+        Out.Handler = FindCommandHandler(Destination);
+        if (!Out.Handler)
         {
-            ECommandResult r = Handler->HandleCommand(Aspect, Command, Value);
-            Handler->PostHandleCommand();
+            return false;
+        }
+        Out.SystemId = CommandNames::Find(Destination);
+        Out.AspectId = CommandNames::Find(Aspect);
+        if (Out.AspectId == INDEX_NONE)
+        {
+            // indexed aspect: "POWERPORT_3" is "POWERPORT_<n>" with index 3
+            int32 Underscore;
+            if (Aspect.FindLastChar(TEXT('_'), Underscore) && Underscore + 1 < Aspect.Len() && Aspect.RightChop(Underscore + 1).IsNumeric())
+            {
+                Out.AspectId = CommandNames::Find(Aspect.Left(Underscore + 1) + TEXT("<n>"));
+                if (Out.AspectId != INDEX_NONE) Out.AspectIndex = FCString::Atoi(*Aspect + Underscore + 1);
+            }
+        }
+        Out.VerbId = CommandNames::Find(Command);
+        if (!Out.Handler->GetCommandTable().Find(Out.AspectId, Out.VerbId, Out.ValueType))
+        {
+            Out.ValueType = Value.IsEmpty() ? ECommandValueType::None : ECommandValueType::Text;
+        }
+        switch (Out.ValueType)
+        {
+            case ECommandValueType::Bool:  Out.bValue = Value.ToBool(); break;
+            case ECommandValueType::Int:   Out.IntValue = FCString::Atoi(*Value); break;
+            case ECommandValueType::Float: Out.FloatValue = FCString::Atof(*Value); break;
+            default: break;
+        }
+        Out.Aspect = MoveTemp(Aspect);
+        Out.Verb = MoveTemp(Command);
+        Out.Value = MoveTemp(Value);
+        return true;
+    }
+
+    /**
+     * Runs a compiled command on its handler.
+     */
+    ECommandResult ExecuteCommand(const FCompiledCommand& Cmd)
+    {
+        if (TransactionDepth > 0)
+        {
+            const double StartTime = FPlatformTime::Seconds();
+            const ECommandResult r = Cmd.IsValid() ? Cmd.Handler->HandleCompiledCommand(Cmd) : ECommandResult::NotHandled;
+            if (r != ECommandResult::NotHandled) TransactionHandlers.AddUnique(Cmd.Handler);
+            TransactionResult.Results.Add(r);
+            if (r == ECommandResult::Handled) TransactionResult.NumHandled++;
+            else TransactionResult.NumFailed++;
+            TransactionResult.ApplyMs += (FPlatformTime::Seconds() - StartTime) * 1000.0;
+            if (CommandObserver && Cmd.IsValid()) CommandObserver(Cmd, r);
             return r;
         }
-        return ECommandResult::NotHandled;
+        if (!Cmd.IsValid())
+        {
+            return ECommandResult::NotHandled;
+        }
+        ECommandResult r = Cmd.Handler->HandleCompiledCommand(Cmd);
+        if (r != ECommandResult::NotHandled) Cmd.Handler->MarkStateChanged();
+        Cmd.Handler->PostHandleCommand();
+        if (CommandObserver) CommandObserver(Cmd, r);
+        return r;
+    }
+
+    /**
+     * Compiles each line of a block of "ASPECT VERB VALUE" fragments for one system (button commands).
+     * Lines that don't compile stay in Out as invalid entries, so executing them returns NotHandled in order.
+     */
+    void CompileCommandLines(const FString& SystemName, const FString& CommandLines, TArray<FCompiledCommand>& Out) const
+    {
+        TArray<FString> Lines;
+        CommandLines.ParseIntoArray(Lines, TEXT("\n"), true);
+        Out.Reset();
+        for (const FString& Line : Lines)
+        {
+            CompileCommand(SystemName + TEXT(".") + Line, Out.AddDefaulted_GetRef());
+        }
     }
 
     /**
@@ -166,17 +328,20 @@ public:
     }
 
     /**
-     * Processes a block of commands by splitting on newlines and calling ProcessCommand.
+     * Processes a block of commands by splitting on newlines and running them as one transaction.
      */
-    void ProcessCommandBlock(const FString& CommandBlock)
+    FCommandTransactionResult ProcessCommandBlock(const FString& CommandBlock)
     {
         TArray<FString> CommandLines;
         CommandBlock.ParseIntoArray(CommandLines, TEXT("\n"), true);
 
+        BeginTransaction();
         for (const FString& Line : CommandLines)
         {
+            if (Line.StartsWith("//")) continue;    // comments aren't counted as failed commands
             ProcessCommand(Line);
         }
+        return CommitTransaction();
     }
 
     TArray<FString> GetSystemNotifications() const
@@ -204,10 +369,13 @@ public:
         CommandHandlers.Empty();
         HandlerMap.Empty();
         Segments.Empty();
+        TransactionHandlers.Reset();
     }
     
 	friend class ULlamaComponent;
 	friend class AVisualTestHarnessActor;
+	friend class ContextBlockBuilder;
+	friend class SimulationSnapshot;
 };
 
 
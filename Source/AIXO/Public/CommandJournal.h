@@ -0,0 +1,375 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/FileManager.h"
+#include "Misc/FileHelper.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "CommandDistributor.h"
+#include "SimulationSnapshot.h"
+
+enum class EJournalRecordType : uint8
+{
+    Tick,           // float DeltaTime; the record's time is the simulation time after the tick
+    Command,        // FString "SYSTEM.ASPECT VERB VALUE", uint8 ECommandResult
+    ToolResult,     // FString tool name, FString JSON sent back to the LLM
+    Keyframe,           // SimulationSnapshot bytes, captured after the tick with the same time; a checkpoint on replay
+    Restore,            // SimulationSnapshot bytes: the session loaded or rewound to this state
+    TransactionBegin,   // no body; an outermost CommandDistributor::BeginTransaction
+    TransactionCommit   // no body; its CommitTransaction
+};
+
+/**
+ * CommandJournal is an append-only binary record of a session: every command CommandDistributor executed,
+ * every tool-call result, every Tick's DeltaTime, and periodic keyframe snapshots. Time is simulation time,
+ * the sum of the recorded DeltaTimes, so a replay lands on the same moments the session did.
+ *
+ * File layout: magic, format version, then records of (uint8 type, double time, int32 size, body). Records are
+ * appended to the file at each Flush(); a file cut short by a crash loads up to its last complete record.
+ * Only keyframes are indexed; everything else is read sequentially by JournalReplay.
+ */
+class CommandJournal
+{
+public:
+    static constexpr uint32 Magic = 0x4A584941;     // "AIXJ"
+    static constexpr int32 FormatVersion = 2;      // 2: Restore and transaction records
+
+    struct FKeyframe
+    {
+        double Time = 0.0;
+        int32 Offset = 0;       // snapshot bytes at Data[Offset, Offset + Size)
+        int32 Size = 0;
+        int32 NextRecord = 0;   // where replay continues after restoring it
+    };
+
+    /** Starts a new journal. With a path, the file is replaced and records are appended to it on Flush(). */
+    void Begin(const FString& InPath = FString())
+    {
+        Reset();
+        Path = InPath;
+        FMemoryWriter Ar(Data);
+        uint32 SavedMagic = Magic;
+        int32 SavedVersion = FormatVersion;
+        Ar << SavedMagic << SavedVersion;
+        if (!Path.IsEmpty()) IFileManager::Get().Delete(*Path);
+        bRecording = true;
+    }
+
+    /** Flushes and stops recording; the journal stays readable. */
+    void Stop()
+    {
+        Flush();
+        bRecording = false;
+    }
+
+    bool IsRecording() const { return bRecording; }
+
+    void RecordTick(float DeltaTime)
+    {
+        if (!bRecording) return;
+        Time += DeltaTime;
+        Append(EJournalRecordType::Tick, [&DeltaTime](FArchive& Ar) { Ar << DeltaTime; });
+    }
+
+    void RecordCommand(const FCompiledCommand& Cmd, ECommandResult Result)
+    {
+        if (!bRecording || !Cmd.IsValid()) return;
+        FString Text = Cmd.Handler->GetSystemName() + TEXT(".") + Cmd.Aspect + TEXT(" ") + Cmd.Verb;
+        if (!Cmd.Value.IsEmpty()) Text += TEXT(" ") + Cmd.Value;
+        uint8 SavedResult = (uint8)Result;
+        Append(EJournalRecordType::Command, [&Text, &SavedResult](FArchive& Ar) { Ar << Text << SavedResult; });
+    }
+
+    void RecordToolResult(const FString& ToolName, const FString& Json)
+    {
+        if (!bRecording) return;
+        FString SavedTool = ToolName;
+        FString SavedJson = Json;
+        Append(EJournalRecordType::ToolResult, [&SavedTool, &SavedJson](FArchive& Ar) { Ar << SavedTool << SavedJson; });
+    }
+
+    void RecordTransaction(bool bBegin)
+    {
+        if (!bRecording) return;
+        Append(bBegin ? EJournalRecordType::TransactionBegin : EJournalRecordType::TransactionCommit, [](FArchive& Ar) {});
+    }
+
+    /** A periodic keyframe, or with bRestore the state the session just jumped to (a snapshot load or a rewind). */
+    void RecordKeyframe(const SimulationSnapshot& Snapshot, bool bRestore = false)
+    {
+        if (!bRecording || Snapshot.IsEmpty()) return;
+        const TArray<uint8>& Bytes = Snapshot.GetData();
+        const int32 Offset = Append(bRestore ? EJournalRecordType::Restore : EJournalRecordType::Keyframe,
+            [&Bytes](FArchive& Ar) { Ar.Serialize(const_cast<uint8*>(Bytes.GetData()), Bytes.Num()); });
+        Keyframes.Add({ Time, Offset, Bytes.Num(), Data.Num() });
+    }
+
+    /** Appends everything recorded since the last Flush() to the file. */
+    bool Flush()
+    {
+        if (Path.IsEmpty() || FlushedBytes >= Data.Num()) return true;
+        TUniquePtr<FArchive> File(IFileManager::Get().CreateFileWriter(*Path, FILEWRITE_Append));
+        if (!File)
+        {
+            UE_LOG(LogTemp, Error, TEXT("CommandJournal: can't write %s"), *Path);
+            return false;
+        }
+        File->Serialize(Data.GetData() + FlushedBytes, Data.Num() - FlushedBytes);
+        FlushedBytes = Data.Num();
+        return true;
+    }
+
+    /** Loads a journal for replay and rebuilds the keyframe index. */
+    bool LoadFromFile(const FString& InPath)
+    {
+        Reset();
+        if (!FFileHelper::LoadFileToArray(Data, *InPath)) return false;
+        FMemoryReader Ar(Data);
+        uint32 SavedMagic = 0;
+        int32 SavedVersion = 0;
+        Ar << SavedMagic << SavedVersion;
+        if (Ar.IsError() || SavedMagic != Magic || SavedVersion != FormatVersion)
+        {
+            UE_LOG(LogTemp, Error, TEXT("CommandJournal: %s is not a journal, or format %d instead of %d"), *InPath, SavedVersion, FormatVersion);
+            Reset();
+            return false;
+        }
+        int32 Offset = (int32)Ar.Tell();
+        EJournalRecordType Type;
+        double RecordTime;
+        int32 BodyOffset, BodySize;
+        while (ReadRecordHeader(Offset, Type, RecordTime, BodyOffset, BodySize))
+        {
+            Offset = BodyOffset + BodySize;
+            Time = RecordTime;
+            if (Type == EJournalRecordType::Keyframe || Type == EJournalRecordType::Restore) Keyframes.Add({ RecordTime, BodyOffset, BodySize, Offset });
+        }
+        if (Offset < Data.Num())
+        {
+            UE_LOG(LogTemp, Warning, TEXT("CommandJournal: %s ends in a partial record, %d bytes dropped"), *InPath, Data.Num() - Offset);
+            Data.SetNum(Offset);
+        }
+        FlushedBytes = Data.Num();
+        return true;
+    }
+
+    /** Last keyframe at or before InTime, or null if the journal has none that early. */
+    const FKeyframe* FindKeyframe(double InTime) const
+    {
+        const FKeyframe* Best = nullptr;
+        for (const FKeyframe& Key : Keyframes)     // ascending time
+        {
+            if (Key.Time > InTime) break;
+            Best = &Key;
+        }
+        return Best;
+    }
+
+    /**
+     * Reads the record header at Offset. Returns false at the end of the journal or at a partial record.
+     */
+    bool ReadRecordHeader(int32 Offset, EJournalRecordType& OutType, double& OutTime, int32& OutBodyOffset, int32& OutBodySize) const
+    {
+        constexpr int32 HeaderSize = sizeof(uint8) + sizeof(double) + sizeof(int32);
+        if (Offset < 0 || Offset + HeaderSize > Data.Num()) return false;
+        const uint8* p = Data.GetData() + Offset;
+        OutType = (EJournalRecordType)p[0];
+        FMemory::Memcpy(&OutTime, p + 1, sizeof(double));
+        FMemory::Memcpy(&OutBodySize, p + 1 + sizeof(double), sizeof(int32));
+        OutBodyOffset = Offset + HeaderSize;
+        return OutBodySize >= 0 && OutBodyOffset + OutBodySize <= Data.Num();
+    }
+
+    const TArray<uint8>& GetData() const { return Data; }
+    const TArray<FKeyframe>& GetKeyframes() const { return Keyframes; }
+    double GetTime() const { return Time; }
+
+private:
+    TArray<uint8> Data;
+    TArray<FKeyframe> Keyframes;
+    FString Path;
+    int32 FlushedBytes = 0;
+    double Time = 0.0;
+    bool bRecording = false;
+
+    void Reset()
+    {
+        Data.Reset();
+        Keyframes.Reset();
+        Path.Reset();
+        FlushedBytes = 0;
+        Time = 0.0;
+        bRecording = false;
+    }
+
+    /** Writes one record at the end of Data; returns the offset of its body. */
+    int32 Append(EJournalRecordType Type, TFunctionRef<void(FArchive&)> WriteBody)
+    {
+        FMemoryWriter Ar(Data, false, true);
+        uint8 SavedType = (uint8)Type;
+        double RecordTime = Time;
+        int32 Size = 0;
+        Ar << SavedType << RecordTime;
+        const int64 SizePos = Ar.Tell();
+        Ar << Size;
+        const int64 BodyStart = Ar.Tell();
+        WriteBody(Ar);
+        const int64 BodyEnd = Ar.Tell();
+        Size = (int32)(BodyEnd - BodyStart);
+        Ar.Seek(SizePos);
+        Ar << Size;
+        Ar.Seek(BodyEnd);
+        return (int32)BodyStart;
+    }
+};
+
+/**
+ * JournalReplay drives a CommandDistributor from a CommandJournal, headless and as fast as it can go.
+ * Seek() restores the nearest keyframe at or before the target and fast-forwards from there: each Tick record
+ * runs SolvePower (the live Tick's VisualizationManager::UpdatePower) and CommandDistributor::TickAll, each
+ * Command record runs ProcessCommand, and transaction records open and commit the same batches the session did,
+ * all in recorded order. Nothing renders and no LLM calls are made on the way.
+ *
+ * Replay is expected to reproduce the session exactly, so later keyframes aren't restored: each is a checkpoint,
+ * compared against the replayed state, and any handler or segment that differs is logged. Only Restore records,
+ * where the session itself jumped, are loaded. Turn off recording into a live journal before replaying into the
+ * distributor it observes.
+ */
+class JournalReplay
+{
+public:
+    JournalReplay(const CommandJournal& InJournal, CommandDistributor& InDistributor, ASubmarineState* InSubState)
+        : Journal(InJournal), Distributor(InDistributor), SubState(InSubState)
+    {
+    }
+
+    TFunction<void()> SolvePower;
+    TFunction<void(double, const FString&, const FString&)> OnToolResult;     // time, tool name, JSON
+
+    /** Restores the last keyframe at or before TargetTime and replays forward to it. */
+    bool Seek(double TargetTime)
+    {
+        const double StartTime = FPlatformTime::Seconds();
+        const CommandJournal::FKeyframe* Key = Journal.FindKeyframe(TargetTime);
+        if (!Key)
+        {
+            UE_LOG(LogTemp, Warning, TEXT("JournalReplay: no keyframe at or before %.2f s"), TargetTime);
+            return false;
+        }
+        if (!RestoreKeyframe(*Key)) return false;
+        Offset = Key->NextRecord;
+        Time = Key->Time;
+        NumTicks = NumCommands = NumCheckpoints = NumMismatches = 0;
+        const bool bOk = Advance(TargetTime);
+        LastSeekMs = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+        return bOk;
+    }
+
+    /** Replays forward from the current position through every record up to TargetTime. */
+    bool Advance(double TargetTime)
+    {
+        if (Offset == 0) return false;      // Seek first
+        EJournalRecordType Type;
+        double RecordTime;
+        int32 BodyOffset, BodySize;
+        while (Journal.ReadRecordHeader(Offset, Type, RecordTime, BodyOffset, BodySize))
+        {
+            if (Type == EJournalRecordType::Tick && RecordTime > TargetTime) break;
+            FMemoryReaderView Ar(MakeArrayView(Journal.GetData().GetData() + BodyOffset, BodySize));
+            switch (Type)
+            {
+                case EJournalRecordType::Tick:
+                {
+                    float DeltaTime = 0.0f;
+                    Ar << DeltaTime;
+                    if (SolvePower) SolvePower();
+                    Distributor.TickAll(DeltaTime);
+                    NumTicks++;
+                    break;
+                }
+                case EJournalRecordType::Command:
+                {
+                    FString Text;
+                    uint8 Result = 0;
+                    Ar << Text << Result;
+                    const ECommandResult Replayed = Distributor.ProcessCommand(Text);
+                    if ((uint8)Replayed != Result)
+                    {
+                        UE_LOG(LogTemp, Warning, TEXT("JournalReplay: '%s' at %.2f s gave %d, recorded %d"), *Text, RecordTime, (int32)Replayed, (int32)Result);
+                    }
+                    NumCommands++;
+                    break;
+                }
+                case EJournalRecordType::ToolResult:
+                {
+                    FString ToolName, Json;
+                    Ar << ToolName << Json;
+                    if (OnToolResult) OnToolResult(RecordTime, ToolName, Json);
+                    break;
+                }
+                case EJournalRecordType::Keyframe:
+                {
+                    CheckKeyframe({ RecordTime, BodyOffset, BodySize, BodyOffset + BodySize });
+                    break;
+                }
+                case EJournalRecordType::Restore:
+                {
+                    RestoreKeyframe({ RecordTime, BodyOffset, BodySize, BodyOffset + BodySize });
+                    break;
+                }
+                case EJournalRecordType::TransactionBegin:
+                {
+                    Distributor.BeginTransaction();
+                    break;
+                }
+                case EJournalRecordType::TransactionCommit:
+                {
+                    if (Distributor.IsInTransaction()) Distributor.CommitTransaction();
+                    break;
+                }
+            }
+            Time = RecordTime;
+            Offset = BodyOffset + BodySize;
+        }
+        if (SolvePower) SolvePower();
+        return true;
+    }
+
+    double GetTime() const { return Time; }
+    int32 GetNumTicks() const { return NumTicks; }
+    int32 GetNumCommands() const { return NumCommands; }
+    int32 GetNumCheckpoints() const { return NumCheckpoints; }
+    int32 GetNumMismatches() const { return NumMismatches; }     // checkpoints the replay didn't match
+    double GetLastSeekMs() const { return LastSeekMs; }
+
+private:
+    const CommandJournal& Journal;
+    CommandDistributor& Distributor;
+    ASubmarineState* SubState;
+    SimulationSnapshot Snapshot;
+    SimulationSnapshot ReplayedState;
+    int32 Offset = 0;
+    double Time = 0.0;
+    int32 NumTicks = 0;
+    int32 NumCommands = 0;
+    int32 NumCheckpoints = 0;
+    int32 NumMismatches = 0;
+    double LastSeekMs = 0.0;
+
+    bool RestoreKeyframe(const CommandJournal::FKeyframe& Key)
+    {
+        Snapshot.SetData(TArray<uint8>(Journal.GetData().GetData() + Key.Offset, Key.Size));
+        return Snapshot.Restore(Distributor, SubState);
+    }
+
+    void CheckKeyframe(const CommandJournal::FKeyframe& Key)
+    {
+        Snapshot.SetData(TArray<uint8>(Journal.GetData().GetData() + Key.Offset, Key.Size));
+        ReplayedState.Capture(Distributor, SubState);
+        NumCheckpoints++;
+        const TArray<FString> Changed = Snapshot.Diff(ReplayedState);
+        if (Changed.Num() == 0) return;
+        NumMismatches++;
+        UE_LOG(LogTemp, Warning, TEXT("JournalReplay: replay diverged at %.2f s in %s"), Key.Time, *FString::Join(Changed, TEXT(", ")));
+    }
+};
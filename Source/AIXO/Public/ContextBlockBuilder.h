@@ -0,0 +1,272 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "CommandDistributor.h"
+#include "ICH_PowerJunction.h"
+#include "PWR_PowerSegment.h"
+
+/**
+ * ContextBlockBuilder keeps the systems (StaticWorldInfo) and status (LowFrequencyState) context block text
+ * for a CommandDistributor's handlers and segments, and rebuilds it only where something changed.
+ *
+ * Each power junction's text is cached as a fragment tagged with the handler's state version; Update() asks
+ * every handler to refresh its version, regenerates the fragments whose version moved, and reassembles a block
+ * only if one of its fragments came out different. Segments have no version of their own, so their status and
+ * power level are sampled the way PWR_PowerGridSolver samples them. A frame where nothing changed costs one
+ * pass of version and sample compares and builds no strings.
+ */
+class ContextBlockBuilder
+{
+public:
+    /** Brings both blocks up to date. Returns true if either block's text changed. */
+    bool Update(const CommandDistributor& Distributor)
+    {
+        const bool bRebuildAll = Distributor.CommandHandlers.Num() != Handlers.Num() || Distributor.Segments.Num() != Segments.Num();
+        if (bRebuildAll)
+        {
+            Reset(Distributor);
+        }
+
+        for (int32 i = 0; i < Handlers.Num(); ++i)
+        {
+            FHandlerEntry& Entry = Handlers[i];
+            ICommandHandler* Handler = Distributor.CommandHandlers[i];
+            if (Entry.Handler != Handler)
+            {
+                Entry = FHandlerEntry();
+                Entry.Handler = Handler;
+            }
+            if (!Handler || !Handler->GetAsPowerJunction()) continue;
+            Handler->RefreshStateVersion();
+            if (Entry.Version == Handler->GetStateVersion()) continue;
+            Entry.Version = Handler->GetStateVersion();
+
+            FString NewSystems = MakeSystemsFragment(*Handler);
+            if (!NewSystems.Equals(Entry.Systems, ESearchCase::CaseSensitive))
+            {
+                Entry.Systems = MoveTemp(NewSystems);
+                bSystemsDirty = true;
+            }
+            FString NewStatus = MakeStatusFragment(*Handler);
+            if (!NewStatus.Equals(Entry.Status, ESearchCase::CaseSensitive))
+            {
+                Entry.Status = MoveTemp(NewStatus);
+                bStatusDirty = true;
+            }
+        }
+
+        for (int32 s = 0; s < Segments.Num(); ++s)
+        {
+            FSegmentEntry& Entry = Segments[s];
+            const PWR_PowerSegment* Segment = Distributor.Segments[s];
+            if (Entry.Segment != Segment)
+            {
+                Entry = FSegmentEntry();
+                Entry.Segment = Segment;
+                bSystemsDirty = true; // the segment list is part of the systems block
+            }
+            if (!Segment || (Entry.bSampled && Entry.Status == Segment->GetStatus() && Entry.PowerLevel == Segment->GetPowerLevel())) continue;
+            Entry.bSampled = true;
+            Entry.Status = Segment->GetStatus();
+            Entry.PowerLevel = Segment->GetPowerLevel();
+            FString NewStatus = MakeSegmentStatusLine(*Segment);
+            if (!NewStatus.Equals(Entry.StatusLine, ESearchCase::CaseSensitive))
+            {
+                Entry.StatusLine = MoveTemp(NewStatus);
+                bStatusDirty = true;
+            }
+        }
+
+        const bool bChanged = bSystemsDirty || bStatusDirty;
+        if (bSystemsDirty) AssembleSystemsBlock();
+        if (bStatusDirty) AssembleStatusBlock();
+        bSystemsDirty = bStatusDirty = false;
+        return bChanged;
+    }
+
+    /** Drops every cached fragment; the next Update() regenerates all of them. */
+    void Reset(const CommandDistributor& Distributor)
+    {
+        Handlers.Reset();
+        Handlers.SetNum(Distributor.CommandHandlers.Num());
+        Segments.Reset();
+        Segments.SetNum(Distributor.Segments.Num());
+        bSystemsDirty = bStatusDirty = true;
+    }
+
+    const FString& GetSystemsBlock() const { return SystemsBlock; }
+    const FString& GetStatusBlock() const { return StatusBlock; }
+
+    // Bumped each time the block's text changes; compare against the version last sent
+    uint32 GetSystemsBlockVersion() const { return SystemsBlockVersion; }
+    uint32 GetStatusBlockVersion() const { return StatusBlockVersion; }
+
+private:
+    struct FHandlerEntry
+    {
+        const ICommandHandler* Handler = nullptr;
+        uint32 Version = 0;     // handler state version the fragments were made from (0 = never)
+        FString Systems;
+        FString Status;
+    };
+    struct FSegmentEntry
+    {
+        const PWR_PowerSegment* Segment = nullptr;
+        bool bSampled = false;
+        EPowerSegmentStatus Status = EPowerSegmentStatus::NORMAL;
+        float PowerLevel = 0.0f;
+        FString StatusLine;
+    };
+
+    TArray<FHandlerEntry> Handlers;     // parallel to CommandDistributor::CommandHandlers
+    TArray<FSegmentEntry> Segments;     // parallel to CommandDistributor::Segments
+    bool bSystemsDirty = true;
+    bool bStatusDirty = true;
+    FString SystemsBlock;
+    FString StatusBlock;
+    uint32 SystemsBlockVersion = 0;
+    uint32 StatusBlockVersion = 0;
+
+    void AssembleSystemsBlock()
+    {
+        int32 Len = 64;
+        for (const FHandlerEntry& Entry : Handlers) Len += Entry.Systems.Len();
+        FString str;
+        str.Reserve(Len + Segments.Num() * 64);
+        str += "\nSUBMARINE SYSTEMS:\n";		// StaticWorldInfo
+        for (const FHandlerEntry& Entry : Handlers) str += Entry.Systems;
+        str += "\nPOWER GRID SEGMENTS:\n";
+        for (const FSegmentEntry& Entry : Segments)
+        {
+            if (Entry.Segment) str += MakeSegmentConnectionLines(*Entry.Segment);
+        }
+        if (!str.Equals(SystemsBlock, ESearchCase::CaseSensitive))
+        {
+            SystemsBlock = MoveTemp(str);
+            SystemsBlockVersion++;
+        }
+    }
+
+    void AssembleStatusBlock()
+    {
+        int32 Len = 64;
+        for (const FHandlerEntry& Entry : Handlers) Len += Entry.Status.Len();
+        for (const FSegmentEntry& Entry : Segments) Len += Entry.StatusLine.Len();
+        FString str;
+        str.Reserve(Len);
+        str += "\nSUBMARINE SYSTEMS STATUS:\n";
+        for (const FHandlerEntry& Entry : Handlers) str += Entry.Status;
+        str += "\nPOWER GRID SEGMENTS STATUS:\n";
+        for (const FSegmentEntry& Entry : Segments) str += Entry.StatusLine;
+        if (!str.Equals(StatusBlock, ESearchCase::CaseSensitive))
+        {
+            StatusBlock = MoveTemp(str);
+            StatusBlockVersion++;
+        }
+    }
+
+    static FString MakeSystemsFragment(const ICommandHandler& Handler)
+    {
+        const ICH_PowerJunction* pj = Handler.GetAsPowerJunction();
+        FString str;
+        if (pj->IsPowerSource()) str += "**" + Handler.GetSystemName() + " IS A POWER SOURCE\n";
+        else str += "**" + Handler.GetSystemName() + "\n";
+        FString gd = Handler.GetSystemGuidance();
+        if (gd.Len() > 0) str += "*GUIDANCE: " + gd + "\n";
+        FString st = Handler.GetSystemStatus();
+        if (st.Len() > 0) str += "*STATUS: " + st + "\n";
+        TArray<FString> cm = Handler.GetAvailableCommands();
+        if (cm.Num() > 0) {
+            str += "*AVAILABLE COMMANDS:\n";
+            for (FString& s : cm) str += s + "\n";
+        }
+        TArray<FString> qr = Handler.GetAvailableQueries();
+        if (qr.Num() > 0) {
+            str += "*AVAILABLE QUERIES:";
+            for (FString& s : qr) str += " " + s;
+            str += "\n";
+        }
+        str += "*CONNECTS TO:";
+        for (int i=0; i<pj->Ports.Num(); i++) {
+            str += " " + pj->Ports[i]->GetName();
+        }
+        str += "\n";
+        return str;
+    }
+
+    static FString MakeStatusFragment(const ICommandHandler& Handler)
+    {
+        const ICH_PowerJunction* pj = Handler.GetAsPowerJunction();
+        FString str = "**" + Handler.GetSystemName();
+        switch (pj->GetStatus()) {
+            case EPowerJunctionStatus::NORMAL:
+                str += " NORMAL";
+                break;
+            case EPowerJunctionStatus::DAMAGED50:
+                str += " 50%% DAMAGED";
+                break;
+            case EPowerJunctionStatus::DAMAGED100:
+                str += " DAMAGED";
+                break;
+            case EPowerJunctionStatus::DESTROYED:
+                str += " DESTROYED";
+                break;
+        }
+        if (pj->IsPowerSource()) {
+            str += FString::Printf(TEXT(" POWER AVAILABLE=%g"), pj->GetPowerAvailable());
+        } else {
+            str += FString::Printf(TEXT(" POWER USAGE=%g"), pj->GetCurrentPowerUsage());
+        }
+        str += FString::Printf(TEXT(" NOISE=%g"), pj->GetCurrentNoiseLevel());
+        str += "\n";
+        // queried state
+        TArray<FString> qs = Handler.QueryEntireState();
+        for (FString& s : qs) str += "    " + s + "\n";
+        // TODO: status: projected battery/LOX depletion times
+        FString sts = Handler.GetSystemStatus();
+        if (sts.Len() > 0) {
+            str += Handler.GetSystemName() + " STATUS:\n" + sts + "\n";
+        }
+        // entire path to the power source
+        str += Handler.GetSystemName() + " POWER PATH: ";
+        const TArray<PWR_PowerSegment*>& PPath = pj->GetPathToSourceSegments();
+        const TArray<ICH_PowerJunction*>& JPath = pj->GetPathToSourceJunction();
+        for (int i=0; i < JPath.Num(); i++) {
+            if (i > 0) str += ":";
+            str += JPath[i]->GetSystemName();
+            if (PPath.Num() > i) str += ":" + PPath[i]->GetName();
+            else if (PPath.Num() < i) str += "<PATH MISSING>";
+        }
+        str += "\n";
+        return str;
+    }
+
+    static FString MakeSegmentConnectionLines(const PWR_PowerSegment& Segment)
+    {
+        FString str;
+        if (Segment.GetJunctionA()) str += FString::Printf(TEXT("%s.A->%s.%d\n"), *Segment.GetName(), *Segment.GetJunctionA()->GetSystemName(), Segment.GetPortA());
+        else str += FString::Printf(TEXT("%s.A: NULL.%d\n"), *Segment.GetName(), Segment.GetPortA());
+        if (Segment.GetJunctionB()) str += FString::Printf(TEXT("%s.B->%s.%d\n"), *Segment.GetName(), *Segment.GetJunctionB()->GetSystemName(), Segment.GetPortB());
+        else str += FString::Printf(TEXT("%s.B: NULL.%d\n"), *Segment.GetName(), Segment.GetPortB());
+        return str;
+    }
+
+    static FString MakeSegmentStatusLine(const PWR_PowerSegment& Segment)
+    {
+        FString str = "**" + Segment.GetName();
+        switch (Segment.GetStatus()) {
+            case EPowerSegmentStatus::NORMAL:
+                str += " NORMAL";
+                break;
+            case EPowerSegmentStatus::SHORTED:
+                str += " SHORTED";
+                break;
+            case EPowerSegmentStatus::OPENED:
+                str += " OPENED";
+                break;
+        }
+        str += FString::Printf(TEXT(" POWER=%g"), Segment.GetPowerLevel());
+        str += "\n";
+        return str;
+    }
+};
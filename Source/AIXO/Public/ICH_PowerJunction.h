@@ -52,8 +52,17 @@ protected:		// determined by power propagator
     bool bIsUnderPowered;
     bool bIsShutdown;
     bool bIsSelected;
+    bool bPowerInputsDirty = true;	// ports/connections changed since the solver last looked (see PWR_PowerGridSolver)
 
     EPowerJunctionStatus Status = EPowerJunctionStatus::NORMAL; // Junction status
+
+private:		// what the state version last covered (see RefreshStateVersion)
+    EPowerJunctionStatus VersionedStatus = EPowerJunctionStatus::NORMAL;
+    float VersionedPower = 0.0f;
+    float VersionedNoise = 0.0f;
+    TArray<ICH_PowerJunction*> VersionedPath;
+    TArray<PWR_PowerSegment*> VersionedSegmentPath;
+protected:
 	FBox2D ActualExtent;	// can be bigger if VE_* is outside the basic box
 
 public:
@@ -139,23 +148,66 @@ public:
         if (Port >= 0 && Port < EnabledPorts.Num())
         {
             EnabledPorts[Port] = bEnabled;
+            MarkPowerDirty();
         }
     }
 
     virtual void SetAllPortsDisabled()
     {
     	for (int i = 0; i<EnabledPorts.Num(); i++) EnabledPorts[i] = false;
+    	MarkPowerDirty();
     }
 
     virtual void PostHandleCommand() override
     {
+    	MarkStateChanged();		// also reached from Tick on self-driven transitions (battery full, depleted)
+    	MarkPowerDirty();		// any command may have changed ports, internal connections or load
     	for (IVisualElement* Element : VisualElements)
         {
         	Element->UpdateState();
 		}
 	}
 
-    virtual bool HasPower() const 
+    // Tells the power solver this junction's ports or connections changed; load and source changes are sampled anyway
+    void MarkPowerDirty() { bPowerInputsDirty = true; }
+
+    // Status, power, noise and path to source are written by damage and the power solver, not by commands
+    virtual void RefreshStateVersion() override
+    {
+        const float Power = IsPowerSource() ? GetPowerAvailable() : GetCurrentPowerUsage();
+        const float Noise = GetCurrentNoiseLevel();
+        if (VersionedStatus != GetStatus() || VersionedPower != Power || VersionedNoise != Noise || VersionedPath != PathToSourceJunction ||
+            VersionedSegmentPath != PathToSourceSegments)
+        {
+            VersionedStatus = GetStatus();
+            VersionedPower = Power;
+            VersionedNoise = Noise;
+            VersionedPath = PathToSourceJunction;
+            VersionedSegmentPath = PathToSourceSegments;
+            MarkStateChanged();
+        }
+    }
+
+    // Damage and port switches; everything the power solver writes is re-solved after a restore
+    virtual void SerializeState(FArchive& Ar) override
+    {
+        int32 Version;
+        if (!SerializeStateVersion(Ar, 1, Version)) return;
+        TArray<bool> Enabled = EnabledPorts;
+        Ar << Status << bIsShutdown << Enabled;
+        if (Ar.IsLoading() && !Ar.IsError())
+        {
+            if (Enabled.Num() != EnabledPorts.Num())
+            {
+                Ar.SetError();		// saved from a differently wired grid
+                return;
+            }
+            EnabledPorts = MoveTemp(Enabled);
+            MarkPowerDirty();
+        }
+    }
+
+    virtual bool HasPower() const
     {
         return true;
     }
@@ -201,19 +253,49 @@ public:
             FString PortStr;
             if (Aspect.Split("_", nullptr, &PortStr))
             {
-                int32 Port = FCString::Atoi(*PortStr);
-                if (Port >= 0 && Port < Ports.Num())
-                {
-                    SetPortEnabled(Port, Command == "ENABLE");
-                    return ECommandResult::Handled;
-                }
-//else UE_LOG(LogTemp, Warning, TEXT("                                : port %d out of range 0..%d"), Port, Ports.Num());
+                return HandlePowerPortCommand(FCString::Atoi(*PortStr), Command == "ENABLE");
             }
 //else UE_LOG(LogTemp, Warning, TEXT("                                : _ not found"));
         }
         return ECommandResult::NotHandled; 
     }
 
+    // POWERPORT_<n> on ids; everything else (subclasses' own aspects) through HandleCommand
+    virtual ECommandResult HandleCompiledCommand(const FCompiledCommand& Cmd) override
+    {
+        const ECommandResult Result = HandleCompiledPowerPortCommand(Cmd);
+        if (Result != ECommandResult::NotHandled)
+        {
+            return Result;
+        }
+        return HandleCommand(Cmd.Aspect, Cmd.Verb, Cmd.Value);
+    }
+
+    // POWERPORT_<n> ENABLE/DISABLE without the string parsing, for HandleCompiledCommand overrides.
+    // Returns NotHandled for anything else; only usable where no subclass intercepts POWERPORT (PWRJ_MultiSelectJunction does).
+    ECommandResult HandleCompiledPowerPortCommand(const FCompiledCommand& Cmd)
+    {
+        static const int32 PowerPortId = CommandNames::Intern(TEXT("POWERPORT_<n>"));
+        static const int32 EnableId = CommandNames::Intern(TEXT("ENABLE"));
+        static const int32 DisableId = CommandNames::Intern(TEXT("DISABLE"));
+        if (Cmd.AspectId != PowerPortId || Cmd.AspectIndex == INDEX_NONE || (Cmd.VerbId != EnableId && Cmd.VerbId != DisableId))
+        {
+            return ECommandResult::NotHandled;
+        }
+        return HandlePowerPortCommand(Cmd.AspectIndex, Cmd.VerbId == EnableId);
+    }
+
+    ECommandResult HandlePowerPortCommand(int32 Port, bool bEnable)
+    {
+        if (Port >= 0 && Port < Ports.Num())
+        {
+            SetPortEnabled(Port, bEnable);
+            return ECommandResult::Handled;
+        }
+//else UE_LOG(LogTemp, Warning, TEXT("                                : port %d out of range 0..%d"), Port, Ports.Num());
+        return ECommandResult::NotHandled;
+    }
+
     virtual bool CanHandleCommand(const FString& Aspect, const FString& Command, const FString& Value) const override
     {
         if (Aspect.StartsWith("POWERPORT_"))
@@ -578,6 +660,7 @@ public:
 					if (besti >= 0) {
 						HandleTouchEventExtraFunction(besti);		// - ___: MultiSelect clear all enables (maybe auto-enable port 0)
 						EnabledPorts[besti] ^= true;
+						MarkPowerDirty();
 						return 1;
 					}
 				}
@@ -652,8 +735,10 @@ public:
 
     friend class PWR_PowerSegment;
     friend class PWR_PowerPropagation;
+    friend class PWR_PowerGridSolver;
     friend class VisualizationManager;
     friend class UPowerGridLoader;
     friend class ULlamaComponent;
 	friend class AVisualTestHarnessActor;
+	friend class ContextBlockBuilder;
 };
@@ -73,6 +73,7 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "CommandCompiler.h"
 
 class ICH_PowerJunction;
 
@@ -87,6 +88,24 @@ enum class ECommandResult
     HandledWithError
 };
 
+/**
+ * Writes CurrentVersion, or reads the version a snapshot layer was saved with into OutVersion.
+ * Returns false, with Ar flagged, if Ar already failed or the saved layer is newer than this build reads;
+ * any older version is accepted and the caller branches on it. Shared by every SerializeState() layer.
+ */
+inline bool SerializeStateLayerVersion(FArchive& Ar, int32 CurrentVersion, int32& OutVersion)
+{
+    OutVersion = CurrentVersion;
+    if (Ar.IsError()) return false;
+    Ar << OutVersion;
+    if (Ar.IsLoading() && (OutVersion < 1 || OutVersion > CurrentVersion))
+    {
+        Ar.SetError();
+        return false;
+    }
+    return !Ar.IsError();
+}
+
 /**
  * ICommandHandler Interface for handling submarine commands.
  */
@@ -103,6 +122,16 @@ protected:
      */
     TArray<FString> NotificationQueue;
 
+    /**
+     * Bumped whenever anything the context blocks describe may have changed (see ContextBlockBuilder).
+     */
+    uint32 StateVersion = 1;
+
+    /**
+     * (aspect, verb) pairs from GetAvailableCommands(), built when the handler is registered.
+     */
+    FCommandTable CommandTable;
+
 public:
     virtual ~ICommandHandler() = default;
 
@@ -122,6 +151,26 @@ public:
     virtual ECommandResult HandleCommand(const FString& Aspect, const FString& Command, const FString& Value) = 0;
     virtual void PostHandleCommand() { };		// override this to rescan visual elements after a command
 
+    /**
+     * Executes a command CommandDistributor already parsed (see FCompiledCommand).
+     * The default hands the original strings to HandleCommand; override to dispatch on AspectId/VerbId and
+     * the typed value instead. An override must give the same results as HandleCommand, and in a class that
+     * subclasses override HandleCommand in, only for commands none of them intercept; whatever it doesn't
+     * recognise goes on to HandleCommand(Cmd.Aspect, Cmd.Verb, Cmd.Value), so those subclasses still see it.
+     */
+    virtual ECommandResult HandleCompiledCommand(const FCompiledCommand& Cmd)
+    {
+        return HandleCommand(Cmd.Aspect, Cmd.Verb, Cmd.Value);
+    }
+
+    /** Interns this handler's names and (re)builds CommandTable from GetAvailableCommands(). */
+    void BuildCommandTable()
+    {
+        CommandNames::Intern(SystemName);
+        CommandTable.Build(GetAvailableCommands());
+    }
+    const FCommandTable& GetCommandTable() const { return CommandTable; }
+
     /**
      * Checks if the handler can process a given command.
      * @param Aspect The aspect of the system to check.
@@ -169,6 +218,27 @@ public:
      */
     virtual FString GetSystemStatus() const { return ""; }
 
+    /**
+     * State version for change-driven text (context blocks); equal versions mean the text is still valid.
+     * Commands bump it through CommandDistributor; RefreshStateVersion() folds in state that changes on its own.
+     */
+    uint32 GetStateVersion() const { return StateVersion; }
+    void MarkStateChanged() { ++StateVersion; }
+
+    /**
+     * Called once per frame before versions are read; override to bump the version when derived
+     * values (power solver results, ticking levels) moved since the last call.
+     */
+    virtual void RefreshStateVersion() { }
+
+    /**
+     * Snapshot hook (see SimulationSnapshot.h): writes, or reads when Ar.IsLoading(), the state a restore needs
+     * beyond what the constructor and loader set up: timers, integrators, actual positions, state machines.
+     * A class that adds such state overrides it, calls its base class first, then versions its own layer with
+     * SerializeStateVersion() so each layer's layout can change on its own.
+     */
+    virtual void SerializeState(FArchive& Ar) { }
+
     /**
      * Adds a message or error to the notification queue.
      * @param Message The message or error to be added.
@@ -208,4 +278,11 @@ public:
      */
     virtual class ICH_PowerJunction* GetAsPowerJunction() { return nullptr; }
     virtual const class ICH_PowerJunction* GetAsPowerJunction() const { return nullptr; }
+
+protected:
+    /** See SerializeStateLayerVersion(). */
+    static bool SerializeStateVersion(FArchive& Ar, int32 CurrentVersion, int32& OutVersion)
+    {
+        return SerializeStateLayerVersion(Ar, CurrentVersion, OutVersion);
+    }
 };
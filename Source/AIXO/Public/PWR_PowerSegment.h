@@ -40,6 +40,7 @@ protected:		// determined by power propagator
     bool bIsSelected;
     float PowerLevel;
     float PowerFlowDirection;
+    bool bPowerInputsDirty = true;	// status changed since the solver last looked (see PWR_PowerGridSolver)
 
 public:
     PWR_PowerSegment(const FString& name) : SystemName(name) { Status = EPowerSegmentStatus::NORMAL; }
@@ -50,7 +51,7 @@ public:
     float GetPowerFlowDirection() const { return PowerFlowDirection; }
     void SetPowerFlowDirection(float Direction) { PowerFlowDirection = Direction; }
     EPowerSegmentStatus GetStatus() const { return Status; }
-    void SetStatus(EPowerSegmentStatus NewStatus) { Status = NewStatus; }
+    void SetStatus(EPowerSegmentStatus NewStatus) { if (Status != NewStatus) bPowerInputsDirty = true; Status = NewStatus; }
     bool IsShorted() const { return bIsShorted; }
     void SetShorted(bool bShorted) { bIsShorted = bShorted; }
     bool IsOverenergized() const { return bIsOverenergized; }
@@ -65,12 +66,23 @@ public:
     int32 GetPortB() const { return PortB; }
     const FString& GetName() const { return SystemName; }
 
+    // Snapshot: damage only; power level, flow and the propagator flags are re-solved after a restore
+    void SerializeState(FArchive& Ar)
+    {
+        int32 Version;
+        if (!SerializeStateLayerVersion(Ar, 1, Version)) return;
+        uint8 SavedStatus = (uint8)Status;
+        Ar << SavedStatus;
+        if (Ar.IsLoading() && !Ar.IsError()) SetStatus((EPowerSegmentStatus)SavedStatus);
+    }
+
     virtual bool HandleTouchEvent(const TouchEvent& Event, CommandDistributor* Distributor);
 
     // Hit testing - implementation moved to cpp file
     bool IsPointNear(const FVector2D& Point) const;
 
     friend class PWR_PowerPropagation;
+    friend class PWR_PowerGridSolver;
     friend class VisualizationManager;
     friend class UPowerGridLoader;
 };
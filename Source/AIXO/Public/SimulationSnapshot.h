@@ -0,0 +1,227 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Misc/FileHelper.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "CommandDistributor.h"
+#include "ICH_PowerJunction.h"
+#include "PWR_PowerSegment.h"
+#include "SubmarineState.h"
+
+/**
+ * SimulationSnapshot is a binary copy of the running simulation: the ASubmarineState fields, every registered
+ * handler's SerializeState() and every segment's status. Capture and Restore copy a few KB of memory instead of
+ * re-parsing and re-applying GenerateCommandsFromEntireState() text, so they're cheap enough for save/load and
+ * for keeping a rewind history.
+ *
+ * Layout: magic, format version, the submarine state payload, then one (name, payload) record per handler and per
+ * segment, written by their SerializeState(). Both are matched by name on restore and each payload is read on its own,
+ * so a handler or segment that no longer exists, or whose layer versions this build can't read, is skipped and logged
+ * without losing the rest of the snapshot. The power solver's outputs aren't saved; Restore marks the grid dirty
+ * and the caller re-solves (VisualizationManager::UpdatePower).
+ */
+class SimulationSnapshot
+{
+public:
+    static constexpr uint32 Magic = 0x53584941;     // "AIXS"
+    static constexpr int32 FormatVersion = 2;      // 2: segments saved through PWR_PowerSegment::SerializeState
+
+    /** Replaces the snapshot with the current state. SubState may be null. */
+    bool Capture(const CommandDistributor& Distributor, ASubmarineState* SubState)
+    {
+        const double StartTime = FPlatformTime::Seconds();
+        Data.Reset();
+        FMemoryWriter Ar(Data);
+        uint32 SavedMagic = Magic;
+        int32 SavedVersion = FormatVersion;
+        Ar << SavedMagic << SavedVersion;
+
+        TArray<uint8> Payload;
+        if (SubState)
+        {
+            FMemoryWriter SubAr(Payload);
+            SubState->SerializeState(SubAr);
+        }
+        Ar << Payload;
+
+        int32 NumHandlers = Distributor.CommandHandlers.Num();
+        Ar << NumHandlers;
+        for (ICommandHandler* Handler : Distributor.CommandHandlers)
+        {
+            FString Name = Handler ? Handler->GetSystemName() : FString();
+            Payload.Reset();
+            if (Handler)
+            {
+                FMemoryWriter HandlerAr(Payload);
+                Handler->SerializeState(HandlerAr);
+            }
+            Ar << Name << Payload;
+        }
+
+        int32 NumSegments = Distributor.Segments.Num();
+        Ar << NumSegments;
+        for (PWR_PowerSegment* Segment : Distributor.Segments)
+        {
+            FString Name = Segment ? Segment->GetName() : FString();
+            Payload.Reset();
+            if (Segment)
+            {
+                FMemoryWriter SegmentAr(Payload);
+                Segment->SerializeState(SegmentAr);
+            }
+            Ar << Name << Payload;
+        }
+
+        CaptureMs = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+        return !Ar.IsError();
+    }
+
+    /**
+     * Puts the simulation back to the captured state. Handlers and segments that were captured but can't be found
+     * or read are logged and left as they are. Returns false only if the snapshot itself is unreadable.
+     */
+    bool Restore(CommandDistributor& Distributor, ASubmarineState* SubState) const
+    {
+        if (Data.Num() == 0) return false;
+        const double StartTime = FPlatformTime::Seconds();
+        FMemoryReader Ar(Data);
+        uint32 SavedMagic = 0;
+        int32 SavedVersion = 0;
+        Ar << SavedMagic << SavedVersion;
+        if (Ar.IsError() || SavedMagic != Magic || SavedVersion != FormatVersion)
+        {
+            UE_LOG(LogTemp, Error, TEXT("SimulationSnapshot: not a snapshot, or format %d instead of %d"), SavedVersion, FormatVersion);
+            return false;
+        }
+
+        TArray<uint8> Payload;
+        Ar << Payload;
+        if (SubState && Payload.Num() > 0)
+        {
+            FMemoryReader SubAr(Payload);
+            SubState->SerializeState(SubAr);
+            if (SubAr.IsError()) UE_LOG(LogTemp, Warning, TEXT("SimulationSnapshot: couldn't read the submarine state"));
+        }
+
+        int32 NumHandlers = 0;
+        Ar << NumHandlers;
+        FString Name;
+        for (int32 i = 0; i < NumHandlers && !Ar.IsError(); ++i)
+        {
+            Ar << Name << Payload;
+            ICommandHandler* Handler = Distributor.FindCommandHandler(Name);
+            if (!Handler)
+            {
+                if (!Name.IsEmpty()) UE_LOG(LogTemp, Warning, TEXT("SimulationSnapshot: no handler '%s', skipped"), *Name);
+                continue;
+            }
+            FMemoryReader HandlerAr(Payload);
+            Handler->SerializeState(HandlerAr);
+            if (HandlerAr.IsError()) UE_LOG(LogTemp, Warning, TEXT("SimulationSnapshot: couldn't read state for '%s'"), *Name);
+        }
+
+        int32 NumSegments = 0;
+        Ar << NumSegments;
+        for (int32 s = 0; s < NumSegments && !Ar.IsError(); ++s)
+        {
+            Ar << Name << Payload;
+            PWR_PowerSegment* Segment = Distributor.Segments.IsValidIndex(s) ? Distributor.Segments[s] : nullptr;
+            if (!Segment || Segment->GetName() != Name)
+            {
+                PWR_PowerSegment* const* Found = Distributor.Segments.FindByPredicate([&Name](const PWR_PowerSegment* Seg) { return Seg && Seg->GetName() == Name; });
+                Segment = Found ? *Found : nullptr;
+            }
+            if (!Segment)
+            {
+                if (!Name.IsEmpty()) UE_LOG(LogTemp, Warning, TEXT("SimulationSnapshot: no segment '%s', skipped"), *Name);
+                continue;
+            }
+            FMemoryReader SegmentAr(Payload);
+            Segment->SerializeState(SegmentAr);
+            if (SegmentAr.IsError()) UE_LOG(LogTemp, Warning, TEXT("SimulationSnapshot: couldn't read state for segment '%s'"), *Name);
+        }
+
+        if (Ar.IsError())
+        {
+            UE_LOG(LogTemp, Error, TEXT("SimulationSnapshot: truncated snapshot"));
+        }
+
+        // the restored switches and damage reach the solver, the visual elements and the context blocks
+        for (ICommandHandler* Handler : Distributor.CommandHandlers)
+        {
+            if (!Handler) continue;
+            Handler->MarkStateChanged();
+            Handler->PostHandleCommand();
+        }
+
+        UE_LOG(LogTemp, Log, TEXT("SimulationSnapshot: restored %d handlers, %d segments from %d bytes in %.3f ms"),
+            NumHandlers, NumSegments, Data.Num(), (FPlatformTime::Seconds() - StartTime) * 1000.0);
+        return true;
+    }
+
+    /**
+     * Names of the records that differ between two snapshots: "SubState", handler system names, and "Segment <name>"
+     * for segments, including ones only one side has. Empty if they hold the same state.
+     */
+    TArray<FString> Diff(const SimulationSnapshot& Other) const
+    {
+        TArray<FString> Changed;
+        if (Data == Other.Data) return Changed;
+        TMap<FString, TArray<uint8>> Mine, Theirs;
+        if (!ReadRecords(Mine) || !Other.ReadRecords(Theirs))
+        {
+            Changed.Add(TEXT("(unreadable snapshot)"));
+            return Changed;
+        }
+        for (const TPair<FString, TArray<uint8>>& Pair : Mine)
+        {
+            const TArray<uint8>* Found = Theirs.Find(Pair.Key);
+            if (!Found || *Found != Pair.Value) Changed.Add(Pair.Key);
+        }
+        for (const TPair<FString, TArray<uint8>>& Pair : Theirs)
+        {
+            if (!Mine.Contains(Pair.Key)) Changed.Add(Pair.Key);
+        }
+        return Changed;
+    }
+
+    bool SaveToFile(const FString& Path) const { return FFileHelper::SaveArrayToFile(Data, *Path); }
+    bool LoadFromFile(const FString& Path) { Data.Reset(); return FFileHelper::LoadFileToArray(Data, *Path); }
+
+    bool IsEmpty() const { return Data.Num() == 0; }
+    const TArray<uint8>& GetData() const { return Data; }
+    void SetData(TArray<uint8> InData) { Data = MoveTemp(InData); }
+    double GetCaptureMs() const { return CaptureMs; }
+
+private:
+    TArray<uint8> Data;
+    double CaptureMs = 0.0;
+
+    bool ReadRecords(TMap<FString, TArray<uint8>>& Out) const
+    {
+        FMemoryReader Ar(Data);
+        uint32 SavedMagic = 0;
+        int32 SavedVersion = 0;
+        Ar << SavedMagic << SavedVersion;
+        if (Ar.IsError() || SavedMagic != Magic || SavedVersion != FormatVersion) return false;
+        TArray<uint8> Payload;
+        FString Name;
+        Ar << Payload;
+        Out.Add(TEXT("SubState"), Payload);
+        int32 Num = 0;
+        Ar << Num;
+        for (int32 i = 0; i < Num && !Ar.IsError(); ++i)
+        {
+            Ar << Name << Payload;
+            Out.Add(Name, Payload);
+        }
+        Ar << Num;
+        for (int32 i = 0; i < Num && !Ar.IsError(); ++i)
+        {
+            Ar << Name << Payload;
+            Out.Add(TEXT("Segment ") + Name, Payload);
+        }
+        return !Ar.IsError();
+    }
+};
@@ -145,6 +145,9 @@ public:
     void UpdateBuoyancy();
     void ApplyPhysics();
     void UpdateRendering();
+
+    /** Writes or reads (Ar.IsLoading()) every field above for SimulationSnapshot; the physics constants aren't included. */
+    void SerializeState(FArchive& Ar);
     
 public:
     UPROPERTY(EditAnywhere, BlueprintReadWrite)
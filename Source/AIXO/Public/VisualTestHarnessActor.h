@@ -10,6 +10,9 @@
 #include "Components/NativeWidgetHost.h"
 #include "ICH_PowerJunction.h"
 #include "PWR_PowerSegment.h"
+#include "ContextBlockBuilder.h"
+#include "SimulationSnapshot.h"
+#include "CommandJournal.h"
 #include "VisualTestHarnessActor.generated.h"
 
 // Forward Declarations
@@ -192,12 +195,52 @@ private:
 	TArray<TUniquePtr<ICH_PowerJunction>> PersistentJunctions;
 	TArray<TUniquePtr<PWR_PowerSegment>>  PersistentSegments;
 
-	FString SystemsContextBlockRecent;
-	FString LowFreqContextBlockRecent;
-    bool bPendingStaticWorldInfoUpdate = false;
-    FString PendingStaticWorldInfoText;
-    bool bPendingLowFrequencyStateUpdate = false;
-    FString PendingLowFrequencyStateText;
+	// Systems/status block text, rebuilt only from handlers whose state version moved; versions last sent to Llama
+	ContextBlockBuilder ContextBlocks;
+	uint32 SystemsContextBlockVersionSent = 0;
+	uint32 LowFreqContextBlockVersionSent = 0;
+
+	// Rewind history, oldest first; slots are reused so capturing doesn't allocate once the history is full
+	TArray<SimulationSnapshot> RewindHistory;
+	float RewindSnapshotTimer = 0.0f;
+	bool RestoreSimulationSnapshot(const SimulationSnapshot& Snapshot);
+
+	// Session journal (commands, tool results, tick times, keyframes) under Saved/Journals/
+	CommandJournal Journal;
+	SimulationSnapshot JournalKeyframe;
+	double LastJournalKeyframeTime = 0.0;
+	void RecordJournalKeyframe(bool bRestore = false);
+
+public:
+	// A snapshot every RewindSnapshotInterval seconds; the newest RewindHistoryLength are kept (0 turns rewind off)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Submarine|Snapshots")
+	float RewindSnapshotInterval = 1.0f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Submarine|Snapshots")
+	int32 RewindHistoryLength = 120;
+
+	// Binary save/load of the whole simulation under Saved/Snapshots/
+	UFUNCTION(BlueprintCallable, Category = "Submarine|Snapshots")
+	bool SaveSimulationSnapshot(const FString& FileName);
+
+	UFUNCTION(BlueprintCallable, Category = "Submarine|Snapshots")
+	bool LoadSimulationSnapshot(const FString& FileName);
+
+	// Goes back to the newest snapshot at least Seconds old and drops the history after it
+	UFUNCTION(BlueprintCallable, Category = "Submarine|Snapshots")
+	bool RewindSimulation(float Seconds);
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Submarine|Journal")
+	bool bRecordJournal = false;
+
+	// Simulation seconds between keyframes; a seek replays at most this much
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Submarine|Journal")
+	float JournalKeyframeInterval = 30.0f;
+
+	// Replays a journal (this session's if FileName is empty) headless up to Time seconds and continues live from there.
+	// Stops this session's recording.
+	UFUNCTION(BlueprintCallable, Category = "Submarine|Journal")
+	bool ReplayJournal(const FString& FileName, float Time);
 
 public:
 	UPROPERTY(EditDefaultsOnly, Category="UI")
@@ -242,6 +285,7 @@ public:
 	FString MakeSystemsBlock();
 	FString MakeStatusBlock();
 	FString MakeHFSString();
+	FString MakeToolCallGrammar();
 	void SendToolResponseToLlama(const FString& ToolName, const FString& JsonResponseContent);
 
 // calls from blueprints
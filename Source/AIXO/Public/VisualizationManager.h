@@ -8,6 +8,7 @@ class ICH_PowerJunction;
 class PWR_PowerSegment;
 class RenderingContext;
 class CommandDistributor;
+class PWR_PowerGridSolver;
 
 /**
  * Manages the collection of visual elements for the power grid,
@@ -19,6 +20,9 @@ private:
     // Lists of top-level drawable objects
     TArray<ICH_PowerJunction*> Junctions;
     TArray<PWR_PowerSegment*> Segments;
+
+    // Re-solves only the parts of the grid that changed since the last UpdatePower()
+    TUniquePtr<PWR_PowerGridSolver> PowerSolver;
     
     // Potentially add lists for other top-level drawable things if needed
 
@@ -35,6 +39,7 @@ public:
     void ClearSelections();
     void SetupSelection(ICH_PowerJunction* Junction);
     void RefreshSelection();
+    bool UpdatePower();		// returns false if nothing changed and no solve ran
 
     // Public state
     ICH_PowerJunction* ClickedOnJunction;